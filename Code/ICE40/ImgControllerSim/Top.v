@@ -2,6 +2,7 @@
 `include "ClockGen.v"
 `include "ICEAppTypes.v"
 `include "PixelValidator.v"
+`include "ImgHistogramValidator.v"
 `include "ImgSim.v"
 `timescale 1ns/1ps
 
@@ -20,6 +21,12 @@ module Top();
     localparam ImgCtrl_AFIFOWordCapacity = (`AFIFO_CapacityBytes/2);
     localparam ImgCtrl_ReadoutWordThresh = ReadoutFIFO_R_Thresh*ImgCtrl_AFIFOWordCapacity;
     localparam ImgCtrl_PaddingWordCount = ImgCtrl_ReadoutWordThresh-1;
+    // ImgCtrl_ThumbBin: ImgController's thumbnail mode (see ImgController's ThumbBin)
+    localparam ImgCtrl_ThumbBin = 0;
+    // ImgCtrl_RAMBankInterleave: RAMController's bank interleaving (see RAMController's BankInterleave)
+    localparam ImgCtrl_RAMBankInterleave = 0;
+    // ImgCtrl_Histogram: ImgController's capture histogram (see ImgController's Histogram)
+    localparam ImgCtrl_Histogram = 0;
     
     // ====================
     // RAM
@@ -98,6 +105,7 @@ module Top();
     reg[`Img_HeaderWordCount*16-1:0]        imgctrl_cmd_header = 0;
     
     reg                                     imgctrl_cmd_thumb = 0;
+    reg                                     imgctrl_cmd_histogramNext = 0;
     wire                                    imgctrl_readout_rst;
     wire                                    imgctrl_readout_start;
     wire                                    imgctrl_readout_ready;
@@ -108,13 +116,17 @@ module Top();
     wire[`RegWidth(`Img_WordCount)-1:0]     imgctrl_status_capturePixelCount;
     wire[17:0]                              imgctrl_status_captureHighlightCount;
     wire[17:0]                              imgctrl_status_captureShadowCount;
+    wire[63:0]                              imgctrl_status_captureHistogram;
     
     ImgController #(
         .ClkFreq(Img_Clk_Freq),
         .HeaderWordCount(`Img_HeaderWordCount),
         .ImgWidth(`Img_Width),
         .ImgHeight(`Img_Height),
-        .PaddingWordCount(ImgCtrl_PaddingWordCount)
+        .PaddingWordCount(ImgCtrl_PaddingWordCount),
+        .ThumbBin(ImgCtrl_ThumbBin),
+        .RAMBankInterleave(ImgCtrl_RAMBankInterleave),
+        .Histogram(ImgCtrl_Histogram)
     ) ImgController (
         .clk(img_clk),
         
@@ -124,6 +136,7 @@ module Top();
         .cmd_skipCount(imgctrl_cmd_skipCount),
         .cmd_header(imgctrl_cmd_header),
         .cmd_thumb(imgctrl_cmd_thumb),
+        .cmd_histogramNext(imgctrl_cmd_histogramNext),
         
         .readout_rst(imgctrl_readout_rst),
         .readout_start(imgctrl_readout_start),
@@ -135,6 +148,7 @@ module Top();
         .status_capturePixelCount(imgctrl_status_capturePixelCount),
         .status_captureHighlightCount(imgctrl_status_captureHighlightCount),
         .status_captureShadowCount(imgctrl_status_captureShadowCount),
+        .status_captureHistogram(imgctrl_status_captureHistogram),
         
         .img_dclk(img_dclk),
         .img_d(img_d),
@@ -153,22 +167,49 @@ module Top();
         .ram_dq(ram_dq)
     );
     
+    // ====================
+    // Input FIFO occupancy
+    // ====================
+    // fifoInCountMax: the high-water mark of ImgController's pixel input FIFO, ie how far
+    // RAMController (row changes, refreshes) falls behind the image sensor
+    localparam FIFOInAddrWidth = `RegWidth(ImgCtrl_AFIFOWordCapacity-1)+1;
+    wire[FIFOInAddrWidth-1:0] fifoInCount =
+        ImgController.AFIFO_fifoIn.w_baddr - ImgController.AFIFO_fifoIn.r_baddr;
+    integer fifoInCountMax = 0;
+    always @(posedge img_clk) begin
+        if (fifoInCount > fifoInCountMax) fifoInCountMax = fifoInCount;
+    end
+    
     // ====================
     // PixelValidator
     // ====================
     PixelValidator PixelValidator();
     
+    // ====================
+    // ImgHistogramValidator
+    // ====================
+    ImgHistogramValidator ImgHistogramValidator();
+    
     task ImgCapture; begin
         integer imgctrl_status_captureDonePrev;
+        realtime startTime;
         $display("\n========== ImgCapture ==========");
         
         // Trigger capture
         imgctrl_status_captureDonePrev = imgctrl_status_captureDone;
         imgctrl_cmd_capture = !imgctrl_cmd_capture;
+        fifoInCountMax = 0;
+        startTime = $realtime;
         
         // Wait until the capture is complete
         wait(imgctrl_status_captureDone !== imgctrl_status_captureDonePrev);
         
+        $display("[ImgCapture] Capture time: %0.1f us, input FIFO high-water mark: %0d/%0d words",
+            ($realtime-startTime)/1000,
+            fifoInCountMax,
+            ImgCtrl_AFIFOWordCapacity
+        );
+        
         $display("[ImgCapture] Capture done (done:%b pixelCount:%0d, highlightCount:%0d, shadowCount:%0d)",
             imgctrl_status_captureDone,
             imgctrl_status_capturePixelCount,
@@ -184,6 +225,37 @@ module Top();
         end
     end endtask
     
+    task ImgHistogram; begin
+        localparam GroupCount = (`Img_HistogramChannelCount*`Img_HistogramBinCount)/`Resp_Arg_ImgHistogram_BinCount;
+        $display("\n========== ImgHistogram ==========");
+        
+        ImgHistogramValidator.Config(
+            `Img_Width,     // imageWidth
+            `Img_Height,    // imageHeight
+            12'hFFF,        // pixelInitial
+            -1              // pixelDelta
+        );
+        
+        // Read all bins twice, to check that the bins wrap around after the last channel
+        for (integer i=0; i<2*GroupCount; i++) begin
+            // Wait for the bins to load
+            for (integer j=0; j<16; j++) begin
+                wait(img_clk);
+                wait(!img_clk);
+            end
+            
+            if (i === GroupCount) begin
+                ImgHistogramValidator.Done();
+                ImgHistogramValidator.Config(`Img_Width, `Img_Height, 12'hFFF, -1);
+            end
+            
+            ImgHistogramValidator.Validate(imgctrl_status_captureHistogram);
+            imgctrl_cmd_histogramNext = !imgctrl_cmd_histogramNext;
+        end
+        
+        ImgHistogramValidator.Done();
+    end endtask
+    
     task ImgReadout(input[`Msg_Arg_ImgReadout_Thumb_Len-1:0] thumb); begin
         localparam ImgPixelInitial      = 16'h0FFF;
         localparam ImgPixelDelta        = -1;
@@ -205,7 +277,8 @@ module Top();
             ImgPixelInitial,                            // pixelInitial
             ImgPixelDelta,                              // pixelDelta
             (!thumb ? 1 : 8),                           // pixelFilterPeriod
-            (!thumb ? 1 : 2)                            // pixelFilterKeep
+            (!thumb ? 1 : 2),                           // pixelFilterKeep
+            (!thumb ? 0 : ImgCtrl_ThumbBin)             // pixelFilterBin
         );
         
         imgctrl_cmd_thumb = thumb;
@@ -245,6 +318,7 @@ module Top();
         wait(!img_clk);
         
         ImgCapture();
+        if (ImgCtrl_Histogram) ImgHistogram();
         
         for (i=0; i<5; i++) begin
             ImgReadout(1); // Readout thumbnail image
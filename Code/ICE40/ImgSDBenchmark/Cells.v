@@ -0,0 +1,114 @@
+`ifndef Cells_v
+`define Cells_v
+
+`timescale 1ns/1ps
+
+// Cells.v: minimal behavioral models of the ICE40 primitives used by ImgController,
+// AFIFO and SDController, for Verilator.
+//
+// yosys' cells_sim.v relies on 4-state semantics (eg `CLOCK_ENABLE === 1'bz` for
+// unconnected clock enables) that Verilator doesn't model, and its SB_RAM40_4K
+// supports every mode, which is slow. These models only support the configurations
+// that our modules use.
+
+// SB_IO: supports PIN_TYPE output modes 0000 (none), 0101 (registered), 1010 (tristate,
+// unregistered), 1101 (registered, registered enable); and input modes 00 (registered)
+// and 01 (unregistered)
+module SB_IO #(
+    parameter PIN_TYPE = 6'b0000_00,
+    parameter PULLUP = 1'b0,
+    parameter NEG_TRIGGER = 1'b0,
+    parameter IO_STANDARD = "SB_LVCMOS"
+)(
+    inout wire  PACKAGE_PIN,
+    input wire  LATCH_INPUT_VALUE,
+    input wire  CLOCK_ENABLE,
+    input wire  INPUT_CLK,
+    input wire  OUTPUT_CLK,
+    input wire  OUTPUT_ENABLE,
+    input wire  D_OUT_0,
+    input wire  D_OUT_1,
+    output wire D_IN_0,
+    output wire D_IN_1
+);
+    localparam OutMode  = PIN_TYPE[5:2];
+    localparam InReg    = (PIN_TYPE[1:0] === 2'b00);
+    
+    reg inReg = 0;
+    reg outReg = 0;
+    reg outEnReg = 0;
+    
+    if (InReg) begin
+        always @(posedge INPUT_CLK) inReg <= PACKAGE_PIN;
+        assign D_IN_0 = inReg;
+    end else begin
+        assign D_IN_0 = PACKAGE_PIN;
+    end
+    assign D_IN_1 = 0;
+    
+    always @(posedge OUTPUT_CLK) begin
+        outReg <= D_OUT_0;
+        outEnReg <= OUTPUT_ENABLE;
+    end
+    
+    case (OutMode)
+    4'b0000: begin end
+    4'b0101: assign PACKAGE_PIN = outReg;
+    4'b1010: assign PACKAGE_PIN = (OUTPUT_ENABLE ? D_OUT_0 : 1'bz);
+    4'b1101: assign PACKAGE_PIN = (outEnReg ? outReg : 1'bz);
+    default: initial begin
+        $display("[SB_IO] Unsupported PIN_TYPE: %b", PIN_TYPE);
+        $finish;
+    end
+    endcase
+endmodule
+
+module SB_LUT4 #(
+    parameter LUT_INIT = 16'h0000
+)(
+    output wire O,
+    input wire  I0,
+    input wire  I1,
+    input wire  I2,
+    input wire  I3
+);
+    assign O = LUT_INIT[{I3, I2, I1, I0}];
+endmodule
+
+// SB_RAM40_4K: supports READ_MODE=WRITE_MODE=0 (256x16) only, which is what AFIFO uses
+// for 16-bit words
+module SB_RAM40_4K #(
+    parameter WRITE_MODE = 0,
+    parameter READ_MODE = 0
+)(
+    output reg[15:0]    RDATA = 0,
+    input wire          RCLK,
+    input wire          RCLKE,
+    input wire          RE,
+    input wire[10:0]    RADDR,
+    input wire          WCLK,
+    input wire          WCLKE,
+    input wire          WE,
+    input wire[10:0]    WADDR,
+    input wire[15:0]    MASK,
+    input wire[15:0]    WDATA
+);
+    initial begin
+        if (WRITE_MODE!==0 || READ_MODE!==0) begin
+            $display("[SB_RAM40_4K] Unsupported mode (WRITE_MODE:%0d READ_MODE:%0d)", WRITE_MODE, READ_MODE);
+            $finish;
+        end
+    end
+    
+    reg[15:0] mem[0:255];
+    
+    always @(posedge WCLK) begin
+        if (WCLKE && WE) mem[WADDR[7:0]] <= (mem[WADDR[7:0]] & MASK) | (WDATA & ~MASK);
+    end
+    
+    always @(posedge RCLK) begin
+        if (RCLKE && RE) RDATA <= mem[RADDR[7:0]];
+    end
+endmodule
+
+`endif // Cells_v
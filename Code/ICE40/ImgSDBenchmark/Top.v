@@ -0,0 +1,349 @@
+`include "Cells.v"
+`include "Util.v"
+`include "Sync.v"
+`include "ICEAppTypes.v"
+`include "ImgController.v"
+`include "AFIFOChain.v"
+`include "SDController.v"
+
+`timescale 1ns/1ps
+
+// ImgSDBenchmark: the capture->SD data path of ICEApp (ImgController -> AFIFOChain ->
+// SDController), with the clocks, image sensor, SDRAM and SD card supplied by the
+// Verilator harness (main.cpp) instead of ClockGen/ImgSim/mobile_sdr/SDCardSim.
+//
+// The AFIFOChain parameters and the ImgController padding match ICEApp's
+// ICEApp_ImgReadoutToSD_En configuration.
+//
+// UNVERIFIED: neither this nor the harness has been built with Verilator yet (see main.cpp).
+module Top #(
+    parameter ImgWidth  = `Img_Width,
+    parameter ImgHeight = `Img_Height
+)(
+    // Clocks (driven by the harness)
+    input wire          img_clk,
+    input wire          sd_clk_int,
+    
+    // Image sensor
+    input wire          img_dclk,
+    input wire[11:0]    img_d,
+    input wire          img_fv,
+    input wire          img_lv,
+    
+    // ImgController command port (clock domain: `img_clk`)
+    input wire          imgctrl_cmd_capture,    // Toggle signal
+    input wire          imgctrl_cmd_readout,    // Toggle signal
+    output wire         imgctrl_readout_start,  // Toggle signal
+    output wire         imgctrl_status_captureDone, // Toggle signal
+    output wire[31:0]   imgctrl_status_capturePixelCount,
+    
+    // SDController config port (clock domain: async)
+    input wire          sd_config_trigger,      // Toggle signal
+    input wire[`SDController_Config_Action_Width-1:0]
+                        sd_config_action,
+    input wire[`SDController_Config_ClkSpeed_Width-1:0]
+                        sd_config_clkSpeed,
+    input wire[`SDController_Config_PinMode_Width-1:0]
+                        sd_config_pinMode,
+    output wire         sd_datOut_done,
+    output wire         sd_datOut_crcErr,
+    
+    // RAM pins: `ram_dqIn` is driven onto `ram_dq` when `ram_dqOE`=1; `ram_dqOut` is
+    // the resolved value of `ram_dq`
+    output wire         ram_cke,
+    output wire[1:0]    ram_ba,
+    output wire[11:0]   ram_a,
+    output wire         ram_cs_,
+    output wire         ram_ras_,
+    output wire         ram_cas_,
+    output wire         ram_we_,
+    output wire[1:0]    ram_dqm,
+    input wire[15:0]    ram_dqIn,
+    input wire          ram_dqOE,
+    output wire[15:0]   ram_dqOut,
+    
+    // SD pins: `sd_datIn[i]` is driven onto `sd_dat[i]` when `sd_datOE[i]`=1; `sd_datOut` is
+    // the resolved value of `sd_dat`
+    output wire         sd_clk,
+    input wire[3:0]     sd_datIn,
+    input wire[3:0]     sd_datOE,
+    output wire[3:0]    sd_datOut,
+    
+    // Instrumentation
+    output wire[15:0]   cfg_imgWidth,
+    output wire[15:0]   cfg_imgHeight,
+    output wire[15:0]   cfg_headerWordCount,
+    output wire[15:0]   cfg_paddingWordCount,
+    output wire[15:0]   cfg_fifoInWordCapacity,
+    output wire[15:0]   cfg_readoutFIFOWordCapacity,
+    output wire[15:0]   fifoIn_count,           // Words in ImgController's pixel input FIFO
+    output reg[31:0]    fifoIn_dropCount = 0,   // Pixels dropped because the input FIFO was full
+    output reg[31:0]    readoutfifo_wCount = 0, // Words written into AFIFOChain (clock domain: `img_clk`)
+    output reg[31:0]    readoutfifo_wStallCount = 0, // Cycles that ImgController readout waited for AFIFOChain
+    output reg[31:0]    readoutfifo_rCount = 0  // Words read from AFIFOChain (clock domain: SDController's `datOutRead_clk`)
+);
+    // ====================
+    // AFIFOChain parameters (see ICEApp.v)
+    // ====================
+    localparam ReadoutFIFO_FIFOCount = 8;
+    localparam ReadoutFIFO_W_Thresh = 1;
+    localparam ReadoutFIFO_R_Thresh = 1;
+    
+    localparam Img_Clk_Freq = 108_000_000;
+    localparam SD_Clk_Freq = 102_000_000;
+    
+    // ====================
+    // RAM
+    // ====================
+    wire        ram_clk;
+    wire[15:0]  ram_dq;
+    assign ram_dq = (ram_dqOE ? ram_dqIn : 16'bz);
+    assign ram_dqOut = ram_dq;
+    
+    // ====================
+    // ImgController
+    // ====================
+    wire                                    imgctrl_readout_rst;
+    wire                                    imgctrl_readout_ready;
+    wire                                    imgctrl_readout_trigger;
+    wire[15:0]                              imgctrl_readout_data;
+    wire                                    imgctrl_readout_done;
+    wire[`RegWidth(ImgWidth*ImgHeight)-1:0] imgctrl_status_capturePixelCountRaw;
+    wire[17:0]                              imgctrl_status_captureHighlightCount;
+    wire[17:0]                              imgctrl_status_captureShadowCount;
+    wire[63:0]                              imgctrl_status_captureHistogram;
+    // ImgCtrl_PaddingWordCount: padding so that ImgController readout outputs enough
+    // data to trigger the AFIFOChain read threshold (`readoutfifo_r_thresh`)
+    localparam ImgCtrl_AFIFOWordCapacity = (`AFIFO_CapacityBytes/2);
+    localparam ImgCtrl_ReadoutWordThresh = ReadoutFIFO_R_Thresh*ImgCtrl_AFIFOWordCapacity;
+    localparam ImgCtrl_PaddingWordCount = ImgCtrl_ReadoutWordThresh-1;
+    ImgController #(
+        .ClkFreq(Img_Clk_Freq),
+        .HeaderWordCount(`Img_HeaderWordCount),
+        .ImgWidth(ImgWidth),
+        .ImgHeight(ImgHeight),
+        .PaddingWordCount(ImgCtrl_PaddingWordCount)
+    ) ImgController (
+        .clk(img_clk),
+        
+        .cmd_capture(imgctrl_cmd_capture),
+        .cmd_readout(imgctrl_cmd_readout),
+        .cmd_ramBlock(1'b0),
+        .cmd_skipCount(1'b0),
+        .cmd_header({`Img_HeaderWordCount{16'h0000}}),
+        .cmd_thumb(1'b0),
+        .cmd_histogramNext(1'b0),
+        
+        .readout_rst(imgctrl_readout_rst),
+        .readout_start(imgctrl_readout_start),
+        .readout_ready(imgctrl_readout_ready),
+        .readout_trigger(imgctrl_readout_trigger),
+        .readout_data(imgctrl_readout_data),
+        .readout_done(imgctrl_readout_done),
+        
+        .status_captureDone(imgctrl_status_captureDone),
+        .status_capturePixelCount(imgctrl_status_capturePixelCountRaw),
+        .status_captureHighlightCount(imgctrl_status_captureHighlightCount),
+        .status_captureShadowCount(imgctrl_status_captureShadowCount),
+        .status_captureHistogram(imgctrl_status_captureHistogram),
+        
+        .img_dclk(img_dclk),
+        .img_d(img_d),
+        .img_fv(img_fv),
+        .img_lv(img_lv),
+        
+        .ram_clk(ram_clk),
+        .ram_cke(ram_cke),
+        .ram_ba(ram_ba),
+        .ram_a(ram_a),
+        .ram_cs_(ram_cs_),
+        .ram_ras_(ram_ras_),
+        .ram_cas_(ram_cas_),
+        .ram_we_(ram_we_),
+        .ram_dqm(ram_dqm),
+        .ram_dq(ram_dq)
+    );
+    
+    assign imgctrl_status_capturePixelCount = imgctrl_status_capturePixelCountRaw;
+    
+    // ====================
+    // AFIFOChain
+    // ====================
+    wire        readoutfifo_rst_;
+    wire        readoutfifo_prop_clk;
+    wire        readoutfifo_w_clk;
+    wire        readoutfifo_w_trigger;
+    wire[15:0]  readoutfifo_w_data;
+    wire        readoutfifo_w_ready;
+    wire        readoutfifo_w_thresh;
+    wire        readoutfifo_r_clk;
+    wire        readoutfifo_r_trigger;
+    wire[15:0]  readoutfifo_r_data;
+    wire        readoutfifo_r_ready;
+    wire        readoutfifo_r_thresh;
+    wire        readoutfifo_async_w_thresh;
+    wire        readoutfifo_async_r_thresh;
+    
+    AFIFOChain #(
+        .W(16),
+        .N(ReadoutFIFO_FIFOCount),
+        .W_Thresh(ReadoutFIFO_W_Thresh),
+        .R_Thresh(ReadoutFIFO_R_Thresh)
+    ) AFIFOChain(
+        .rst_(readoutfifo_rst_),
+        
+        .prop_clk(readoutfifo_prop_clk),
+        
+        .w_clk(readoutfifo_w_clk),
+        .w_trigger(readoutfifo_w_trigger),
+        .w_data(readoutfifo_w_data),
+        .w_ready(readoutfifo_w_ready),
+        .w_thresh(readoutfifo_w_thresh),
+        
+        .r_clk(readoutfifo_r_clk),
+        .r_trigger(readoutfifo_r_trigger),
+        .r_data(readoutfifo_r_data),
+        .r_ready(readoutfifo_r_ready),
+        .r_thresh(readoutfifo_r_thresh),
+        
+        .async_w_thresh(readoutfifo_async_w_thresh),
+        .async_r_thresh(readoutfifo_async_r_thresh)
+    );
+    
+    assign readoutfifo_prop_clk = readoutfifo_w_clk;
+    
+    // ====================
+    // SDController
+    // ====================
+    wire        sd_cmd;
+    tri1[3:0]   sd_dat;
+    wire        sd_pullup_1v8_en_;
+    wire        sd_cmd_done;
+    wire        sd_resp_done;
+    wire[135:0] sd_resp_data;
+    wire        sd_resp_crcErr;
+    wire        sd_datOut_trigger;
+    wire        sd_datOutRead_clk;
+    wire        sd_datOutRead_ready;
+    wire        sd_datOutRead_trigger;
+    wire[15:0]  sd_datOutRead_data;
+    wire        sd_datOutRead_done;
+    wire        sd_datIn_done;
+    wire        sd_datIn_crcErr;
+    wire        sd_datInWrite_rst;
+    wire        sd_datInWrite_clk;
+    wire        sd_datInWrite_trigger;
+    wire[15:0]  sd_datInWrite_data;
+    wire        sd_status_dat0Idle;
+    
+    SDController #(
+        .ClkFreq(SD_Clk_Freq)
+    ) SDController (
+        .clk(sd_clk_int),
+        
+        .sd_clk(sd_clk),
+        .sd_cmd(sd_cmd),
+        .sd_dat(sd_dat),
+        .sd_pullup_1v8_en_(sd_pullup_1v8_en_),
+        
+        .config_trigger(sd_config_trigger),
+        .config_action(sd_config_action),
+        .config_clkSpeed(sd_config_clkSpeed),
+        .config_clkDelay({`SDController_Config_ClkDelay_Width{1'b0}}),
+        .config_pinMode(sd_config_pinMode),
+        
+        .cmd_trigger(1'b0),
+        .cmd_data(48'b0),
+        .cmd_respType(2'b0),
+        .cmd_datInType(2'b0),
+        .cmd_done(sd_cmd_done),
+        
+        .resp_done(sd_resp_done),
+        .resp_data(sd_resp_data),
+        .resp_crcErr(sd_resp_crcErr),
+        
+        .datOut_trigger(sd_datOut_trigger),
+        .datOut_done(sd_datOut_done),
+        .datOut_crcErr(sd_datOut_crcErr),
+        
+        .datOutRead_clk(sd_datOutRead_clk),
+        .datOutRead_ready(sd_datOutRead_ready),
+        .datOutRead_trigger(sd_datOutRead_trigger),
+        .datOutRead_data(sd_datOutRead_data),
+        .datOutRead_done(sd_datOutRead_done),
+        
+        .datIn_done(sd_datIn_done),
+        .datIn_crcErr(sd_datIn_crcErr),
+        
+        .datInWrite_rst(sd_datInWrite_rst),
+        .datInWrite_clk(sd_datInWrite_clk),
+        .datInWrite_ready(1'b1),
+        .datInWrite_trigger(sd_datInWrite_trigger),
+        .datInWrite_data(sd_datInWrite_data),
+        
+        .status_dat0Idle(sd_status_dat0Idle)
+    );
+    
+    genvar i;
+    for (i=0; i<4; i=i+1) begin
+        assign sd_dat[i] = (sd_datOE[i] ? sd_datIn[i] : 1'bz);
+    end
+    assign sd_datOut = sd_dat;
+    
+    // ====================
+    // ImgReadout -> SD (see ICEApp_ImgReadoutToSD_En)
+    // ====================
+    assign readoutfifo_rst_         = !imgctrl_readout_rst;
+    assign readoutfifo_w_clk        = img_clk;
+    assign readoutfifo_w_trigger    = imgctrl_readout_ready;
+    assign readoutfifo_w_data       = imgctrl_readout_data;
+    assign readoutfifo_r_clk        = sd_datOutRead_clk;
+    assign readoutfifo_r_trigger    = sd_datOutRead_trigger;
+    assign sd_datOut_trigger        = imgctrl_readout_start;
+    assign sd_datOutRead_ready      = readoutfifo_r_thresh;
+    assign sd_datOutRead_data       = readoutfifo_r_data;
+    assign imgctrl_readout_trigger  = readoutfifo_w_ready;
+    
+    `Sync(sd_datOutRead_doneX, imgctrl_readout_done, posedge, sd_datOutRead_clk);
+    assign sd_datOutRead_done = sd_datOutRead_doneX;
+    
+    // ====================
+    // Instrumentation
+    // ====================
+    assign cfg_imgWidth                 = ImgWidth;
+    assign cfg_imgHeight                = ImgHeight;
+    assign cfg_headerWordCount          = `Img_HeaderWordCount;
+    assign cfg_paddingWordCount         = ImgCtrl_PaddingWordCount;
+    assign cfg_fifoInWordCapacity       = ImgCtrl_AFIFOWordCapacity;
+    assign cfg_readoutFIFOWordCapacity  = ReadoutFIFO_FIFOCount*ImgCtrl_AFIFOWordCapacity;
+    
+    // fifoIn_count: the difference of the input FIFO's write/read addresses (which have an
+    // extra bit, see AFIFO). It's sampled across clock domains so it's only approximate, but
+    // that's sufficient to track the high-water mark.
+    localparam FIFOInAddrWidth = `RegWidth(ImgCtrl_AFIFOWordCapacity-1)+1;
+    wire[FIFOInAddrWidth-1:0] fifoIn_countRaw =
+        ImgController.AFIFO_fifoIn.w_baddr - ImgController.AFIFO_fifoIn.r_baddr;
+    assign fifoIn_count = fifoIn_countRaw;
+    
+    always @(posedge img_dclk) begin
+        if (ImgController.fifoIn_w_trigger && !ImgController.fifoIn_w_ready) begin
+            fifoIn_dropCount <= fifoIn_dropCount+1;
+        end
+    end
+    
+    always @(posedge img_clk) begin
+        if (readoutfifo_w_trigger && readoutfifo_w_ready) begin
+            readoutfifo_wCount <= readoutfifo_wCount+1;
+        end
+        
+        if (imgctrl_readout_ready && !readoutfifo_w_ready) begin
+            readoutfifo_wStallCount <= readoutfifo_wStallCount+1;
+        end
+    end
+    
+    always @(posedge readoutfifo_r_clk) begin
+        if (readoutfifo_r_trigger && readoutfifo_r_ready) begin
+            readoutfifo_rCount <= readoutfifo_rCount+1;
+        end
+    end
+endmodule
@@ -0,0 +1,724 @@
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include "verilated.h"
+#include "VTop.h"
+
+// ImgSDBenchmark: Verilator harness for the capture->SD data path (Top.v). It captures
+// full-size frames from a model of the image sensor's pixel bus into a model of the SDRAM,
+// reads them out to a model of the SD card, validates the pixels that arrive at the card,
+// and reports the throughput of each stage.
+//
+// Models:
+//   _Sensor:   AR0330 parallel pixel bus (img_dclk/img_fv/img_lv/img_d), with the same
+//              frame timing as ImgSim by default
+//   _SDRAM:    AS4C8M16 SDR SDRAM (the part RAMController's timing parameters are for):
+//              full-page bursts, CAS latency 3, DQM read latency 2, and checks of the
+//              command timing parameters and refresh interval
+//   _SDCard:   the DAT side of a 4-bit SD card receiving a multi-block write: checks the
+//              data CRCs and end bits, and responds with the CRC status token and busy, like
+//              SDCardSim
+//
+// Building requires Verilator 5 (`make run` builds and runs a single frame).
+//
+// UNVERIFIED: this harness was written without Verilator available, and has never been
+// built or run, so it may not compile and it has produced no numbers. Treat it as scaffolding:
+// build it, check that ImgControllerSim/ICEAppSim agree with its capture/readout times, and
+// only then rely on its report.
+//
+// Usage:
+//   ImgSDBenchmark [frames=1] [sdBusyClocks=16] [hblank=6] [vblank=6]
+//     frames:          number of capture+readout iterations
+//     sdBusyClocks:    sd_clk cycles that the card signals busy after each block
+//     hblank/vblank:   img_dclk cycles between rows / frames
+
+using _Time = uint64_t; // Picoseconds
+
+static constexpr _Time _Ps(double ns) { return (_Time)(ns*1000 + .5); }
+static constexpr double _Ms(_Time t) { return (double)t/1e9; }
+static constexpr double _Us(_Time t) { return (double)t/1e6; }
+
+// ====================
+// Clocks
+// ====================
+struct _Clock {
+    const char* name = nullptr;
+    double halfPeriodPs = 0;
+    uint64_t toggleCount = 0;
+    bool level = false;
+    
+    double freq() const { return 1e12/(2*halfPeriodPs); }
+    _Time nextToggle() const { return (_Time)std::llround((toggleCount+1)*halfPeriodPs); }
+};
+
+static _Clock _ClockMake(const char* name, double freq) {
+    return _Clock{ .name=name, .halfPeriodPs=1e12/(2*freq) };
+}
+
+// ====================
+// _Sensor
+// ====================
+class _Sensor {
+public:
+    // FrameStartDelay: img_dclk cycles between img_fv=1 and the first row (see ImgSim)
+    static constexpr uint32_t FrameStartDelay = 6;
+    
+    _Sensor() {}
+    _Sensor(uint32_t width, uint32_t height, uint32_t hblank, uint32_t vblank) :
+    _width(width), _height(height), _hblank(hblank), _vblank(vblank) {}
+    
+    // Pixel(): the value of pixel `idx` of every frame. Hashed (instead of incrementing
+    // like ImgSim) so that addressing bugs that are a multiple of a power of 2 are caught.
+    static uint16_t Pixel(uint32_t idx) {
+        return (uint16_t)((idx*2654435761u) >> 20) & 0xFFF;
+    }
+    
+    uint32_t frameCycles() const {
+        return FrameStartDelay + _height*(_width+_hblank) + _vblank;
+    }
+    
+    // fall(): updates the pins after a falling edge of img_dclk, so they're stable for the
+    // next rising edge
+    void fall(VTop& top) {
+        const uint32_t rowCycles = _width+_hblank;
+        const uint32_t c = _cycle;
+        bool fv = false;
+        bool lv = false;
+        uint16_t d = 0;
+        
+        if (c < FrameStartDelay) {
+            fv = true;
+        } else if (c-FrameStartDelay < _height*rowCycles) {
+            const uint32_t row = (c-FrameStartDelay) / rowCycles;
+            const uint32_t col = (c-FrameStartDelay) % rowCycles;
+            fv = true;
+            lv = (col < _width);
+            if (lv) d = Pixel(row*_width + col);
+        }
+        
+        top.img_fv = fv;
+        top.img_lv = lv;
+        top.img_d = d;
+        
+        if (fv && !_fvPrev) frameStartCount++;
+        _fvPrev = fv;
+        _cycle = (c+1 < frameCycles() ? c+1 : 0);
+    }
+    
+    uint64_t frameStartCount = 0;
+
+private:
+    uint32_t _width = 0;
+    uint32_t _height = 0;
+    uint32_t _hblank = 0;
+    uint32_t _vblank = 0;
+    uint32_t _cycle = 0;
+    bool _fvPrev = false;
+};
+
+// ====================
+// _SDRAM
+// ====================
+class _SDRAM {
+public:
+    static constexpr uint32_t BankCount     = 4;
+    static constexpr uint32_t RowCount      = 4096;
+    static constexpr uint32_t ColCount      = 512;
+    static constexpr uint32_t CAS           = 3;
+    static constexpr uint32_t DQMReadDelay  = 2;
+    static constexpr uint16_t InitVal       = 0xCAFE;
+    
+    // Timing parameters (see RAMController)
+    static constexpr _Time T_RC             = _Ps(60);
+    static constexpr _Time T_RFC            = _Ps(80);
+    static constexpr _Time T_RRD            = _Ps(12);
+    static constexpr _Time T_RAS            = _Ps(48);
+    static constexpr _Time T_RCD            = _Ps(18);
+    static constexpr _Time T_RP             = _Ps(18);
+    static constexpr _Time T_WR             = _Ps(15);
+    static constexpr _Time T_MRD            = _Ps(2*1000/108.); // 2 cycles
+    static constexpr _Time T_REFI           = _Ps(7812);
+    // RefreshPostponeMax: the number of refreshes that can be postponed
+    static constexpr uint32_t RefreshPostponeMax = 8;
+    
+    _SDRAM() : _mem((size_t)BankCount*RowCount*ColCount, InitVal) {}
+    
+    // rise(): handles a rising edge of ram_clk at time `t`. Samples the command pins
+    // (which must have their pre-edge values) and updates `top.ram_dqIn`/`top.ram_dqOE`
+    // with the data that the SDRAM drives at this edge.
+    void rise(VTop& top, _Time t) {
+        const uint64_t c = _cycle++;
+        
+        // Drive read data scheduled for this edge
+        _ReadSlot& slot = _readSlots[c % _readSlots.size()];
+        const bool masked = (_dqmHistory >> (DQMReadDelay-1)) & 1;
+        top.ram_dqOE = (slot.valid && !masked);
+        top.ram_dqIn = slot.data;
+        slot.valid = false;
+        
+        const bool dqm = top.ram_dqm & 1;
+        _dqmHistory = (_dqmHistory<<1) | dqm;
+        
+        if (!top.ram_cke || top.ram_cs_) return;
+        const uint8_t cmd = (top.ram_ras_<<2) | (top.ram_cas_<<1) | top.ram_we_;
+        const uint8_t ba = top.ram_ba;
+        const uint16_t a = top.ram_a;
+        
+        switch (cmd) {
+        case _Cmd::SetMode: {
+            if (ba == 0) {
+                // Full-page bursts, sequential, CAS latency 3
+                if ((a & 0x7) != 0x7)               _violation(t, "mode: burst length isn't full page");
+                if (((a>>4) & 0x7) != CAS)          _violation(t, "mode: unexpected CAS latency");
+            }
+            _modeSet = t;
+            break;
+        }
+        
+        case _Cmd::AutoRefresh: {
+            for (const _Bank& b : _banks) {
+                if (b.active)                       _violation(t, "refresh: bank active");
+                if (t-b.precharged < T_RP)          _violation(t, "refresh: tRP");
+            }
+            if (_refreshed && t-_refreshed<T_RFC)   _violation(t, "refresh: tRFC");
+            if (_refreshed) {
+                refreshIntervalMax = std::max(refreshIntervalMax, t-_refreshed);
+                if (t-_refreshed > (RefreshPostponeMax+1)*T_REFI) _violation(t, "refresh: interval");
+            }
+            _refreshed = t;
+            refreshCount++;
+            break;
+        }
+        
+        case _Cmd::Precharge: {
+            const bool all = (a >> 10) & 1;
+            for (uint8_t i=0; i<BankCount; i++) {
+                if (!all && i!=ba) continue;
+                _Bank& b = _banks[i];
+                if (b.active) {
+                    if (t-b.activated < T_RAS)      _violation(t, "precharge: tRAS");
+                    if (b.written && t-b.written<T_WR) _violation(t, "precharge: tWR");
+                }
+                b.active = false;
+                b.precharged = t;
+                if (_burst.kind!=_Burst::None && _burst.bank==i) _burst.kind = _Burst::None;
+            }
+            break;
+        }
+        
+        case _Cmd::BankActivate: {
+            _Bank& b = _banks[ba];
+            if (b.active)                           _violation(t, "activate: bank already active");
+            if (t-b.precharged < T_RP)              _violation(t, "activate: tRP");
+            if (b.activated && t-b.activated<T_RC)  _violation(t, "activate: tRC");
+            if (_activated && t-_activated<T_RRD)   _violation(t, "activate: tRRD");
+            if (_refreshed && t-_refreshed<T_RFC)   _violation(t, "activate: tRFC");
+            if (_modeSet && t-_modeSet<T_MRD)       _violation(t, "activate: tMRD");
+            b.active = true;
+            b.row = a;
+            b.activated = t;
+            b.written = 0;
+            _activated = t;
+            activateCount++;
+            break;
+        }
+        
+        case _Cmd::Write:
+        case _Cmd::Read: {
+            _Bank& b = _banks[ba];
+            if (!b.active)                          _violation(t, "read/write: bank not active");
+            if (t-b.activated < T_RCD)              _violation(t, "read/write: tRCD");
+            _burst.kind = (cmd==_Cmd::Write ? _Burst::Write : _Burst::Read);
+            _burst.bank = ba;
+            _burst.col = a % ColCount;
+            break;
+        }
+        
+        case _Cmd::Nop:
+            break;
+        
+        default:
+            _violation(t, "unsupported command");
+            break;
+        }
+        
+        // Advance the burst; full-page bursts wrap around within the row
+        if (_burst.kind != _Burst::None) {
+            const _Bank& b = _banks[_burst.bank];
+            uint16_t& word = _mem[(((size_t)_burst.bank*RowCount)+b.row)*ColCount + _burst.col];
+            if (_burst.kind == _Burst::Write) {
+                if (!dqm) {
+                    word = top.ram_dqOut;
+                    _banks[_burst.bank].written = t;
+                    writeCount++;
+                }
+            } else {
+                _ReadSlot& s = _readSlots[(c+CAS) % _readSlots.size()];
+                s.valid = true;
+                s.data = word;
+                readCount++;
+            }
+            _burst.col = (_burst.col+1) % ColCount;
+        }
+    }
+    
+    void printStats() const {
+        printf("  activates: %ju, words written: %ju, words read: %ju, refreshes: %ju (max interval: %.2f us)\n",
+            (uintmax_t)activateCount, (uintmax_t)writeCount, (uintmax_t)readCount, (uintmax_t)refreshCount,
+            _Us(refreshIntervalMax));
+        if (_violations.empty()) {
+            printf("  timing violations: none ✅\n");
+        } else {
+            for (const auto& [name, count] : _violations) {
+                printf("  timing violation: %s (%ju) ❌\n", name.c_str(), (uintmax_t)count);
+            }
+        }
+    }
+    
+    uint64_t violationCount() const {
+        uint64_t r = 0;
+        for (const auto& [name, count] : _violations) r += count;
+        return r;
+    }
+    
+    uint64_t activateCount = 0;
+    uint64_t writeCount = 0;
+    uint64_t readCount = 0;
+    uint64_t refreshCount = 0;
+    _Time refreshIntervalMax = 0;
+
+private:
+    // _Cmd: {ras_, cas_, we_}
+    struct _Cmd {
+        static constexpr uint8_t SetMode        = 0b000;
+        static constexpr uint8_t AutoRefresh    = 0b001;
+        static constexpr uint8_t Precharge      = 0b010;
+        static constexpr uint8_t BankActivate   = 0b011;
+        static constexpr uint8_t Write          = 0b100;
+        static constexpr uint8_t Read           = 0b101;
+        static constexpr uint8_t Nop            = 0b111;
+    };
+    
+    struct _Bank {
+        bool active = false;
+        uint16_t row = 0;
+        _Time activated = 0;
+        _Time precharged = 0;
+        _Time written = 0;
+    };
+    
+    struct _Burst {
+        enum { None, Write, Read } kind = None;
+        uint8_t bank = 0;
+        uint16_t col = 0;
+    };
+    
+    struct _ReadSlot {
+        bool valid = false;
+        uint16_t data = 0;
+    };
+    
+    void _violation(_Time t, const char* name) {
+        uint64_t& count = _violations[name];
+        if (!count) printf("[SDRAM] Timing violation at %.3f us: %s ❌\n", _Us(t), name);
+        count++;
+    }
+    
+    std::vector<uint16_t> _mem;
+    std::array<_Bank,BankCount> _banks = {};
+    _Burst _burst;
+    std::array<_ReadSlot,8> _readSlots = {};
+    uint32_t _dqmHistory = 0;
+    uint64_t _cycle = 0;
+    _Time _activated = 0;
+    _Time _refreshed = 0;
+    _Time _modeSet = 0;
+    std::map<std::string,uint64_t> _violations;
+};
+
+// ====================
+// _SDCard
+// ====================
+class _SDCard {
+public:
+    static constexpr uint32_t BlockNibbleCount  = 1024;
+    static constexpr uint32_t CRCBitCount       = 16;
+    // NCRC: sd_clk cycles between the end bit of the data and the CRC status token (2-8)
+    static constexpr uint32_t NCRC              = 2;
+    // ReadyClocks: sd_clk cycles that DAT0=1 is driven after busy, before releasing the
+    // lines (see SDCardSim)
+    static constexpr uint32_t ReadyClocks       = 4;
+    
+    _SDCard(uint32_t busyClocks) : _busyClocks(busyClocks) {}
+    
+    // rise(): handles a rising edge of sd_clk; `dat` is the pre-edge value of the DAT lines
+    void rise(uint8_t dat, _Time t) {
+        switch (_state) {
+        case _State::Idle:
+            // Wait for the start bit
+            if (!dat) {
+                _nibble = 0;
+                _crc = {};
+                _state = _State::Data;
+                if (!blockCount) firstBlockTime = t;
+            }
+            break;
+        
+        case _State::Data:
+            for (int i=0; i<4; i++) _crc[i] = _CRC16Update(_crc[i], (dat>>i)&1);
+            _word = (_word<<4) | dat;
+            _nibble++;
+            if (!(_nibble % 4)) _recvWord(_word);
+            if (_nibble == BlockNibbleCount) {
+                _nibble = 0;
+                _crcTheirs = {};
+                _state = _State::CRC;
+            }
+            break;
+        
+        case _State::CRC:
+            for (int i=0; i<4; i++) _crcTheirs[i] = (_crcTheirs[i]<<1) | ((dat>>i)&1);
+            if (++_nibble == CRCBitCount) _state = _State::End;
+            break;
+        
+        case _State::End: {
+            bool ok = (dat == 0xF);
+            for (int i=0; i<4; i++) ok &= (_crc[i] == _crcTheirs[i]);
+            if (!ok) {
+                crcErrCount++;
+                if (crcErrCount == 1) printf("[SDCard] Bad CRC/end bits in block %ju ❌\n", (uintmax_t)blockCount);
+            }
+            // Token: start bit, CRC status (010=OK, 101=error), end bit; then busy
+            _resp.clear();
+            _resp.insert(_resp.end(), NCRC, -1);
+            for (int8_t b : (ok ? std::array<int8_t,5>{0,0,1,0,1} : std::array<int8_t,5>{0,1,0,1,1})) _resp.push_back(b);
+            _resp.insert(_resp.end(), _busyClocks, 0);
+            _resp.insert(_resp.end(), ReadyClocks, 1);
+            _respIdx = 0;
+            blockCount++;
+            lastBlockTime = t;
+            _state = _State::Resp;
+            break;
+        }
+        
+        case _State::Resp:
+            break;
+        }
+    }
+    
+    // fall(): handles a falling edge of sd_clk, and updates the DAT0 drive
+    void fall(VTop& top) {
+        if (_state != _State::Resp) return;
+        if (_respIdx < _resp.size()) {
+            const int8_t b = _resp[_respIdx++];
+            top.sd_datOE = (b>=0 ? 0x1 : 0x0);
+            top.sd_datIn = (b>0 ? 0x1 : 0x0);
+        } else {
+            top.sd_datOE = 0;
+            _state = _State::Idle;
+        }
+    }
+    
+    // expect(): configures validation of the next readout
+    void expect(uint32_t headerWordCount, uint32_t pixelCount) {
+        _headerWordCount = headerWordCount;
+        _pixelCount = pixelCount;
+        _wordIdx = 0;
+    }
+    
+    uint64_t blockCount = 0;
+    uint64_t crcErrCount = 0;
+    uint64_t pixelErrCount = 0;
+    uint64_t pixelOKCount = 0;
+    _Time firstBlockTime = 0;
+    _Time lastBlockTime = 0;
+
+private:
+    enum class _State { Idle, Data, CRC, End, Resp };
+    
+    // _CRC16Update: CRC-16-CCITT (x^16+x^12+x^5+1), one bit at a time, MSB first
+    static uint16_t _CRC16Update(uint16_t crc, bool bit) {
+        const bool fb = bit ^ (crc>>15);
+        crc <<= 1;
+        if (fb) crc ^= 0x1021;
+        return crc;
+    }
+    
+    void _recvWord(uint16_t w) {
+        const uint64_t idx = _wordIdx++;
+        if (idx<_headerWordCount || idx>=_headerWordCount+_pixelCount) return;
+        
+        // RAM words are little endian (see ImgController)
+        const uint16_t px = _Sensor::Pixel((uint32_t)(idx-_headerWordCount));
+        const uint16_t expected = (uint16_t)((px&0xFF)<<8 | (px>>8));
+        if (w == expected) {
+            pixelOKCount++;
+        } else {
+            if (!pixelErrCount) {
+                printf("[SDCard] Bad pixel %ju (expected: 0x%04x, got: 0x%04x) ❌\n",
+                    (uintmax_t)(idx-_headerWordCount), expected, w);
+            }
+            pixelErrCount++;
+        }
+    }
+    
+    const uint32_t _busyClocks = 0;
+    _State _state = _State::Idle;
+    uint32_t _nibble = 0;
+    uint16_t _word = 0;
+    std::array<uint16_t,4> _crc = {};
+    std::array<uint16_t,4> _crcTheirs = {};
+    std::vector<int8_t> _resp; // -1: released, 0/1: driven
+    size_t _respIdx = 0;
+    uint32_t _headerWordCount = 0;
+    uint32_t _pixelCount = 0;
+    uint64_t _wordIdx = 0;
+};
+
+// ====================
+// _Sim
+// ====================
+class _Sim {
+public:
+    _Sim(int argc, const char* argv[], uint32_t sdBusyClocks, uint32_t hblank, uint32_t vblank) :
+    _ctx(std::make_unique<VerilatedContext>()),
+    _sdCard(sdBusyClocks) {
+        _ctx->commandArgs(argc, argv);
+        _top = std::make_unique<VTop>(_ctx.get());
+        _top->eval();
+        // The image size is a parameter of Top, so the sensor can only be configured once
+        // the model exists
+        _sensor = _Sensor(_top->cfg_imgWidth, _top->cfg_imgHeight, hblank, vblank);
+    }
+    
+    VTop& top() { return *_top; }
+    _Time time() const { return _t; }
+    _SDRAM& sdram() { return _sdram; }
+    _SDCard& sdCard() { return _sdCard; }
+    _Sensor& sensor() { return _sensor; }
+    const _Clock& imgClk() const { return _imgClk; }
+    const _Clock& sdClkInt() const { return _sdClkInt; }
+    const _Clock& imgDClk() const { return _imgDClk; }
+    
+    // step(): advances to the next clock edge
+    void step() {
+        VTop& top = *_top;
+        _t = std::min({ _imgClk.nextToggle(), _sdClkInt.nextToggle(), _imgDClk.nextToggle() });
+        
+        bool imgClkRise = false;
+        bool imgDClkFall = false;
+        for (_Clock* clk : { &_imgClk, &_sdClkInt, &_imgDClk }) {
+            if (clk->nextToggle() != _t) continue;
+            clk->toggleCount++;
+            clk->level = !clk->level;
+            if (clk==&_imgClk && clk->level)    imgClkRise = true;
+            if (clk==&_imgDClk && !clk->level)  imgDClkFall = true;
+        }
+        
+        // Sample the pins before the edges are evaluated
+        const bool sdClkPrev = top.sd_clk;
+        const uint8_t sdDatPrev = top.sd_datOut;
+        if (imgClkRise) _sdram.rise(top, _t);
+        if (imgDClkFall) _sensor.fall(top);
+        
+        top.img_clk = _imgClk.level;
+        top.sd_clk_int = _sdClkInt.level;
+        top.img_dclk = _imgDClk.level;
+        top.eval();
+        
+        if (!sdClkPrev && top.sd_clk) _sdCard.rise(sdDatPrev, _t);
+        if (sdClkPrev && !top.sd_clk) _sdCard.fall(top);
+        
+        if (imgClkRise) {
+            fifoInMax = std::max(fifoInMax, (uint32_t)top.fifoIn_count);
+            const uint32_t readoutFIFOCount = top.readoutfifo_wCount - top.readoutfifo_rCount - readoutFIFOBase;
+            readoutFIFOMax = std::max(readoutFIFOMax, readoutFIFOCount);
+        }
+        
+        if (_ctx->gotFinish()) throw std::runtime_error("design called $finish");
+    }
+    
+    // stepUntil(): steps until `fn` returns true, or throws after `timeout`
+    template<typename T_Fn>
+    void stepUntil(T_Fn fn, _Time timeout, const char* what) {
+        const _Time deadline = _t+timeout;
+        while (!fn()) {
+            if (_t > deadline) throw std::runtime_error(std::string("timeout waiting for ") + what);
+            step();
+        }
+    }
+    
+    void stepFor(_Time d) {
+        const _Time end = _t+d;
+        while (_t < end) step();
+    }
+    
+    void finish() { _top->final(); }
+    
+    uint32_t fifoInMax = 0;
+    uint32_t readoutFIFOMax = 0;
+    uint32_t readoutFIFOBase = 0;
+
+private:
+    std::unique_ptr<VerilatedContext> _ctx;
+    std::unique_ptr<VTop> _top;
+    _Clock _imgClk = _ClockMake("img_clk", 108e6);
+    _Clock _sdClkInt = _ClockMake("sd_clk_int", 102e6);
+    // img_dclk: 16 MHz EXTCLK /4 *147 /6 (see ImgSensor)
+    _Clock _imgDClk = _ClockMake("img_dclk", 98e6);
+    _SDRAM _sdram;
+    _Sensor _sensor;
+    _SDCard _sdCard;
+    _Time _t = 0;
+};
+
+static uint32_t _ArgUInt(int argc, const char* argv[], int idx, uint32_t def) {
+    // Skip Verilator's +args
+    std::vector<const char*> args;
+    for (int i=1; i<argc; i++) if (argv[i][0] != '+') args.push_back(argv[i]);
+    if (idx >= (int)args.size()) return def;
+    return (uint32_t)std::stoul(args[idx]);
+}
+
+int main(int argc, const char* argv[]) {
+    try {
+        const uint32_t frameCount   = _ArgUInt(argc, argv, 0, 1);
+        const uint32_t sdBusyClocks = _ArgUInt(argc, argv, 1, 16);
+        const uint32_t hblank       = _ArgUInt(argc, argv, 2, 6);
+        const uint32_t vblank       = _ArgUInt(argc, argv, 3, 6);
+        
+        _Sim sim(argc, argv, sdBusyClocks, hblank, vblank);
+        VTop& top = sim.top();
+        const uint32_t width = top.cfg_imgWidth;
+        const uint32_t height = top.cfg_imgHeight;
+        const uint32_t pixelCount = width*height;
+        const uint32_t headerWordCount = top.cfg_headerWordCount;
+        constexpr uint32_t ChecksumWordCount = 2;
+        constexpr uint32_t BlockWordCount = 256;
+        const uint32_t readoutWordCount = headerWordCount + pixelCount + ChecksumWordCount + top.cfg_paddingWordCount;
+        const uint32_t readoutBlockCount = readoutWordCount / BlockWordCount;
+        const _Time frameTime = (_Time)std::llround(sim.sensor().frameCycles() * 2*sim.imgDClk().halfPeriodPs);
+        const _Time timeout = 2*frameTime + _Ps(1e6);
+        
+        printf("Image: %ux%u, sensor frame time: %.3f ms (img_dclk: %.0f MHz, hblank: %u, vblank: %u)\n",
+            width, height, _Ms(frameTime), sim.imgDClk().freq()/1e6, hblank, vblank);
+        printf("img_clk: %.0f MHz, sd_clk_int: %.0f MHz, SD busy: %u clocks/block\n",
+            sim.imgClk().freq()/1e6, sim.sdClkInt().freq()/1e6, sdBusyClocks);
+        
+        const auto wallStart = std::chrono::steady_clock::now();
+        
+        // Configure SDController: fast clock, 1.8V push-pull
+        top.sd_config_action = 1; // SDController_Config_Action_Init
+        top.sd_config_clkSpeed = 1; // SDController_Config_ClkSpeed_Fast
+        top.sd_config_pinMode = 0; // SDController_Config_PinMode_PushPull1V8
+        top.sd_config_trigger = !top.sd_config_trigger;
+        
+        bool ok = true;
+        for (uint32_t frame=0; frame<frameCount; frame++) {
+            printf("\n========== Frame %u ==========\n", frame);
+            
+            // Capture
+            const _Time captureStart = sim.time();
+            const uint64_t imgClkCaptureStart = sim.imgClk().toggleCount/2;
+            const uint64_t frameStartCount = sim.sensor().frameStartCount;
+            const uint32_t dropCountStart = top.fifoIn_dropCount;
+            const uint8_t captureDone = top.imgctrl_status_captureDone;
+            sim.fifoInMax = 0;
+            top.imgctrl_cmd_capture = !top.imgctrl_cmd_capture;
+            sim.stepUntil([&] { return top.imgctrl_status_captureDone != captureDone; }, timeout, "capture");
+            const _Time captureEnd = sim.time();
+            const uint64_t imgClkCaptureEnd = sim.imgClk().toggleCount/2;
+            
+            const uint32_t capturePixelCount = top.imgctrl_status_capturePixelCount;
+            const uint32_t dropCount = top.fifoIn_dropCount - dropCountStart;
+            printf("Capture: %.3f ms (%ju sensor frame starts), %.3f img_clk cycles/pixel\n",
+                _Ms(captureEnd-captureStart), (uintmax_t)(sim.sensor().frameStartCount-frameStartCount),
+                (double)(imgClkCaptureEnd-imgClkCaptureStart)/pixelCount);
+            printf("  pixels: %u (expected: %u) %s, dropped: %u %s\n",
+                capturePixelCount, pixelCount, (capturePixelCount==pixelCount ? "✅" : "❌"),
+                dropCount, (!dropCount ? "✅" : "❌"));
+            printf("  input FIFO high-water mark: %u/%u words\n", sim.fifoInMax, (uint32_t)top.cfg_fifoInWordCapacity);
+            ok &= (capturePixelCount==pixelCount && !dropCount);
+            
+            // Readout
+            _SDCard& card = sim.sdCard();
+            card.expect(headerWordCount, pixelCount);
+            const uint64_t blockCountStart = card.blockCount;
+            const uint64_t pixelErrCountStart = card.pixelErrCount;
+            const uint64_t pixelOKCountStart = card.pixelOKCount;
+            const uint64_t crcErrCountStart = card.crcErrCount;
+            const uint32_t stallCountStart = top.readoutfifo_wStallCount;
+            const uint64_t imgClkReadoutStart = sim.imgClk().toggleCount/2;
+            const uint64_t sdClkReadoutStart = sim.sdClkInt().toggleCount/2;
+            const uint64_t ramReadCountStart = sim.sdram().readCount;
+            const _Time readoutStart = sim.time();
+            const uint8_t readoutStartToggle = top.imgctrl_readout_start;
+            top.imgctrl_cmd_readout = !top.imgctrl_cmd_readout;
+            
+            // Reset the AFIFOChain occupancy once ImgController has reset the chain
+            sim.stepUntil([&] { return top.imgctrl_readout_start != readoutStartToggle; }, timeout, "readout start");
+            sim.readoutFIFOBase = top.readoutfifo_wCount - top.readoutfifo_rCount;
+            sim.readoutFIFOMax = 0;
+            
+            sim.stepUntil([&] {
+                return card.blockCount-blockCountStart>=readoutBlockCount && top.sd_datOut_done;
+            }, timeout, "readout");
+            const _Time readoutEnd = sim.time();
+            const uint64_t imgClkReadoutEnd = sim.imgClk().toggleCount/2;
+            const uint64_t sdClkReadoutEnd = sim.sdClkInt().toggleCount/2;
+            
+            const uint64_t blockCount = card.blockCount-blockCountStart;
+            const uint64_t pixelOKCount = card.pixelOKCount-pixelOKCountStart;
+            const uint64_t pixelErrCount = card.pixelErrCount-pixelErrCountStart;
+            const uint64_t crcErrCount = card.crcErrCount-crcErrCountStart;
+            const double readoutSec = (double)(readoutEnd-readoutStart)/1e12;
+            printf("Readout: %.3f ms, %.2f MB/s, %.3f img_clk cycles/pixel, %.3f sd_clk cycles/word\n",
+                _Ms(readoutEnd-readoutStart), (blockCount*BlockWordCount*2)/readoutSec/1e6,
+                (double)(imgClkReadoutEnd-imgClkReadoutStart)/pixelCount,
+                (double)(sdClkReadoutEnd-sdClkReadoutStart)/(blockCount*BlockWordCount));
+            printf("  SD blocks: %ju (expected: %u) %s, CRC errors: %ju %s\n",
+                (uintmax_t)blockCount, readoutBlockCount, (blockCount==readoutBlockCount ? "✅" : "❌"),
+                (uintmax_t)crcErrCount, (!crcErrCount ? "✅" : "❌"));
+            printf("  pixels valid: %ju/%u %s\n", (uintmax_t)pixelOKCount, pixelCount,
+                (pixelOKCount==pixelCount && !pixelErrCount ? "✅" : "❌"));
+            printf("  SDRAM words read: %ju (%.1f%% of img_clk cycles)\n",
+                (uintmax_t)(sim.sdram().readCount-ramReadCountStart),
+                100.*(sim.sdram().readCount-ramReadCountStart)/(imgClkReadoutEnd-imgClkReadoutStart));
+            printf("  readout FIFO high-water mark: %u/%u words, ImgController stalled %u img_clk cycles\n",
+                sim.readoutFIFOMax, (uint32_t)top.cfg_readoutFIFOWordCapacity,
+                (uint32_t)top.readoutfifo_wStallCount-stallCountStart);
+            ok &= (blockCount==readoutBlockCount && !crcErrCount && pixelOKCount==pixelCount && !pixelErrCount);
+            
+            printf("Capture->SD: %.3f ms\n", _Ms(readoutEnd-captureStart));
+        }
+        
+        sim.finish();
+        const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now()-wallStart).count();
+        
+        printf("\nSDRAM:\n");
+        sim.sdram().printStats();
+        ok &= !sim.sdram().violationCount();
+        
+        printf("\nSimulated %.3f ms in %.2f s (%.1f%% of real time)\n",
+            _Ms(sim.time()), wallSec, 100.*((double)sim.time()/1e12)/wallSec);
+        
+        if (!ok) {
+            printf("FAILED ❌\n");
+            return 1;
+        }
+        printf("OK ✅\n");
+        
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -3,7 +3,7 @@
 `include "Delay.v"
 
 `ifdef SIM
-`include "../../mt48h32m16lf/mobile_sdr.v"
+`include "mt48h32m16lf/mobile_sdr.v"
 `endif
 
 `timescale 1ns/1ps
@@ -13,19 +13,17 @@ module Top(
     
     input wire[1:0]     ram_cmd,
     input wire[2:0]     ram_cmd_block,
-    output reg          ram_write_ready,
+    output wire         ram_write_ready,
     input wire          ram_write_trigger,
     input wire[15:0]    ram_write_data,
-    output reg          ram_write_done,
-    output reg          ram_read_ready,
+    output wire         ram_read_ready,
     input wire          ram_read_trigger,
     output wire[15:0]   ram_read_data,
-    output reg          ram_read_done,
     
     output wire         ram_clk,
     output wire         ram_cke,
     output wire[1:0]    ram_ba,
-    output wire[12:0]   ram_a,
+    output wire[11:0]   ram_a,
     output wire         ram_cs_,
     output wire         ram_ras_,
     output wire         ram_cas_,
@@ -35,7 +33,7 @@ module Top(
 );
     RAMController #(
         .ClkFreq(120_000_000),
-        .BlockSize(2304*1296)
+        .BlockCount(8) // 3-bit `ram_cmd_block`
     ) RAMController(
         .clk(clk24mhz),
         
@@ -45,12 +43,10 @@ module Top(
         .write_ready(ram_write_ready),
         .write_trigger(ram_write_trigger),
         .write_data(ram_write_data),
-        .write_done(ram_write_done),
         
         .read_ready(ram_read_ready),
         .read_trigger(ram_read_trigger),
         .read_data(ram_read_data),
-        .read_done(ram_read_done),
         
         .ram_clk(ram_clk),
         .ram_cke(ram_cke),
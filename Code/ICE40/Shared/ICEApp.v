@@ -33,6 +33,12 @@
     `define _ICEApp_SPIReadout_En
 `endif
 
+// ICEApp_ImgHistogram_En: enables ImgController's capture histogram and Msg_Type_ImgHistogram
+// (requires an Img configuration)
+`ifdef ICEApp_ImgHistogram_En
+    `define _ICEApp_ImgHistogram_En
+`endif
+
 module ICEApp(
     input wire          ice_img_clk16mhz,
     
@@ -161,6 +167,7 @@ module ICEApp(
     reg[0:0]                                imgctrl_cmd_skipCount = 0;
     reg[`Img_HeaderWordCount*16-1:0]        imgctrl_cmd_header = 0;
     reg                                     imgctrl_cmd_thumb = 0;
+    reg                                     imgctrl_cmd_histogramNext = 0;
     wire                                    imgctrl_readout_rst;
     wire                                    imgctrl_readout_start;
     wire                                    imgctrl_readout_ready;
@@ -171,17 +178,24 @@ module ICEApp(
     wire[`RegWidth(`Img_WordCount)-1:0]     imgctrl_status_capturePixelCount;
     wire[17:0]                              imgctrl_status_captureHighlightCount;
     wire[17:0]                              imgctrl_status_captureShadowCount;
+    wire[63:0]                              imgctrl_status_captureHistogram;
     // ImgCtrl_PaddingWordCount: padding so that ImgController readout outputs enough
     // data to trigger the AFIFOChain read threshold (`readoutfifo_r_thresh`)
     localparam ImgCtrl_AFIFOWordCapacity = (`AFIFO_CapacityBytes/2);
     localparam ImgCtrl_ReadoutWordThresh = ReadoutFIFO_R_Thresh*ImgCtrl_AFIFOWordCapacity;
     localparam ImgCtrl_PaddingWordCount = ImgCtrl_ReadoutWordThresh-1;
+    `ifdef _ICEApp_ImgHistogram_En
+        localparam ImgCtrl_Histogram = 1;
+    `else
+        localparam ImgCtrl_Histogram = 0;
+    `endif
     ImgController #(
         .ClkFreq(Img_Clk_Freq),
         .HeaderWordCount(`Img_HeaderWordCount),
         .ImgWidth(`Img_Width),
         .ImgHeight(`Img_Height),
-        .PaddingWordCount(ImgCtrl_PaddingWordCount)
+        .PaddingWordCount(ImgCtrl_PaddingWordCount),
+        .Histogram(ImgCtrl_Histogram)
     ) ImgController (
         .clk(img_clk),
         
@@ -191,6 +205,7 @@ module ICEApp(
         .cmd_skipCount(imgctrl_cmd_skipCount),
         .cmd_header(imgctrl_cmd_header),
         .cmd_thumb(imgctrl_cmd_thumb),
+        .cmd_histogramNext(imgctrl_cmd_histogramNext),
         
         .readout_rst(imgctrl_readout_rst),
         .readout_start(imgctrl_readout_start),
@@ -203,6 +218,7 @@ module ICEApp(
         .status_capturePixelCount(imgctrl_status_capturePixelCount),
         .status_captureHighlightCount(imgctrl_status_captureHighlightCount),
         .status_captureShadowCount(imgctrl_status_captureShadowCount),
+        .status_captureHistogram(imgctrl_status_captureHistogram),
         
         .img_dclk(img_dclk),
         .img_d(img_d),
@@ -796,6 +812,15 @@ module ICEApp(
                     spi_resp[`Resp_Arg_ImgCaptureStatus_ShadowCount_Bits] <= imgctrl_status_captureShadowCount;
                 end
                 
+`ifdef _ICEApp_ImgHistogram_En
+                // Respond with the current histogram bins, and advance to the next bins
+                `Msg_Type_ImgHistogram: begin
+                    $display("[SPI] Got Msg_Type_ImgHistogram");
+                    spi_resp[`Resp_Arg_ImgHistogram_Bins_Bits] <= imgctrl_status_captureHistogram;
+                    imgctrl_cmd_histogramNext <= !imgctrl_cmd_histogramNext;
+                end
+`endif // _ICEApp_ImgHistogram_En
+                
                 `Msg_Type_ImgReadout: begin
                     $display("[SPI] Got Msg_Type_ImgReadout");
                     imgctrl_cmd_ramBlock <= spi_msgArg[`Msg_Arg_ImgReadout_SrcRAMBlock_Bits];
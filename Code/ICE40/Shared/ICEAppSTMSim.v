@@ -246,7 +246,8 @@ task TestSDReadoutToSPI_Readout; begin
         16'hFFFF,   // pixelInitial
         -1,         // pixelDelta
         1,          // pixelFilterPeriod
-        1           // pixelFilterKeep
+        1,          // pixelFilterKeep
+        0           // pixelFilterBin
     );
     
     SPIReadout(
@@ -276,7 +277,8 @@ task TestImgReadoutToSPI_Readout(input[`Msg_Arg_ImgReadout_Thumb_Len-1:0] thumb)
         Sim_ImgPixelInitial,    // pixelInitial
         Sim_ImgPixelDelta,      // pixelDelta
         (!thumb ? 1 : 8),       // pixelFilterPeriod
-        (!thumb ? 1 : 2)        // pixelFilterKeep
+        (!thumb ? 1 : 2),       // pixelFilterKeep
+        0                       // pixelFilterBin (ICEApp's ImgController decimates thumbnails)
     );
     
     SPIReadout(
@@ -14,6 +14,7 @@
 `ifdef _ICEApp_Img_En
 `include "ImgSim.v"
 `include "ImgI2CSlaveSim.v"
+`include "ImgHistogramValidator.v"
 
 // MOBILE_SDR_INIT_VAL: Initialize the memory because ImgController reads a few words
 // beyond the image that's written to the RAM, and we don't want to read `x` (don't care)
@@ -109,6 +110,8 @@ module ICEAppSim();
             .i2c_clk(img_sclk),
             .i2c_data(img_sdata)
         );
+        
+        ImgHistogramValidator ImgHistogramValidator();
     `endif // _ICEApp_Img_En
     
     `ifdef _ICEApp_SD_En
@@ -415,6 +418,25 @@ module ICEAppSim();
         );
     end endtask
     
+    task TestImgHistogram; begin
+        localparam GroupCount = (`Img_HistogramChannelCount*`Img_HistogramBinCount)/`Resp_Arg_ImgHistogram_BinCount;
+        $display("\n[ICEAppSim] ========== TestImgHistogram ==========");
+        
+        ImgHistogramValidator.Config(
+            `Img_Width,             // imageWidth
+            `Img_Height,            // imageHeight
+            Sim_ImgPixelInitial,    // pixelInitial
+            Sim_ImgPixelDelta       // pixelDelta
+        );
+        
+        for (integer i=0; i<GroupCount; i++) begin
+            SendMsg(`Msg_Type_ImgHistogram, 0);
+            ImgHistogramValidator.Validate(spi_resp[`Resp_Arg_ImgHistogram_Bins_Bits]);
+        end
+        
+        ImgHistogramValidator.Done();
+    end endtask
+    
     task TestImgReadout(
         input[`Msg_Arg_ImgReadout_SrcRAMBlock_Len-1:0] srcRAMBlock,
         input[`Msg_Arg_ImgReadout_Thumb_Len-1:0] thumb
@@ -756,7 +778,8 @@ module ICEAppSim();
             Sim_ImgPixelInitial,                            // pixelInitial
             Sim_ImgPixelDelta,                              // pixelDelta
             (!thumb ? 1 : 8),                               // pixelFilterPeriod
-            (!thumb ? 1 : 2)                                // pixelFilterKeep
+            (!thumb ? 1 : 2),                               // pixelFilterKeep
+            0                                               // pixelFilterBin (ICEApp's ImgController decimates thumbnails)
         );
         
         // Start image readout
@@ -916,6 +939,9 @@ module ICEAppSim();
             
             TestImgI2CWriteRead();
             TestImgCapture();
+            `ifdef _ICEApp_ImgHistogram_En
+                TestImgHistogram();
+            `endif // _ICEApp_ImgHistogram_En
         `endif // _ICEApp_Img_En
 
         `ifdef _ICEApp_SD_En
@@ -105,6 +105,10 @@
 
 `define Msg_Type_Readout                                        `Msg_Type_StartBit | `Msg_Type_Len'h0D
 
+`define Msg_Type_ImgHistogram                                   `Msg_Type_StartBit | `Msg_Type_Resp | `Msg_Type_Len'h0E
+`define     Resp_Arg_ImgHistogram_Bins_Bits                     63:0 // 4 bins, 16 bits each, first bin in the MSBs
+`define     Resp_Arg_ImgHistogram_BinCount                      4
+
 `define Msg_Type_Nop                                            `Msg_Type_Len'h00
 
 `ifdef SIM
@@ -121,6 +125,9 @@
 `define Img_HeaderWordCount     16
 `define Img_ChecksumWordCount   2
 
+`define Img_HistogramChannelCount   4 // One per CFA position
+`define Img_HistogramBinCount       64
+
 `define Img_PixelCount          (`Img_Width * `Img_Height)
 `define Img_ThumbPixelCount     (`Img_ThumbWidth * `Img_ThumbHeight)
 
@@ -13,12 +13,16 @@ module ImgController #(
     parameter ImgWidth                  = 4096,
     parameter ImgHeight                 = 4096,
     parameter PaddingWordCount          = 42,
+    parameter ThumbBin                  = 0, // Thumbnail mode: average each 8x8 block (1) or decimate (0)
+    parameter RAMBankInterleave         = 0, // RAMController's BankInterleave
+    parameter Histogram                 = 0, // Build a capture histogram (1) or not (0); see `status_captureHistogram`
     
     localparam HeaderWidth              = HeaderWordCount*16,
     localparam ImgPixelCount            = ImgWidth*ImgHeight,
     localparam ChecksumWordCount        = 2,
     localparam ChecksumWidth            = ChecksumWordCount*16,
-    localparam ChecksumPaddingWordCount = PaddingWordCount+ChecksumWordCount
+    localparam ChecksumPaddingWordCount = PaddingWordCount+ChecksumWordCount,
+    localparam ThumbBinBufDepth         = ImgWidth/2 // (ImgWidth/8 blocks) * (2x2 CFA colors)
 )(
     input wire          clk,
     
@@ -30,6 +34,7 @@ module ImgController #(
     input wire[HeaderWidth-1:0]
                         cmd_header,
     input wire          cmd_thumb,      // Thumbnail readout mode
+    input wire          cmd_histogramNext, // Toggle signal: advance `status_captureHistogram` to the next bins
     
     // Readout port (clock domain: `clk`)
     output reg          readout_rst = 0,
@@ -45,6 +50,7 @@ module ImgController #(
                         status_capturePixelCount,
     output wire[17:0]   status_captureHighlightCount,
     output wire[17:0]   status_captureShadowCount,
+    output reg[63:0]    status_captureHistogram = 0, // 4 histogram bins, first bin in the MSBs
     
     // Img port (clock domain: `img_dclk`)
     input wire          img_dclk,
@@ -78,7 +84,8 @@ module ImgController #(
     
     RAMController #(
         .ClkFreq(ClkFreq),
-        .BlockCount(2)
+        .BlockCount(2),
+        .BankInterleave(RAMBankInterleave)
     ) RAMController (
         .clk(clk),
         
@@ -227,9 +234,11 @@ module ImgController #(
         
         fifoIn_frameStart <= (!fifoIn_fvPrev && fifoIn_fv);
         
+`ifdef SIM
         if (fifoIn_w_trigger) begin
             $display("[ImgController:fifoIn] Wrote word into FIFO: %x", fifoIn_w_data);
         end
+`endif
         
         // Count pixel stats (number of highlights/shadows)
         // We're pipelining `fifoIn_countStat` and `fifoIn_countStatPx` here for performance
@@ -321,6 +330,168 @@ module ImgController #(
     // // calculating the checksum, to match host behavior
     // assign readout_checksum_din  = {readout_data[7:0], readout_data[15:8]};
     
+    // ====================
+    // Capture Histogram
+    // ====================
+    // During capture, we build a histogram of each CFA channel from the pixels as they're
+    // written to RAM, sampling the upper-left 2x2 of each 8x8 block (1/16 of the pixels, so
+    // the 16-bit counts can't overflow).
+    //
+    // Bins are log-spaced: a pixel's bin is a 6-bit float with a 3-bit exponent and a 3-bit
+    // mantissa, which splits [0,32) into 8 linear bins, and each octave above that into 8 bins
+    // (see Img::Histogram::Bin()). Each bin is read, incremented and written back over 4
+    // cycles; same-channel samples are 8 pixels apart, so the updates never overlap.
+    //
+    // After a capture, `status_captureHistogram` holds the first 4 bins (channel 0, bins 0-3),
+    // and each `cmd_histogramNext` toggle advances it to the next 4 bins, wrapping after the
+    // last channel.
+    //
+    // With Histogram=0, the histogram is never cleared, updated or loaded (so the memory
+    // isn't used), and captures finish exactly as they did without it.
+    localparam HistChannelCount = 4;
+    localparam HistBinCount = 64;
+    localparam HistDepth = HistChannelCount*HistBinCount;
+    localparam HistGroupCount = HistDepth/4;
+    
+    reg[15:0] ctrl_hist_mem[0:HistDepth-1];
+    reg[`RegWidth(HistDepth-1)-1:0] ctrl_hist_rAddr = 0;
+    reg[15:0] ctrl_hist_rData = 0;
+    reg ctrl_hist_wTrigger = 0;
+    reg[`RegWidth(HistDepth-1)-1:0] ctrl_hist_wAddr = 0;
+    reg[15:0] ctrl_hist_wData = 0;
+    always @(posedge clk) begin
+        ctrl_hist_rData <= ctrl_hist_mem[ctrl_hist_rAddr];
+        if (ctrl_hist_wTrigger) begin
+            ctrl_hist_mem[ctrl_hist_wAddr] <= ctrl_hist_wData;
+        end
+    end
+    
+    `TogglePulse(ctrl_hist_next, cmd_histogramNext, posedge, clk);
+    reg ctrl_hist_clear = 0; // Pulse: zero the histogram and start counting
+    reg ctrl_hist_load = 0; // Pulse: load the first bins into `status_captureHistogram`
+    reg ctrl_hist_valid = 0;
+    reg[`RegWidth(HistDepth)-1:0] ctrl_hist_clearCount = 0;
+    
+    // ctrl_hist_pixelEn: a pixel is being written to RAM (RAM words are little endian)
+    wire ctrl_hist_pixelEn = Histogram && fifoIn_r_ready && ramctrl_write_ready;
+    wire[11:0] ctrl_hist_pixel = {fifoIn_r_data[3:0], fifoIn_r_data[15:8]};
+    reg[`RegWidth(ImgWidth-1)-1:0] ctrl_hist_x = 0;
+    reg[2:0] ctrl_hist_y = 0;
+    
+    reg ctrl_hist_sample = 0;
+    reg[1:0] ctrl_hist_sampleChannel = 0;
+    reg[11:0] ctrl_hist_samplePixel = 0;
+    reg ctrl_hist_readEn = 0;
+    reg ctrl_hist_incEn = 0;
+    reg[`RegWidth(HistDepth-1)-1:0] ctrl_hist_incAddr = 0;
+    
+    reg[`RegWidth(HistGroupCount-1)-1:0] ctrl_hist_group = 0;
+    reg[2:0] ctrl_hist_groupReadCount = 0;
+    reg[1:0] ctrl_hist_groupReadIdx = 0;
+    reg ctrl_hist_groupReadEn = 0;
+    reg ctrl_hist_groupLoadEn = 0;
+    
+    // ctrl_hist_busy: the histogram is being cleared or updated
+    wire ctrl_hist_busy = (
+        ctrl_hist_clear || ctrl_hist_clearCount ||
+        ctrl_hist_sample || ctrl_hist_readEn || ctrl_hist_incEn || ctrl_hist_wTrigger
+    );
+    
+    always @(posedge clk) begin
+        ctrl_hist_wTrigger <= 0; // Pulse
+        ctrl_hist_sample <= 0; // Pulse
+        ctrl_hist_readEn <= 0; // Pulse
+        ctrl_hist_incEn <= 0; // Pulse
+        ctrl_hist_groupReadEn <= 0; // Pulse
+        ctrl_hist_groupLoadEn <= 0; // Pulse
+        
+        // Track the position of pixels being written to RAM, and sample the upper-left 2x2
+        // of each 8x8 block
+        if (ctrl_hist_pixelEn) begin
+            if (ctrl_hist_x !== ImgWidth-1) begin
+                ctrl_hist_x <= ctrl_hist_x+1;
+            end else begin
+                ctrl_hist_x <= 0;
+                ctrl_hist_y <= ctrl_hist_y+1;
+            end
+            
+            ctrl_hist_sample <= (!ctrl_hist_x[2:1] && !ctrl_hist_y[2:1]);
+            ctrl_hist_sampleChannel <= {ctrl_hist_y[0], ctrl_hist_x[0]};
+            ctrl_hist_samplePixel <= ctrl_hist_pixel;
+        end
+        
+        // Read the sample's bin
+        if (ctrl_hist_sample) begin
+            ctrl_hist_readEn <= 1;
+            casez (ctrl_hist_samplePixel[11:5])
+            7'b1??????: ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd7, ctrl_hist_samplePixel[10:8]};
+            7'b01?????: ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd6, ctrl_hist_samplePixel[ 9:7]};
+            7'b001????: ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd5, ctrl_hist_samplePixel[ 8:6]};
+            7'b0001???: ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd4, ctrl_hist_samplePixel[ 7:5]};
+            7'b00001??: ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd3, ctrl_hist_samplePixel[ 6:4]};
+            7'b000001?: ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd2, ctrl_hist_samplePixel[ 5:3]};
+            7'b0000001: ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd1, ctrl_hist_samplePixel[ 4:2]};
+            default:    ctrl_hist_rAddr <= {ctrl_hist_sampleChannel, 3'd0, ctrl_hist_samplePixel[ 4:2]};
+            endcase
+        end
+        
+        // Wait for the read
+        if (ctrl_hist_readEn) begin
+            ctrl_hist_incEn <= 1;
+            ctrl_hist_incAddr <= ctrl_hist_rAddr;
+        end
+        
+        // Write back the incremented bin
+        if (ctrl_hist_incEn) begin
+            ctrl_hist_wTrigger <= 1;
+            ctrl_hist_wAddr <= ctrl_hist_incAddr;
+            ctrl_hist_wData <= ctrl_hist_rData+1;
+        end
+        
+        // Zero the histogram
+        if (ctrl_hist_clearCount) begin
+            ctrl_hist_clearCount <= ctrl_hist_clearCount-1;
+            ctrl_hist_wTrigger <= 1;
+            ctrl_hist_wAddr <= ctrl_hist_clearCount-1;
+            ctrl_hist_wData <= 0;
+        end
+        
+        if (ctrl_hist_clear) begin
+            ctrl_hist_clearCount <= HistDepth;
+            ctrl_hist_valid <= 0;
+            ctrl_hist_x <= 0;
+            ctrl_hist_y <= 0;
+        end
+        
+        // Load the 4 bins of `ctrl_hist_group` into `status_captureHistogram`
+        // The memory has a 2-cycle read latency, so each word arrives 2 cycles after its
+        // address is supplied.
+        if (ctrl_hist_groupReadCount) begin
+            ctrl_hist_groupReadCount <= ctrl_hist_groupReadCount-1;
+            ctrl_hist_groupReadIdx <= ctrl_hist_groupReadIdx+1;
+            ctrl_hist_groupReadEn <= 1;
+            ctrl_hist_rAddr <= {ctrl_hist_group, ctrl_hist_groupReadIdx};
+        end
+        
+        ctrl_hist_groupLoadEn <= ctrl_hist_groupReadEn;
+        if (ctrl_hist_groupLoadEn) begin
+            status_captureHistogram <= (status_captureHistogram<<16)|ctrl_hist_rData;
+        end
+        
+        if (ctrl_hist_load) begin
+            ctrl_hist_valid <= 1;
+            ctrl_hist_group <= 0;
+            ctrl_hist_groupReadCount <= 4;
+            ctrl_hist_groupReadIdx <= 0;
+        end
+        
+        if (ctrl_hist_next && ctrl_hist_valid) begin
+            ctrl_hist_group <= ctrl_hist_group+1;
+            ctrl_hist_groupReadCount <= 4;
+            ctrl_hist_groupReadIdx <= 0;
+        end
+    end
+    
     // ====================
     // Control State Machine
     // ====================
@@ -329,6 +500,7 @@ module ImgController #(
     reg[`RegWidth(ImgWidth)-1:0] ctrl_readout_pixelX = 0;
     reg[`RegWidth(ImgHeight)-1:0] ctrl_readout_pixelY = 0;
     reg ctrl_readout_pixelFilterEn = 0;
+    reg ctrl_readout_binEn = 0;
     // ctrl_readout_pixelKeep: keep the pixel if filtering is disabled (ie non-thumbnail mode),
     // or if filtering is enabled and the pixel is in the upper-left 2x2 corner of any 8x8 group
     wire ctrl_readout_pixelKeep = (
@@ -347,9 +519,64 @@ module ImgController #(
     reg[`RegWidth2(HeaderWordCount-1,ChecksumPaddingWordCount-1)-1:0] ctrl_shiftout_count = 0;
     reg[`RegWidth(Ctrl_State_Count-1)-1:0] ctrl_shiftout_nextState = 0;
     
-    reg[1:0] ctrl_delay_count = 0;
+    // ctrl_delay_count: ThumbBin=1 needs an extra bit for the 4-cycle checksum wait
+    reg[(ThumbBin ? 2 : 1):0] ctrl_delay_count = 0;
     reg[`RegWidth(Ctrl_State_Count-1)-1:0] ctrl_delay_nextState = 0;
     
+    // ====================
+    // Thumbnail binning
+    // ====================
+    // In thumbnail mode with ThumbBin=1, each thumbnail pixel is the average of the 16
+    // same-color pixels of an 8x8 block, instead of the block's upper-left pixel.
+    //
+    // Each CFA row's pixels are summed horizontally in registers (ctrl_bin_sum), and the
+    // sums are accumulated vertically in a line buffer (ctrl_bin_buf) that holds one partial
+    // sum per (block, CFA color) of the current 8-row band. On the last row of each CFA row
+    // parity in the band, the completed sums are output instead of stored, which emits
+    // thumbnail pixels in raster order.
+    //
+    // The sums are seeded with 8 so that the final >>4 rounds to nearest.
+    reg[15:0] ctrl_bin_buf[0:ThumbBinBufDepth-1];
+    reg[`RegWidth(ThumbBinBufDepth-1)-1:0] ctrl_bin_bufRAddr = 0;
+    reg[15:0] ctrl_bin_bufRData = 0;
+    reg ctrl_bin_bufWTrigger = 0;
+    reg[`RegWidth(ThumbBinBufDepth-1)-1:0] ctrl_bin_bufWAddr = 0;
+    reg[15:0] ctrl_bin_bufWData = 0;
+    always @(posedge clk) begin
+        ctrl_bin_bufRData <= ctrl_bin_buf[ctrl_bin_bufRAddr];
+        if (ctrl_bin_bufWTrigger) begin
+            ctrl_bin_buf[ctrl_bin_bufWAddr] <= ctrl_bin_bufWData;
+        end
+    end
+    
+    // ctrl_bin_pixelEn: a RAM word was accepted while binning
+    // ctrl_readout_pixelY===ImgHeight once the image is finished, when RAMController may still
+    // supply words that we discard.
+    wire ctrl_bin_pixelEn = (
+        ThumbBin && ctrl_readout_binEn && ramctrl_read_ready && ramctrl_read_trigger &&
+        (ctrl_readout_pixelY !== ImgHeight)
+    );
+    // ctrl_bin_pixel: the accepted pixel value (RAM words are little endian)
+    wire[11:0] ctrl_bin_pixel = {ramctrl_read_data[3:0], ramctrl_read_data[15:8]};
+    wire[2:0] ctrl_bin_x = ctrl_readout_pixelX[2:0];
+    wire[2:0] ctrl_bin_y = ctrl_readout_pixelY[2:0];
+    wire[`RegWidth(ThumbBinBufDepth-1)-1:0] ctrl_bin_addr0 = {ctrl_readout_pixelX>>3, ctrl_readout_pixelY[0], 1'b0};
+    wire[`RegWidth(ThumbBinBufDepth-1)-1:0] ctrl_bin_addr1 = {ctrl_readout_pixelX>>3, ctrl_readout_pixelY[0], 1'b1};
+    reg[13:0] ctrl_bin_sum[0:1];
+    reg[15:0] ctrl_bin_old[0:1];
+    
+    // ctrl_bin_stage*: a completed horizontal sum, which is accumulated on the next cycle
+    reg ctrl_bin_stage = 0;
+    reg ctrl_bin_stageFirst = 0;
+    reg ctrl_bin_stageLast = 0;
+    reg[13:0] ctrl_bin_stageSum = 0;
+    reg[15:0] ctrl_bin_stageOld = 0;
+    reg[`RegWidth(ThumbBinBufDepth-1)-1:0] ctrl_bin_stageAddr = 0;
+    wire[15:0] ctrl_bin_stageTotal = (ctrl_bin_stageFirst ? 16'd8 : ctrl_bin_stageOld) + ctrl_bin_stageSum;
+    // ctrl_bin_emit: the stage will output a thumbnail pixel, so we can't accept a RAM word
+    // (which needs the readout flop to be empty) on this cycle
+    wire ctrl_bin_emit = ThumbBin && ctrl_bin_stage && ctrl_bin_stageLast;
+    
     localparam Ctrl_State_Idle          = 0;  // +0
     localparam Ctrl_State_Capture       = 1;  // +3
     localparam Ctrl_State_Readout       = 5;  // +4
@@ -359,6 +586,8 @@ module ImgController #(
     reg[`RegWidth(Ctrl_State_Count-1)-1:0] ctrl_state = 0;
     always @(posedge clk) begin
         ramctrl_cmd <= `RAMController_Cmd_None;
+        ctrl_hist_clear <= 0; // Pulse
+        ctrl_hist_load <= 0; // Pulse
         readout_rst <= 0; // Pulse
         readout_checksum_rst <= 0; // Pulse
         ctrl_delay_count <= ctrl_delay_count-1;
@@ -368,13 +597,15 @@ module ImgController #(
             ctrl_shiftout_count <= ctrl_shiftout_count-1;
         end
         
+`ifdef SIM
         if (readout_ready && readout_trigger) begin
             $display("[ImgController:Readout] readout_data: %x", readout_data);
         end
+`endif
         
         // readout_checksum_din <= {readout_data[7:0], readout_data[15:8]};
         
-        if (ctrl_readout_pixelFilterEn && ramctrl_read_ready && ramctrl_read_trigger) begin
+        if ((ctrl_readout_pixelFilterEn || (ThumbBin && ctrl_readout_binEn)) && ramctrl_read_ready && ramctrl_read_trigger) begin
             if (ctrl_readout_pixelX !== ImgWidth-1) begin
                 ctrl_readout_pixelX <= ctrl_readout_pixelX+1;
             end else begin
@@ -400,6 +631,53 @@ module ImgController #(
         readout_checksum_en <= readout_checksum_trigger; // Pulse
         readout_checksum_trigger <= 0; // Pulse
         
+        // Thumbnail binning
+        // The pixels of each 8-pixel block row arrive in CFA order (px=x[0]), so:
+        //   x=0/1: start the horizontal sums, and read the line buffer for px=0
+        //   x=2  : latch the line buffer for px=0, and read it for px=1
+        //   x=4  : latch the line buffer for px=1
+        //   x=6/7: stage the completed sums
+        ctrl_bin_bufWTrigger <= 0; // Pulse
+        ctrl_bin_stage <= 0; // Pulse
+        if (ctrl_bin_pixelEn) begin
+            if (!ctrl_bin_x[2:1])   ctrl_bin_sum[ctrl_bin_x[0]] <= ctrl_bin_pixel;
+            else                    ctrl_bin_sum[ctrl_bin_x[0]] <= ctrl_bin_sum[ctrl_bin_x[0]] + ctrl_bin_pixel;
+            
+            case (ctrl_bin_x)
+            0: ctrl_bin_bufRAddr <= ctrl_bin_addr0;
+            2: begin
+                ctrl_bin_old[0] <= ctrl_bin_bufRData;
+                ctrl_bin_bufRAddr <= ctrl_bin_addr1;
+            end
+            4: ctrl_bin_old[1] <= ctrl_bin_bufRData;
+            6, 7: begin
+                ctrl_bin_stage <= 1;
+                ctrl_bin_stageFirst <= (ctrl_bin_y[2:1] === 0);
+                ctrl_bin_stageLast <= (ctrl_bin_y[2:1] === 3);
+                ctrl_bin_stageSum <= ctrl_bin_sum[ctrl_bin_x[0]] + ctrl_bin_pixel;
+                ctrl_bin_stageOld <= ctrl_bin_old[ctrl_bin_x[0]];
+                ctrl_bin_stageAddr <= (ctrl_bin_x[0] ? ctrl_bin_addr1 : ctrl_bin_addr0);
+            end
+            endcase
+        end
+        
+        if (ctrl_bin_stage) begin
+            if (!ctrl_bin_stageLast) begin
+                ctrl_bin_bufWTrigger <= 1;
+                ctrl_bin_bufWAddr <= ctrl_bin_stageAddr;
+                ctrl_bin_bufWData <= ctrl_bin_stageTotal;
+            
+            end else begin
+                // Output the average (ctrl_bin_stageTotal[15:4]) in the same little-endian
+                // format as the RAM words.
+                // Our RAM-word acceptance on the previous cycle guarantees that the readout
+                // flop is empty.
+                readout_data <= {ctrl_bin_stageTotal[11:4], 4'b0, ctrl_bin_stageTotal[15:12]};
+                readout_ready <= 1;
+                readout_checksum_trigger <= 1;
+            end
+        end
+        
         
         case (ctrl_state)
         Ctrl_State_Idle: begin
@@ -413,6 +691,8 @@ module ImgController #(
             // Supply 'Write' RAM command
             ramctrl_cmd_block <= cmd_ramBlock;
             ramctrl_cmd <= `RAMController_Cmd_Write;
+            // Reset the histogram
+            ctrl_hist_clear <= Histogram;
             $display("[ImgController:Capture] Waiting for RAMController to be ready to write...");
             ctrl_state <= Ctrl_State_Capture+1;
         end
@@ -424,7 +704,9 @@ module ImgController #(
             // initialize upon power on. If we attempted a capture during this time,
             // we'd drop most/all of the pixels because RAMController/SDRAM wouldn't
             // be ready to write yet.
-            if (ramctrl_cmd===`RAMController_Cmd_None && ramctrl_write_ready) begin
+            // With Histogram=1, we also wait for the histogram to finish clearing, before any
+            // pixels arrive.
+            if (ramctrl_cmd===`RAMController_Cmd_None && ramctrl_write_ready && (!Histogram || !ctrl_hist_busy)) begin
                 $display("[ImgController:Capture] Waiting for FIFO to reset...");
                 // Start the FIFO data flow now that RAMController is ready to write
                 ctrl_fifoInCaptureTrigger <= !ctrl_fifoInCaptureTrigger;
@@ -440,8 +722,11 @@ module ImgController #(
         end
         
         Ctrl_State_Capture+3: begin
-            if (ctrl_fifoInDone) begin
+            // Wait for the frame to end
+            // With Histogram=1, also wait for its pixels to drain through the histogram
+            if (ctrl_fifoInDone && (!Histogram || (!fifoIn_r_ready && !ctrl_hist_busy))) begin
                 $display("[ImgController:Capture] Finished");
+                ctrl_hist_load <= Histogram;
                 status_captureDone <= !status_captureDone;
                 ctrl_state <= Ctrl_State_Idle;
             end
@@ -470,8 +755,9 @@ module ImgController #(
             readout_checksum_rst <= 1;
             // Signal that readout is starting
             readout_start <= !readout_start;
-            // Enable pixel filter if we're in thumbnail mode
-            ctrl_readout_pixelFilterEn <= cmd_thumb;
+            // Enable pixel filter/binning if we're in thumbnail mode
+            ctrl_readout_pixelFilterEn <= cmd_thumb && !ThumbBin;
+            ctrl_readout_binEn <= cmd_thumb && ThumbBin;
             // Output the header
             ctrl_shiftout_data <= cmd_header;
             ctrl_shiftout_count <= HeaderWordCount-1;
@@ -494,14 +780,20 @@ module ImgController #(
         
         // Output pixels
         Ctrl_State_Readout+3: begin // 8
-            if (ramctrl_read_ready && ctrl_readout_dataLoad) begin
-                readout_data <= ramctrl_read_data;
-                readout_ready <= ctrl_readout_pixelKeep;
-                readout_checksum_trigger <= ctrl_readout_pixelKeep;
+            // With ThumbBin=1, we can't accept a RAM word while binning emits a pixel (see
+            // `ramctrl_read_trigger`)
+            if (ramctrl_read_ready && ctrl_readout_dataLoad && !ctrl_bin_emit) begin
+                // When binning, the output comes from the binning logic instead
+                if (!ThumbBin || !ctrl_readout_binEn) begin
+                    readout_data <= ramctrl_read_data;
+                    readout_ready <= ctrl_readout_pixelKeep;
+                    readout_checksum_trigger <= ctrl_readout_pixelKeep;
+                end
                 
                 if (ctrl_readout_pixelDone) begin
-                    // We need 3 wait states before we sample the checksum
-                    ctrl_delay_count <= 3;
+                    // We need 3 wait states before we sample the checksum, plus 1 when binning
+                    // because the final thumbnail pixel is output on the next cycle
+                    ctrl_delay_count <= ((ThumbBin && ctrl_readout_binEn) ? 4 : 3);
                     ctrl_delay_nextState <= Ctrl_State_Readout+4;
                     ctrl_state <= Ctrl_State_Delay;
                 end
@@ -562,8 +854,9 @@ module ImgController #(
     assign ramctrl_write_data = fifoIn_r_data;
     
     // ramctrl_read_trigger: trigger another read from RAM if our flop is currently empty (!readout_ready),
-    // or it's not empty and the client drained the word on this cycle
-    assign ramctrl_read_trigger = ctrl_readout_dataLoad;
+    // or it's not empty and the client drained the word on this cycle, unless the binning
+    // logic is about to output a thumbnail pixel
+    assign ramctrl_read_trigger = ctrl_readout_dataLoad && !ctrl_bin_emit;
     
 endmodule
 
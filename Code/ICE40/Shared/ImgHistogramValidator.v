@@ -0,0 +1,90 @@
+`ifndef ImgHistogramValidator_v
+`define ImgHistogramValidator_v
+
+`include "Util.v"
+`include "ICEAppTypes.v"
+
+`timescale 1ns/1ps
+
+// ImgHistogramValidator: validates the capture histogram read from ImgController against
+// the histogram of an image whose pixels follow `pixelInitial + pixelIdx*pixelDelta`
+module ImgHistogramValidator();
+    localparam BinCount     = `Img_HistogramBinCount;
+    localparam EntryCount   = `Img_HistogramChannelCount*`Img_HistogramBinCount;
+    
+    integer     _expected[0:EntryCount-1];
+    integer     _entryIdx = 0;
+    
+    // Bin(): reference model of ImgController's histogram bins (see Img::Histogram::Bin())
+    function integer Bin(input[11:0] px);
+        integer e;
+        begin
+            if (px < 32) begin
+                Bin = px>>2;
+            end else begin
+                e = 1;
+                while (px >= (64<<(e-1))) e++;
+                Bin = 8*e + ((px>>(e+1)) & 7);
+            end
+        end
+    endfunction
+    
+    task Config(
+        input integer   imageWidth,     // Pixel width of image
+        input integer   imageHeight,    // Pixel height of image
+        input reg[11:0] pixelInitial,   // Value of the first pixel
+        input integer   pixelDelta      // Difference between a pixel's value and the previous pixel's value
+    ); begin
+        integer x;
+        integer y;
+        reg[11:0] px;
+        
+        for (integer i=0; i<EntryCount; i++) _expected[i] = 0;
+        _entryIdx = 0;
+        
+        // Sample the upper-left 2x2 of each 8x8 block, like ImgController
+        for (y=0; y<imageHeight; y++) begin
+            for (x=0; x<imageWidth; x++) begin
+                if (x%8<2 && y%8<2) begin
+                    px = pixelInitial + (y*imageWidth+x)*pixelDelta;
+                    _expected[((y%2)*2 + (x%2))*BinCount + Bin(px)]++;
+                end
+            end
+        end
+    end endtask
+    
+    // Validate(): validates the next `Resp_Arg_ImgHistogram_BinCount bins, first bin in the MSBs
+    task Validate(input[63:0] bins); begin
+        for (integer i=0; i<`Resp_Arg_ImgHistogram_BinCount; i++) begin
+            reg[15:0] got;
+            got = `LeftBits(bins, i*16, 16);
+            
+            if (_entryIdx >= EntryCount) begin
+                $display("[ImgHistogramValidator] Received too many bins (index:%0d) ❌", _entryIdx);
+                `Finish;
+            
+            end else if (got === _expected[_entryIdx]) begin
+                $display("[ImgHistogramValidator] Received valid bin (channel:%0d bin:%0d, expected:%0d, got:%0d) ✅",
+                    _entryIdx/BinCount, _entryIdx%BinCount, _expected[_entryIdx], got);
+            
+            end else begin
+                $display("[ImgHistogramValidator] Received invalid bin (channel:%0d bin:%0d, expected:%0d, got:%0d) ❌",
+                    _entryIdx/BinCount, _entryIdx%BinCount, _expected[_entryIdx], got);
+                `Finish;
+            end
+            
+            _entryIdx++;
+        end
+    end endtask
+    
+    task Done; begin
+        if (_entryIdx === EntryCount) begin
+            $display("[ImgHistogramValidator] Received expected bin count: %0d ✅", _entryIdx);
+        end else begin
+            $display("[ImgHistogramValidator] Received unexpected bin count: %0d (expected: %0d) ❌", _entryIdx, EntryCount);
+            `Finish;
+        end
+    end endtask
+endmodule
+
+`endif // ImgHistogramValidator_v
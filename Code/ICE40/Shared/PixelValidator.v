@@ -50,6 +50,7 @@ module PixelValidator();
     integer     _cfgPixelDelta          = 0;
     integer     _cfgPixelFilterPeriod   = 0;
     integer     _cfgPixelFilterKeep     = 0;
+    integer     _cfgPixelFilterBin      = 0;
     
     `define ImagePixelCount     (_cfgImageWidth*_cfgImageHeight)
     `define ImageWordCount      (_cfgHeader.size/2 + `ImagePixelCount + _cfgChecksumWordCount + _cfgPaddingWordCount)
@@ -68,7 +69,8 @@ module PixelValidator();
         input reg[15:0] pixelInitial,       // Expected value of the first pixel
         input integer   pixelDelta,         // Expected difference between current word value and previous word value
         input integer   pixelFilterPeriod,  // Period of the pixel filter (used for thumbnailing)
-        input integer   pixelFilterKeep     // Count of pixels to keep at the beginning of a period (used for thumbnailing)
+        input integer   pixelFilterKeep,    // Count of pixels to keep at the beginning of a period (used for thumbnailing)
+        input integer   pixelFilterBin      // Expect kept pixels to be the average of their period's same-phase pixels (used for thumbnailing)
     ); begin
         _cfgHeader              = header;
         _cfgImageWidth          = imageWidth;
@@ -80,6 +82,7 @@ module PixelValidator();
         _cfgPixelDelta          = pixelDelta;
         _cfgPixelFilterPeriod   = pixelFilterPeriod;
         _cfgPixelFilterKeep     = pixelFilterKeep;
+        _cfgPixelFilterBin      = pixelFilterBin;
         
         _wordIdx                = 0;
         _wordPrev               = 0;
@@ -113,6 +116,7 @@ module PixelValidator();
         $display("[PixelValidator]   _cfgPixelDelta:        %0d",  _cfgPixelDelta);
         $display("[PixelValidator]   _cfgPixelFilterPeriod: %0d",  _cfgPixelFilterPeriod);
         $display("[PixelValidator]   _cfgPixelFilterKeep:   %0d",  _cfgPixelFilterKeep);
+        $display("[PixelValidator]   _cfgPixelFilterBin:    %0d",  _cfgPixelFilterBin);
     end endtask
     
     function[15:0] PixelExpectedValue();
@@ -122,6 +126,8 @@ module PixelValidator();
         integer px;
         integer py;
         integer pidx;
+        integer n;
+        integer sum;
         // reg[31:0] pixelX;
         // reg[31:0] pixelY;
         begin
@@ -134,7 +140,21 @@ module PixelValidator();
             pidx = (py*imgWidth) + px;
             // $display("[PixelValidator] _pixelIdx:%0d -> px:%0d py:%0d [imgWidth:%0d]", _pixelIdx, px, py, imgWidth);
             // Calculate the expected pixel value given the pixel index
-            PixelExpectedValue = _cfgPixelInitial + (pidx*_cfgPixelDelta);
+            if (!_cfgPixelFilterBin) begin
+                PixelExpectedValue = _cfgPixelInitial + (pidx*_cfgPixelDelta);
+            
+            // Binning: average the n*n pixels of the same phase (ie CFA color) in the period,
+            // rounding to nearest, to mirror ImgController
+            end else begin
+                n = _cfgPixelFilterPeriod/_cfgPixelFilterKeep;
+                sum = 0;
+                for (integer iy=0; iy<n; iy++) begin
+                    for (integer ix=0; ix<n; ix++) begin
+                        sum += _cfgPixelInitial + ((pidx + (iy*_cfgPixelFilterKeep*imgWidth) + (ix*_cfgPixelFilterKeep))*_cfgPixelDelta);
+                    end
+                end
+                PixelExpectedValue = (sum + (n*n)/2) / (n*n);
+            end
         end
     endfunction
     
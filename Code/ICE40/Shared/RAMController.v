@@ -13,6 +13,7 @@ module RAMController #(
     parameter ClkFreq                   = 16_000_000,
     parameter RAMClkDelay               = 0,
     parameter BlockCount                = 16,   // Number of blocks to divide the RAM into
+    parameter BankInterleave            = 0,    // Interleave rows across banks and postpone refreshes (1) or not (0)
     
     localparam WordWidth                = 16,
     localparam BankWidth                = 2,
@@ -22,9 +23,17 @@ module RAMController #(
     
     localparam AddrWidth                = BankWidth+RowWidth+ColWidth,
     localparam WordCount                = 64'b1<<AddrWidth,
-    `define BankBits                    AddrWidth-1                     -: BankWidth
-    `define RowBits                     AddrWidth-BankWidth-1           -: RowWidth
-    `define ColBits                     AddrWidth-BankWidth-RowWidth-1  -: ColWidth
+    // Addresses are ordered {bank, row, col}. With BankInterleave=1, they're ordered
+    // {row, bank, col} instead, so that consecutive rows of the address space are in different
+    // banks. This allows the next bank's row to be activated while we're still accessing the
+    // current bank's row, so that crossing a row boundary doesn't stall. (`PageBits is only
+    // meaningful with BankInterleave=1.)
+    localparam BankMSB                  = (BankInterleave ? ColWidth+BankWidth-1 : AddrWidth-1),
+    localparam RowMSB                   = (BankInterleave ? AddrWidth-1 : AddrWidth-BankWidth-1),
+    `define BankBits                    BankMSB                         -: BankWidth
+    `define RowBits                     RowMSB                          -: RowWidth
+    `define ColBits                     ColWidth-1                      -: ColWidth
+    `define PageBits                    AddrWidth-1                     -: RowWidth+BankWidth
     
     localparam BlockWordCount           = WordCount/BlockCount,
     localparam BlockWordCountRegWidth   = `RegWidth(BlockWordCount-1),
@@ -64,7 +73,9 @@ module RAMController #(
 );
     // Alliance AS4C8M16MSA-6BIN Timing parameters (nanoseconds)
     localparam T_INIT                   = 200000;   // Power up initialization time
-    localparam T_REFI                   = 15625;    // Time between refreshes (4K refreshes / 64ms)
+    // T_REFI: the AS4C8M16 only needs 4K refreshes / 64ms (15625 ns), but the mt48h32m16lf
+    // (which the sims model) needs 8K, so use the stricter of the two
+    localparam T_REFI                   = 7812;     // Time between refreshes (8K refreshes / 64ms)
     localparam T_RC                     = 60;       // Bank activate to bank activate time (same bank)
     localparam T_RFC                    = 80;       // Refresh time
     localparam T_RRD                    = 12;       // Row activate to row activate time (different banks)
@@ -84,7 +95,8 @@ module RAMController #(
     // ras_, cas_, we_
     localparam RAM_Cmd_SetMode          = 3'b000;
     localparam RAM_Cmd_AutoRefresh      = 3'b001;
-    localparam RAM_Cmd_PrechargeAll     = 3'b010;
+    localparam RAM_Cmd_PrechargeAll     = 3'b010;   // ram_a[10]=1
+    localparam RAM_Cmd_Precharge        = 3'b010;   // ram_a[10]=0, ram_ba=bank
     localparam RAM_Cmd_BankActivate     = 3'b011;
     localparam RAM_Cmd_Write            = 3'b100;
     localparam RAM_Cmd_Read             = 3'b101;
@@ -278,6 +290,15 @@ module RAMController #(
     reg[Refresh_State_Width-1:0] refresh_nextState = 0;
     reg refresh_trigger = 0;
     
+    // Refresh_PendingMax: with BankInterleave=1, refreshes are postponed until the data path
+    // is idle (see `refresh_idle`), but only up to Refresh_PendingMax refreshes; beyond that,
+    // the data path is interrupted. SDR SDRAMs allow up to 8 refreshes to be postponed (ie up
+    // to 9*T_REFI between refreshes) as long as the average rate of 8K refreshes per 64ms is
+    // kept, which it is since every postponed refresh is issued later. With 4 pending, the
+    // longest gap between refreshes is ~5*T_REFI (39us). With BankInterleave=0, a refresh is
+    // issued as soon as T_REFI elapses.
+    localparam Refresh_PendingMax = 4;
+    reg[`RegWidth(Refresh_PendingMax)-1:0] refresh_pending = 0;
     
     
     localparam InterruptDelay = `Max6(
@@ -368,10 +389,76 @@ module RAMController #(
     
     reg data_write_issueCmd = 0;
     
+    // ====================
+    // Bank State Machine Registers
+    // ====================
+    // With BankInterleave=1, the bank state machine runs while the data state machine is
+    // streaming, and uses the command slots that the stream doesn't use to precharge the bank
+    // that the stream left, and to activate the row that the stream enters next (which is in
+    // the next bank; see `PageBits). When the stream reaches the end of a row, it continues in
+    // the next bank without waiting for a precharge/activate, if the bank state machine is
+    // _Ready. With BankInterleave=0, the bank state machine stays _Idle.
+    localparam Bank_State_Idle              = 0;    // +0
+    localparam Bank_State_Go                = 1;    // +2
+    localparam Bank_State_Ready             = 4;    // +0
+    localparam Bank_State_Delay             = 5;    // +0
+    localparam Bank_State_Count             = 6;
+    localparam Bank_State_Width             = `RegWidth(Bank_State_Count-1);
+    
+    reg[Bank_State_Width-1:0] bank_state = 0;
+    reg[Bank_State_Width-1:0] bank_nextState = 0;
+    
+    reg bank_precharge = 0;
+    reg[BankWidth-1:0] bank_prechargeBank = 0;
+    reg[RowWidth+BankWidth-1:0] bank_nextPage = 0;
+    
+    localparam Bank_GoDelay = `Max3(
+        // T_WR: ensure "write recover" time before precharging the bank that we just
+        // finished writing
+        // -2 cycles getting to the next state
+        Clocks(ClkFreq,T_WR,2),
+        // T_RAS: ensure "row activate to precharge time" for the bank that we're precharging,
+        // in case the data state machine only activated it recently (eg after a refresh)
+        // -2 cycles getting to the next state
+        Clocks(ClkFreq,T_RAS,2),
+        // T_RRD: ensure "activate bank A to activate bank B time", since the data state
+        // machine may have just activated the current bank
+        // -2 cycles getting to the next state
+        Clocks(ClkFreq,T_RRD,2)
+    );
+    
+    localparam Bank_DelayCounterWidth = `RegWidth2(
+        Bank_GoDelay,
+        Clocks(ClkFreq,T_RCD,2)
+    );
+    reg[Bank_DelayCounterWidth-1:0] bank_delayCounter = 0;
+    
+    // bank_cmdSlot: whether the data state machine leaves the RAM command slot unused in
+    // this cycle, so the bank state machine can use it
+    wire bank_cmdSlot = (
+        (data_state===Data_State_Write+1 && !(write_trigger && data_write_issueCmd)) ||
+        (data_state===Data_State_Read+1) ||
+        (data_state===Data_State_Read+2)
+    );
+    
+    // refresh_idle: whether the data path is idle (no command underway, or the writer has no
+    // data / the reader isn't accepting data), so that a refresh doesn't stall it
+    wire refresh_idle = (
+        (data_state===Data_State_Idle) ||
+        (data_state===Data_State_Write+1 && !write_trigger) ||
+        (data_state===Data_State_Read+2 && !read_trigger)
+    );
+    wire refresh_start = (BankInterleave ?
+        (init_done && !refresh_trigger && refresh_pending &&
+            (refresh_idle || refresh_pending>=Refresh_PendingMax)) :
+        !refresh_counter
+    );
+    
 	always @(posedge clk) begin
         init_delayCounter <= init_delayCounter-1;
         refresh_delayCounter <= refresh_delayCounter-1;
         data_delayCounter <= data_delayCounter-1;
+        bank_delayCounter <= bank_delayCounter-1;
         refresh_counter <= (refresh_counter ? refresh_counter-1 : Refresh_Delay);
         // data_refreshCounter <= 2;
         
@@ -507,6 +594,8 @@ module RAMController #(
                     // Precharge all banks
                     ramCmd <= RAM_Cmd_PrechargeAll;
                     ramA <= 'b10000000000; // ram_a[10]=1 for PrechargeAll
+                    // The banks that the bank state machine activated are now precharged
+                    bank_state <= Bank_State_Idle;
                     
                     refresh_delayCounter <= Clocks(ClkFreq,T_RP,2); // -2 cycles getting to the next state
                     refresh_state <= Refresh_State_Delay;
@@ -537,6 +626,54 @@ module RAMController #(
                 endcase
             
             end else begin
+                // ====================
+                // Bank State Machine
+                // ====================
+                case (bank_state)
+                Bank_State_Idle: begin
+                end
+                
+                Bank_State_Go: begin
+                    bank_delayCounter <= Bank_GoDelay;
+                    bank_state <= Bank_State_Delay;
+                    bank_nextState <= Bank_State_Go+1;
+                end
+                
+                Bank_State_Go+1: begin
+                    // Precharge the bank that the stream left
+                    if (!bank_precharge) begin
+                        bank_state <= Bank_State_Go+2;
+                    end else if (bank_cmdSlot) begin
+                        // $display("[RAM-CTRL] Precharge bank %0d", bank_prechargeBank);
+                        ramCmd <= RAM_Cmd_Precharge;
+                        ramBA <= bank_prechargeBank;
+                        ramA <= 'b00000000000; // ram_a[10]=0 to only precharge `ram_ba`
+                        bank_state <= Bank_State_Go+2;
+                    end
+                end
+                
+                Bank_State_Go+2: begin
+                    // Activate the row that the stream enters next
+                    if (bank_cmdSlot) begin
+                        // $display("[RAM-CTRL] Activate page %h", bank_nextPage);
+                        ramCmd <= RAM_Cmd_BankActivate;
+                        ramBA <= bank_nextPage[0 +: BankWidth];
+                        ramA <= bank_nextPage[BankWidth +: RowWidth];
+                        
+                        bank_delayCounter <= Clocks(ClkFreq,T_RCD,2); // -2 cycles getting to the next state
+                        bank_state <= Bank_State_Delay;
+                        bank_nextState <= Bank_State_Ready;
+                    end
+                end
+                
+                Bank_State_Ready: begin
+                end
+                
+                Bank_State_Delay: begin
+                    if (!bank_delayCounter) bank_state <= bank_nextState;
+                end
+                endcase
+                
                 // ====================
                 // Data State Machine
                 // ====================
@@ -551,6 +688,13 @@ module RAMController #(
                     ramBA <= data_addr[`BankBits];
                     ramA <= data_addr[`RowBits];
                     
+                    // Activate the next row in the background
+                    if (BankInterleave) begin
+                        bank_precharge <= 0;
+                        bank_nextPage <= data_addr[`PageBits]+1;
+                        bank_state <= Bank_State_Go;
+                    end
+                    
                     data_write_issueCmd <= 1; // The first write needs to issue the write command
                     data_delayCounter <= Data_BankActivateDelay;
                     data_state <= Data_State_Delay;
@@ -567,6 +711,7 @@ module RAMController #(
                     write_ready <= 1; // Accept more data
                     if (write_trigger) begin
                         // $display("[RAM-CTRL] Wrote mem[%h] = %h", data_addr, write_data);
+                        if (BankInterleave && data_write_issueCmd) ramBA <= data_addr[`BankBits]; // Supply the bank address
                         if (data_write_issueCmd) ramA <= data_addr[`ColBits]; // Supply the column address
                         ramDQOut <= write_data; // Supply data to be written
                         ramDQOutEn <= 1;
@@ -578,13 +723,27 @@ module RAMController #(
                         // Handle reaching the end of a row or the end of block
                         if (&data_addr[`ColBits]) begin
                             // $display("[RAM-CTRL] End of row / end of block");
-                            // Override `write_ready=1` above since we can't handle new data in the next state
-                            write_ready <= 0;
+                            if (bank_state === Bank_State_Ready) begin
+                                // The next row is already active, so continue writing there.
+                                // The write command needs to be re-issued for the new bank.
+                                data_write_issueCmd <= 1;
+                                
+                                // Precharge this bank and activate the following row in the background
+                                bank_precharge <= 1;
+                                bank_prechargeBank <= data_addr[`BankBits];
+                                bank_nextPage <= data_addr[`PageBits]+2;
+                                bank_state <= Bank_State_Go;
                             
-                            // Abort writing
-                            data_delayCounter <= Data_FinishDelay;
-                            data_state <= Data_State_Delay;
-                            data_nextState <= Data_State_Finish;
+                            end else begin
+                                // Override `write_ready=1` above since we can't handle new data in the next state
+                                write_ready <= 0;
+                                
+                                // Abort writing
+                                bank_state <= Bank_State_Idle;
+                                data_delayCounter <= Data_FinishDelay;
+                                data_state <= Data_State_Delay;
+                                data_nextState <= Data_State_Finish;
+                            end
                         end
                         
                     end else begin
@@ -602,6 +761,13 @@ module RAMController #(
                     ramBA <= data_addr[`BankBits];
                     ramA <= data_addr[`RowBits];
                     
+                    // Activate the next row in the background
+                    if (BankInterleave) begin
+                        bank_precharge <= 0;
+                        bank_nextPage <= data_addr[`PageBits]+1;
+                        bank_state <= Bank_State_Go;
+                    end
+                    
                     data_delayCounter <= Data_BankActivateDelay;
                     data_state <= Data_State_Delay;
                     data_nextState <= Data_State_Read;
@@ -610,6 +776,7 @@ module RAMController #(
                 Data_State_Read: begin
                     // $display("[RAM-CTRL] Data_State_Read");
                     // $display("[RAM-CTRL] Read mem[%h] = %h", data_addr, write_data);
+                    if (BankInterleave) ramBA <= data_addr[`BankBits]; // Supply the bank address
                     ramA <= data_addr[`ColBits]; // Supply the column address
                     ramDQM <= RAM_DQM_Unmasked; // Unmask the data
                     ramCmd <= RAM_Cmd_Read; // Give read command
@@ -637,10 +804,24 @@ module RAMController #(
                         // Handle reaching the end of a row or the end of block
                         if (&data_addr[`ColBits]) begin
                             // $display("[RAM-CTRL] End of row / end of block");
-                            // Abort reading
-                            data_delayCounter <= Data_FinishDelay;
-                            data_state <= Data_State_Delay;
-                            data_nextState <= Data_State_Finish;
+                            if (bank_state === Bank_State_Ready) begin
+                                // The next row is already active, so issue the read command
+                                // for it right away
+                                data_state <= Data_State_Read;
+                                
+                                // Precharge this bank and activate the following row in the background
+                                bank_precharge <= 1;
+                                bank_prechargeBank <= data_addr[`BankBits];
+                                bank_nextPage <= data_addr[`PageBits]+2;
+                                bank_state <= Bank_State_Go;
+                            
+                            end else begin
+                                // Abort reading
+                                bank_state <= Bank_State_Idle;
+                                data_delayCounter <= Data_FinishDelay;
+                                data_state <= Data_State_Delay;
+                                data_nextState <= Data_State_Finish;
+                            end
                         end else begin
                             // Notify that more data is available
                             read_ready <= 1;
@@ -657,6 +838,7 @@ module RAMController #(
                     // $display("[RAM-CTRL] Data_State_Finish");
                     ramCmd <= RAM_Cmd_PrechargeAll;
                     ramA <= 'b10000000000; // ram_a[10]=1 for PrechargeAll
+                    bank_state <= Bank_State_Idle;
                     
                     data_delayCounter <= Clocks(ClkFreq,T_RP,2); // -2 cycles getting to the next state
                     data_state <= Data_State_Delay;
@@ -669,7 +851,9 @@ module RAMController #(
                 endcase
             end
             
-            if (!refresh_counter) begin
+            // Postpone refreshes until the data path is idle, or until too many are pending
+            if (BankInterleave) refresh_pending <= refresh_pending + !refresh_counter - refresh_start;
+            if (refresh_start) begin
                 // Override our `_ready` flags if we're refreshing on the next cycle
                 write_ready <= 0;
                 read_ready <= 0;
@@ -502,7 +502,9 @@ module SDController #(
                 datOut_state <= 1;
             
             end else begin
+`ifdef SIM
                 $display("[SDController:DatOut] Card busy (%b)", datIn_reg[0]);
+`endif
             end
             
 `ifdef SIM
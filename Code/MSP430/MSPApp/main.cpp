@@ -16,6 +16,7 @@
 #include "Code/Shared/Time.h"
 #include "Code/Shared/TimeConstants.h"
 #include "Code/Shared/MSPTriggers.h"
+#include "Code/Shared/MSPTasks.h"
 #include "Startup.h"
 #include "GPIO.h"
 #include "Clock.h"
@@ -106,21 +107,11 @@ static T_Property<bool,_EventsEnabledChanged,_MotionPoweredUpdate> _EventsEnable
 struct _MotionPowered : T_AssertionCounter<_MotionPoweredUpdate> {};
 
 // _Triggers: stores our current event state
-using _Triggers = T_MSPTriggers<_State, _MotionPowered::Assertion>;
-
-[[gnu::noinline]]
-static constexpr Time::Instant _TimeInstantAdd(const Time::Instant& time, Time::TicksS32 deltaTicks) {
-    return time + deltaTicks;
-}
-
-static constexpr Time::TicksU32 _TicksForMs(uint64_t ms) {
-    return ((ms * Time::TicksPeriod::den) / (1000 * Time::TicksPeriod::num));
-}
-
-template<typename T_Dst, typename T_Src>
-static T_Dst& _Cast(T_Src& x) {
-    return static_cast<T_Dst&>(x);
-}
+// TODO: T_MSPTriggers became per-instance (it references `_State.settings.triggers` rather
+// than using static members) without MSPApp being built for the MSP430; build it and compare
+// its .text/.data/.bss sizes against the previous firmware before deploying.
+using _TriggersType = T_MSPTriggers<_MotionPowered::Assertion>;
+static _TriggersType _Triggers(_State.settings.triggers);
 
 // MARK: - Reset
 
@@ -307,8 +298,7 @@ struct _TaskPower {
                 _BatteryLevelSet(_BatterySampler::Sample());
                 
                 // Update our state
-                _RTCCounter = _BatterySampleIntervalRTC;
-                _CaptureCounter = _BatterySampleIntervalCapture;
+                _BatterySampleSchedule.reset();
                 _BatteryLevelUpdate = false;
             }
         }
@@ -335,8 +325,7 @@ struct _TaskPower {
         // Short-circuit if we're in battery trap
         // We don't want to monitor the battery while we're in battery trap, to minimize battery use
         if (_BatteryTrap()) return;
-        _CaptureCounter--; // Rollover OK since we reset _CaptureCounter in Run()
-        if (!_CaptureCounter) {
+        if (_BatterySampleSchedule.capture()) {
             BatteryLevelUpdate();
             BatteryLevelWait();
         }
@@ -347,8 +336,7 @@ struct _TaskPower {
         // We don't want to monitor the battery while we're in battery trap, to minimize battery use
         if (_BatteryTrap()) return false;
         
-        _RTCCounter--; // Rollover OK since we reset _RTCCounter in Run()
-        if (!_RTCCounter) {
+        if (_BatterySampleSchedule.rtc()) {
             BatteryLevelUpdate();
             return true;
         }
@@ -570,10 +558,8 @@ struct _TaskPower {
     static constexpr uint8_t _StateBatteryTrap  = 1<<1;
     static constexpr uint8_t _StateWired        = 1<<2;
     
-    static constexpr uint16_t _BatterySampleIntervalRTCDays = 4;
-    static constexpr uint16_t _BatterySampleIntervalRTC     = (_BatterySampleIntervalRTCDays * Time::Day) / _RTC::InterruptIntervalTicks;
-    static constexpr uint16_t _BatterySampleIntervalCapture = 512;
-    static_assert(_BatterySampleIntervalRTC == 168);  // Debug
+    using _BatterySampleScheduleType = T_MSPBatterySampleSchedule<_RTC::InterruptIntervalTicks>;
+    static_assert(_BatterySampleScheduleType::IntervalRTC == 168);  // Debug
     
     // _BatteryTrapLevelEnter/_BatteryTrapLevelExit: these are the millivolt values corresponding
     // to the indicated battery percentages. These were calculated by linearizing the battery
@@ -581,8 +567,7 @@ struct _TaskPower {
     static constexpr MSP::BatteryLevelMv _BatteryTrapLevelEnter = 3321; // 2% battery
     static constexpr MSP::BatteryLevelMv _BatteryTrapLevelExit  = 3681; // 10% battery
     
-    static inline uint16_t _RTCCounter = 0;
-    static inline uint16_t _CaptureCounter = 0;
+    static inline _BatterySampleScheduleType _BatterySampleSchedule;
     
     static inline MSP::BatteryLevelMv _BatteryLevel = MSP::BatteryLevelMvInvalid;
     static inline bool _BatteryLevelUpdate = false;
@@ -834,16 +819,7 @@ struct _TaskSD {
             SD::CardId cardId;
             SD::CardData cardData;
             _State.rca = _SDCard::Init(&cardId, &cardData);
-            
-            // If SD state isn't valid, or the existing SD card id doesn't match the current
-            // card id, reset the SD state.
-            if (!::_State.sd.valid || memcmp(&::_State.sd.cardId, &cardId, sizeof(cardId))) {
-                _SDStateInit(cardId, cardData);
-            
-            // Otherwise the SD state is valid and the SD card id matches, so init the ring buffers.
-            } else {
-                _ImgRingBufInit();
-            }
+            _SDStateLoad(cardId, cardData);
         
         } else {
             // We've previously enabled the SD card successfully since _TaskSD::Reset();
@@ -853,104 +829,25 @@ struct _TaskSD {
     }
     
     static void _Write(uint8_t srcRAMBlock) {
-        const MSP::ImgRingBuf& imgRingBuf = ::_State.sd.imgRingBufs[0];
-        
-        // Copy full-size image from RAM -> SD card
-        {
-            const SD::Block block = MSP::SDBlockStart(::_State.sd.baseFull, ImgSD::Full::ImageBlockCount, imgRingBuf.buf.idx);
-            _SDCard::WriteImage(*_State.rca, srcRAMBlock, block, Img::Size::Full);
-        }
-        
-        // Copy thumbnail from RAM -> SD card
-        {
-            const SD::Block block = MSP::SDBlockStart(::_State.sd.baseThumb, ImgSD::Thumb::ImageBlockCount, imgRingBuf.buf.idx);
-            _SDCard::WriteImage(*_State.rca, srcRAMBlock, block, Img::Size::Thumb);
-        }
+        // Copy full-size image / thumbnail from RAM -> SD card
+        MSP::ImgWrite(::_State.sd, [&] (SD::Block block, Img::Size size) {
+            _SDCard::WriteImage(*_State.rca, srcRAMBlock, block, size);
+        });
         
         _ImgRingBufIncrement();
         _State.writing = false;
     }
     
-    // _SDStateInit(): resets the _State.sd struct
-    static void _SDStateInit(const SD::CardId& cardId, const SD::CardData& cardData) {
-        using namespace MSP;
-        // CombinedBlockCount: thumbnail block count + full-size block count
-        constexpr uint32_t CombinedBlockCount = ImgSD::Thumb::ImageBlockCount + ImgSD::Full::ImageBlockCount;
-        // blockCap: the capacity of the SD card in SD blocks (1 block == 512 bytes)
-        const uint32_t blockCap = SD::BlockCapacity(cardData);
-        // imgCap: the capacity of the SD card in number of images
-        const uint32_t imgCap = blockCap / CombinedBlockCount;
-        
+    // _SDStateLoad(): resets the _State.sd struct if it doesn't belong to the current card, otherwise
+    // finds the correct image ring buffer; see MSP::SDStateLoad()
+    static void _SDStateLoad(const SD::CardId& cardId, const SD::CardData& cardData) {
         FRAMWriteEn writeEn; // Enable FRAM writing
-        
-        // Mark the _State as invalid in case we lose power in the middle of modifying it
-        ::_State.sd.valid = false;
-        std::atomic_signal_fence(std::memory_order_seq_cst);
-        
-        // Set .cardId
-        {
-            ::_State.sd.cardId = cardId;
-        }
-        
-        // Set .imgCap
-        {
-            ::_State.sd.imgCap = imgCap;
-        }
-        
-        // Set .baseFull / .baseThumb
-        {
-            ::_State.sd.baseFull = imgCap * ImgSD::Full::ImageBlockCount;
-            ::_State.sd.baseThumb = ::_State.sd.baseFull + imgCap * ImgSD::Thumb::ImageBlockCount;
-        }
-        
-        // Set .imgRingBufs
-        {
-            ImgRingBuf::Set(::_State.sd.imgRingBufs[0], {});
-            ImgRingBuf::Set(::_State.sd.imgRingBufs[1], {});
-        }
-        
-        std::atomic_signal_fence(std::memory_order_seq_cst);
-        ::_State.sd.valid = true;
-    }
-    
-    // _ImgRingBufInit(): find the correct image ring buffer (the one with the greatest id that's valid)
-    // and copy it into the other slot so that there are two copies. If neither slot contains a valid ring
-    // buffer, reset them both so that they're both empty (and valid).
-    static void _ImgRingBufInit() {
-        using namespace MSP;
-        FRAMWriteEn writeEn; // Enable FRAM writing
-        
-        ImgRingBuf& a = ::_State.sd.imgRingBufs[0];
-        ImgRingBuf& b = ::_State.sd.imgRingBufs[1];
-        const std::optional<int> comp = ImgRingBuf::Compare(a, b);
-        if (comp && *comp>0) {
-            // a>b (a is newer), so set b=a
-            ImgRingBuf::Set(b, a);
-        
-        } else if (comp && *comp<0) {
-            // b>a (b is newer), so set a=b
-            ImgRingBuf::Set(a, b);
-        
-        } else if (!comp) {
-            // Both a and b are invalid; reset them both
-            ImgRingBuf::Set(a, {});
-            ImgRingBuf::Set(b, {});
-        }
+        MSP::SDStateLoad(::_State.sd, cardId, cardData);
     }
     
     static void _ImgRingBufIncrement() {
-        using namespace MSP;
-        const uint32_t imgCap = ::_State.sd.imgCap;
-        
-        MSP::ImgRingBuf x = ::_State.sd.imgRingBufs[0];
-        x.buf.id++;
-        x.buf.idx = (x.buf.idx<imgCap-1 ? x.buf.idx+1 : 0);
-        
-        {
-            FRAMWriteEn writeEn; // Enable FRAM writing
-            ImgRingBuf::Set(::_State.sd.imgRingBufs[0], x);
-            ImgRingBuf::Set(::_State.sd.imgRingBufs[1], x);
-        }
+        FRAMWriteEn writeEn; // Enable FRAM writing
+        MSP::ImgRingBufIncrement(::_State.sd);
     }
     
     static inline struct __State {
@@ -1003,62 +900,53 @@ struct _TaskImg {
         // Set the initial exposure _before_ we enable streaming, so that the very first frame
         // has the correct exposure, so we don't have to skip any frames on the first capture.
         _ImgSensor::SetCoarseIntTime(_State.autoExp.integrationTime());
+        // Only the histogram path adjusts the analog gain, so otherwise leave the sensor's
+        // default gain alone
+        if constexpr (_AutoExposureHistogram) _ImgSensor::SetAnalogGain(_State.autoExp.analogGain());
         // Enable image streaming
         _ImgSensor::SetStreamEnabled(true);
     }
     
     static void _Capture(const Img::Id& id) {
-        // Try up to `CaptureAttemptCount` times to capture a properly-exposed image
-        constexpr uint8_t CaptureAttemptCount = 3;
-        uint8_t bestExpBlock = 0;
-        uint8_t bestExpScore = 0;
-        for (uint8_t i=0; i<CaptureAttemptCount; i++) {
-            // skipCount:
-            // On the initial capture, we didn't set the exposure, so we don't need to skip any images.
-            // On subsequent captures, we did set the exposure before the capture, so we need to skip a single
-            // image since the first image after setting the exposure is invalid.
-            const uint8_t skipCount = (!i ? 0 : 1);
-            
-            // expBlock: Store images in the block belonging to the worst-exposed image captured so far
-            const uint8_t expBlock = !bestExpBlock;
-            
-            // Populate the header
-            static Img::Header header = {
-                .magic          = Img::Header::MagicNumber,
-                .version        = Img::Header::Version,
-                .imageWidth     = Img::Full::PixelWidth,
-                .imageHeight    = Img::Full::PixelHeight,
-                .coarseIntTime  = 0,
-                .analogGain     = 0,
-                .id             = 0,
-                .timestamp      = 0,
-                .batteryLevelMv = MSP::BatteryLevelMvInvalid,
-            };
-            
-            header.coarseIntTime    = _State.autoExp.integrationTime();
-            header.id               = id;
-            header.timestamp        = _RTC::Now();
-            header.batteryLevelMv   = _TaskPower::BatteryLevelGet();
-            
-            // Capture an image to RAM
-            #warning TODO: optimize the header logic so that we don't set the magic/version/imageWidth/imageHeight every time, since it only needs to be set once per ice40 power-on
-            const _ICE::ImgCaptureStatusResp resp = _ICE::ImgCapture(header, expBlock, skipCount);
-            const uint8_t expScore = _State.autoExp.update(resp.highlightCount(), resp.shadowCount());
-            if (!bestExpScore || (expScore > bestExpScore)) {
-                bestExpBlock = expBlock;
-                bestExpScore = expScore;
+        _State.captureBlock = MSP::ImgCapture(_State.autoExp,
+            [&] (uint8_t expBlock, uint8_t skipCount) {
+                // Populate the header
+                static Img::Header header = {
+                    .magic          = Img::Header::MagicNumber,
+                    .version        = Img::Header::Version,
+                    .imageWidth     = Img::Full::PixelWidth,
+                    .imageHeight    = Img::Full::PixelHeight,
+                    .coarseIntTime  = 0,
+                    .analogGain     = 0,
+                    .id             = 0,
+                    .timestamp      = 0,
+                    .batteryLevelMv = MSP::BatteryLevelMvInvalid,
+                };
+                
+                header.coarseIntTime    = _State.autoExp.integrationTime();
+                if constexpr (_AutoExposureHistogram) header.analogGain = _State.autoExp.analogGain();
+                header.id               = id;
+                header.timestamp        = _RTC::Now();
+                header.batteryLevelMv   = _TaskPower::BatteryLevelGet();
+                
+                // Capture an image to RAM
+                #warning TODO: optimize the header logic so that we don't set the magic/version/imageWidth/imageHeight every time, since it only needs to be set once per ice40 power-on
+                const _ICE::ImgCaptureStatusResp resp = _ICE::ImgCapture(header, expBlock, skipCount);
+                
+                // Update the exposure
+                return MSP::ImgAutoExposureUpdate<_ICE>(_State.autoExp, resp);
+            },
+            [] {
+                // Update the exposure
+                _ImgSensor::SetCoarseIntTime(_State.autoExp.integrationTime());
+                if constexpr (_AutoExposureHistogram) _ImgSensor::SetAnalogGain(_State.autoExp.analogGain());
             }
-            
-            // We're done if we don't have any exposure changes
-            if (!_State.autoExp.changed()) break;
-            
-            // Update the exposure
-            _ImgSensor::SetCoarseIntTime(_State.autoExp.integrationTime());
-        }
-        
-        _State.captureBlock = bestExpBlock;
+        );
     }
     
+    // _AutoExposureHistogram: see MSP::ImgAutoExposureHistogram
+    static constexpr bool _AutoExposureHistogram = MSP::ImgAutoExposureHistogram;
+    
     static inline struct __State {
         __State() {} // Compiler bug workaround
         uint8_t captureBlock = 0;
@@ -1104,66 +992,23 @@ struct _TaskEvent {
         return _EventTimer::ISRTimer(iv);
     }
     
-    static void _TimeTrigger(_Triggers::TimeTriggerEvent& ev) {
-        _Triggers::TimeTrigger& trigger = ev.trigger();
-        // Schedule the CaptureImageEvent, but only if we're not in fast-forward mode
-        if (_State.live) CaptureStart(trigger, ev.time);
-        // Reschedule TimeTriggerEvent for its next trigger time
-        EventInsert(ev);
-    }
-    
-    static void _MotionEnablePower(_Triggers::MotionEnablePowerEvent& ev) {
-        _Triggers::MotionTrigger& trigger = (_Triggers::MotionTrigger&)ev;
-        // Enable motion power
-        trigger.enablePower();
-    }
-    
-    static void _MotionEnable(_Triggers::MotionEnableEvent& ev) {
-        _Triggers::MotionTrigger& trigger = ev.trigger();
-        
-        // Enable motion power / motion
-        trigger.enable();
-        
-        // Schedule the MotionDisableEvent, if applicable.
-        // This needs to happen before we reschedule `ev` because we need its .time to
-        // properly schedule the MotionDisableEvent!
-        const uint32_t durationTicks = trigger.base().durationTicks;
-        if (durationTicks) {
-            EventInsert(_Cast<_Triggers::MotionDisableEvent&>(trigger), _TimeInstantAdd(ev.time, durationTicks));
-        }
-        
-        // Reschedule MotionEnableEvent for its next trigger time
-        const bool repeat = EventInsert(ev);
-        
-        // Schedule MotionEnablePowerEvent event `PowerOnDelayMs` before the MotionEnableEvent.
-        if (repeat) {
-            EventInsert(_Cast<_Triggers::MotionEnablePowerEvent>(trigger),
-                _TimeInstantAdd(ev.time, -_TicksForMs(_Motion::PowerOnDelayMs)));
-        }
-    }
+    // T_MSPEvents hooks
+    static constexpr uint32_t MotionPowerOnDelayMs = _Motion::PowerOnDelayMs;
     
-    static void _MotionDisable(_Triggers::MotionDisableEvent& ev) {
-        _Triggers::MotionTrigger& trigger = (_Triggers::MotionTrigger&)ev;
-        // Disable motion power / motion
-        trigger.disable();
+    static bool Live() {
+        return _State.live;
     }
     
-    static void _MotionUnsuppressPower(_Triggers::MotionUnsuppressPowerEvent& ev) {
-        _Triggers::MotionTrigger& trigger = (_Triggers::MotionTrigger&)ev;
-        // Unsuppress motion power
-        trigger.unsuppressPower();
+    static Time::Instant Now() {
+        return _RTC::Now();
     }
     
-    static void _MotionUnsuppress(_Triggers::MotionUnsuppressEvent& ev) {
-        _Triggers::MotionTrigger& trigger = (_Triggers::MotionTrigger&)ev;
-        // Unsuppress motion
-        trigger.unsuppressMotion();
+    static void EventFirst() {
+        // The new event is the first event, so interrupt Run() so that it re-schedules _EventTimer.
+        _EventTimer::Schedule(0);
     }
     
-    static void _CaptureImage(_Triggers::CaptureImageEvent& ev) {
-        // We should never get a CaptureImageEvent event while in fast-forward mode
-        Assert(_State.live);
-        
+    static void CaptureImage(_TriggersType::CaptureImageEvent& ev) {
         constexpr MSP::ImgRingBuf& imgRingBuf = ::_State.sd.imgRingBufs[0];
         
         // Notify _TaskPower that we're performing a capture, and wait for it to sample the battery if it decided to.
@@ -1216,83 +1061,10 @@ struct _TaskEvent {
         
         _TaskPower::VDDIMGSDEnabled(false);
         _TaskPower::VDDBEnabled(false);
-        
-        ev.countRem--;
-        if (ev.countRem) {
-            EventInsert(ev, _TimeInstantAdd(ev.time, ev.capture->delayTicks));
-        }
     }
     
-    static void _DST(_Triggers::DSTEvent& ev) {
-        // Re-insert the DSTEvent before adjusting all subsequent events' times,
-        // because we need to adjust the DSTEvent's time too.
-        EventInsert(ev);
-        
-        const Time::TicksS32 adj = ev.base().adjustmentTicks;
-        _Triggers::Event* x = _Triggers::EventBegin();
-        while (x != _Triggers::EventEnd()) {
-            x->time = _TimeInstantAdd(x->time, adj);
-            x = x->next;
-        }
-    }
-    
-    static void EventInsert(_Triggers::Event& ev, const Time::Instant& time) {
-        _Triggers::EventInsert(ev, time);
-        if (&ev == _Triggers::EventBegin()) {
-            // The new event is the first event, so interrupt Run() so that it re-schedules _EventTimer.
-            _EventTimer::Schedule(0);
-        }
-    }
-    
-    static bool EventInsert(_Triggers::RepeatEvent& ev) {
-        const Time::TicksU32 delta = _Triggers::RepeatAdvance(ev.repeat);
-        // delta=0 means Repeat=never, in which case we don't reschedule the event
-        if (delta) {
-            EventInsert(ev, _TimeInstantAdd(ev.time, delta));
-            return true;
-        }
-        return false;
-    }
-    
-    static void EventInsert(_Triggers::DSTEvent& ev) {
-        const Time::TicksU32 delta = _Triggers::DSTPhaseAdvance(ev.phase);
-        EventInsert(ev, _TimeInstantAdd(ev.time, delta));
-    }
-    
-    static bool CaptureStart(_Triggers::CaptureImageEvent& ev, const Time::Instant& time) {
-        // Bail if the CaptureImageEvent is already underway
-        if (ev.countRem) return false;
-        
-        // Reset capture count
-        ev.countRem = ev.capture->count;
-        if (ev.countRem) {
-            EventInsert(ev, time);
-        }
-        return true;
-    }
-    
-    static void _EventHandle(_Triggers::Event& ev) {
-        // Handle the event
-        using T = _Triggers::Event::Type;
-        switch (ev.type) {
-        case T::TimeTrigger:
-            _TimeTrigger(           _Cast<_Triggers::TimeTriggerEvent&>(ev)             ); break;
-        case T::MotionEnablePower:
-            _MotionEnablePower(     _Cast<_Triggers::MotionEnablePowerEvent&>(ev)       ); break;
-        case T::MotionEnable:
-            _MotionEnable(          _Cast<_Triggers::MotionEnableEvent&>(ev)            ); break;
-        case T::MotionDisable:
-            _MotionDisable(         _Cast<_Triggers::MotionDisableEvent&>(ev)           ); break;
-        case T::MotionUnsuppressPower:
-            _MotionUnsuppressPower( _Cast<_Triggers::MotionUnsuppressPowerEvent&>(ev)   ); break;
-        case T::MotionUnsuppress:
-            _MotionUnsuppress(      _Cast<_Triggers::MotionUnsuppressEvent&>(ev)        ); break;
-        case T::CaptureImage:
-            _CaptureImage(          _Cast<_Triggers::CaptureImageEvent&>(ev)            ); break;
-        case T::DST:
-            _DST(                   _Cast<_Triggers::DSTEvent&>(ev)                     ); break;
-        }
-    }
+    // Events: the event handlers, shared with MSPAppSimulator
+    using Events = T_MSPEvents<_TriggersType, _Triggers, _TaskEvent>;
     
     static void Run() {
         // Reset our state
@@ -1303,13 +1075,13 @@ struct _TaskEvent {
         
         // Init Triggers
         const Time::Instant startTime = _RTC::Now();
-        _Triggers::Init(startTime);
+        _Triggers.init(startTime);
         
         // Fast-forward through events
         for (;;) {
-            _Triggers::Event* ev = _Triggers::EventBegin();
-            if (ev==_Triggers::EventEnd() || (ev->time > startTime)) break;
-            _EventHandle(_Triggers::EventPop());
+            _TriggersType::Event* ev = _Triggers.eventBegin();
+            if (ev==_Triggers.eventEnd() || (ev->time > startTime)) break;
+            Events::EventHandle(_Triggers.eventPop());
         }
         
         _State.live = true;
@@ -1317,8 +1089,8 @@ struct _TaskEvent {
         // Handle events
         for (;;) {
             // Wait until we have an event
-            _Scheduler::Wait([] { return _Triggers::EventBegin() != _Triggers::EventEnd(); });
-            _Triggers::Event*const ev = _Triggers::EventBegin();
+            _Scheduler::Wait([] { return _Triggers.eventBegin() != _Triggers.eventEnd(); });
+            _TriggersType::Event*const ev = _Triggers.eventBegin();
             
             // Schedule _EventTimer for `ev`
             _EventTimer::Schedule(ev->time);
@@ -1327,7 +1099,7 @@ struct _TaskEvent {
             if (!waited) continue;
             
             // Handle the event
-            _EventHandle(_Triggers::EventPop());
+            Events::EventHandle(_Triggers.eventPop());
         }
     }
     
@@ -1374,9 +1146,7 @@ struct _TaskButton {
         // Ignore button presses if events are disabled
         if (!_EventsEnabled) return;
         
-        for (auto it=_Triggers::ButtonTriggerBegin(); it!=_Triggers::ButtonTriggerEnd(); it++) {
-            _TaskEvent::CaptureStart(*it, _RTC::Now());
-        }
+        _TaskEvent::Events::ButtonHandle();
     }
     
     static void Run() {
@@ -1486,44 +1256,7 @@ struct _TaskMotion {
         if (!_EventsEnabled) return;
         
         // When motion occurs, start captures for each enabled motion trigger
-        for (auto it=_Triggers::MotionTriggerBegin(); it!=_Triggers::MotionTriggerEnd(); it++) {
-            _Triggers::MotionTrigger& trigger = *it;
-            
-            // Check if we should ignore this trigger
-            if (!trigger.enabled()) continue;
-            
-            // Start capture
-            const Time::Instant time = _RTC::Now();
-            const bool captureStarted = _TaskEvent::CaptureStart(trigger, time);
-            // CaptureStart() returns false if a capture is already in progress for this trigger.
-            // Short-circuit if that's the case.
-            if (!captureStarted) continue;
-            
-            // Update the number of motion triggers remaining.
-            // If this was the last trigger that we're allowed, set the `StateMaxImageCount` bit,
-            // which will disable motion for this trigger until the next MotionEnableEvent.
-            if (trigger.countRem) {
-                trigger.countRem--;
-                if (!trigger.countRem) {
-                    trigger.hitMaxImageCount();
-                }
-            }
-            
-            // Suppress motion for the specified duration, if suppression is enabled
-            const Time::TicksU32 suppressTicks = trigger.base().suppressTicks;
-            if (suppressTicks) {
-                // Suppress power/motion immediately
-                trigger.suppress();
-                
-                // Schedule MotionUnsuppressEvent
-                const Time::Instant unsuppressTime = _TimeInstantAdd(time, suppressTicks);
-                _TaskEvent::EventInsert(_Cast<_Triggers::MotionUnsuppressEvent>(trigger), unsuppressTime);
-                
-                // Schedule MotionUnsuppressPowerEvent event `PowerOnDelayMs` before the MotionUnsuppressEvent.
-                const Time::Instant prepareTime = _TimeInstantAdd(unsuppressTime, -_TicksForMs(_Motion::PowerOnDelayMs));
-                _TaskEvent::EventInsert(_Cast<_Triggers::MotionUnsuppressPowerEvent>(trigger), prepareTime);
-            }
-        }
+        _TaskEvent::Events::MotionHandle();
     }
     
     static constexpr auto _PowerOffDebounceDuration = _Scheduler::Ms<1000>;
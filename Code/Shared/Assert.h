@@ -28,6 +28,8 @@ __Abort:
 #elif defined(__APPLE__)
     void abort(void);
     abort();
+#elif defined(__linux__)
+    __builtin_abort();
 #else
     #error Task: Unsupported architecture
 #endif
@@ -1,17 +1,237 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 #include <cassert>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#include <arm_neon.h>
+#endif
+
+// ChecksumFletcher32Engine: incremental Fletcher-32, bit-identical to ICE40's FletcherChecksum.v
+//
+// Data is interpreted as a sequence of little-endian 16-bit words. update() can be called with
+// chunks of any length (including odd lengths), so the checksum can be computed while data
+// streams in.
+//
+// Rather than reducing `a` and `b` modulo 65535 for every word, we accumulate blocks of words
+// without reducing, and reduce once per block. Within a block, words are summed in vector lanes
+// (SSE2/AVX2/NEON, when available); for a block of N words w[j]:
+//
+//   a' = a + sum(w[j])
+//   b' = b + N*a + sum((N-j)*w[j])
+//
+// Each lane `l` of an L-lane vector accumulates va[l] = sum(w[t,l]) and vb[l] = sum((T-t)*w[t,l])
+// over T steps, where w[t,l] = w[t*L+l]. Since N-j = L*(T-t)-l:
+//
+//   sum((N-j)*w[j]) = L*sum(vb[l]) - sum(l*va[l])
+struct ChecksumFletcher32Engine {
+    void update(const void* data, size_t len) {
+        const uint8_t* p = (const uint8_t*)data;
+        if (!len) return;
+        
+        // Complete the word that was split across update() calls
+        if (_pending) {
+            _words(_pendingByte | ((uint32_t)p[0] << 8));
+            _reduce();
+            _pending = false;
+            p++;
+            len--;
+        }
+        
+        const size_t wordCount = len/sizeof(uint16_t);
+        _words(p, wordCount);
+        p += wordCount*sizeof(uint16_t);
+        len -= wordCount*sizeof(uint16_t);
+        
+        if (len) {
+            _pendingByte = p[0];
+            _pending = true;
+        }
+    }
+    
+    // updateZeros(): equivalent to update() with `len` zero bytes, in constant time
+    // Zero words don't change `a`, and add `a` to `b` once per word.
+    void updateZeros(size_t len) {
+        assert(!_pending);
+        assert(!(len % sizeof(uint16_t)));
+        const uint64_t wordCount = len/sizeof(uint16_t);
+        _b = (_b + (wordCount%_Mod)*_a) % _Mod;
+    }
+    
+    // checksum(): returns the checksum of the data supplied so far
+    // The data supplied so far must be a whole number of 16-bit words.
+    uint32_t checksum() const {
+        assert(!_pending);
+        return (uint32_t)((_b % _Mod) << 16) | (uint32_t)(_a % _Mod);
+    }
+    
+    // _Mod: Fletcher-32's modulus
+    static constexpr uint64_t _Mod = UINT16_MAX;
+    // _BlockSteps: vector steps per block; the largest count such that vb lanes can't overflow
+    // 32 bits: 65535 * T*(T+1)/2 < 2^32
+    static constexpr size_t _BlockSteps = 256;
+    // _ScalarBlockWords: words per block in the scalar path; bounds `_b` well below 2^64
+    static constexpr size_t _ScalarBlockWords = 1<<16;
+    
+    static uint16_t _Load16(const uint8_t* p) {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+    
+    void _words(uint32_t w) {
+        _a += w;
+        _b += _a;
+    }
+    
+    void _reduce() {
+        _a %= _Mod;
+        _b %= _Mod;
+    }
+    
+    // _wordsScalar(): deferred-modulo scalar path
+    void _wordsScalar(const uint8_t* p, size_t count) {
+        while (count) {
+            const size_t n = (count<_ScalarBlockWords ? count : _ScalarBlockWords);
+            for (size_t i=0; i<n; i++) {
+                _a += _Load16(p);
+                _b += _a;
+                p += sizeof(uint16_t);
+            }
+            _reduce();
+            count -= n;
+        }
+    }
+    
+    // _block(): folds the lane accumulators of a block of `steps` vector steps into _a/_b
+    template<size_t T_Lanes>
+    void _block(size_t steps, const uint32_t (&va)[T_Lanes], const uint32_t (&vb)[T_Lanes]) {
+        const uint64_t n = (uint64_t)steps*T_Lanes;
+        uint64_t sumA = 0;
+        uint64_t sumB = 0;
+        uint64_t sumLA = 0;
+        for (size_t l=0; l<T_Lanes; l++) {
+            sumA += va[l];
+            sumB += vb[l];
+            sumLA += (uint64_t)l*va[l];
+        }
+        // _a and _b are reduced (<_Mod) on entry, so none of this can overflow 64 bits
+        _b += n*_a + T_Lanes*sumB - sumLA;
+        _a += sumA;
+        _reduce();
+    }
+    
+#if defined(__AVX2__)
+    static constexpr size_t _Lanes = 16;
+    
+    void _wordsVector(const uint8_t* p, size_t steps) {
+        while (steps) {
+            const size_t n = (steps<_BlockSteps ? steps : _BlockSteps);
+            __m256i va0 = _mm256_setzero_si256(), va1 = _mm256_setzero_si256();
+            __m256i vb0 = _mm256_setzero_si256(), vb1 = _mm256_setzero_si256();
+            for (size_t t=0; t<n; t++) {
+                const __m128i x0 = _mm_loadu_si128((const __m128i*)p);
+                const __m128i x1 = _mm_loadu_si128((const __m128i*)(p+16));
+                va0 = _mm256_add_epi32(va0, _mm256_cvtepu16_epi32(x0));
+                va1 = _mm256_add_epi32(va1, _mm256_cvtepu16_epi32(x1));
+                vb0 = _mm256_add_epi32(vb0, va0);
+                vb1 = _mm256_add_epi32(vb1, va1);
+                p += _Lanes*sizeof(uint16_t);
+            }
+            
+            uint32_t a[_Lanes];
+            uint32_t b[_Lanes];
+            _mm256_storeu_si256((__m256i*)&a[0], va0);
+            _mm256_storeu_si256((__m256i*)&a[8], va1);
+            _mm256_storeu_si256((__m256i*)&b[0], vb0);
+            _mm256_storeu_si256((__m256i*)&b[8], vb1);
+            _block(n, a, b);
+            steps -= n;
+        }
+    }
+#elif defined(__SSE2__)
+    static constexpr size_t _Lanes = 8;
+    
+    void _wordsVector(const uint8_t* p, size_t steps) {
+        const __m128i zero = _mm_setzero_si128();
+        while (steps) {
+            const size_t n = (steps<_BlockSteps ? steps : _BlockSteps);
+            __m128i va0 = zero, va1 = zero;
+            __m128i vb0 = zero, vb1 = zero;
+            for (size_t t=0; t<n; t++) {
+                const __m128i x = _mm_loadu_si128((const __m128i*)p);
+                va0 = _mm_add_epi32(va0, _mm_unpacklo_epi16(x, zero));
+                va1 = _mm_add_epi32(va1, _mm_unpackhi_epi16(x, zero));
+                vb0 = _mm_add_epi32(vb0, va0);
+                vb1 = _mm_add_epi32(vb1, va1);
+                p += _Lanes*sizeof(uint16_t);
+            }
+            
+            uint32_t a[_Lanes];
+            uint32_t b[_Lanes];
+            _mm_storeu_si128((__m128i*)&a[0], va0);
+            _mm_storeu_si128((__m128i*)&a[4], va1);
+            _mm_storeu_si128((__m128i*)&b[0], vb0);
+            _mm_storeu_si128((__m128i*)&b[4], vb1);
+            _block(n, a, b);
+            steps -= n;
+        }
+    }
+#elif defined(__ARM_NEON) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    static constexpr size_t _Lanes = 8;
+    
+    void _wordsVector(const uint8_t* p, size_t steps) {
+        while (steps) {
+            const size_t n = (steps<_BlockSteps ? steps : _BlockSteps);
+            uint32x4_t va0 = vdupq_n_u32(0), va1 = vdupq_n_u32(0);
+            uint32x4_t vb0 = vdupq_n_u32(0), vb1 = vdupq_n_u32(0);
+            for (size_t t=0; t<n; t++) {
+                const uint16x8_t x = vld1q_u16((const uint16_t*)p);
+                va0 = vaddw_u16(va0, vget_low_u16(x));
+                va1 = vaddw_u16(va1, vget_high_u16(x));
+                vb0 = vaddq_u32(vb0, va0);
+                vb1 = vaddq_u32(vb1, va1);
+                p += _Lanes*sizeof(uint16_t);
+            }
+            
+            uint32_t a[_Lanes];
+            uint32_t b[_Lanes];
+            vst1q_u32(&a[0], va0);
+            vst1q_u32(&a[4], va1);
+            vst1q_u32(&b[0], vb0);
+            vst1q_u32(&b[4], vb1);
+            _block(n, a, b);
+            steps -= n;
+        }
+    }
+#else
+    // No vector unit available; treat each word as a 1-lane vector step
+    static constexpr size_t _Lanes = 1;
+    
+    void _wordsVector(const uint8_t* p, size_t steps) {
+        _wordsScalar(p, steps);
+    }
+#endif
+    
+    void _words(const uint8_t* p, size_t count) {
+        const size_t steps = count/_Lanes;
+        _wordsVector(p, steps);
+        p += steps*_Lanes*sizeof(uint16_t);
+        count -= steps*_Lanes;
+        _wordsScalar(p, count);
+    }
+    
+    uint64_t _a = 0;
+    uint64_t _b = 0;
+    uint32_t _pendingByte = 0;
+    bool _pending = false;
+};
+
 inline uint32_t ChecksumFletcher32(const void* data, size_t len) {
-    // TODO: optimize so we don't perform a division each iteration
     assert(!(len % sizeof(uint16_t)));
-    const uint16_t* words = (const uint16_t*)data;
-    const size_t wordCount = len/sizeof(uint16_t);
-    uint32_t a = 0;
-    uint32_t b = 0;
-    for (size_t i=0; i<wordCount; i++) {
-        a = (a+words[i]) % UINT16_MAX;
-        b = (b+a) % UINT16_MAX;
-    }
-    return (b<<16) | a;
+    ChecksumFletcher32Engine engine;
+    engine.update(data, len);
+    return engine.checksum();
 }
@@ -46,3 +46,17 @@ uint64_t GetBits(const T& bytes) {
     static_assert(T_Start >= T_End);
     return GetBits(&bytes, sizeof(T), T_Start, T_End);
 }
+
+// SetBits(): inverse of GetBits(); sets bits [T_Start, T_End] of `bytes` to `val`
+template<uint8_t T_Start, uint8_t T_End, typename T>
+void SetBits(T& bytes, uint64_t val) {
+    static_assert(T_Start < sizeof(T)*8);
+    static_assert(T_Start >= T_End);
+    uint8_t* b = (uint8_t*)&bytes;
+    for (uint8_t i=T_End; i<=T_Start; i++) {
+        const size_t byteIdx = sizeof(T)-(i/8)-1;
+        const uint8_t bitMask = 1<<(i%8);
+        if (val & ((uint64_t)1<<(i-T_End))) b[byteIdx] |= bitMask;
+        else b[byteIdx] &= ~bitMask;
+    }
+}
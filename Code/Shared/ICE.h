@@ -284,6 +284,18 @@ public:
         constexpr ReadoutMsg() : Msg(MsgType::StartBit | 0x0D) {}
     };
     
+    struct ImgHistogramMsg : Msg {
+        constexpr ImgHistogramMsg() : Msg(MsgType::StartBit | MsgType::Resp | 0x0E) {}
+    };
+    
+    struct ImgHistogramResp : Resp {
+        static constexpr uint8_t BinCount = 4;
+        // bin(): returns the count of the `idx`th bin in this response (first bin in the MSBs)
+        uint16_t bin(uint8_t idx) const {
+            return ((uint16_t)Resp::payload[2*idx]<<8) | Resp::payload[2*idx+1];
+        }
+    };
+    
     struct NopMsg : Msg {
         constexpr NopMsg() : Msg(0x00) {}
     };
@@ -357,6 +369,24 @@ public:
         return resp;
     }
     
+    // ImgHistogram(): reads the histogram of the most recent capture, calling
+    // `fn(channel, bin, count)` for every bin of every channel
+    template<typename T_Fn>
+    static void ImgHistogram(T_Fn fn) {
+        // Each response carries the next `ImgHistogramResp::BinCount` bins, and ICE40 wraps
+        // back to the first bin after the last, so reading every bin once leaves ICE40
+        // ready for the next reader
+        constexpr uint8_t RespCount = (Img::Histogram::ChannelCount*Img::Histogram::BinCount) / ImgHistogramResp::BinCount;
+        for (uint8_t i=0; i<RespCount; i++) {
+            ImgHistogramResp resp;
+            Transfer(ImgHistogramMsg(), &resp);
+            for (uint8_t ii=0; ii<ImgHistogramResp::BinCount; ii++) {
+                const uint16_t idx = (uint16_t)i*ImgHistogramResp::BinCount + ii;
+                fn(idx/Img::Histogram::BinCount, idx%Img::Histogram::BinCount, resp.bin(ii));
+            }
+        }
+    }
+    
     #warning TODO: optimize the attempt mechanism -- how long should we sleep each iteration? how many attempts?
     static ImgI2CStatusResp ImgI2C(bool write, uint16_t addr, uint16_t val) {
         Transfer(ImgI2CTransactionMsg(write, 2, addr, val));
@@ -68,4 +68,37 @@ constexpr uint16_t FineIntTimeMax       = 16383;
 constexpr uint16_t AnalogGainMax        = 63;
 constexpr Pixel PixelMax                = 0x0FFF; // 12 bit values
 
+// Histogram: the per-channel histogram that ICE40 computes during a capture (see ImgController)
+//
+// ICE40 samples the upper-left 2x2 pixels of every 8x8 block, and bins each one by a 6-bit
+// float (3-bit exponent, 3-bit mantissa). For pixel values >=32, bin `8*k-32` begins at
+// `2^k`, so each bin spans 1/8 stop.
+namespace Histogram {
+    constexpr uint8_t ChannelCount          = 4; // One per CFA position
+    constexpr uint8_t BinCount              = 64;
+    constexpr uint16_t SubsampleFactor      = 16;
+    constexpr uint32_t ChannelSampleCount   = Full::PixelCount/SubsampleFactor/ChannelCount;
+    
+    // Bin(): returns the bin that ICE40 assigns `px` to
+    constexpr uint8_t Bin(Pixel px) {
+        if (px < 32) return px>>2;
+        uint8_t e = 1;
+        while (px >= (64<<(e-1))) e++;
+        return 8*e + ((px>>(e+1)) & 7);
+    }
+    
+    // BinMin(): returns the smallest pixel value that belongs to `bin`
+    constexpr Pixel BinMin(uint8_t bin) {
+        if (bin < 8) return 4*bin;
+        return (8 + (bin&7)) << ((bin>>3)+1);
+    }
+    
+    static_assert(Bin(0) == 0);
+    static_assert(Bin(31) == 7);
+    static_assert(Bin(32) == 8);
+    static_assert(Bin(PixelMax) == BinCount-1);
+    static_assert(BinMin(BinCount-1) <= PixelMax);
+    static_assert(Bin(BinMin(44)) == 44);
+};
+
 } // namespace Img
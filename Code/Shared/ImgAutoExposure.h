@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <algorithm>
+#include <iterator>
 #include "Img.h"
 
 namespace Img {
@@ -38,7 +39,85 @@ public:
         return score;
     }
     
+    // update(): single-step update from a capture histogram (see Img::Histogram), whose
+    // bins span 1/8 stop each, so the exposure correction is computed directly in 1/8 stops
+    // instead of being approached iteratively. `hist` may be the sum (or average) of any
+    // number of channels.
+    //
+    // The corrected exposure is split between the integration time and the analog gain;
+    // see setExposure().
+    uint8_t update(const uint16_t (&hist)[Histogram::BinCount]) {
+        // TargetBin: the mean bin of a well-exposed image (~18% gray)
+        constexpr int32_t TargetBin = 43;
+        // HighlightBinMax: the 99th percentile can't be pushed above this bin
+        constexpr int16_t HighlightBinMax = 61;
+        // HighlightPullMax: how far below TargetBin the highlights can pull the mean, so that
+        // small clipped areas (like light sources) don't darken the rest of the image
+        constexpr int16_t HighlightPullMax = 16;
+        // SaturatedDelta: when the histogram is clipped, the true brightness is unknown, so
+        // back off by this amount and let the next capture measure it
+        constexpr int16_t SaturatedDelta = -24;
+        constexpr int16_t DeltaMax = 64;
+        constexpr int16_t AdjustThreshold = 4;
+        
+        // Sum the bins in units of 1/8 stop (see _BinStops8)
+        int32_t total = 0;
+        int32_t sum = 0;
+        for (uint8_t i=0; i<Histogram::BinCount; i++) {
+            total += hist[i];
+            sum += (int32_t)hist[i] * (i<std::size(_BinStops8) ? _BinStops8[i] : i);
+        }
+        
+        if (!total) {
+            _changed = false;
+            return 0;
+        }
+        
+        // Find the 99th percentile bin
+        int16_t p99 = Histogram::BinCount-1;
+        for (int32_t above=0; p99>0; p99--) {
+            above += hist[p99];
+            if (above >= total/100) break;
+        }
+        
+        // delta = TargetBin-mean, rounded
+        const int32_t err = TargetBin*total - sum;
+        const int16_t deltaMean = (err + (err>=0 ? total/2 : -total/2)) / total;
+        int16_t delta = std::min(deltaMean, (int16_t)(HighlightBinMax-p99));
+        delta = std::max(delta, (int16_t)(deltaMean-HighlightPullMax));
+        if (hist[Histogram::BinCount-1] >= total/4) {
+            delta = std::min(delta, SaturatedDelta);
+        }
+        delta = std::max((int16_t)-DeltaMax, std::min(DeltaMax, delta));
+        
+        // exposure *= 2^(delta/8)
+        const uint16_t tprev = _t;
+        const uint8_t gprev = _gain;
+        const int16_t stops = (delta>=0 ? delta/8 : -((-delta+7)/8));
+        uint32_t e = (exposure() * _Pow2Frac8[delta-stops*8]) >> 8;
+        e = (stops>=0 ? e<<stops : e>>-stops);
+        setExposure(e);
+        
+        _changed = (std::abs(delta)>AdjustThreshold && (_t!=tprev || _gain!=gprev));
+        return ScoreBest-std::abs(delta);
+    }
+    
+    // exposure(): the integration time multiplied by the analog gain
+    uint32_t exposure() const { return (uint32_t)_t << _gain; }
+    
+    // setExposure(): splits `e` between the integration time and the analog gain. Gain
+    // amplifies noise, so it's only used once the integration time reaches CoarseIntTimeMax,
+    // and only in whole stops (the sensor's coarse gain steps: 1x/2x/4x/8x).
+    void setExposure(uint32_t e) {
+        uint8_t g = 0;
+        while (g<_GainStopMax && e>((uint32_t)Img::CoarseIntTimeMax<<g)) g++;
+        _gain = g;
+        _t = std::max((uint32_t)1, std::min((uint32_t)Img::CoarseIntTimeMax, (e + ((1<<g)>>1)) >> g));
+    }
+    
     uint16_t integrationTime() const { return _t; }
+    // analogGain(): the value for the sensor's analog gain register (Sensor::SetAnalogGain())
+    uint16_t analogGain() const { return (uint16_t)_gain << _AnalogGainCoarseShift; }
     bool changed() const { return _changed; }
     
 private:
@@ -49,7 +128,21 @@ private:
         return r;
     }
     
+    // _BinStops8: for the linear bins below 32, the position of the bin's center on the
+    // 1/8-stop scale of the bins above it, so that the mean reflects the log brightness of
+    // dark captures instead of overestimating it
+    static constexpr int8_t _BinStops8[8] = { -24, -11, -5, -2, 1, 4, 6, 7 };
+    
+    // _AnalogGainCoarseShift / _GainStopMax: the coarse gain field of the analog gain
+    // register; gain = 2^field
+    static constexpr uint8_t _AnalogGainCoarseShift = 4;
+    static constexpr uint8_t _GainStopMax = 3;
+    
+    // _Pow2Frac8: 2^(i/8) in Q8
+    static constexpr uint16_t _Pow2Frac8[8] = { 256, 279, 304, 332, 362, 394, 431, 470 };
+    
     uint16_t _t = 1024;
+    uint8_t _gain = 0; // Stops
     bool _changed = false;
 };
 
@@ -392,6 +392,82 @@ struct [[gnu::packed]] SDState {
 static_assert(!(sizeof(SDState) % 2)); // Check alignment
 static_assert(sizeof(SDState) == 56); // Debug
 
+// SDStateInit(): resets `sd` for the card described by `cardId` / `cardData`
+// The caller must enable FRAM writing, if necessary.
+inline void SDStateInit(SDState& sd, const SD::CardId& cardId, const SD::CardData& cardData) {
+    // CombinedBlockCount: thumbnail block count + full-size block count
+    constexpr uint32_t CombinedBlockCount = ImgSD::Thumb::ImageBlockCount + ImgSD::Full::ImageBlockCount;
+    // blockCap: the capacity of the SD card in SD blocks (1 block == 512 bytes)
+    const uint32_t blockCap = SD::BlockCapacity(cardData);
+    // imgCap: the capacity of the SD card in number of images
+    const uint32_t imgCap = blockCap / CombinedBlockCount;
+    
+    // Mark the state as invalid in case we lose power in the middle of modifying it
+    sd.valid = false;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    
+    // Set .cardId
+    {
+        sd.cardId = cardId;
+    }
+    
+    // Set .imgCap
+    {
+        sd.imgCap = imgCap;
+    }
+    
+    // Set .baseFull / .baseThumb
+    {
+        sd.baseFull = imgCap * ImgSD::Full::ImageBlockCount;
+        sd.baseThumb = sd.baseFull + imgCap * ImgSD::Thumb::ImageBlockCount;
+    }
+    
+    // Set .imgRingBufs
+    {
+        ImgRingBuf::Set(sd.imgRingBufs[0], {});
+        ImgRingBuf::Set(sd.imgRingBufs[1], {});
+    }
+    
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    sd.valid = true;
+}
+
+// ImgRingBufInit(): find the correct image ring buffer (the one with the greatest id that's valid)
+// and copy it into the other slot so that there are two copies. If neither slot contains a valid ring
+// buffer, reset them both so that they're both empty (and valid).
+// The caller must enable FRAM writing, if necessary.
+inline void ImgRingBufInit(SDState& sd) {
+    ImgRingBuf& a = sd.imgRingBufs[0];
+    ImgRingBuf& b = sd.imgRingBufs[1];
+    const std::optional<int> comp = ImgRingBuf::Compare(a, b);
+    if (comp && *comp>0) {
+        // a>b (a is newer), so set b=a
+        ImgRingBuf::Set(b, a);
+    
+    } else if (comp && *comp<0) {
+        // b>a (b is newer), so set a=b
+        ImgRingBuf::Set(a, b);
+    
+    } else if (!comp) {
+        // Both a and b are invalid; reset them both
+        ImgRingBuf::Set(a, {});
+        ImgRingBuf::Set(b, {});
+    }
+}
+
+// ImgRingBufIncrement(): advance both image ring buffers past the image that was just written
+// The caller must enable FRAM writing, if necessary.
+inline void ImgRingBufIncrement(SDState& sd) {
+    const uint32_t imgCap = sd.imgCap;
+    
+    ImgRingBuf x = sd.imgRingBufs[0];
+    x.buf.id++;
+    x.buf.idx = (x.buf.idx<imgCap-1 ? x.buf.idx+1 : 0);
+    
+    ImgRingBuf::Set(sd.imgRingBufs[0], x);
+    ImgRingBuf::Set(sd.imgRingBufs[1], x);
+}
+
 struct [[gnu::packed]] State {
     struct [[gnu::packed]] Header {
         uint32_t magic;
@@ -0,0 +1,385 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "Code/Shared/MSP.h"
+#include "Code/Shared/MSPTriggers.h"
+#include "Code/Shared/ImgAutoExposure.h"
+#include "Code/Shared/ImgSD.h"
+#include "Code/Shared/Time.h"
+#include "Code/Shared/TimeConstants.h"
+#include "Code/Shared/Assert.h"
+
+// MSPTasks.h: the platform-independent logic of MSPApp's tasks (_TaskEvent, _TaskImg, _TaskSD,
+// _TaskPower's battery sampling), so that MSPAppSimulator runs the firmware's own code. The
+// hardware operations (power, ICE40, SD card, Scheduler) are supplied by the caller.
+
+namespace MSP {
+
+// ImgAutoExposureHistogram: whether auto exposure uses the capture histogram rather than
+// the highlight/shadow counts. Off until MSPApp has been built with it enabled and its
+// RAM/FRAM usage checked, and until the ICE40 bitstream with Msg_Type_ImgHistogram has
+// been simulated and deployed.
+static constexpr bool ImgAutoExposureHistogram = false;
+
+// ImgAutoExposureUpdate(): updates `autoExp` from the most recent capture's histogram if
+// it's enabled and valid, otherwise from the capture's highlight/shadow counts.
+//
+// The histogram is averaged over the CFA channels so that the counts fit in 16 bits. It's
+// invalid if a channel's counts don't sum to ChannelSampleCount, which is the case if the
+// ICE40 bitstream predates Msg_Type_ImgHistogram. The histogram storage only exists if
+// T_Histogram=true, since it's declared in the discarded `if constexpr` branch otherwise.
+template<typename T_ICE, bool T_Histogram=ImgAutoExposureHistogram>
+inline uint8_t ImgAutoExposureUpdate(Img::AutoExposure& autoExp, const typename T_ICE::ImgCaptureStatusResp& resp) {
+    if constexpr (T_Histogram) {
+        static uint16_t hist[Img::Histogram::BinCount];
+        static uint32_t sums[Img::Histogram::ChannelCount];
+        for (uint16_t& x : hist) x = 0;
+        for (uint32_t& x : sums) x = 0;
+        T_ICE::ImgHistogram([] (uint8_t channel, uint8_t bin, uint16_t count) {
+            sums[channel] += count;
+            hist[bin] += count/Img::Histogram::ChannelCount;
+        });
+        
+        bool valid = true;
+        for (uint32_t x : sums) {
+            if (x != Img::Histogram::ChannelSampleCount) valid = false;
+        }
+        if (valid) return autoExp.update(hist);
+    }
+    return autoExp.update(resp.highlightCount(), resp.shadowCount());
+}
+
+// ImgCapture(): captures up to `CaptureAttemptCount` images, stopping once the exposure
+// settles, and returns the RAM block that holds the best-exposed image
+//
+//   capture(expBlock, skipCount): captures an image into RAM block `expBlock`, updates
+//     `autoExp`, and returns the exposure score
+//   exposureSet(): applies `autoExp`'s new exposure to the image sensor
+template<typename T_Capture, typename T_ExposureSet>
+inline uint8_t ImgCapture(const Img::AutoExposure& autoExp, T_Capture capture, T_ExposureSet exposureSet) {
+    // Try up to `CaptureAttemptCount` times to capture a properly-exposed image
+    constexpr uint8_t CaptureAttemptCount = 3;
+    uint8_t bestExpBlock = 0;
+    uint8_t bestExpScore = 0;
+    for (uint8_t i=0; i<CaptureAttemptCount; i++) {
+        // skipCount:
+        // On the initial capture, we didn't set the exposure, so we don't need to skip any images.
+        // On subsequent captures, we did set the exposure before the capture, so we need to skip a single
+        // image since the first image after setting the exposure is invalid.
+        const uint8_t skipCount = (!i ? 0 : 1);
+        
+        // expBlock: Store images in the block belonging to the worst-exposed image captured so far
+        const uint8_t expBlock = !bestExpBlock;
+        
+        // Capture an image to RAM, and update the exposure
+        const uint8_t expScore = capture(expBlock, skipCount);
+        if (!bestExpScore || (expScore > bestExpScore)) {
+            bestExpBlock = expBlock;
+            bestExpScore = expScore;
+        }
+        
+        // We're done if we don't have any exposure changes
+        if (!autoExp.changed()) break;
+        
+        // Update the exposure
+        exposureSet();
+    }
+    return bestExpBlock;
+}
+
+// SDStateLoad(): prepares `sd` for the card described by `cardId` / `cardData`: resets the
+// SD state if it isn't valid or it belongs to a different card, otherwise finds the correct
+// image ring buffer. Returns whether the SD state was reset.
+// The caller must enable FRAM writing, if necessary.
+inline bool SDStateLoad(SDState& sd, const SD::CardId& cardId, const SD::CardData& cardData) {
+    // If SD state isn't valid, or the existing SD card id doesn't match the current
+    // card id, reset the SD state.
+    if (!sd.valid || memcmp(&sd.cardId, &cardId, sizeof(cardId))) {
+        SDStateInit(sd, cardId, cardData);
+        return true;
+    }
+    
+    // Otherwise the SD state is valid and the SD card id matches, so init the ring buffers.
+    ImgRingBufInit(sd);
+    return false;
+}
+
+// ImgWrite(): copies the full-size image and thumbnail from RAM to their slots in the SD
+// card's image regions, at the image ring buffer's current index. The caller advances the
+// ring buffer afterwards, via ImgRingBufIncrement().
+//
+//   writeImage(block, size): copies the image of size `size` from RAM -> SD block `block`
+template<typename T_WriteImage>
+inline void ImgWrite(const SDState& sd, T_WriteImage writeImage) {
+    const ImgRingBuf& imgRingBuf = sd.imgRingBufs[0];
+    
+    // Copy full-size image from RAM -> SD card
+    {
+        const SD::Block block = SDBlockStart(sd.baseFull, ImgSD::Full::ImageBlockCount, imgRingBuf.buf.idx);
+        writeImage(block, Img::Size::Full);
+    }
+    
+    // Copy thumbnail from RAM -> SD card
+    {
+        const SD::Block block = SDBlockStart(sd.baseThumb, ImgSD::Thumb::ImageBlockCount, imgRingBuf.buf.idx);
+        writeImage(block, Img::Size::Thumb);
+    }
+}
+
+} // namespace MSP
+
+// T_MSPBatterySampleSchedule: decides when _TaskPower samples the battery: every
+// `IntervalRTCDays` days of RTC interrupts, or every `IntervalCapture` captures, whichever
+// comes first
+template<Time::TicksU16 T_RTCInterruptIntervalTicks>
+struct T_MSPBatterySampleSchedule {
+    static constexpr uint16_t IntervalRTCDays   = 4;
+    static constexpr uint16_t IntervalRTC       = (IntervalRTCDays * Time::Day) / T_RTCInterruptIntervalTicks;
+    static constexpr uint16_t IntervalCapture   = 512;
+    
+    // reset(): restarts both intervals; called when the battery is sampled
+    void reset() {
+        _rtc = IntervalRTC;
+        _capture = IntervalCapture;
+    }
+    
+    // rtc() / capture(): count an RTC interrupt / capture, and return whether the battery
+    // should be sampled
+    bool rtc() {
+        _rtc--; // Rollover OK since reset() is called when the battery is sampled
+        return !_rtc;
+    }
+    
+    bool capture() {
+        _capture--; // Rollover OK since reset() is called when the battery is sampled
+        return !_capture;
+    }
+    
+    uint16_t _rtc = 0;
+    uint16_t _capture = 0;
+};
+
+// T_MSPEvents: _TaskEvent's event handling: handles each type of event in the
+// T_MSPTriggers event list, and starts captures for time / motion / button triggers.
+//
+// T_Platform provides:
+//   static constexpr uint32_t MotionPowerOnDelayMs: motion sensor power-on time
+//   static bool Live(): false while fast-forwarding through past events
+//   static Time::Instant Now(): the current time
+//   static void EventFirst(): called when an inserted event becomes the first event
+//   static void CaptureImage(CaptureImageEvent& ev): powers up and performs a single capture
+template<typename T_Triggers, T_Triggers& T_TriggersInst, typename T_Platform>
+struct T_MSPEvents {
+    using Event                         = typename T_Triggers::Event;
+    using RepeatEvent                   = typename T_Triggers::RepeatEvent;
+    using TimeTriggerEvent              = typename T_Triggers::TimeTriggerEvent;
+    using MotionEnablePowerEvent        = typename T_Triggers::MotionEnablePowerEvent;
+    using MotionEnableEvent             = typename T_Triggers::MotionEnableEvent;
+    using MotionDisableEvent            = typename T_Triggers::MotionDisableEvent;
+    using MotionUnsuppressPowerEvent    = typename T_Triggers::MotionUnsuppressPowerEvent;
+    using MotionUnsuppressEvent         = typename T_Triggers::MotionUnsuppressEvent;
+    using CaptureImageEvent             = typename T_Triggers::CaptureImageEvent;
+    using DSTEvent                      = typename T_Triggers::DSTEvent;
+    using TimeTrigger                   = typename T_Triggers::TimeTrigger;
+    using MotionTrigger                 = typename T_Triggers::MotionTrigger;
+    
+    static void EventInsert(Event& ev, const Time::Instant& time) {
+        _Triggers.eventInsert(ev, time);
+        if (&ev == _Triggers.eventBegin()) {
+            // The new event is the first event, so let the platform re-schedule its event timer
+            T_Platform::EventFirst();
+        }
+    }
+    
+    static bool EventInsert(RepeatEvent& ev) {
+        const Time::TicksU32 delta = T_Triggers::RepeatAdvance(ev.repeat);
+        // delta=0 means Repeat=never, in which case we don't reschedule the event
+        if (delta) {
+            EventInsert(ev, _TimeInstantAdd(ev.time, delta));
+            return true;
+        }
+        return false;
+    }
+    
+    static void EventInsert(DSTEvent& ev) {
+        const Time::TicksU32 delta = T_Triggers::DSTPhaseAdvance(ev.phase);
+        EventInsert(ev, _TimeInstantAdd(ev.time, delta));
+    }
+    
+    static bool CaptureStart(CaptureImageEvent& ev, const Time::Instant& time) {
+        // Bail if the CaptureImageEvent is already underway
+        if (ev.countRem) return false;
+        
+        // Reset capture count
+        ev.countRem = ev.capture->count;
+        if (ev.countRem) {
+            EventInsert(ev, time);
+        }
+        return true;
+    }
+    
+    static void EventHandle(Event& ev) {
+        // Handle the event
+        using T = typename Event::Type;
+        switch (ev.type) {
+        case T::TimeTrigger:
+            _TimeTrigger(           static_cast<TimeTriggerEvent&>(ev)              ); break;
+        case T::MotionEnablePower:
+            _MotionEnablePower(     static_cast<MotionEnablePowerEvent&>(ev)        ); break;
+        case T::MotionEnable:
+            _MotionEnable(          static_cast<MotionEnableEvent&>(ev)             ); break;
+        case T::MotionDisable:
+            _MotionDisable(         static_cast<MotionDisableEvent&>(ev)            ); break;
+        case T::MotionUnsuppressPower:
+            _MotionUnsuppressPower( static_cast<MotionUnsuppressPowerEvent&>(ev)    ); break;
+        case T::MotionUnsuppress:
+            _MotionUnsuppress(      static_cast<MotionUnsuppressEvent&>(ev)         ); break;
+        case T::CaptureImage:
+            _CaptureImage(          static_cast<CaptureImageEvent&>(ev)             ); break;
+        case T::DST:
+            _DST(                   static_cast<DSTEvent&>(ev)                      ); break;
+        }
+    }
+    
+    // MotionHandle(): starts captures for each enabled motion trigger, in response to motion
+    static void MotionHandle() {
+        for (auto it=_Triggers.motionTriggerBegin(); it!=_Triggers.motionTriggerEnd(); it++) {
+            MotionTrigger& trigger = *it;
+            
+            // Check if we should ignore this trigger
+            if (!trigger.enabled()) continue;
+            
+            // Start capture
+            const Time::Instant time = T_Platform::Now();
+            const bool captureStarted = CaptureStart(trigger, time);
+            // CaptureStart() returns false if a capture is already in progress for this trigger.
+            // Short-circuit if that's the case.
+            if (!captureStarted) continue;
+            
+            // Update the number of motion triggers remaining.
+            // If this was the last trigger that we're allowed, set the `StateMaxImageCount` bit,
+            // which will disable motion for this trigger until the next MotionEnableEvent.
+            if (trigger.countRem) {
+                trigger.countRem--;
+                if (!trigger.countRem) {
+                    trigger.hitMaxImageCount();
+                }
+            }
+            
+            // Suppress motion for the specified duration, if suppression is enabled
+            const Time::TicksU32 suppressTicks = _Triggers.base(trigger).suppressTicks;
+            if (suppressTicks) {
+                // Suppress power/motion immediately
+                trigger.suppress();
+                
+                // Schedule MotionUnsuppressEvent
+                const Time::Instant unsuppressTime = _TimeInstantAdd(time, suppressTicks);
+                EventInsert(static_cast<MotionUnsuppressEvent&>(trigger), unsuppressTime);
+                
+                // Schedule MotionUnsuppressPowerEvent event `PowerOnDelayMs` before the MotionUnsuppressEvent.
+                const Time::Instant prepareTime = _TimeInstantAdd(unsuppressTime, -_TicksForMs(T_Platform::MotionPowerOnDelayMs));
+                EventInsert(static_cast<MotionUnsuppressPowerEvent&>(trigger), prepareTime);
+            }
+        }
+    }
+    
+    // ButtonHandle(): starts captures for each button trigger, in response to a button press
+    static void ButtonHandle() {
+        for (auto it=_Triggers.buttonTriggerBegin(); it!=_Triggers.buttonTriggerEnd(); it++) {
+            CaptureStart(*it, T_Platform::Now());
+        }
+    }
+    
+    static void _TimeTrigger(TimeTriggerEvent& ev) {
+        TimeTrigger& trigger = _Triggers.trigger(ev);
+        // Schedule the CaptureImageEvent, but only if we're not in fast-forward mode
+        if (T_Platform::Live()) CaptureStart(trigger, ev.time);
+        // Reschedule TimeTriggerEvent for its next trigger time
+        EventInsert(ev);
+    }
+    
+    static void _MotionEnablePower(MotionEnablePowerEvent& ev) {
+        MotionTrigger& trigger = (MotionTrigger&)ev;
+        // Enable motion power
+        trigger.enablePower();
+    }
+    
+    static void _MotionEnable(MotionEnableEvent& ev) {
+        MotionTrigger& trigger = _Triggers.trigger(ev);
+        
+        // Enable motion power / motion
+        trigger.enable(_Triggers.base(trigger).count);
+        
+        // Schedule the MotionDisableEvent, if applicable.
+        // This needs to happen before we reschedule `ev` because we need its .time to
+        // properly schedule the MotionDisableEvent!
+        const uint32_t durationTicks = _Triggers.base(trigger).durationTicks;
+        if (durationTicks) {
+            EventInsert(static_cast<MotionDisableEvent&>(trigger), _TimeInstantAdd(ev.time, durationTicks));
+        }
+        
+        // Reschedule MotionEnableEvent for its next trigger time
+        const bool repeat = EventInsert(ev);
+        
+        // Schedule MotionEnablePowerEvent event `PowerOnDelayMs` before the MotionEnableEvent.
+        if (repeat) {
+            EventInsert(static_cast<MotionEnablePowerEvent&>(trigger),
+                _TimeInstantAdd(ev.time, -_TicksForMs(T_Platform::MotionPowerOnDelayMs)));
+        }
+    }
+    
+    static void _MotionDisable(MotionDisableEvent& ev) {
+        MotionTrigger& trigger = (MotionTrigger&)ev;
+        // Disable motion power / motion
+        trigger.disable();
+    }
+    
+    static void _MotionUnsuppressPower(MotionUnsuppressPowerEvent& ev) {
+        MotionTrigger& trigger = (MotionTrigger&)ev;
+        // Unsuppress motion power
+        trigger.unsuppressPower();
+    }
+    
+    static void _MotionUnsuppress(MotionUnsuppressEvent& ev) {
+        MotionTrigger& trigger = (MotionTrigger&)ev;
+        // Unsuppress motion
+        trigger.unsuppressMotion();
+    }
+    
+    static void _CaptureImage(CaptureImageEvent& ev) {
+        // We should never get a CaptureImageEvent event while in fast-forward mode
+        Assert(T_Platform::Live());
+        
+        T_Platform::CaptureImage(ev);
+        
+        ev.countRem--;
+        if (ev.countRem) {
+            EventInsert(ev, _TimeInstantAdd(ev.time, ev.capture->delayTicks));
+        }
+    }
+    
+    static void _DST(DSTEvent& ev) {
+        // Re-insert the DSTEvent before adjusting all subsequent events' times,
+        // because we need to adjust the DSTEvent's time too.
+        EventInsert(ev);
+        
+        const Time::TicksS32 adj = _Triggers.base(ev).adjustmentTicks;
+        Event* x = _Triggers.eventBegin();
+        while (x != _Triggers.eventEnd()) {
+            x->time = _TimeInstantAdd(x->time, adj);
+            x = x->next;
+        }
+    }
+    
+    // _TimeInstantAdd(): noinline to save code space on MSP430, since it has many callers
+    [[gnu::noinline]]
+    static constexpr Time::Instant _TimeInstantAdd(const Time::Instant& time, Time::TicksS32 deltaTicks) {
+        return time + deltaTicks;
+    }
+    
+    static constexpr Time::TicksU32 _TicksForMs(uint64_t ms) {
+        return ((ms * Time::TicksPeriod::den) / (1000 * Time::TicksPeriod::num));
+    }
+    
+    static constexpr T_Triggers& _Triggers = T_TriggersInst;
+};
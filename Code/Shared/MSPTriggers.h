@@ -5,17 +5,15 @@
 #include "Code/Shared/TimeConstants.h"
 #include "Code/Shared/Assert.h"
 
-// TODO: when we move to using >=C++20, we want to give _State.settings.events as T_Base, but we have to give
-//       the whole _State while we're on C++17, because C++17 doesn't allow giving subojects as non-type
-//       template parameters.
-//       We created _T_Base for this reason, and can remove it and replace all uses with T_Base when we switch.
-template<
-auto& T_Base,
-typename T_MotionPowered
->
+// T_MSPTriggers: the runtime state of a MSP::Triggers (the event linked list and the
+// per-trigger state), which references the MSP::Triggers that it was constructed with.
+// All state is per-instance, so that multiple instances can coexist (eg in
+// BatteryLifeSimulator, which runs several simulations concurrently).
+template<typename T_MotionPowered>
 struct T_MSPTriggers {
-    static constexpr auto& _T_Base = T_Base.settings.triggers;
-    using _Base = std::remove_reference_t<decltype(_T_Base)>;
+    using _Base = MSP::Triggers;
+    
+    T_MSPTriggers(const _Base& base) : _base(base) {}
     
     struct Event {
         enum class Type : uint8_t {
@@ -56,19 +54,14 @@ struct T_MSPTriggers {
     
     struct RepeatEvent : Event {
         RepeatEvent() = default;
-        RepeatEvent(typename _Base::RepeatEvent& b) : Event(Event::Convert(b.type)), repeat(b.repeat) {}
-        auto& base() { return _BaseElm(_T_Base.repeatEvent, _RepeatEvent, *this); }
+        RepeatEvent(const typename _Base::RepeatEvent& b) : Event(Event::Convert(b.type)), repeat(b.repeat) {}
         
         MSP::Repeat repeat;
     };
     
-    struct TimeTriggerEvent : RepeatEvent {
-        auto& trigger() { return _TimeTrigger[RepeatEvent::base().idx]; }
-    };
+    struct TimeTriggerEvent : RepeatEvent {};
     
-    struct MotionEnableEvent : RepeatEvent {
-        auto& trigger() { return _MotionTrigger[RepeatEvent::base().idx]; }
-    };
+    struct MotionEnableEvent : RepeatEvent {};
     
     
     
@@ -105,8 +98,7 @@ struct T_MSPTriggers {
     
     struct TimeTrigger : CaptureImageEvent {
         TimeTrigger() = default;
-        TimeTrigger(typename _Base::TimeTrigger& b) : CaptureImageEvent(b.capture) {}
-        auto& base() { return _BaseElm(_T_Base.timeTrigger, _TimeTrigger, *this); }
+        TimeTrigger(const typename _Base::TimeTrigger& b) : CaptureImageEvent(b.capture) {}
     };
     
     struct MotionTrigger :
@@ -122,8 +114,7 @@ struct T_MSPTriggers {
         static constexpr State StateMaxImageCount   = 1<<4;
         
         MotionTrigger() = default;
-        MotionTrigger(typename _Base::MotionTrigger& b) : CaptureImageEvent(b.capture), state(0), countRem(0) {}
-        auto& base() { return _BaseElm(_T_Base.motionTrigger, _MotionTrigger, *this); }
+        MotionTrigger(const typename _Base::MotionTrigger& b) : CaptureImageEvent(b.capture), state(0), countRem(0) {}
         
         static constexpr bool _Enabled(State x) {
             return x == (StatePowerEnable|StateMotionEnable);
@@ -137,7 +128,8 @@ struct T_MSPTriggers {
             return _Enabled(state);
         }
         
-        void enable() {
+        // enable(): `count` is the trigger's MSP::Triggers::MotionTrigger::count
+        void enable(uint16_t count) {
             // Enable power / motion
             // Include StatePowerEnable to power on the motion sensor, because it may not be powered already,
             // because the very first MotionEnableEvent doesn't have a corresponding MotionEnablePowerEvent,
@@ -146,7 +138,7 @@ struct T_MSPTriggers {
                 StatePowerEnable|StateMotionEnable,
                 StateMaxImageCount
             );
-            countRem = base().count;
+            countRem = count;
         }
         
         void disable() {
@@ -218,25 +210,34 @@ struct T_MSPTriggers {
     
     struct ButtonTrigger : CaptureImageEvent {
         ButtonTrigger() = default;
-        ButtonTrigger(typename _Base::ButtonTrigger& b) : CaptureImageEvent(b.capture) {}
-        auto& base() { return _BaseElm(_T_Base.buttonTrigger, _ButtonTrigger, *this); }
+        ButtonTrigger(const typename _Base::ButtonTrigger& b) : CaptureImageEvent(b.capture) {}
     };
     
     struct DSTEvent : Event {
         DSTEvent() = default;
-        DSTEvent(typename _Base::DSTEvent& b) : Event(Event::Type::DST), phase(b.phase) {}
-        auto& base() { return _BaseElm(_T_Base.dstEvent, _DSTEvent, *this); }
+        DSTEvent(const typename _Base::DSTEvent& b) : Event(Event::Type::DST), phase(b.phase) {}
         MSP::DSTPhase phase;
     };
     
-    static void Init(const Time::Instant& t) {
+    // base(): returns the MSP::Triggers element that `x` was created from
+    auto& base(RepeatEvent& x)      { return _BaseElm(_base.repeatEvent, _repeatEvent, x); }
+    auto& base(TimeTrigger& x)      { return _BaseElm(_base.timeTrigger, _timeTrigger, x); }
+    auto& base(MotionTrigger& x)    { return _BaseElm(_base.motionTrigger, _motionTrigger, x); }
+    auto& base(ButtonTrigger& x)    { return _BaseElm(_base.buttonTrigger, _buttonTrigger, x); }
+    auto& base(DSTEvent& x)         { return _BaseElm(_base.dstEvent, _dstEvent, x); }
+    
+    // trigger(): returns the trigger that the event `x` acts upon
+    auto& trigger(TimeTriggerEvent& x)  { return _timeTrigger[base(x).idx]; }
+    auto& trigger(MotionEnableEvent& x) { return _motionTrigger[base(x).idx]; }
+    
+    void init(const Time::Instant& t) {
         // Reset everything
-        _Front = _End;
-        for (auto& x : _RepeatEvent)    x = RepeatEvent(x.base());
-        for (auto& x : _TimeTrigger)    x = TimeTrigger(x.base());
-        for (auto& x : _MotionTrigger)  x = MotionTrigger(x.base());
-        for (auto& x : _ButtonTrigger)  x = ButtonTrigger(x.base());
-        for (auto& x : _DSTEvent)       x = DSTEvent(x.base());
+        _front = _End;
+        for (auto& x : _repeatEvent)    x = RepeatEvent(base(x));
+        for (auto& x : _timeTrigger)    x = TimeTrigger(base(x));
+        for (auto& x : _motionTrigger)  x = MotionTrigger(base(x));
+        for (auto& x : _buttonTrigger)  x = ButtonTrigger(base(x));
+        for (auto& x : _dstEvent)       x = DSTEvent(base(x));
         
 //        // If we don't know the absolute time, run in 'relative time mode', where we still
 //        // execute events with the same relative timing as in 'absolute time mode', we just
@@ -244,25 +245,25 @@ struct T_MSPTriggers {
 //        // time from all events, such that the first event starts at Time::Instant=0.
 //        Time::Instant sub = 0;
 //        if (!Time::Absolute(t)) {
-//            sub = _RepeatEvent[0].base().time;
+//            sub = base(_repeatEvent[0]).time;
 //        }
         
         // Schedule events
-        for (auto it=RepeatEventBegin(); it!=RepeatEventEnd(); it++) {
-            EventInsert(*it, it->base().time);
+        for (auto it=repeatEventBegin(); it!=repeatEventEnd(); it++) {
+            eventInsert(*it, base(*it).time);
         }
         
-        for (auto it=DSTEventBegin(); it!=DSTEventEnd(); it++) {
-            EventInsert(*it, it->base().time);
+        for (auto it=dstEventBegin(); it!=dstEventEnd(); it++) {
+            eventInsert(*it, base(*it).time);
         }
     }
     
-    static void EventInsert(Event& ev, const Time::Instant& t) {
-        EventPop(ev);
+    void eventInsert(Event& ev, const Time::Instant& t) {
+        eventPop(ev);
         ev.time = t;
         
-        Event** prev = &_Front;
-        Event* curr = _Front;
+        Event** prev = &_front;
+        Event* curr = _front;
         while (curr!=_End && (ev.time > curr->time)) {
             prev = &curr->next;
             curr = curr->next;
@@ -272,21 +273,21 @@ struct T_MSPTriggers {
         ev.next = curr;
     }
     
-    static Event& EventPop() {
-        Assert(_Front != _End);
-        Event& ev = *_Front;
-        EventPop(ev);
+    Event& eventPop() {
+        Assert(_front != _End);
+        Event& ev = *_front;
+        eventPop(ev);
         return ev;
     }
     
-    // EventPop(): remove event from linked list
-    static void EventPop(Event& ev) {
+    // eventPop(): remove event from linked list
+    void eventPop(Event& ev) {
         // Only pop the event if we know it's in the list, to avoid having to search
         // for it (since we're using a singly-linked list to save memory).
         if (!ev.scheduled()) return;
         
-        Event** prev = &_Front;
-        Event* curr = _Front;
+        Event** prev = &_front;
+        Event* curr = _front;
         while (curr!=_End && curr!=&ev) {
             prev = &curr->next;
             curr = curr->next;
@@ -297,24 +298,28 @@ struct T_MSPTriggers {
         ev.next = nullptr;
     }
     
-    static auto EventBegin() { return _Front; }
-    static auto EventEnd()   { return _End; }
+    auto eventBegin() const { return _front; }
+    auto eventEnd() const   { return _End; }
     
-    static auto RepeatEventBegin() { return std::begin(_RepeatEvent); }
-    static auto RepeatEventEnd()   { return std::begin(_RepeatEvent)+RepeatEventCount(); }
-    static auto RepeatEventCount() { return _T_Base.repeatEventCount; }
+    auto repeatEventBegin() { return std::begin(_repeatEvent); }
+    auto repeatEventEnd()   { return std::begin(_repeatEvent)+repeatEventCount(); }
+    auto repeatEventCount() const { return _base.repeatEventCount; }
     
-    static auto TimeTriggerBegin() { return std::begin(_TimeTrigger); }
-    static auto TimeTriggerEnd() { return std::begin(_TimeTrigger)+_T_Base.timeTriggerCount; }
+    auto timeTriggerBegin() { return std::begin(_timeTrigger); }
+    auto timeTriggerEnd() { return std::begin(_timeTrigger)+_base.timeTriggerCount; }
     
-    static auto MotionTriggerBegin() { return std::begin(_MotionTrigger); }
-    static auto MotionTriggerEnd() { return std::begin(_MotionTrigger)+_T_Base.motionTriggerCount; }
+    auto motionTriggerBegin() { return std::begin(_motionTrigger); }
+    auto motionTriggerEnd() { return std::begin(_motionTrigger)+_base.motionTriggerCount; }
+    auto motionTriggerBegin() const { return std::begin(_motionTrigger); }
+    auto motionTriggerEnd() const { return std::begin(_motionTrigger)+_base.motionTriggerCount; }
     
-    static auto ButtonTriggerBegin() { return std::begin(_ButtonTrigger); }
-    static auto ButtonTriggerEnd() { return std::begin(_ButtonTrigger)+_T_Base.buttonTriggerCount; }
+    auto buttonTriggerBegin() { return std::begin(_buttonTrigger); }
+    auto buttonTriggerEnd() { return std::begin(_buttonTrigger)+_base.buttonTriggerCount; }
+    auto buttonTriggerBegin() const { return std::begin(_buttonTrigger); }
+    auto buttonTriggerEnd() const { return std::begin(_buttonTrigger)+_base.buttonTriggerCount; }
     
-    static auto DSTEventBegin() { return std::begin(_DSTEvent); }
-    static auto DSTEventEnd() { return std::begin(_DSTEvent)+_T_Base.dstEventCount; }
+    auto dstEventBegin() { return std::begin(_dstEvent); }
+    auto dstEventEnd() { return std::begin(_dstEvent)+_base.dstEventCount; }
     
     static Time::TicksU32 RepeatAdvance(MSP::Repeat& x) {
         static constexpr Time::TicksU32 YearPlusDay = Time::Year+Time::Day;
@@ -362,18 +367,20 @@ struct T_MSPTriggers {
     }
     
     template<typename T_Dst, typename T_Src, size_t T_Count>
-    static T_Dst& _BaseElm(T_Dst (&dst)[T_Count], T_Src (&src)[T_Count], T_Src& elm) {
+    static T_Dst& _BaseElm(T_Dst (&dst)[T_Count], T_Src (&src)[T_Count], const T_Src& elm) {
         Assert(&elm>=src && &elm<(src+T_Count));
         const size_t idx = &elm-src;
         return dst[idx];
     }
     
+    const _Base& _base;
+    
     // Triggers
-    static inline RepeatEvent   _RepeatEvent[std::size(_T_Base.repeatEvent)];
-    static inline TimeTrigger   _TimeTrigger[std::size(_T_Base.timeTrigger)];
-    static inline MotionTrigger _MotionTrigger[std::size(_T_Base.motionTrigger)];
-    static inline ButtonTrigger _ButtonTrigger[std::size(_T_Base.buttonTrigger)];
-    static inline DSTEvent      _DSTEvent[std::size(_T_Base.dstEvent)];
+    RepeatEvent   _repeatEvent[std::extent_v<decltype(_Base::repeatEvent)>];
+    TimeTrigger   _timeTrigger[std::extent_v<decltype(_Base::timeTrigger)>];
+    MotionTrigger _motionTrigger[std::extent_v<decltype(_Base::motionTrigger)>];
+    ButtonTrigger _buttonTrigger[std::extent_v<decltype(_Base::buttonTrigger)>];
+    DSTEvent      _dstEvent[std::extent_v<decltype(_Base::dstEvent)>];
     
     // Event linked list
     // _End: a sentinel value representing the end of the linked list.
@@ -382,12 +389,12 @@ struct T_MSPTriggers {
     // Ideally _End would be `static constexpr` instead of `static inline`, but C++ doesn't allow
     // constexpr reinterpret_cast. In C++20 we could use std::bit_cast for this.
     static inline Event*const _End = (Event*)0x0001;
-    static inline Event* _Front;
+    Event* _front = nullptr;
     
-//    static constexpr size_t _TotalSize = sizeof(_RepeatEvent)   +
-//                                         sizeof(_TimeTrigger)   +
-//                                         sizeof(_MotionTrigger) +
-//                                         sizeof(_ButtonTrigger) +
-//                                         sizeof(_Front)         ;
+//    static constexpr size_t _TotalSize = sizeof(_repeatEvent)   +
+//                                         sizeof(_timeTrigger)   +
+//                                         sizeof(_motionTrigger) +
+//                                         sizeof(_buttonTrigger) +
+//                                         sizeof(_front)         ;
 //    StaticPrint(_TotalSize);
 };
@@ -30,10 +30,10 @@ namespace Time {
 //       The implementation searches for the .delta/.interval fixed-point ratio that's
 //       closest to the target floating-point ratio.
 //
-inline MSP::TimeAdjustment TimeAdjustmentCalculate(const MSP::TimeState& state) {
+// `nowTime` is the true current time; the overload without `nowTime` uses Time::Clock::now().
+inline MSP::TimeAdjustment TimeAdjustmentCalculate(const MSP::TimeState& state, const Time::Clock::time_point& nowTime) {
     assert(Time::Absolute(state.start));
     assert(Time::Absolute(state.time));
-    const Time::Clock::time_point nowTime = Time::Clock::now();
     const Time::Clock::time_point deviceStartTime = Time::Clock::TimePointFromTimeInstant(state.start);
     const Time::Clock::time_point deviceNowTime = Time::Clock::TimePointFromTimeInstant(state.time);
     
@@ -88,4 +88,8 @@ inline MSP::TimeAdjustment TimeAdjustmentCalculate(const MSP::TimeState& state)
     };
 }
 
+inline MSP::TimeAdjustment TimeAdjustmentCalculate(const MSP::TimeState& state) {
+    return TimeAdjustmentCalculate(state, Time::Clock::now());
+}
+
 } // namespace Time
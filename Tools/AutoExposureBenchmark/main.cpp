@@ -0,0 +1,279 @@
+#include <vector>
+#include <string>
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include "Code/Shared/Img.h"
+#include "Code/Shared/ImgAutoExposure.h"
+
+// AutoExposureBenchmark: replays raw frames through Img::AutoExposure, to compare how many
+// captures each algorithm needs to converge, and how far from the ideal exposure it lands
+//
+// Algorithms:
+//   legacy:     AutoExposure::update(highlightCount, shadowCount), which only adjusts the
+//               integration time, by at most 1/16 of its range per capture
+//   predictive: AutoExposure::update(hist), which computes the exposure from the capture
+//               histogram and splits it between the integration time and the analog gain
+//
+// Each frame is replayed from a range of starting exposures. A capture at exposure E is
+// modeled by scaling the frame's pixels by E/E0 (where E0 is the exposure the frame was
+// recorded at) and clipping at Img::PixelMax. The statistics of each capture are computed
+// like ImgController computes them: highlight/shadow counts from every 4th pixel of every 4th
+// row, and the histogram from the upper-left 2x2 pixels of every 8x8 block, averaged over the
+// CFA channels like MSPApp.
+//
+// The ideal exposure is the one that places the frame's median pixel at 18% gray. Frames
+// whose median is clipped or black have no ideal exposure, so they only contribute to the
+// capture counts.
+//
+// Usage:
+//   AutoExposureBenchmark [dir]
+//     Replays every frame in `dir`, or a set of synthetic scenes if no directory is given.
+//     Frames are either images read from a device's library with `MDCUtil ImgReadFull`
+//     (an Img::Header followed by the pixels; the header supplies the recorded exposure),
+//     or headerless .cfa files (raw 2304x1296 Img::Pixel samples), which are assumed to
+//     have been recorded at AutoExposure's initial exposure.
+
+namespace fs = std::filesystem;
+
+static constexpr size_t Width = Img::Full::PixelWidth;
+static constexpr size_t Height = Img::Full::PixelHeight;
+
+// CaptureCountMax: stop replaying an algorithm that hasn't converged after this many captures
+static constexpr uint8_t CaptureCountMax = 8;
+// CaptureAttemptCount: the number of captures MSPApp allows per image
+static constexpr uint8_t CaptureAttemptCount = 3;
+// StartStops: starting exposures, in stops relative to the ideal exposure
+static constexpr int StartStops[] = { -6, -4, -2, 0, 2, 4, 6 };
+
+struct _Frame {
+    std::string name;
+    std::vector<Img::Pixel> px;
+    double exposure = 0; // Recorded exposure (integration time * analog gain)
+};
+
+struct _Capture {
+    uint32_t highlightCount = 0;
+    uint32_t shadowCount = 0;
+    uint16_t hist[Img::Histogram::BinCount] = {};
+};
+
+struct _Result {
+    uint32_t runs = 0;
+    uint32_t captures = 0;
+    uint32_t convergedWithinAttempts = 0;
+    uint32_t converged = 0;
+    std::vector<double> errs; // |error| in stops
+};
+
+// _AnalogGain(): the gain of the analog gain register's coarse field (2^field), which is the
+// only part of the register that AutoExposure uses
+static double _AnalogGain(uint16_t analogGain) {
+    return std::exp2(analogGain >> 4);
+}
+
+static _Frame _ReadFrame(const fs::path& path) {
+    std::vector<uint8_t> data(fs::file_size(path));
+    std::ifstream f(path, std::ios::binary);
+    f.read((char*)data.data(), data.size());
+    if (!f) throw std::runtime_error("failed to read: " + path.string());
+    
+    _Frame frame = { .name = path.filename().string() };
+    size_t off = 0;
+    Img::Header header;
+    memcpy(&header, data.data(), std::min(data.size(), sizeof(header)));
+    if (data.size()>=sizeof(header) && header.magic.u24==Img::Header::MagicNumber.u24) {
+        if (header.imageWidth!=Width || header.imageHeight!=Height) {
+            throw std::runtime_error("not a full-size image: " + path.string());
+        }
+        frame.exposure = header.coarseIntTime * _AnalogGain(header.analogGain);
+        off = Img::PixelsOffset;
+    } else {
+        frame.exposure = Img::AutoExposure().exposure();
+    }
+    
+    if (data.size()-off < Img::Full::PixelLen) throw std::runtime_error("invalid frame: " + path.string());
+    frame.px.resize(Img::Full::PixelCount);
+    memcpy(frame.px.data(), data.data()+off, Img::Full::PixelLen);
+    if (!frame.exposure) throw std::runtime_error("frame has no exposure: " + path.string());
+    return frame;
+}
+
+static std::vector<_Frame> _ReadFrames(const fs::path& dir) {
+    std::vector<fs::path> paths;
+    for (const fs::directory_entry& e : fs::directory_iterator(dir)) {
+        if (e.is_regular_file()) paths.push_back(e.path());
+    }
+    std::sort(paths.begin(), paths.end());
+    
+    std::vector<_Frame> frames;
+    for (const fs::path& p : paths) frames.push_back(_ReadFrame(p));
+    return frames;
+}
+
+// _SyntheticFrame(): a scene whose log2 brightness varies by `stops` around `medianPx`,
+// recorded at `exposure`, with blocks of different brightness, gradients and sensor noise
+static _Frame _SyntheticFrame(const char* name, uint32_t seed, double medianPx, double stops, double exposure) {
+    _Frame frame = { .name = name, .px = std::vector<Img::Pixel>(Img::Full::PixelCount), .exposure = exposure };
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> block(0, stops);
+    std::normal_distribution<double> noise(0, 2);
+    constexpr size_t BlockSize = 48;
+    std::vector<double> blocks((Width/BlockSize) * (Height/BlockSize));
+    for (double& b : blocks) b = block(rng);
+    
+    for (size_t y=0; y<Height; y++) {
+        for (size_t x=0; x<Width; x++) {
+            const double b = blocks[(y/BlockSize)*(Width/BlockSize) + x/BlockSize];
+            const double gradient = .5*std::sin(x*.01) * std::sin(y*.013);
+            const double v = medianPx*std::exp2(b+gradient) + noise(rng);
+            frame.px[y*Width+x] = (Img::Pixel)std::clamp(std::lround(v), 0L, (long)Img::PixelMax);
+        }
+    }
+    return frame;
+}
+
+static std::vector<_Frame> _SyntheticFrames() {
+    return {
+        _SyntheticFrame("synthetic-daylight",   0, 700,  1.5, 512),
+        _SyntheticFrame("synthetic-bright",     1, 1500, 1.0, 4),
+        _SyntheticFrame("synthetic-hdr",        2, 400,  3.0, 256),
+        _SyntheticFrame("synthetic-dim",        3, 40,   1.5, Img::CoarseIntTimeMax),
+        _SyntheticFrame("synthetic-dark",       4, 6,    1.0, Img::CoarseIntTimeMax),
+    };
+}
+
+// _IdealExposure(): the exposure that places the frame's median pixel at 18% gray, or 0 if the
+// median is clipped or black
+static double _IdealExposure(const _Frame& frame) {
+    std::vector<Img::Pixel> px = frame.px;
+    std::nth_element(px.begin(), px.begin()+px.size()/2, px.end());
+    const Img::Pixel median = px[px.size()/2];
+    if (!median || median>=Img::PixelMax) return 0;
+    return frame.exposure * (.18*Img::PixelMax) / median;
+}
+
+static _Capture _CaptureFrame(const _Frame& frame, double exposure) {
+    using namespace Img::Histogram;
+    const double k = exposure / frame.exposure;
+    const auto pixel = [&] (size_t x, size_t y) {
+        // Pixels that clipped in the recording are at least PixelMax, so they stay clipped at
+        // longer exposures, and become at least PixelMax*k at shorter ones
+        const Img::Pixel px = frame.px[y*Width+x];
+        if (px>=Img::PixelMax && k>=1) return Img::PixelMax;
+        return (Img::Pixel)std::min((long)Img::PixelMax, std::lround(px*k));
+    };
+    
+    _Capture cap;
+    
+    // Highlight/shadow counts: the top 7 bits of every 4th pixel of every 4th row
+    for (size_t y=0; y<Height; y+=4) {
+        for (size_t x=0; x<Width; x+=4) {
+            const Img::Pixel px = pixel(x, y);
+            if ((px>>5) == 0x7F)    cap.highlightCount++;
+            else if (!(px>>5))      cap.shadowCount++;
+        }
+    }
+    
+    // Histogram: the upper-left 2x2 pixels of every 8x8 block, averaged over the channels
+    uint16_t hist[ChannelCount][BinCount] = {};
+    for (size_t y=0; y<Height; y++) {
+        if (y%8 >= 2) continue;
+        for (size_t x=0; x<Width; x++) {
+            if (x%8 >= 2) continue;
+            hist[(y%2)*2 + (x%2)][Bin(pixel(x, y))]++;
+        }
+    }
+    for (uint8_t ch=0; ch<ChannelCount; ch++) {
+        for (uint8_t i=0; i<BinCount; i++) cap.hist[i] += hist[ch][i]/ChannelCount;
+    }
+    return cap;
+}
+
+template<bool T_Predictive>
+static void _Replay(const _Frame& frame, double idealExposure, uint32_t startExposure, _Result& result) {
+    Img::AutoExposure ae;
+    ae.setExposure(startExposure);
+    
+    uint8_t captures = 0;
+    bool converged = false;
+    while (captures < CaptureCountMax) {
+        const _Capture cap = _CaptureFrame(frame, ae.exposure());
+        captures++;
+        if constexpr (T_Predictive) ae.update(cap.hist);
+        else                        ae.update(cap.highlightCount, cap.shadowCount);
+        if (!ae.changed()) {
+            converged = true;
+            break;
+        }
+    }
+    
+    result.runs++;
+    result.captures += captures;
+    result.converged += converged;
+    result.convergedWithinAttempts += (converged && captures<=CaptureAttemptCount);
+    if (idealExposure) result.errs.push_back(std::abs(std::log2(ae.exposure() / idealExposure)));
+}
+
+static void _PrintResult(const char* name, _Result r) {
+    std::sort(r.errs.begin(), r.errs.end());
+    double errMean = 0;
+    for (double e : r.errs) errMean += e;
+    if (!r.errs.empty()) errMean /= r.errs.size();
+    const double errP90 = (r.errs.empty() ? 0 : r.errs[(r.errs.size()*9)/10 - (r.errs.size()>=10 ? 1 : 0)]);
+    printf("  %-12s captures: %5.2f   converged: %5.1f%%   converged within %u: %5.1f%%   |error| mean: %5.2f stops   p90: %5.2f stops\n",
+        name,
+        (double)r.captures/r.runs,
+        100.*r.converged/r.runs,
+        (unsigned)CaptureAttemptCount,
+        100.*r.convergedWithinAttempts/r.runs,
+        errMean, errP90);
+}
+
+int main(int argc, const char* argv[]) {
+    try {
+        const std::vector<_Frame> frames = (argc>1 ? _ReadFrames(argv[1]) : _SyntheticFrames());
+        if (frames.empty()) throw std::runtime_error("no frames");
+        
+        _Result legacyTotal;
+        _Result predictiveTotal;
+        for (const _Frame& frame : frames) {
+            const double ideal = _IdealExposure(frame);
+            const double center = (ideal ? ideal : frame.exposure);
+            if (ideal) printf("%s: recorded exposure %.0f, ideal exposure %.0f\n", frame.name.c_str(), frame.exposure, ideal);
+            else       printf("%s: recorded exposure %.0f, no ideal exposure (median clipped or black)\n", frame.name.c_str(), frame.exposure);
+            
+            _Result legacy;
+            _Result predictive;
+            for (int stops : StartStops) {
+                const double start = std::clamp(center*std::exp2(stops), 1., (double)Img::CoarseIntTimeMax);
+                _Replay<false>(frame, ideal, (uint32_t)std::lround(start), legacy);
+                _Replay<true>(frame, ideal, (uint32_t)std::lround(start), predictive);
+            }
+            _PrintResult("legacy", legacy);
+            _PrintResult("predictive", predictive);
+            
+            for (_Result* r : { &legacyTotal, &predictiveTotal }) {
+                const _Result& src = (r==&legacyTotal ? legacy : predictive);
+                r->runs += src.runs;
+                r->captures += src.captures;
+                r->converged += src.converged;
+                r->convergedWithinAttempts += src.convergedWithinAttempts;
+                r->errs.insert(r->errs.end(), src.errs.begin(), src.errs.end());
+            }
+        }
+        
+        printf("\nAll frames (%zu):\n", frames.size());
+        _PrintResult("legacy", legacyTotal);
+        _PrintResult("predictive", predictiveTotal);
+        
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
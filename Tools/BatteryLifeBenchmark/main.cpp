@@ -0,0 +1,175 @@
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include "BatteryLifeSimulator.h"
+
+// BatteryLifeBenchmark: compares BatteryLifeSimulator with and without fast-forwarding
+//
+// For each trigger configuration and each of WorstCase/BestCase, runs the simulation
+// step-by-step (Constants::fastForward=false) and with fast-forwarding, and prints the
+// speedup along with how far the fast-forwarded battery curve strays from the
+// step-by-step one, and the total energy consumed by each.
+
+using namespace MDCStudio::BatteryLifeSimulator;
+
+static constexpr std::chrono::seconds SampleInterval = date::days(7);
+
+struct Config {
+    const char* name = nullptr;
+    MSP::Triggers triggers = {};
+};
+
+static MSP::Triggers::RepeatEvent& _RepeatEventAdd(MSP::Triggers& t, Time::Instant time,
+    MSP::Triggers::Event::Type type, uint8_t idx, MSP::Repeat repeat) {
+    
+    MSP::Triggers::RepeatEvent& ev = t.repeatEvent[t.repeatEventCount++];
+    ev.time = time;
+    ev.type = type;
+    ev.idx = idx;
+    ev.repeat = repeat;
+    return ev;
+}
+
+static MSP::Repeat _Daily() {
+    MSP::Repeat x = { .type = MSP::Repeat::Type::Daily };
+    x.Daily.interval = 1;
+    return x;
+}
+
+static void _DSTEventsAdd(MSP::Triggers& t, Time::Instant day) {
+    using namespace Time;
+    t.dstEvent[0] = { { .time = day + 69*Day + 10*Hour, .type = MSP::Triggers::Event::Type::DST, .idx = 0 }, {}, +Hour };
+    t.dstEvent[1] = { { .time = day + 307*Day + 9*Hour, .type = MSP::Triggers::Event::Type::DST, .idx = 1 }, {}, -Hour };
+    t.dstEventCount = 2;
+}
+
+// _Configs(): trigger configurations, from sparse to dense
+static std::vector<Config> _Configs() {
+    using namespace Time;
+    const Instant now = Time::Clock::TimeInstantFromTimePoint(Time::Clock::now());
+    const Instant day = AbsoluteBit | (((now & ~AbsoluteBit) / Day) * Day);
+    std::vector<Config> configs;
+    
+    // Daily: a capture at 9:30 every day
+    {
+        Config c = { .name = "Daily" };
+        MSP::Triggers& t = c.triggers;
+        t.timeTrigger[0] = { .capture = { .delayTicks = 0, .count = 1, .ledFlash = 0 } };
+        t.timeTriggerCount = 1;
+        _RepeatEventAdd(t, day + 9*Hour + 30*Minute, MSP::Triggers::Event::Type::TimeTrigger, 0, _Daily());
+        _DSTEventsAdd(t, day);
+        configs.push_back(c);
+    }
+    
+    // Weekly: 5 captures every 2 hours on Mon/Wed/Fri/Sun, plus a button trigger
+    {
+        Config c = { .name = "Weekly" };
+        MSP::Triggers& t = c.triggers;
+        t.timeTrigger[0] = { .capture = { .delayTicks = 2*Second, .count = 5, .ledFlash = 0 } };
+        t.timeTriggerCount = 1;
+        MSP::Repeat repeat = { .type = MSP::Repeat::Type::Weekly };
+        repeat.Weekly.days = 0b1010101;
+        for (uint8_t h=0; h<24; h+=2) {
+            _RepeatEventAdd(t, day + h*Hour, MSP::Triggers::Event::Type::TimeTrigger, 0, repeat);
+        }
+        t.buttonTrigger[0] = { .capture = { .delayTicks = 0, .count = 1, .ledFlash = 1 } };
+        t.buttonTriggerCount = 1;
+        _DSTEventsAdd(t, day);
+        configs.push_back(c);
+    }
+    
+    // Motion: motion enabled 07:00-19:00 daily with 3 captures per motion, plus a capture every 2 hours
+    {
+        Config c = { .name = "Motion" };
+        MSP::Triggers& t = c.triggers;
+        t.timeTrigger[0] = { .capture = { .delayTicks = 0, .count = 1, .ledFlash = 0 } };
+        t.timeTriggerCount = 1;
+        for (uint8_t h=0; h<24; h+=2) {
+            _RepeatEventAdd(t, day + h*Hour, MSP::Triggers::Event::Type::TimeTrigger, 0, _Daily());
+        }
+        t.motionTrigger[0] = {
+            .capture = { .delayTicks = 5*Second, .count = 3, .ledFlash = 0 },
+            .count = 0,
+            .durationTicks = 12*Hour,
+            .suppressTicks = 0,
+        };
+        t.motionTriggerCount = 1;
+        _RepeatEventAdd(t, day + 7*Hour, MSP::Triggers::Event::Type::MotionEnable, 0, _Daily());
+        _DSTEventsAdd(t, day);
+        configs.push_back(c);
+    }
+    
+    // MotionDense: motion always enabled with 10 captures per motion
+    {
+        Config c = { .name = "MotionDense" };
+        MSP::Triggers& t = c.triggers;
+        t.motionTrigger[0] = {
+            .capture = { .delayTicks = 1*Second, .count = 10, .ledFlash = 0 },
+            .count = 0,
+            .durationTicks = 0,
+            .suppressTicks = 0,
+        };
+        t.motionTriggerCount = 1;
+        _RepeatEventAdd(t, day, MSP::Triggers::Event::Type::MotionEnable, 0, _Daily());
+        _DSTEventsAdd(t, day);
+        configs.push_back(c);
+    }
+    
+    return configs;
+}
+
+// _Level(): the battery level at time `t`, linearly interpolated between `points`
+static float _Level(const std::vector<Point>& points, std::chrono::seconds t) {
+    for (auto it=points.begin()+1; it!=points.end(); it++) {
+        if (it->time < t) continue;
+        const Point& a = *(it-1);
+        const Point& b = *it;
+        const float k = (float)(t-a.time).count() / (b.time-a.time).count();
+        return a.batteryLevel + k*(b.batteryLevel-a.batteryLevel);
+    }
+    return points.back().batteryLevel;
+}
+
+struct Run {
+    std::vector<Point> points;
+    double energy = 0;
+    double durationMs = 0;
+};
+
+static Run _Simulate(const MSP::Triggers& triggers, const Parameters& params, bool fastForward) {
+    const Constants consts = { .fastForward = fastForward };
+    Simulator sim(consts, params, triggers);
+    const auto timeStart = std::chrono::steady_clock::now();
+    Run r = { .points = sim.simulate() };
+    r.energy = sim.energy().total();
+    r.durationMs = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-timeStart).count();
+    return r;
+}
+
+static void _Print(const Config& config, const char* paramsName, const Parameters& params) {
+    const Run step = _Simulate(config.triggers, params, false);
+    const Run ff = _Simulate(config.triggers, params, true);
+    
+    // Determine the maximum difference between the two battery curves
+    const std::chrono::seconds end = std::max(step.points.back().time, ff.points.back().time);
+    float levelErrMax = 0;
+    for (std::chrono::seconds t(0); t<=end; t+=SampleInterval) {
+        levelErrMax = std::max(levelErrMax, std::abs(_Level(step.points, t)-_Level(ff.points, t)));
+    }
+    
+    const double lifeStepDays = (double)step.points.back().time.count() / 86400;
+    const double lifeFFDays = (double)ff.points.back().time.count() / 86400;
+    printf("%-12s %-10s %10.1f ms %10.1f ms %8.1fx   life: %7.1f / %7.1f days   energy: %7.1f / %7.1f J   max level error: %.4f%%\n",
+        config.name, paramsName, step.durationMs, ff.durationMs, step.durationMs/ff.durationMs,
+        lifeStepDays, lifeFFDays, step.energy, ff.energy, levelErrMax*100);
+}
+
+int main(int argc, const char* argv[]) {
+    printf("%-12s %-10s %13s %13s %9s\n", "Config", "Params", "Step", "FastForward", "Speedup");
+    for (const Config& config : _Configs()) {
+        _Print(config, "WorstCase", WorstCase);
+        _Print(config, "BestCase", BestCase);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include "Cache.h"
+#include "ShardedCache.h"
+
+// CacheBenchmark: compares the throughput of Cache and ShardedCache when hit by N threads
+//
+// Each thread performs lookups of random keys; on a miss, it pops a free entry, fills it,
+// and inserts it into the cache (like ImageSource does with its thumbnail cache). The key space
+// is slightly larger than the cache's capacity, so most lookups hit.
+
+static constexpr size_t Cap = 512;
+static constexpr size_t KeyCount = 600;
+static constexpr auto Duration = std::chrono::seconds(1);
+
+using Val = uint8_t[256];
+
+struct Result {
+    uint64_t ops = 0;
+    uint64_t hits = 0;
+};
+
+template<typename T_Cache>
+static Result _Bench(T_Cache& cache, size_t threadCount) {
+    std::atomic<bool> stop = false;
+    std::vector<Result> results(threadCount);
+    std::vector<std::thread> threads;
+    for (size_t t=0; t<threadCount; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937_64 rng(t);
+            Result& r = results[t];
+            while (!stop.load(std::memory_order_relaxed)) {
+                // Do a batch of operations between checks of `stop`
+                for (int i=0; i<256; i++) {
+                    const uint64_t key = rng() % KeyCount;
+                    auto entry = cache.get(key);
+                    if (entry) {
+                        assert((*entry)[0] == (uint8_t)key);
+                        r.hits++;
+                    } else {
+                        auto reserved = cache.pop();
+                        memset(*reserved.entry(), (uint8_t)key, sizeof(Val));
+                        cache.set(key, std::move(reserved));
+                    }
+                    r.ops++;
+                }
+            }
+        });
+    }
+    
+    std::this_thread::sleep_for(Duration);
+    stop = true;
+    for (std::thread& t : threads) t.join();
+    
+    Result r;
+    for (const Result& x : results) {
+        r.ops += x.ops;
+        r.hits += x.hits;
+    }
+    return r;
+}
+
+template<typename T_Cache>
+static void _Print(const char* name, size_t threadCount) {
+    auto cache = std::make_unique<T_Cache>();
+    const Result r = _Bench(*cache, threadCount);
+    const auto durationSec = std::chrono::duration<double>(Duration).count();
+    printf("%-14s threads=%-3ju %10.2f Mops/s   hit rate: %.1f%%\n", name, (uintmax_t)threadCount,
+        (double)r.ops/durationSec/1e6, 100*(double)r.hits/r.ops);
+}
+
+int main(int argc, const char* argv[]) {
+    size_t threadMax = std::thread::hardware_concurrency();
+    if (argc > 1) threadMax = strtoull(argv[1], nullptr, 0);
+    if (!threadMax) threadMax = 1;
+    
+    for (size_t threadCount=1;; threadCount*=2) {
+        threadCount = std::min(threadCount, threadMax);
+        _Print<Cache<uint64_t,Val,Cap>>("Cache", threadCount);
+        _Print<ShardedCache<uint64_t,Val,Cap>>("ShardedCache", threadCount);
+        if (threadCount == threadMax) break;
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include "Code/Shared/ChecksumFletcher32.h"
+
+// ChecksumBenchmark: verifies ChecksumFletcher32Engine against reference implementations, and
+// compares its throughput with the original scalar implementation
+//
+// Build with a different ARCH to exercise the other code paths, eg:
+//   make ARCH=-mno-avx2      (SSE2)
+//   make ARCH="-mno-avx2 -mno-sse2"   (scalar)
+
+// _ChecksumFletcher32Scalar: the original implementation, which reduces for every word
+static uint32_t _ChecksumFletcher32Scalar(const void* data, size_t len) {
+    const uint16_t* words = (const uint16_t*)data;
+    const size_t wordCount = len/sizeof(uint16_t);
+    uint32_t a = 0;
+    uint32_t b = 0;
+    for (size_t i=0; i<wordCount; i++) {
+        a = (a+words[i]) % UINT16_MAX;
+        b = (b+a) % UINT16_MAX;
+    }
+    return (b<<16) | a;
+}
+
+// _ChecksumFletcher32HDL: model of ICE40's FletcherChecksum.v, which reduces via a conditional
+// subtraction in 17-bit arithmetic
+static uint32_t _ChecksumFletcher32HDL(const void* data, size_t len) {
+    const uint16_t* words = (const uint16_t*)data;
+    const size_t wordCount = len/sizeof(uint16_t);
+    constexpr uint32_t Mask17 = 0x1FFFF;
+    uint32_t ax = 0;
+    uint32_t bx = 0;
+    for (size_t i=0; i<wordCount; i++) {
+        const uint32_t a1 = (ax + words[i] - 0xFFFF) & Mask17;
+        const uint32_t a2 = (ax + words[i]) & Mask17;
+        ax = (!(a1 & 0x10000) ? a1 : a2);
+        
+        const uint32_t b1 = (bx + ax - 0xFFFF) & Mask17;
+        const uint32_t b2 = (bx + ax) & Mask17;
+        bx = (!(b1 & 0x10000) ? b1 : b2);
+    }
+    return ((bx & 0xFFFF) << 16) | (ax & 0xFFFF);
+}
+
+static void _Fail(const char* what, size_t len, uint32_t expected, uint32_t got) {
+    fprintf(stderr, "FAIL: %s (len:%zu expected:0x%08x got:0x%08x)\n", what, len, expected, got);
+    exit(1);
+}
+
+static void _Verify() {
+    std::mt19937_64 rng(0);
+    std::vector<uint8_t> buf(1<<20);
+    
+    // Patterns: random data, and the all-ones/all-zeroes data that exercises the edges of the
+    // modular reduction
+    for (int pattern=0; pattern<3; pattern++) {
+        for (uint8_t& x : buf) {
+            x = (pattern==0 ? (uint8_t)rng() : (pattern==1 ? 0xFF : 0x00));
+        }
+        
+        for (int iter=0; iter<200; iter++) {
+            size_t len = 2*(rng() % (buf.size()/2 + 1));
+            // Also exercise the small lengths
+            if (iter < 64) len = 2*iter;
+            
+            const uint32_t expected = _ChecksumFletcher32Scalar(buf.data(), len);
+            const uint32_t hdl = _ChecksumFletcher32HDL(buf.data(), len);
+            if (hdl != expected) _Fail("HDL model", len, expected, hdl);
+            
+            const uint32_t got = ChecksumFletcher32(buf.data(), len);
+            if (got != expected) _Fail("ChecksumFletcher32", len, expected, got);
+            
+            // Feed the engine randomly-sized (including odd-sized) chunks
+            ChecksumFletcher32Engine engine;
+            for (size_t off=0; off<len;) {
+                const size_t chunk = std::min(len-off, (size_t)(rng() % 70000));
+                engine.update(buf.data()+off, chunk);
+                off += chunk;
+            }
+            if (engine.checksum() != expected) _Fail("ChecksumFletcher32Engine", len, expected, engine.checksum());
+        }
+    }
+    printf("Verified\n");
+}
+
+template<typename T_Fn>
+static double _Bench(const std::vector<uint8_t>& buf, T_Fn fn) {
+    using namespace std::chrono;
+    constexpr auto Duration = seconds(1);
+    volatile uint32_t sink = 0;
+    size_t iters = 0;
+    const auto start = steady_clock::now();
+    auto now = start;
+    while (now-start < Duration) {
+        sink = sink + fn(buf.data(), buf.size());
+        iters++;
+        now = steady_clock::now();
+    }
+    const double sec = duration_cast<duration<double>>(now-start).count();
+    return ((double)iters*buf.size() / (1024*1024)) / sec;
+}
+
+int main(int argc, const char* argv[]) {
+    _Verify();
+    
+    struct {
+        const char* name;
+        size_t len;
+    } sizes[] = {
+        { "thumbnail", 373760 },
+        { "full image", 5963776 },
+    };
+    
+    std::mt19937_64 rng(1);
+    for (const auto& size : sizes) {
+        std::vector<uint8_t> buf(size.len);
+        for (uint8_t& x : buf) x = (uint8_t)rng();
+        
+        const double scalar = _Bench(buf, _ChecksumFletcher32Scalar);
+        const double engine = _Bench(buf, ChecksumFletcher32);
+        printf("%-12s scalar: %8.1f MiB/sec   engine: %8.1f MiB/sec   (%.1fx)\n",
+            size.name, scalar, engine, engine/scalar);
+    }
+    return 0;
+}
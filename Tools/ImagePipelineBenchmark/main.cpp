@@ -0,0 +1,231 @@
+#include <vector>
+#include <chrono>
+#include <random>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include "Tools/Shared/ImagePipeline/CPU/ImagePipeline.h"
+#include "Tools/Shared/ImagePipeline/CPU/FFCC.h"
+
+// ImagePipelineBenchmark: measures the throughput of each stage of ImagePipeline::CPU
+//
+// Usage:
+//   ImagePipelineBenchmark bench [image.cfa]
+//     Times each stage separately, then the fused Pipeline::Run(), on `image.cfa` (raw
+//     Img::Full-sized Img::Pixel samples) or on a synthetic image if none is given. Also
+//     times FFCC on the image's thumbnail, with a placeholder model (the real model is only
+//     available to the macOS targets).
+//
+// This only measures speed: ImagePipeline::CPU's output hasn't been compared against the
+// Metal pipeline.
+
+namespace fs = std::filesystem;
+using namespace ImagePipeline::CPU;
+
+static constexpr size_t Width = Img::Full::PixelWidth;
+static constexpr size_t Height = Img::Full::PixelHeight;
+static constexpr CFADesc CFA = {CFAColor::Green, CFAColor::Red, CFAColor::Blue, CFAColor::Green};
+
+static Pipeline::Options _Options() {
+    Pipeline::Options opts = {
+        .cfaDesc = CFA,
+        .illum = ColorRaw{ 0.9, 1.0, 0.7 },
+        .colorMatrix = ColorMatrix{{
+            {  0.61, 0.25, 0.10 },
+            {  0.22, 0.81, -0.03 },
+            { -0.02, -0.11, 0.95 },
+        }},
+        .reconstructHighlights = { .en = true },
+        .exposure = .1,
+        .saturation = .2,
+        .brightness = .05,
+        .contrast = .3,
+        .localContrast = { .amount = .3, .radius = 40 },
+    };
+    return opts;
+}
+
+static std::vector<Img::Pixel> _ReadCFA(const fs::path& path) {
+    std::vector<Img::Pixel> px(Width*Height);
+    std::ifstream f(path, std::ios::binary);
+    f.read((char*)px.data(), px.size()*sizeof(Img::Pixel));
+    if (!f || f.peek()!=EOF) throw std::runtime_error("invalid .cfa file: " + path.string());
+    return px;
+}
+
+// _SyntheticImage(): a mosaicked test scene with smooth gradients, hard edges, fine detail,
+// clipped highlights and noise
+static std::vector<Img::Pixel> _SyntheticImage() {
+    std::vector<Img::Pixel> px(Width*Height);
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0, .004);
+    for (size_t y=0; y<Height; y++) {
+        for (size_t x=0; x<Width; x++) {
+            const float u = (float)x/Width;
+            const float v = (float)y/Height;
+            float rgb[] = { .2f+.6f*u, .3f+.4f*v, .5f-.3f*u*v };
+            // Hard edges
+            if (((x/96) + (y/96)) % 2) for (float& c : rgb) c *= .4;
+            // Fine detail
+            const float d = .1f*std::sin(x*.9f)*std::sin(y*.7f);
+            for (float& c : rgb) c += d;
+            // Clipped highlight
+            const float dx = (float)x-1700, dy = (float)y-400;
+            if (dx*dx+dy*dy < 150*150) for (float& c : rgb) c = 1.5;
+            
+            const float s = rgb[(size_t)CFA.color(x,y)] + noise(rng);
+            px[y*Width+x] = (Img::Pixel)std::lround(std::clamp(s, 0.f, 1.f)*Img::PixelMax);
+        }
+    }
+    return px;
+}
+
+// _Thumb(): downsamples a full-size image to thumbnail size by discarding pixels, while
+// preserving the CFA layout (like ImgController's default thumbnail mode, ThumbBin=0)
+static std::vector<Img::Pixel> _Thumb(const std::vector<Img::Pixel>& px) {
+    constexpr size_t Factor = Width / Img::Thumb::PixelWidth;
+    std::vector<Img::Pixel> thumb(Img::Thumb::PixelCount);
+    for (size_t y=0; y<Img::Thumb::PixelHeight; y++) {
+        for (size_t x=0; x<Img::Thumb::PixelWidth; x++) {
+            const size_t sx = (x/2)*2*Factor + (x%2);
+            const size_t sy = (y/2)*2*Factor + (y%2);
+            thumb[y*Img::Thumb::PixelWidth+x] = px[sy*Width+sx];
+        }
+    }
+    return thumb;
+}
+
+// _Time(): returns the fastest of `iters` runs of `fn`, in milliseconds
+static double _Time(size_t iters, const std::function<void()>& fn) {
+    double best = INFINITY;
+    for (size_t i=0; i<iters; i++) {
+        const auto t = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t).count());
+    }
+    return best;
+}
+
+static void _PrintTime(const char* name, double ms) {
+    printf("  %-32s %9.2f ms %9.1f MPix/s\n", name, ms, (Width*Height/1e6) / (ms/1000));
+}
+
+static void _Bench(const std::vector<Img::Pixel>& px) {
+    constexpr size_t Iters = 10;
+    const Pipeline::Options opts = _Options();
+    const ColorTransform ct = Pipeline::ColorTransformForOptions(opts);
+    std::vector<float> out(3*Width*Height);
+    
+    printf("Stages (%zu threads):\n", (size_t)std::thread::hardware_concurrency());
+    Plane raw = Pipeline::LoadRaw(Width, Height, px.data());
+    _PrintTime("LoadRaw", _Time(Iters, [&] { Pipeline::LoadRaw(Width, Height, px.data()); }));
+    
+    _PrintTime("ReconstructHighlights", _Time(Iters, [&] {
+        Plane r = raw;
+        ReconstructHighlights::Run(opts.cfaDesc, *opts.illum, r);
+    }));
+    
+    std::array<Plane,3> rgb;
+    _PrintTime("DebayerLMMSE", _Time(Iters, [&] {
+        DebayerLMMSE::Run(opts.cfaDesc, false, raw, rgb);
+    }));
+    _PrintTime("DebayerLMMSE (applyGamma)", _Time(Iters, [&] {
+        DebayerLMMSE::Run(opts.cfaDesc, true, raw, rgb);
+    }));
+    
+    std::array<Plane,3> lab = { Plane(Width,Height), Plane(Width,Height), Plane(Width,Height) };
+    _PrintTime("Color (-> Lab)", _Time(Iters, [&] {
+        ParallelForRows(Height, [&] (size_t y0, size_t y1) {
+            for (size_t y=y0; y<y1; y++) {
+                ct.toLab(Width, rgb[0].row(y), rgb[1].row(y), rgb[2].row(y), lab[0].row(y), lab[1].row(y), lab[2].row(y));
+            }
+        });
+    }));
+    
+    _PrintTime("LocalContrast (blur)", _Time(Iters, [&] {
+        Plane l = lab[0];
+        GaussianBlur::Run(l, opts.localContrast.radius);
+    }));
+    
+    _PrintTime("Color (Lab -> LSRGB)", _Time(Iters, [&] {
+        ParallelForRows(Height, [&] (size_t y0, size_t y1) {
+            for (size_t y=y0; y<y1; y++) {
+                ct.toLSRGB(Width, lab[0].row(y), lab[1].row(y), lab[2].row(y), out.data()+3*y*Width);
+            }
+        });
+    }));
+    
+    printf("\nPipeline::Run():\n");
+    Pipeline::Options basic = opts;
+    basic.reconstructHighlights.en = false;
+    basic.localContrast = {};
+    _PrintTime("fused (no highlights / LC)", _Time(Iters, [&] {
+        Pipeline::Run(basic, Width, Height, px.data(), out.data());
+    }));
+    _PrintTime("all stages", _Time(Iters, [&] {
+        Pipeline::Run(opts, Width, Height, px.data(), out.data());
+    }));
+    
+    // FFCC with a placeholder model: an identity filter for the pixel histogram and no bias,
+    // which costs the same as the real model
+    {
+        const std::vector<std::complex<double>> f0(FFCC::BinCount*FFCC::BinCount, 1);
+        const std::vector<std::complex<double>> f1(FFCC::BinCount*FFCC::BinCount, 0);
+        const std::vector<double> b(FFCC::BinCount*FFCC::BinCount, 0);
+        const FFCC ffcc({
+            .params = {
+                .histogram = {
+                    .binCount       = FFCC::BinCount,
+                    .binSize        = 1./32,
+                    .startingUV     = -0.531250,
+                    .minIntensity   = 1./256,
+                },
+            },
+            .F_fft = { f0.data(), f1.data() },
+            .B = b.data(),
+        });
+        
+        const std::vector<Img::Pixel> thumb = _Thumb(px);
+        std::array<double,3> illum = {};
+        const double ms = _Time(100, [&] {
+            illum = ffcc.run(opts.cfaDesc, Img::Thumb::PixelWidth, Img::Thumb::PixelHeight, thumb.data());
+        });
+        printf("\nFFCC (%ux%u thumbnail, 1 thread):\n", Img::Thumb::PixelWidth, Img::Thumb::PixelHeight);
+        printf("  %-32s %9.3f ms   illum: %.4f %.4f %.4f\n", "run", ms, illum[0], illum[1], illum[2]);
+    }
+    
+    Pipeline::Stats stats;
+    Pipeline::Run(opts, Width, Height, px.data(), out.data(), &stats);
+    printf("\nPipeline::Run() passes (all stages):\n");
+    _PrintTime("load", stats.load.count());
+    _PrintTime("reconstructHighlights", stats.reconstructHighlights.count());
+    _PrintTime("debayer + color", stats.debayer.count());
+    _PrintTime("localContrast", stats.localContrast.count());
+    _PrintTime("color", stats.color.count());
+}
+
+static void _PrintUsage() {
+    printf("Usage:\n");
+    printf("  ImagePipelineBenchmark bench [image.cfa]\n");
+}
+
+int main(int argc, const char* argv[]) {
+    const std::string cmd = (argc>1 ? argv[1] : "bench");
+    try {
+        if (cmd == "bench") {
+            _Bench(argc>2 ? _ReadCFA(argv[2]) : _SyntheticImage());
+        } else {
+            _PrintUsage();
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
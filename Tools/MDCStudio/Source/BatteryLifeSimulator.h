@@ -1,6 +1,10 @@
 #pragma once
 #include <chrono>
 #include <list>
+#include <deque>
+#include <atomic>
+#include <cmath>
+#include <dispatch/dispatch.h>
 #include <iostream>
 #include "DeviceSettings.h"
 #include "Code/Shared/Clock.h"
@@ -9,6 +13,7 @@
 #include "Code/Shared/MSPTriggers.h"
 #include "date/date.h"
 #include "Code/Shared/TimeString.h"
+#include "Tools/Shared/PowerModel.h"
 
 namespace MDCStudio::BatteryLifeSimulator {
 
@@ -17,20 +22,29 @@ struct Constants {
     static constexpr std::chrono::seconds BatteryLifeMax = date::years(3);
     std::chrono::seconds motionStimulusInterval = std::chrono::minutes(10);
     std::chrono::seconds buttonStimulusInterval = std::chrono::hours(6);
+    // fastForward: skip over periods of time during which the simulation repeats itself;
+    // see Simulator::_fastForward()
+    bool fastForward = true;
 };
 
 struct Parameters {
-    uint32_t batteryImageCaptureCapacity = 0;
+    // batteryEnergy: usable energy of a full battery, in joules
+    double batteryEnergy = 0;
+    // captureAttempts: average number of capture attempts per image (for auto exposure to converge)
+    float captureAttempts = 0;
     float batteryDailySelfDischarge = 0;
+    PowerModel::Costs costs = PowerModel::Default;
 };
 
 constexpr Parameters WorstCase = {
-    .batteryImageCaptureCapacity = 50000,
+    .batteryEnergy = PowerModel::BatteryEnergy*.75,
+    .captureAttempts = 3,
     .batteryDailySelfDischarge = 0.0017083156,     // 5% per month == 1-(1-.05)^(1/30) per day
 };
 
 constexpr Parameters BestCase = {
-    .batteryImageCaptureCapacity = 80000,
+    .batteryEnergy = PowerModel::BatteryEnergy,
+    .captureAttempts = 1,
     .batteryDailySelfDischarge = 0.0006731968785,  // 2% per month == 1-(1-.02)^(1/30) per day
 };
 
@@ -132,34 +146,50 @@ struct Simulator {
     
     Simulator(const Constants& consts,
         const Parameters& params,
-        const MSP::Triggers& triggers) : _consts(consts), _params(params), _triggers(triggers) {
+        const MSP::Triggers& triggers) : _consts(consts), _params(params), _triggers(triggers), _triggersState(_triggers) {
         
 //        _MSPTriggersPrint(triggers);
         
         assert(consts.motionStimulusInterval.count() > 0);
         assert(consts.buttonStimulusInterval.count() > 0);
+        assert(params.batteryEnergy > 0);
+        
+        for (bool ledFlash : {false, true}) {
+            _captureEnergy[ledFlash] = PowerModel::EnergyForUsage(params.costs,
+                PowerModel::CaptureUsage(params.captureAttempts, ledFlash));
+        }
     }
     
+    // Copy/move: illegal; _triggersState points into itself and references _triggers
+    Simulator(const Simulator& x) = delete;
+    Simulator& operator=(const Simulator& x) = delete;
+    Simulator(Simulator&& x) = delete;
+    Simulator& operator=(Simulator&& x) = delete;
+    
     // _BatteryLevelNormalize(): adjust the battery level `x` so that it spans [0,1].
     // This is so that 1 maps to 1 and _BatteryEmptyLevel maps to 0.
     static float _BatteryLevelNormalize(float x) {
         return (x-_BatteryEmptyLevel) / (1-_BatteryEmptyLevel);
     }
     
-    std::vector<Point> simulate() {
-        // Since _MSPState is static, require that we're called from a single thread (the main thread) only.
-        // In the future we'd like to remove this requirement; see comment about _MSPState.
-        assert([NSThread isMainThread]);
+    // simulate(): run the simulation until the battery dies.
+    // All state is owned by the Simulator instance, so distinct instances can simulate
+    // concurrently. If `cancel` is given and becomes true, simulate() bails early and
+    // returns no points.
+    std::vector<Point> simulate(const std::atomic<bool>* cancel=nullptr) {
         auto debugTimeStart = std::chrono::steady_clock::now();
         
         _batteryLevel = 1;
-        _MSPState.settings.triggers = _triggers;
+        _batteryTransform = {};
+        _energy = {};
+        _snapshots.clear();
+        _live = false;
         
         const Time::Instant timeStart = Time::Clock::TimeInstantFromTimePoint(Time::Clock::now());
 //        printf("timeStart: 0x%jx\n", (uintmax_t)timeStart);
         
         _time = timeStart;
-        _Triggers::Init(_time);
+        _triggersState.init(_time);
         
         // Insert the initial point where the battery is fully charged
         std::vector<Point> points = {{
@@ -169,14 +199,18 @@ struct Simulator {
         
         uint64_t i;
         for (i=0;; i++) {
+            if (cancel && cancel->load(std::memory_order_relaxed)) return {};
+            
             _batteryDailySelfDischargeSchedule();
             _motionStimulusSchedule();
             _buttonStimulusSchedule();
             
-            _Triggers::Event& ev = *_Triggers::EventBegin();
-            _Triggers::EventPop();
+            _Triggers::Event& ev = *_triggersState.eventBegin();
+            _triggersState.eventPop();
             
-            // Make our current time the event's time
+            // Make our current time the event's time, accounting for the idle drain since
+            // the previous event
+            if (_live) _idle(ev.time);
             _time = ev.time;
             
             // Go live when we hit the current time
@@ -192,6 +226,13 @@ struct Simulator {
             // Handle the event
             _eventHandle(ev);
             
+            // Skip ahead if the simulation is repeating itself.
+            // We only check once per day, after the daily self-discharge, since all periods
+            // that we detect are a multiple of days.
+            if (&ev == &_batteryDailySelfDischargeEvent) {
+                _fastForward(points, timeStart);
+            }
+            
             const std::chrono::seconds duration = _duration(timeStart);
             if (duration != points.back().time) {
                 points.push_back({
@@ -202,6 +243,9 @@ struct Simulator {
             
             // Bail once the battery level is below our threshold
             if (_batteryLevel < _BatteryEmptyLevel) break;
+            // Bail once we exceed the maximum battery life, since we trim the points beyond
+            // Constants::BatteryLifeMax anyway
+            if (duration > Constants::BatteryLifeMax) break;
         }
         
         // Bail once the battery level is below our threshold
@@ -241,30 +285,35 @@ struct Simulator {
 //        return points;
     }
     
-    // TODO: for now MSP::State is static which is gross and means we're not thread safe.
-    // In the future, figure out how to make it non-static, but still share the T_MSPTriggers
-    // code with MSPApp.
-    static inline MSP::State _MSPState;
-    using _Triggers = T_MSPTriggers<_MSPState, bool>;
+    // energy(): the energy consumed by the most recent simulate(), by category
+    const PowerModel::Energy& energy() const {
+        return _energy;
+    }
+    
+    using _Triggers = T_MSPTriggers<bool>;
     
     _Triggers::Event _batteryDailySelfDischargeEvent = {};
     _Triggers::Event _motionStimulusEvent = {};
     _Triggers::Event _buttonStimulusEvent = {};
     
     std::chrono::seconds _duration(Time::Instant timeStart) {
+        return _duration(timeStart, _time);
+    }
+    
+    static std::chrono::seconds _duration(Time::Instant timeStart, Time::Instant time) {
         const auto t1 = Time::Clock::TimePointFromTimeInstant(timeStart);
-        const auto t2 = Time::Clock::TimePointFromTimeInstant(_time);
+        const auto t2 = Time::Clock::TimePointFromTimeInstant(time);
         return std::chrono::duration_cast<std::chrono::seconds>(t2-t1);
     }
     
     void _eventInsert(_Triggers::Event& ev, Time::Instant time) {
-        _Triggers::EventInsert(ev, time);
+        _triggersState.eventInsert(ev, time);
     }
     
     void _eventInsert(_Triggers::RepeatEvent& ev) {
         const Time::TicksU32 delta = _Triggers::RepeatAdvance(ev.repeat);
         // delta=0 means Repeat=never, in which case we don't reschedule the event
-        if (delta) _Triggers::EventInsert(ev, ev.time+delta);
+        if (delta) _triggersState.eventInsert(ev, ev.time+delta);
     }
     
     void _eventInsert(_Triggers::DSTEvent& ev) {
@@ -276,7 +325,10 @@ struct Simulator {
     void _batteryDailySelfDischarge() {
         if (_live) {
 //            _printTime(); printf("Battery self-discharge\n");
-            _batteryLevel *= 1-_params.batteryDailySelfDischarge;
+            const float k = 1-_params.batteryDailySelfDischarge;
+            _batteryLevel *= k;
+            _batteryTransform.a *= k;
+            _batteryTransform.b *= k;
         }
         _batteryDailySelfDischargeSchedule();
     }
@@ -310,7 +362,7 @@ struct Simulator {
 //        _printTime(); printf("Motion stimulus\n");
         
         // When motion occurs, start captures for each enabled motion trigger
-        for (auto it=_Triggers::MotionTriggerBegin(); it!=_Triggers::MotionTriggerEnd(); it++) {
+        for (auto it=_triggersState.motionTriggerBegin(); it!=_triggersState.motionTriggerEnd(); it++) {
 //            _printTime(); printf("Motion trigger\n");
             
             _Triggers::MotionTrigger& trigger = *it;
@@ -335,7 +387,7 @@ struct Simulator {
             }
             
             // Suppress motion for the specified duration, if suppression is enabled
-            const Time::TicksU32 suppressTicks = trigger.base().suppressTicks;
+            const Time::TicksU32 suppressTicks = _triggersState.base(trigger).suppressTicks;
             if (suppressTicks) {
                 // Suppress power/motion immediately
                 trigger.suppress();
@@ -352,7 +404,7 @@ struct Simulator {
         if (_motionStimulusEvent.scheduled()) return false;
         // Check if there are any motion triggers that are enabled (.enabled()==true) for which
         // captures aren't currently underway (ev.countRem==0)
-        for (auto it=_Triggers::MotionTriggerBegin(); it!=_Triggers::MotionTriggerEnd(); it++) {
+        for (auto it=_triggersState.motionTriggerBegin(); it!=_triggersState.motionTriggerEnd(); it++) {
             const _Triggers::MotionTrigger& trigger = *it;
             const _Triggers::CaptureImageEvent& ev = trigger;
             if (trigger.enabled() && !ev.countRem) return true;
@@ -378,7 +430,7 @@ struct Simulator {
     void _buttonStimulus() {
         if (!_live) return;
 //        _printTime(); printf("Button stimulus\n");
-        for (auto it=_Triggers::ButtonTriggerBegin(); it!=_Triggers::ButtonTriggerEnd(); it++) {
+        for (auto it=_triggersState.buttonTriggerBegin(); it!=_triggersState.buttonTriggerEnd(); it++) {
 //            _printTime(); printf("Button trigger\n");
             _captureStart(*it, _time);
         }
@@ -389,7 +441,7 @@ struct Simulator {
         if (_buttonStimulusEvent.scheduled()) return false;
         // Check if there are any button triggers that for which
         // captures aren't currently underway (ev.countRem==0)
-        for (auto it=_Triggers::ButtonTriggerBegin(); it!=_Triggers::ButtonTriggerEnd(); it++) {
+        for (auto it=_triggersState.buttonTriggerBegin(); it!=_triggersState.buttonTriggerEnd(); it++) {
             const _Triggers::ButtonTrigger& trigger = *it;
             const _Triggers::CaptureImageEvent& ev = trigger;
             if (!ev.countRem) return true;
@@ -404,7 +456,7 @@ struct Simulator {
     }
     
     void _timeTrigger(_Triggers::TimeTriggerEvent& ev) {
-        _Triggers::TimeTrigger& trigger = ev.trigger();
+        _Triggers::TimeTrigger& trigger = _triggersState.trigger(ev);
         if (_live) {
             _captureStart(trigger, ev.time);
         }
@@ -412,13 +464,13 @@ struct Simulator {
     }
     
     void _motionEnable(_Triggers::MotionEnableEvent& ev) {
-        _Triggers::MotionTrigger& trigger = ev.trigger();
-        trigger.enable();
+        _Triggers::MotionTrigger& trigger = _triggersState.trigger(ev);
+        trigger.enable(_triggersState.base(trigger).count);
         
         // Schedule the MotionDisableEvent, if applicable.
         // This needs to happen before we reschedule `ev` because we need its .time to
         // properly schedule the MotionDisableEvent!
-        const uint32_t durationTicks = trigger.base().durationTicks;
+        const uint32_t durationTicks = _triggersState.base(trigger).durationTicks;
         if (durationTicks) {
             _eventInsert(static_cast<_Triggers::MotionDisableEvent&>(trigger), ev.time+durationTicks);
         }
@@ -449,7 +501,7 @@ struct Simulator {
 //        auto tp = Time::Clock::TimePointFromTimeInstant(_time);
 //        auto tp = Time::Clock::to_sys(Time::Clock::TimePointFromTimeInstant(_time));
         
-        _batteryLevel -= _imageCaptureCost();
+        _energyConsume(_captureEnergy[(bool)ev.capture->ledFlash]);
         
         ev.countRem--;
         if (ev.countRem) {
@@ -457,6 +509,29 @@ struct Simulator {
         }
     }
     
+    // _idle(): consume the energy drawn continuously (sleep current, powered motion sensors)
+    // between _time and `time`
+    void _idle(Time::Instant time) {
+        // DST adjustments can move events backwards in time, in which case there's nothing to consume
+        if (time <= _time) return;
+        
+        bool motionPowered = false;
+        for (auto it=_triggersState.motionTriggerBegin(); it!=_triggersState.motionTriggerEnd(); it++) {
+            motionPowered |= it->powered;
+        }
+        
+        const double sec = std::chrono::duration<double>(Time::Clock::DurationFromTicks(time-_time)).count();
+        _energyConsume(PowerModel::EnergyForUsage(_params.costs,
+            PowerModel::SleepUsage(sec, (motionPowered ? sec : 0))));
+    }
+    
+    void _energyConsume(const PowerModel::Energy& x) {
+        const double cost = x.total() / _params.batteryEnergy;
+        _batteryLevel -= cost;
+        _batteryTransform.b += cost;
+        _energy += x;
+    }
+    
     void _dst(_Triggers::DSTEvent& ev) {
 //        printf("DSTEvent @ %s\n", Calendar::TimestampString(_time).c_str());
         
@@ -464,9 +539,9 @@ struct Simulator {
         // because we need to adjust the DSTEvent's time too.
         _eventInsert(ev);
         
-        const Time::TicksS32 adj = ev.base().adjustmentTicks;
-        _Triggers::Event* x = _Triggers::EventBegin();
-        while (x != _Triggers::EventEnd()) {
+        const Time::TicksS32 adj = _triggersState.base(ev).adjustmentTicks;
+        _Triggers::Event* x = _triggersState.eventBegin();
+        while (x != _triggersState.eventEnd()) {
 //            if (x->type != _Triggers::Event::Type::DST) {
             x->time = x->time+adj;
             x = x->next;
@@ -507,6 +582,189 @@ struct Simulator {
         }
     }
     
+    // _BatteryTransform: the effect of a span of simulated time on the battery level, which is
+    // always affine since the battery only ever self-discharges (multiply) or captures (subtract):
+    //   level' = a*level - b
+    struct _BatteryTransform {
+        double a = 1;
+        double b = 0;
+        
+        // then(): returns the transform that applies `this` followed by `x`
+        _BatteryTransform then(const _BatteryTransform& x) const {
+            return { .a = x.a*a, .b = x.a*b + x.b };
+        }
+    };
+    
+    // _Snapshot: the simulator's state at a given time, used to detect when the simulation
+    // has started repeating itself
+    struct _Snapshot {
+        Time::Instant time = 0;
+        // events: the event list, in order
+        std::vector<std::pair<const _Triggers::Event*, Time::Instant>> events;
+        // state: the trigger state that isn't captured by `events`
+        std::vector<uint8_t> state;
+        // battery: the battery transform from the previous snapshot to this one
+        _BatteryTransform battery;
+        // energy: the cumulative energy consumed as of this snapshot
+        PowerModel::Energy energy;
+    };
+    
+    // _SnapshotCountMax: the number of daily snapshots we keep, which determines the longest
+    // period that we can detect (a week, to handle weekly schedules)
+    static constexpr size_t _SnapshotCountMax = 7;
+    
+    template<typename T>
+    static void _StatePush(std::vector<uint8_t>& state, const T& x) {
+        const uint8_t* b = (const uint8_t*)&x;
+        state.insert(state.end(), b, b+sizeof(x));
+    }
+    
+    _Snapshot _snapshotCreate() {
+        _Snapshot snap = {
+            .time = _time,
+            .battery = _batteryTransform,
+            .energy = _energy,
+        };
+        
+        for (const _Triggers::Event* ev=_triggersState.eventBegin(); ev!=_triggersState.eventEnd(); ev=ev->next) {
+            snap.events.emplace_back(ev, ev->time);
+        }
+        
+        for (auto it=_triggersState.repeatEventBegin(); it!=_triggersState.repeatEventEnd(); it++) {
+            _StatePush(snap.state, it->repeat);
+        }
+        for (auto it=_triggersState.timeTriggerBegin(); it!=_triggersState.timeTriggerEnd(); it++) {
+            _StatePush(snap.state, it->countRem);
+        }
+        for (auto it=_triggersState.motionTriggerBegin(); it!=_triggersState.motionTriggerEnd(); it++) {
+            _StatePush(snap.state, static_cast<const _Triggers::CaptureImageEvent&>(*it).countRem);
+            _StatePush(snap.state, it->state);
+            _StatePush(snap.state, it->powered);
+            _StatePush(snap.state, it->countRem);
+        }
+        for (auto it=_triggersState.buttonTriggerBegin(); it!=_triggersState.buttonTriggerEnd(); it++) {
+            _StatePush(snap.state, it->countRem);
+        }
+        for (auto it=_triggersState.dstEventBegin(); it!=_triggersState.dstEventEnd(); it++) {
+            _StatePush(snap.state, it->phase);
+        }
+        return snap;
+    }
+    
+    // _periodic(): returns whether the simulation at `s1` is in the same state as at `s0`, modulo
+    // the time that elapsed between them. If so, every subsequent span of time of that length
+    // behaves identically, until one of the events in `fixed` fires.
+    //
+    // `fixed` is populated with the events that are scheduled at the same absolute time in both
+    // snapshots (ie events that haven't fired during the period, like DST events and yearly
+    // repeats), which therefore bound how far we can fast-forward.
+    bool _periodic(const _Snapshot& s0, const _Snapshot& s1, std::vector<const _Triggers::Event*>& fixed) const {
+        const Time::TicksU64 period = s1.time-s0.time;
+        
+        // The stimuluses occur at multiples of their intervals in absolute time (see _NextInterval()),
+        // so the period must be a multiple of their intervals for them to repeat identically
+        if (period % Time::Clock::TicksFromDuration(_consts.motionStimulusInterval)) return false;
+        if (period % Time::Clock::TicksFromDuration(_consts.buttonStimulusInterval)) return false;
+        
+        if (s0.state != s1.state) return false;
+        if (s0.events.size() != s1.events.size()) return false;
+        
+        // Find the fixed events
+        fixed.clear();
+        for (const auto& x : s1.events) {
+            if (x.second>s1.time && std::find(s0.events.begin(), s0.events.end(), x)!=s0.events.end()) {
+                fixed.push_back(x.first);
+            }
+        }
+        
+        // Verify that the remaining events are scheduled identically relative to each
+        // snapshot's time, in the same order
+        const auto isFixed = [&] (const auto& x) {
+            return std::find(fixed.begin(), fixed.end(), x.first) != fixed.end();
+        };
+        auto it0 = s0.events.begin();
+        auto it1 = s1.events.begin();
+        for (;;) {
+            while (it0!=s0.events.end() && isFixed(*it0)) it0++;
+            while (it1!=s1.events.end() && isFixed(*it1)) it1++;
+            if (it0==s0.events.end() || it1==s1.events.end()) {
+                return it0==s0.events.end() && it1==s1.events.end();
+            }
+            if (it0->first != it1->first) return false;
+            if (it1->second-it0->second != period) return false;
+            it0++;
+            it1++;
+        }
+    }
+    
+    // _fastForward(): if the simulation is repeating itself with a period of N days, skip ahead
+    // by as many periods as possible by applying each period's aggregate effect on the battery,
+    // instead of simulating every event.
+    //
+    // We stop short of any period in which a fixed event (eg DST, a yearly trigger) would fire,
+    // or in which the battery would die, and resume simulating normally from there.
+    void _fastForward(std::vector<Point>& points, Time::Instant timeStart) {
+        if (!_consts.fastForward || !_live) return;
+        
+        _Snapshot snap = _snapshotCreate();
+        _batteryTransform = {};
+        
+        std::vector<const _Triggers::Event*> fixed;
+        for (size_t k=1; k<=_snapshots.size(); k++) {
+            const _Snapshot& prev = _snapshots[_snapshots.size()-k];
+            if (!_periodic(prev, snap, fixed)) continue;
+            
+            // Determine the battery transform for one period
+            _BatteryTransform battery;
+            for (size_t i=_snapshots.size()-k+1; i<_snapshots.size(); i++) {
+                battery = battery.then(_snapshots[i].battery);
+            }
+            battery = battery.then(snap.battery);
+            
+            Time::Instant fence = std::numeric_limits<Time::Instant>::max();
+            for (const _Triggers::Event* ev : fixed) fence = std::min(fence, ev->time);
+            
+            const Time::TicksU64 period = snap.time-prev.time;
+            Time::Instant time = _time;
+            double level = _batteryLevel;
+            uint64_t count = 0;
+            for (;;) {
+                const double l = battery.a*level - battery.b;
+                if (time+period >= fence) break;
+                if (l < _BatteryEmptyLevel) break;
+                
+                time += period;
+                level = l;
+                count++;
+                
+                const std::chrono::seconds duration = _duration(timeStart, time);
+                points.push_back({
+                    .time = duration,
+                    .batteryLevel = std::max(0.f, _BatteryLevelNormalize(level)),
+                });
+                if (duration > Constants::BatteryLifeMax) break;
+            }
+            if (!count) break;
+            
+            // Shift every non-fixed event forward by the skipped time
+            const Time::TicksU64 delta = time-_time;
+            for (_Triggers::Event* ev=_triggersState.eventBegin(); ev!=_triggersState.eventEnd(); ev=ev->next) {
+                if (std::find(fixed.begin(), fixed.end(), ev) != fixed.end()) continue;
+                ev->time += delta;
+            }
+            
+            _time = time;
+            _batteryLevel = level;
+            _energy += (snap.energy-prev.energy) * count;
+            // Our snapshots are stale now
+            _snapshots.clear();
+            return;
+        }
+        
+        _snapshots.push_back(std::move(snap));
+        if (_snapshots.size() > _SnapshotCountMax) _snapshots.pop_front();
+    }
+    
     void _printTime() {
         const date::time_zone& tz = *date::current_zone();
         const auto tp = tz.to_local(date::clock_cast<std::chrono::system_clock>(
@@ -522,10 +780,6 @@ struct Simulator {
         std::cout << " ] ";
     }
     
-    float _imageCaptureCost() const {
-        return 1.f / _params.batteryImageCaptureCapacity;
-    }
-    
 //    static constexpr date::days _BatteryLifeDurationMin = date::days(1);
 //    static constexpr date::days _BatteryLifeDurationMax = date::days(365*3);
     
@@ -536,10 +790,46 @@ struct Simulator {
     const Constants _consts;
     const Parameters _params;
     const MSP::Triggers _triggers;
+    _Triggers _triggersState;
+    // _captureEnergy: energy of a single capture, indexed by ledFlash
+    PowerModel::Energy _captureEnergy[2];
     
     Time::Instant _time = 0;
     bool _live = false;
-    float _batteryLevel = 0;
+    // _batteryLevel: double since it accumulates many tiny capture costs
+    double _batteryLevel = 0;
+    _BatteryTransform _batteryTransform;
+    PowerModel::Energy _energy;
+    std::deque<_Snapshot> _snapshots;
+};
+
+struct Result {
+    std::vector<Point> points;
+    // energy: the energy consumed over the battery's life, by category
+    PowerModel::Energy energy;
 };
 
+// Simulate(): simulate each element of `params` concurrently on the global dispatch queues,
+// returning the results in the same order as `params`.
+// Blocks until every simulation completes; returns an empty vector if `cancel` becomes true.
+inline std::vector<Result> Simulate(const Constants& consts,
+    const std::vector<Parameters>& params, const MSP::Triggers& triggers,
+    const std::atomic<bool>* cancel=nullptr) {
+    
+    std::vector<Result> results(params.size());
+    // Capture pointers since blocks capture C++ objects by const copy
+    const Constants* c = &consts;
+    const Parameters* p = params.data();
+    const MSP::Triggers* t = &triggers;
+    Result* r = results.data();
+    dispatch_apply(params.size(), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        Simulator sim(*c, p[i], *t);
+        r[i].points = sim.simulate(cancel);
+        r[i].energy = sim.energy();
+    });
+    
+    if (cancel && cancel->load()) return {};
+    return results;
+}
+
 } // namespace MDCStudio::BatteryLifeSimulator
@@ -1,5 +1,6 @@
 #import <Cocoa/Cocoa.h>
 #import <chrono>
+#import <optional>
 #import "Code/Shared/MSP.h"
 @class BatteryLifeView;
 
@@ -21,5 +22,8 @@ struct BatteryLifeEstimate {
 - (instancetype)initWithFrame:(NSRect)frame;
 - (void)setDelegate:(id<BatteryLifeViewDelegate>)delegate;
 - (void)setTriggers:(const MSP::Triggers&)triggers;
-- (BatteryLifeViewTypes::BatteryLifeEstimate)batteryLifeEstimate;
+// batteryLifeEstimate: returns nullopt while a simulation of the current triggers is underway,
+// ie until its result arrives. The delegate is notified via -batteryLifeViewChanged: whenever a
+// new estimate is available.
+- (std::optional<BatteryLifeViewTypes::BatteryLifeEstimate>)batteryLifeEstimate;
 @end
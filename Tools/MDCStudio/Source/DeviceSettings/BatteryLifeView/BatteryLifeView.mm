@@ -38,6 +38,7 @@ namespace DS = DeviceSettings;
     bool _storeLoadUnderway;
     MSP::Triggers _triggers;
     std::optional<T::BatteryLifeEstimate> _estimate;
+    std::shared_ptr<std::atomic<bool>> _simulateCancel;
 }
 
 static float _StimulusIntervalClamp(float x) {
@@ -106,6 +107,11 @@ static void _ButtonStimulusInterval(const DS::Duration& x) {
     return self;
 }
 
+- (void)dealloc {
+    // Stop our in-flight simulation, if any
+    if (_simulateCancel) *_simulateCancel = true;
+}
+
 template<bool T_Forward>
 static void _Copy(DS::Duration& x, NSTextField* field, NSPopUpButton* menu) {
     using X = std::remove_reference_t<decltype(x)>;
@@ -168,7 +174,6 @@ static void _StoreLoad(BatteryLifeView* self) {
 - (IBAction)_actionViewChanged:(id)sender {
     _StoreLoad(self);
     [self _update];
-    [_delegate batteryLifeViewChanged:self];
 }
 
 //- (void)cancelOperation:(id)sender {
@@ -182,19 +187,16 @@ static void _StoreLoad(BatteryLifeView* self) {
 - (void)setTriggers:(const MSP::Triggers&)triggers {
     _triggers = triggers;
     [self _update];
-    [_delegate batteryLifeViewChanged:self];
 }
 
-- (T::BatteryLifeEstimate)batteryLifeEstimate {
-    [self _updateIfNeeded];
-    return *_estimate;
+- (std::optional<T::BatteryLifeEstimate>)batteryLifeEstimate {
+    return _estimate;
 }
 
 - (void)_prefsChanged {
     if (_storeLoadUnderway) return;
     _Load(self);
     [self _update];
-    [_delegate batteryLifeViewChanged:self];
 }
 
 - (void)_update {
@@ -203,13 +205,61 @@ static void _StoreLoad(BatteryLifeView* self) {
         .buttonStimulusInterval = SecondsFromDuration(_ButtonStimulusInterval()),
     };
     
-    MDCStudio::BatteryLifeSimulator::Simulator simMin(
-        constants, MDCStudio::BatteryLifeSimulator::WorstCase, _triggers);
-    MDCStudio::BatteryLifeSimulator::Simulator simMax(
-        constants, MDCStudio::BatteryLifeSimulator::BestCase, _triggers);
+    // Cancel the previous simulation, since its results are stale, and clear the estimate
+    // since it no longer reflects our triggers
+    if (_simulateCancel) *_simulateCancel = true;
+    _estimate = std::nullopt;
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    _simulateCancel = cancel;
     
-    const auto pointsMin = simMin.simulate();
-    const auto pointsMax = simMax.simulate();
+    // Simulate the worst/best cases concurrently off the main thread, and publish the
+    // results on the main thread, unless another simulation was started in the meantime.
+    const MSP::Triggers triggers = _triggers;
+    __weak auto selfWeak = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        __block auto results = MDCStudio::BatteryLifeSimulator::Simulate(constants, {
+            MDCStudio::BatteryLifeSimulator::WorstCase,
+            MDCStudio::BatteryLifeSimulator::BestCase,
+        }, triggers, cancel.get());
+        if (results.empty()) return;
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            // Only consult `cancel` on the main thread, so that it can't be set between
+            // our check and applying the results
+            if (*cancel) return;
+            [selfWeak _updateResultMin:results[0] max:results[1]];
+        });
+    });
+}
+
+// _EnergyString(): describes where the energy goes, as the percentage of the total that
+// each category consumes
+static NSString* _EnergyString(const PowerModel::Energy& x) {
+    const double total = x.total();
+    if (total <= 0) return nil;
+    const std::pair<const char*, double> categories[] = {
+        {"SD card",          x.sd},
+        {"Image capture",    x.capture},
+        {"Image sensor",     x.sensor},
+        {"FPGA",             x.ice40},
+        {"Motion sensor",    x.motion},
+        {"Sleep",            x.sleep},
+        {"LED",              x.led},
+        {"Battery sampling", x.battery},
+        {"Wakeups",          x.wakeup},
+    };
+    NSMutableString* r = [NSMutableString stringWithString:@"Energy usage:"];
+    for (const auto& [name, energy] : categories) {
+        [r appendFormat:@"\n  %s: %.1f%%", name, 100*energy/total];
+    }
+    return r;
+}
+
+- (void)_updateResultMin:(const MDCStudio::BatteryLifeSimulator::Result&)min
+    max:(const MDCStudio::BatteryLifeSimulator::Result&)max {
+    
+    const std::vector<MDCStudio::BatteryLifeSimulator::Point>& pointsMin = min.points;
+    const std::vector<MDCStudio::BatteryLifeSimulator::Point>& pointsMax = max.points;
     assert(!pointsMin.empty());
     assert(!pointsMax.empty());
     
@@ -233,6 +283,11 @@ static void _StoreLoad(BatteryLifeView* self) {
     [_batteryLifeMaxDurationLabel setStringValue:@(DeviceSettings::StringForDuration(_estimate->max).c_str())];
     [_batteryLifeSingularDurationLabel setStringValue:@(DeviceSettings::StringForDuration(_estimate->max).c_str())];
     
+    // Show where the energy goes when hovering over the duration labels
+    [_batteryLifeMinDurationLabel setToolTip:_EnergyString(min.energy)];
+    [_batteryLifeMaxDurationLabel setToolTip:_EnergyString(max.energy)];
+    [_batteryLifeSingularDurationLabel setToolTip:_EnergyString(max.energy)];
+    
     // Update date labels
     {
         using namespace std::chrono;
@@ -259,11 +314,8 @@ static void _StoreLoad(BatteryLifeView* self) {
     [_legendSingularView setHidden:!singular];
     [_batteryLifeMinDateLine setHidden:singular];
     [_batteryLifeMinDateLabel setHidden:singular];
-}
-
-- (void)_updateIfNeeded {
-    if (_estimate) return;
-    [self _update];
+    
+    [_delegate batteryLifeViewChanged:self];
 }
 
 @end
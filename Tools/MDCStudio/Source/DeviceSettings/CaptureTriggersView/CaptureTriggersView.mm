@@ -725,9 +725,12 @@ static void _ListItemRemove(CaptureTriggersView* self, size_t idx) {
 }
 
 - (void)_updateBatteryLifeTitle {
+    // The estimate is computed asynchronously; keep our current title until it's available,
+    // at which point we'll be called again via -batteryLifeViewChanged:
     const auto estimate = [_batteryLifeView batteryLifeEstimate];
+    if (!estimate) return;
     [_batteryLifeButton setTitle:[NSString stringWithFormat:@"  %@",
-        @(StringForDurationRange(estimate.min, estimate.max).c_str())]];
+        @(StringForDurationRange(estimate->min, estimate->max).c_str())]];
 }
 
 - (const MSP::Triggers&)triggers {
@@ -0,0 +1,254 @@
+#pragma once
+#include <filesystem>
+#include <array>
+#include <list>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <cstring>
+#include <cassert>
+#include "Code/Lib/Toastbox/FileDescriptor.h"
+#include "Code/Lib/Toastbox/RuntimeError.h"
+#include "Code/Shared/ChecksumFletcher32.h"
+
+namespace MDCStudio {
+
+// DiskCache: a persistent, size-bounded cache of blobs, keyed by (Namespace, id)
+//
+// Each blob is stored in its own file, preceded by a header containing the blob's key, length and
+// Fletcher-32 checksum. read() validates all three, so blobs that were torn (eg by a crash while
+// writing) or corrupted are treated as misses and deleted.
+//
+// When the total size of the cache exceeds `cap`, the least-recently-used blobs are deleted.
+// Recency is persisted via the files' modification times, so it survives restarts.
+struct DiskCache {
+    using Path = std::filesystem::path;
+    using Namespace = std::array<uint8_t,16>;
+    
+    struct Key {
+        Namespace ns = {};
+        uint64_t id = 0;
+    };
+    
+    DiskCache(const Path& dir, uint64_t cap) : _dir(dir), _cap(cap) {
+        namespace fs = std::filesystem;
+        fs::create_directories(_dir);
+        
+        // Populate our LRU from the existing files, most-recently-used first
+        struct File {
+            std::string name;
+            uint64_t len = 0;
+            struct timespec mtime = {};
+        };
+        
+        std::vector<File> files;
+        for (const fs::directory_entry& e : fs::directory_iterator(_dir)) {
+            const std::string name = e.path().filename().string();
+            if (name.at(0) == '.') continue;
+            
+            // Delete temporary files left by a write() that didn't complete
+            if (e.path().extension() == _TmpExtension) {
+                std::error_code ec;
+                fs::remove(e.path(), ec);
+                continue;
+            }
+            
+            struct stat st;
+            const int ir = stat(e.path().c_str(), &st);
+            if (ir) continue;
+            files.push_back({ .name=name, .len=(uint64_t)st.st_size, .mtime=st.st_mtimespec });
+        }
+        
+        std::sort(files.begin(), files.end(), [] (const File& a, const File& b) {
+            if (a.mtime.tv_sec != b.mtime.tv_sec) return a.mtime.tv_sec > b.mtime.tv_sec;
+            return a.mtime.tv_nsec > b.mtime.tv_nsec;
+        });
+        
+        auto lock = std::unique_lock(_lock);
+        for (const File& f : files) {
+            _entryAdd(lock, f.name, f.len);
+        }
+        _evict(lock);
+        
+        printf("[DiskCache] %s: %ju entries, %.1f MiB\n", _dir.c_str(), (uintmax_t)_entries.size(),
+            (double)_len/(1024*1024));
+    }
+    
+    // read(): reads the blob for `key` into `dst`, which must be `len` bytes
+    // Returns whether the blob existed and was valid.
+    bool read(const Key& key, void* dst, size_t len) {
+        const std::string name = _Name(key);
+        {
+            auto lock = std::unique_lock(_lock);
+            const auto find = _entries.find(name);
+            if (find == _entries.end()) return false;
+            // Move the entry to the front of the LRU
+            _lru.splice(_lru.begin(), _lru, find->second);
+        }
+        
+        const Path path = _dir / name;
+        try {
+            const int fdi = open(path.c_str(), O_RDONLY|O_CLOEXEC);
+            if (fdi < 0) throw Toastbox::RuntimeError("open failed: %s", strerror(errno));
+            const Toastbox::FileDescriptor fd(fdi);
+            
+            _SerializedHeader header;
+            struct iovec iov[] = {
+                { .iov_base=&header, .iov_len=sizeof(header) },
+                { .iov_base=dst, .iov_len=len },
+            };
+            const ssize_t sr = readv(fd, iov, std::size(iov));
+            if (sr < 0) throw Toastbox::RuntimeError("readv failed: %s", strerror(errno));
+            if ((size_t)sr != sizeof(header)+len) throw Toastbox::RuntimeError("short read");
+            if (header.version != _Version) throw Toastbox::RuntimeError("invalid version");
+            if (header.len != len) throw Toastbox::RuntimeError("invalid length");
+            const Namespace ns = header.ns;
+            if (ns!=key.ns || header.id!=key.id) throw Toastbox::RuntimeError("invalid key");
+            if (header.checksum != ChecksumFletcher32(dst, len)) throw Toastbox::RuntimeError("invalid checksum");
+            
+            // Update the file's modification time, so that its recency persists across launches
+            futimens(fd, nullptr);
+            return true;
+            
+        } catch (const std::exception& e) {
+            printf("[DiskCache] Removing invalid entry %s: %s\n", name.c_str(), e.what());
+            _remove(name);
+            return false;
+        }
+    }
+    
+    // write(): writes the blob for `key`, evicting the least-recently-used blobs as needed
+    // `len` must be even (a requirement of ChecksumFletcher32).
+    void write(const Key& key, const void* src, size_t len) {
+        if (len % 2) throw Toastbox::RuntimeError("invalid length: %ju", (uintmax_t)len);
+        const std::string name = _Name(key);
+        const Path path = _dir / name;
+        const Path pathTmp = _dir / (name + _TmpExtension);
+        
+        const _SerializedHeader header = {
+            .version = _Version,
+            .len = (uint32_t)len,
+            .ns = key.ns,
+            .id = key.id,
+            .checksum = ChecksumFletcher32(src, len),
+        };
+        
+        // Write to a temporary file and then rename it, so a reader never observes a partial blob
+        {
+            const int fdi = open(pathTmp.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+            if (fdi < 0) throw Toastbox::RuntimeError("open failed: %s", strerror(errno));
+            const Toastbox::FileDescriptor fd(fdi);
+            
+            struct iovec iov[] = {
+                { .iov_base=(void*)&header, .iov_len=sizeof(header) },
+                { .iov_base=(void*)src, .iov_len=len },
+            };
+            const ssize_t sw = writev(fd, iov, std::size(iov));
+            if (sw < 0) throw Toastbox::RuntimeError("writev failed: %s", strerror(errno));
+            if ((size_t)sw != sizeof(header)+len) throw Toastbox::RuntimeError("short write");
+        }
+        
+        std::filesystem::rename(pathTmp, path);
+        
+        auto lock = std::unique_lock(_lock);
+        _entryAdd(lock, name, sizeof(header)+len);
+        _evict(lock);
+    }
+    
+    // clear(): removes every blob from the cache
+    void clear() {
+        std::vector<std::string> names;
+        {
+            auto lock = std::unique_lock(_lock);
+            for (const _Entry& e : _lru) names.push_back(e.name);
+            _lru.clear();
+            _entries.clear();
+            _len = 0;
+        }
+        
+        for (const std::string& name : names) {
+            std::error_code ec;
+            std::filesystem::remove(_dir / name, ec);
+        }
+    }
+    
+    struct [[gnu::packed]] _SerializedHeader {
+        uint32_t version = 0;
+        uint32_t len = 0;
+        Namespace ns = {};
+        uint64_t id = 0;
+        uint32_t checksum = 0;
+        uint32_t _pad = 0;
+    };
+    
+    struct _Entry {
+        std::string name;
+        uint64_t len = 0;
+    };
+    
+    using _LRU = std::list<_Entry>;
+    
+    static constexpr uint32_t _Version = 0;
+    static constexpr const char* _TmpExtension = ".tmp";
+    
+    static std::string _Name(const Key& key) {
+        char name[64];
+        char* p = name;
+        for (uint8_t x : key.ns) p += snprintf(p, 3, "%02x", x);
+        snprintf(p, sizeof(name)-(p-name), "-%ju", (uintmax_t)key.id);
+        return name;
+    }
+    
+    void _entryAdd(const std::unique_lock<std::mutex>& lock, const std::string& name, uint64_t len) {
+        assert(lock);
+        if (auto find=_entries.find(name); find!=_entries.end()) {
+            _len -= find->second->len;
+            _lru.erase(find->second);
+            _entries.erase(find);
+        }
+        
+        _lru.push_front({ .name=name, .len=len });
+        _entries[name] = _lru.begin();
+        _len += len;
+    }
+    
+    void _evict(const std::unique_lock<std::mutex>& lock) {
+        assert(lock);
+        while (_len>_cap && !_lru.empty()) {
+            const _Entry& e = _lru.back();
+            std::error_code ec;
+            std::filesystem::remove(_dir / e.name, ec);
+            _len -= e.len;
+            _entries.erase(e.name);
+            _lru.pop_back();
+        }
+    }
+    
+    void _remove(const std::string& name) {
+        {
+            auto lock = std::unique_lock(_lock);
+            const auto find = _entries.find(name);
+            if (find == _entries.end()) return;
+            _len -= find->second->len;
+            _lru.erase(find->second);
+            _entries.erase(find);
+        }
+        std::error_code ec;
+        std::filesystem::remove(_dir / name, ec);
+    }
+    
+    const Path _dir;
+    const uint64_t _cap = 0;
+    std::mutex _lock; // Protects the following
+    _LRU _lru; // Front: most recently used
+    std::unordered_map<std::string,_LRU::iterator> _entries;
+    uint64_t _len = 0;
+};
+    
+} // namespace MDCStudio
@@ -57,7 +57,7 @@ public:
     using TmpStorage = std::array<uint8_t, TmpStorageLen>;
     
     static void ThumbRender(Toastbox::Renderer& renderer, MTKTextureLoader* txtLoader,
-        ThumbCompressor& compressor, TmpStorage& tmpStorage, NSURL* url, ImageRecord& rec) {
+        ThumbCompressor& compressor, TmpStorage& tmpStorage, NSURL* url, ImageRecord& rec, ImageThumb& thumb) {
         
         using namespace MDCStudio;
                 using namespace ImagePipeline;
@@ -121,14 +121,14 @@ public:
             renderer.sync(txtRgba8);
         }
         
-        // Compress thumbnail, store in rec.thumb.data
+        // Compress thumbnail, store in thumb.data
         {
             renderer.commitAndWait();
             
             [txtRgba8 getBytes:tmpStorage.data() bytesPerRow:ImageThumb::ThumbWidth*4
                 fromRegion:MTLRegionMake2D(0,0,ImageThumb::ThumbWidth,ImageThumb::ThumbHeight) mipmapLevel:0];
             
-            compressor.encode(tmpStorage.data(), rec.thumb.data);
+            compressor.encode(tmpStorage.data(), thumb.data);
         }
     }
     
@@ -162,16 +162,17 @@ public:
                 _renderThumbs.recs.erase(it);
             }
             
-            // Render thumb to `rec.thumb`
+            // Render thumb to `rec.blob()`
             {
                 const std::filesystem::path ImagesDirPath = "/Users/dave/Desktop/Old/2022-1-26/TestImages-5k";
                 NSURL* url = [NSURL fileURLWithPath:[NSString stringWithFormat:@"%s/%012ju.jpg", ImagesDirPath.c_str(), (uintmax_t)rec->info.addrFull]];
-                ThumbRender(renderer, txtLoader, compressor, *tmpStorage, url, *rec);
+                ThumbRender(renderer, txtLoader, compressor, *tmpStorage, url, *rec, rec.blob());
                 rec->options.thumb.render = false;
             }
             
             // Notify image library that the image changed
             {
+                auto lock = std::unique_lock(*_imageLibrary);
                 _imageLibrary->observersNotify(ImageLibrary::Event::Type::ChangeProperty, { rec });
             }
         }
@@ -189,7 +190,7 @@ private:
         std::mutex lock; // Protects this struct
         std::condition_variable signal;
         std::thread thread;
-        std::set<ImageRecordPtr> recs;
+        ImageSet recs;
         bool stop = false;
     } _renderThumbs;
 };
@@ -165,7 +165,7 @@ static CGColorSpaceRef _LinearSRGBColorSpace() {
             const size_t h = ImageThumb::ThumbHeight;
             Renderer::Txt thumbTxt = _renderer.textureCreate(ImageThumb::PixelFormat, w, h);
             [thumbTxt replaceRegion:MTLRegionMake2D(0,0,w,h) mipmapLevel:0
-                slice:0 withBytes:_imageRecord->thumb.data bytesPerRow:w*4 bytesPerImage:0];
+                slice:0 withBytes:_imageRecord.blob().data bytesPerRow:w*4 bytesPerImage:0];
             
             _renderer.render(_image.txt, thumbTxt);
             if (!popts.timestamp.string.empty()) {
@@ -2,6 +2,7 @@
 #import <Metal/Metal.h>
 #import <MetalKit/MetalKit.h>
 #import <thread>
+#import <chrono>
 #import "ImageGridLayerTypes.h"
 #import "Util.h"
 #import "ImageThumb.h"
@@ -17,6 +18,14 @@ using namespace MDCStudio;
 static constexpr auto _ThumbWidth = ImageThumb::ThumbWidth;
 static constexpr auto _ThumbHeight = ImageThumb::ThumbHeight;
 
+// _ThumbPrefetchLookahead: how far ahead (in time, at the current scroll velocity) to prefetch thumbnails
+static constexpr double _ThumbPrefetchLookahead = 0.5; // Seconds
+static constexpr int32_t _ThumbPrefetchRowsMax = 16;
+// _ScrollVelocitySmoothing: weight of the newest sample in our exponentially-smoothed scroll velocity
+static constexpr double _ScrollVelocitySmoothing = 0.5;
+// _ScrollVelocityTimeout: displays further apart than this are considered separate scrolls
+static constexpr double _ScrollVelocityTimeout = 0.25; // Seconds
+
 @interface ImageGridLayer : AnchoredMetalDocumentLayer
 
 - (instancetype)initWithImageSource:(ImageSourcePtr)imageSource
@@ -67,6 +76,13 @@ using _ChunkTextures = Toastbox::LRU<ImageLibrary::ChunkStrongRef,_ChunkTexture,
         size_t count = 0;
         id<MTLBuffer> buf;
     } _selectionDraw;
+    
+    struct {
+        std::chrono::steady_clock::time_point time;
+        int32_t y = 0; // Grid coordinates
+        double velocity = 0; // Grid coordinates per second; positive when scrolling towards the end
+        std::vector<ImageRecordPtr> prefetch; // Records most recently supplied to prefetchThumbs()
+    } _scroll;
 }
 
 static CGColorSpaceRef _LinearSRGBColorSpace() {
@@ -221,7 +237,7 @@ static void _ChunkTextureUpdateSlice(_ChunkTexture& ct, const ImageLibrary::Reco
     const uint32_t loadCount = ref->status.loadCount;
     if (loadCount != ct.loadCounts[ref.idx]) {
 //        printf("Update slice\n");
-        const uint8_t* b = ref.chunk->mmap.data() + ref.idx*sizeof(ImageRecord) + offsetof(ImageRecord, thumb.data);
+        const uint8_t* b = (const uint8_t*)ref.blob().data;
         [ct.txt replaceRegion:MTLRegionMake2D(0,0,ImageThumb::ThumbWidth,ImageThumb::ThumbHeight) mipmapLevel:0
             slice:ref.idx withBytes:b bytesPerRow:ImageThumb::ThumbWidth*4 bytesPerImage:0];
         
@@ -380,6 +396,8 @@ static MTLTextureDescriptor* _TextureDescriptor() {
     
     // Re-render the visible thumbnails that are marked dirty
     _ThumbRenderIfNeeded(_imageSource, { visibleBegin, visibleEnd });
+    // Prefetch the dirty thumbnails that we're likely to scroll to next
+    [self _thumbPrefetch:visibleIndexRange];
 }
 
 - (void)display {
@@ -579,7 +597,7 @@ static _IterRange _VisibleRange(Toastbox::Grid::IndexRange ir, const ImageLibrar
 }
 
 static void _ThumbRenderIfNeeded(ImageSourcePtr is, _IterRange range) {
-    std::set<ImageRecordPtr> recs;
+    ImageSet recs;
     for (auto it=range.first; it!=range.second; it++) {
         if ((*it)->options.thumb.render) {
             recs.insert(*it);
@@ -595,6 +613,60 @@ static void _ThumbRenderIfNeeded(ImageSourcePtr is, _IterRange range) {
     _ThumbRenderIfNeeded(_imageSource, vr);
 }
 
+// _thumbPrefetch: supplies the dirty thumbnails that are adjacent to the visible range to
+// ImageSource::prefetchThumbs(). We prefetch more rows in the direction that we're scrolling
+// the faster we're scrolling, and one row in the opposite direction.
+// _imageLibrary must be locked!
+- (void)_thumbPrefetch:(Toastbox::Grid::IndexRange)vir {
+    using namespace std::chrono;
+    
+    // Update our scroll velocity estimate
+    {
+        const auto now = steady_clock::now();
+        const int32_t y = _GridRectFromCGRect([self frame], [self contentsScale]).point.y;
+        const double dt = duration<double>(now-_scroll.time).count();
+        if (dt < _ScrollVelocityTimeout) {
+            if (dt > 0) {
+                const double v = (y-_scroll.y) / dt;
+                _scroll.velocity = _ScrollVelocitySmoothing*v + (1-_ScrollVelocitySmoothing)*_scroll.velocity;
+            }
+        } else {
+            _scroll.velocity = 0;
+        }
+        _scroll.time = now;
+        _scroll.y = y;
+    }
+    
+    const int64_t colCount = _grid.columnCount();
+    const int64_t rowPitch = _grid.rectForCellIndex((int32_t)colCount).point.y - _grid.rectForCellIndex(0).point.y;
+    if (colCount<=0 || rowPitch<=0) return;
+    
+    const int64_t rowsAhead = std::clamp((int64_t)lround(std::abs(_scroll.velocity)*_ThumbPrefetchLookahead/rowPitch),
+        (int64_t)1, (int64_t)_ThumbPrefetchRowsMax);
+    const bool forward = (_scroll.velocity >= 0);
+    
+    const int64_t recordCount = (int64_t)_imageLibrary->recordCount();
+    const int64_t visibleBegin = vir.start;
+    const int64_t visibleEnd = (int64_t)vir.start + (int64_t)vir.count;
+    const auto begin = ImageLibrary::BeginSorted(*_imageLibrary, _sortNewestFirst);
+    
+    std::vector<ImageRecordPtr> prefetch;
+    const auto collect = [&] (int64_t idx) {
+        if (idx<0 || idx>=recordCount) return;
+        const ImageRecordPtr rec = *(begin+idx);
+        if (rec->options.thumb.render) prefetch.push_back(rec);
+    };
+    
+    // Collect in order of distance from the visible range: ahead first, then behind
+    for (int64_t i=0; i<rowsAhead*colCount; i++) collect(forward ? visibleEnd+i : visibleBegin-1-i);
+    for (int64_t i=0; i<colCount; i++) collect(forward ? visibleBegin-1-i : visibleEnd+i);
+    
+    // Short-circuit if nothing changed, which is the common case when we're not scrolling
+    if (prefetch == _scroll.prefetch) return;
+    _scroll.prefetch = prefetch;
+    _imageSource->prefetchThumbs(std::move(prefetch));
+}
+
 // _imageLibrary must be locked!
 - (bool)_recordsIntersectVisibleRange:(const ImageSet&)changed {
     if (changed.empty()) return false;
@@ -50,27 +50,36 @@ struct [[gnu::packed]] ImageStatus {
 
 static_assert(!(sizeof(ImageStatus) % 8)); // Ensure that ImageStatus is a multiple of 8 bytes
 
+// ImageRecord: the metadata for an image
+// The image's thumbnail (ImageThumb) is stored separately, as the record's blob (RecordRef::blob()),
+// so that scanning the metadata of many images doesn't need to touch their thumbnails.
 struct [[gnu::packed]] ImageRecord {
-    static constexpr uint32_t Version = 0;
+    static constexpr uint32_t Version = 1;
     
     ImageInfo info;
     ImageStatus status;
     ImageOptions options;
-    
-    // _pad: necessary for our thumbnail compression to keep our `thumb` member aligned
-    // to a 16-byte boundary.
-    uint8_t _pad[8];
-    
-    ImageThumb thumb;
 };
 
 // Ensure that ImageRecord is a multiple of 8 bytes
 static_assert(!(sizeof(ImageRecord) % 8));
 
-// Ensure that the thumbnail is aligned to a 4-pixel boundary
-static_assert(!(offsetof(ImageRecord, thumb) % 16));
+// Ensure that consecutive thumbnails are aligned to a 4-pixel boundary
+static_assert(!(sizeof(ImageThumb) % 16));
 
-struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
+// _ImageRecordV0: the Version 0 ImageRecord, where the thumbnail was stored inline
+// Only used to migrate Version 0 libraries.
+struct [[gnu::packed]] _ImageRecordV0 {
+    static constexpr uint32_t Version = 0;
+    
+    ImageInfo info;
+    ImageStatus status;
+    ImageOptions options;
+    uint8_t _pad[8];
+    ImageThumb thumb;
+};
+
+struct ImageLibrary : Object, RecordStore<ImageRecord, 128, ImageThumb>, std::mutex {
     using RecordStore::RecordStore;
     using IterAny = Toastbox::IterAny<RecordRefConstIter>;
     
@@ -84,7 +93,7 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
         };
         
         Type type = Type::Add;
-        std::set<RecordStrongRef> records;
+        RecordSet records;
     };
     
     static IterAny BeginSorted(const ImageLibrary& lib, bool sortNewestFirst) {
@@ -97,18 +106,40 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
         else                 return lib.end();
     }
     
+    // unlock(): releases the library lock. Weak RecordRefs are only dereferenced with the lock
+    // held, so the chunk mappings that were evicted in the meantime can be unmapped now.
+    void unlock() {
+        RecordStore::reclaim();
+        std::mutex::unlock();
+    }
+    
     void read(RecordStore::Path path) {
         try {
-            std::ifstream f = RecordStore::read(path);
+            _MigrateV0(path);
+        } catch (const std::exception& e) {
+            printf("[ImageLibrary] Version 0 migration failed: %s\n", e.what());
+        }
+        
+        try {
+            std::istringstream f = RecordStore::read(path);
             _StateRead(f, _state);
         } catch (const std::exception& e) {
             printf("Recreating ImageLibrary; cause: %s\n", e.what());
         }
     }
     
-    void write() {
-        std::ofstream f = RecordStore::write();
+    // write(): writes the library to disk
+    // If `compact` is true and removals have left enough of the library's chunks unused, performs
+    // a bounded amount of thorough compaction (via RecordStore::compact()) before writing.
+    // Compaction forces RecordStore::write() to rewrite the whole Index rather than append to the
+    // Journal, so it's reserved for when there's a meaningful amount of space to reclaim.
+    void write(bool compact=false) {
+        if (compact && RecordStore::reclaimableCount()>=_CompactReclaimableMin(recordCount())) {
+            RecordStore::compact(_CompactRecordMoveMax);
+        }
+        std::ostringstream f;
         _StateWrite(f, _state);
+        RecordStore::write(f.str());
     }
     
     void add(size_t count) {
@@ -117,25 +148,21 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
         // Notify observers that we changed
         Event ev;
         ev.type = Event::Type::Add;
-        for (auto i=end()-count; i!=end(); i++) {
-            ev.records.insert(*i);
-        }
+        ev.records.insert(end()-count, end());
         Object::observersNotify(ev);
     }
     
     void remove(RecordRefConstIter begin, RecordRefConstIter end) {
         Event ev;
         ev.type = Event::Type::Remove;
-        for (auto i=begin; i!=end; i++) {
-            ev.records.insert(*i);
-        }
+        ev.records.insert(begin, end);
         
         RecordStore::remove(begin, end);
         // Notify observers that we changed
         Object::observersNotify(ev);
     }
     
-    void remove(const std::set<RecordStrongRef>& recs) {
+    void remove(const RecordSet& recs) {
         RecordStore::remove(recs);
         
         // Notify observers that we changed
@@ -159,6 +186,16 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
         return RecordStore::Find(begin(), end(), ref);
     }
     
+    // idLowerBound(): returns the first record whose image id is >= `id`
+    // This relies on the library being ordered by image id, which holds because images are always
+    // appended in the order that the device captured them.
+    RecordRefConstIter idLowerBound(Img::Id id) const {
+        return std::lower_bound(begin(), end(), 0,
+            [&](const RecordRef& sample, auto) -> bool {
+                return sample->info.id < id;
+            });
+    }
+    
     void imageIdEnd(Img::Id x) { _state.imageIdEnd = x; }
     Img::Id imageIdEnd() const { return _state.imageIdEnd; }
     
@@ -170,7 +207,7 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
         }
     }
     
-    void observersNotify(Event::Type type, std::set<RecordStrongRef> records) {
+    void observersNotify(Event::Type type, RecordSet records) {
         Event ev;
         ev.type = type;
         ev.records = std::move(records);
@@ -178,6 +215,15 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
     }
     
     static constexpr uint32_t _Version = 0;
+    // _CompactRecordMoveMax: max number of records moved by a single compaction pass, which bounds
+    // how long the library is locked while compacting
+    static constexpr size_t _CompactRecordMoveMax = 16*ChunkRecordCap;
+    
+    // _CompactReclaimableMin(): the number of unused record slots (see RecordStore::reclaimableCount())
+    // required before write() compacts: 1/8 of the library, and at least one compaction pass' worth
+    static size_t _CompactReclaimableMin(size_t recordCount) {
+        return std::max(recordCount/8, _CompactRecordMoveMax);
+    }
     
     struct [[gnu::packed]] _SerializedState {
         uint32_t version = 0;
@@ -191,7 +237,7 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
         Img::Id imageIdEnd = 0;
     };
     
-    static void _StateRead(std::ifstream& f, _State& state) {
+    static void _StateRead(std::istream& f, _State& state) {
         try {
             state = {};
             
@@ -213,7 +259,62 @@ struct ImageLibrary : Object, RecordStore<ImageRecord, 128>, std::mutex {
         }
     }
     
-    static void _StateWrite(std::ofstream& f, const _State& state) {
+    // _MigrateV0(): migrates a Version 0 library, where ImageRecord contained the thumbnail,
+    // to the current format, where thumbnails are stored as blobs.
+    //
+    // The migrated library is built in a separate directory and then swapped into place, so a
+    // crash mid-migration leaves the Version 0 library intact.
+    static void _MigrateV0(const RecordStore::Path& path) {
+        namespace fs = std::filesystem;
+        const RecordStore::Path pathNew = path.string() + "-Migrate";
+        const RecordStore::Path pathOld = path.string() + "-V0";
+        
+        // Recover from a crash that occurred while swapping the libraries
+        if (!fs::exists(path) && fs::exists(pathOld)) fs::rename(pathOld, path);
+        
+        // Short-circuit if the library isn't Version 0
+        {
+            std::ifstream f(_IndexPath(path), std::ios::binary);
+            uint32_t version = 0;
+            if (!f.read((char*)&version, sizeof(version))) return;
+            if (version != _ImageRecordV0::Version) return;
+        }
+        
+        printf("[ImageLibrary] Migrating Version 0 library\n");
+        const auto timeStart = std::chrono::steady_clock::now();
+        
+        fs::remove_all(pathNew);
+        {
+            RecordStore<_ImageRecordV0, ChunkRecordCap> src;
+            const std::string state = src.read(path).str();
+            
+            RecordStore dst;
+            dst.create(pathNew);
+            dst.add(src.recordCount());
+            
+            auto it = dst.begin();
+            for (const auto& srcRef : src) {
+                const _ImageRecordV0& srcRec = *srcRef;
+                ImageRecord& dstRec = **it;
+                dstRec.info = srcRec.info;
+                dstRec.status = srcRec.status;
+                dstRec.options = srcRec.options;
+                it->blob() = srcRec.thumb;
+                it++;
+            }
+            
+            dst.write(state);
+        }
+        
+        fs::rename(path, pathOld);
+        fs::rename(pathNew, path);
+        fs::remove_all(pathOld);
+        
+        const auto durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-timeStart).count();
+        printf("[ImageLibrary] Migration took %ju ms\n", (uintmax_t)durationMs);
+    }
+    
+    static void _StateWrite(std::ostream& f, const _State& state) {
         const _SerializedState serialized = {
             .version = _Version,
             .imageIdEnd = state.imageIdEnd,
@@ -228,26 +329,40 @@ using ImageLibraryPtr = SharedPtr<ImageLibrary>;
 using ImageRecordIter = ImageLibrary::RecordRefConstIter;
 using ImageRecordIterAny = Toastbox::IterAny<ImageRecordIter>;
 using ImageRecordPtr = ImageLibrary::RecordStrongRef;
-using ImageSet = std::set<ImageRecordPtr>;
+using ImageSet = ImageLibrary::RecordSet;
 
 // ImageSetsOverlap: returns whether there's an intersection between a and b.
-// This is templated so we can compare between std::set<RecordRef> and std::set<RecordStrongRef>
+// This is templated so we can compare between any ordered sets of records (eg ImageSet and
+// std::set<RecordRef>); it's a linear merge of the two sets.
 template<typename T_A, typename T_B>
 bool ImageSetsOverlap(const T_A& a, const T_B& b) {
-    ImageSet r;
-    for (const ImageRecordPtr& x : a) {
-        if (b.find(x) != b.end()) {
-            return true;
-        }
+    auto ia = a.begin();
+    auto ib = b.begin();
+    while (ia!=a.end() && ib!=b.end()) {
+        const ImageLibrary::RecordRef ra = *ia;
+        const ImageLibrary::RecordRef rb = *ib;
+        if (ra < rb)      ia++;
+        else if (rb < ra) ib++;
+        else              return true;
     }
     return false;
 }
 
 inline ImageSet ImageSetsIntersect(const ImageSet& a, const ImageSet& b) {
     ImageSet r;
-    for (const ImageRecordPtr& x : a) {
-        if (b.find(x) != b.end()) {
-            r.insert(x);
+    auto ia = a.begin();
+    auto ib = b.begin();
+    while (ia!=a.end() && ib!=b.end()) {
+        const ImageLibrary::RecordRef ra = *ia;
+        const ImageLibrary::RecordRef rb = *ib;
+        if (ra < rb) {
+            ia++;
+        } else if (rb < ra) {
+            ib++;
+        } else {
+            r.insert(ra);
+            ia++;
+            ib++;
         }
     }
     return r;
@@ -255,18 +370,24 @@ inline ImageSet ImageSetsIntersect(const ImageSet& a, const ImageSet& b) {
 
 inline ImageSet ImageSetsXOR(const ImageSet& a, const ImageSet& b) {
     ImageSet r;
-    for (const ImageRecordPtr& x : a) {
-        if (b.find(x) == b.end()) {
-            r.insert(x);
-        }
-    }
-    
-    for (const ImageRecordPtr& x : b) {
-        if (a.find(x) == a.end()) {
-            r.insert(x);
+    auto ia = a.begin();
+    auto ib = b.begin();
+    while (ia!=a.end() && ib!=b.end()) {
+        const ImageLibrary::RecordRef ra = *ia;
+        const ImageLibrary::RecordRef rb = *ib;
+        if (ra < rb) {
+            r.insert(ra);
+            ia++;
+        } else if (rb < ra) {
+            r.insert(rb);
+            ib++;
+        } else {
+            ia++;
+            ib++;
         }
     }
-    
+    r.insert(ia, a.end());
+    r.insert(ib, b.end());
     return r;
 }
 
@@ -22,20 +22,17 @@ struct ImageSelection : Object {
     void images(ImageSet x) {
         // Remove images that aren't loaded
         // Ie, don't allow placeholder images to be selected
-        for (auto it=x.begin(); it!=x.end();) {
-            if (!(*it)->status.loadCount) {
-                it = x.erase(it);
-            } else {
-                it++;
-            }
+        ImageSet loaded;
+        for (const ImageLibrary::RecordRef& rec : x) {
+            if (rec->status.loadCount) loaded.insert(rec);
         }
-        _images(x);
+        _images(std::move(loaded));
     }
     
     void _handleImagesRemoved(const ImageSet& images) {
         // Remove images from the selection that were removed from the ImageLibrary
         bool changed = false;
-        for (ImageRecordPtr rec : images) {
+        for (const ImageLibrary::RecordRef& rec : images) {
             changed |= __images.erase(rec);
         }
         if (changed) observersNotify({});
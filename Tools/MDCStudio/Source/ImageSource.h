@@ -3,6 +3,10 @@
 #import <thread>
 #import <set>
 #import <array>
+#import <optional>
+#import <deque>
+#import <list>
+#import <map>
 #import <chrono>
 #import <AppleTextureEncoder.h>
 #import "Code/Lib/Toastbox/Atomic.h"
@@ -20,6 +24,8 @@
 #import "Tools/Shared/ELF32Binary.h"
 #import "ImageLibrary.h"
 #import "Cache.h"
+#import "ShardedCache.h"
+#import "DiskCache.h"
 
 namespace MDCStudio {
 
@@ -44,8 +50,16 @@ struct ImageSource : Object {
     
     using Cleanup = std::unique_ptr<_Cleanup>;
     
+    struct _ImageRecordHash {
+        size_t operator()(const ImageRecordPtr& x) const {
+            return std::hash<const void*>()(x.chunk) ^ x.idx;
+        }
+    };
+    
+    // _ThumbCache: sharded because it's hit concurrently by the thumbnail render threads and the
+    // main thread
     using __ThumbBuffer = uint8_t[ImgSD::Thumb::ImagePaddedLen];
-    using _ThumbCache = Cache<ImageRecordPtr,__ThumbBuffer,512,(uint8_t)Priority::Low>;
+    using _ThumbCache = ShardedCache<ImageRecordPtr,__ThumbBuffer,512,(uint8_t)Priority::Low,8,_ImageRecordHash>;
     using _ThumbBuffer = _ThumbCache::Entry;
     using _ThumbBufferReserved = _ThumbCache::Reserved;
     
@@ -105,6 +119,15 @@ struct ImageSource : Object {
             _imageLibrary->read(_dir / "ImageLibrary");
         }
         
+        // Open our disk caches
+        // Failing to open them isn't fatal; we just read everything from the device instead
+        try {
+            _diskCache.thumb.emplace(_dir / "Cache" / "Thumb", _ThumbDiskCacheCap);
+            _diskCache.image.emplace(_dir / "Cache" / "Full", _ImageDiskCacheCap);
+        } catch (const std::exception& e) {
+            printf("[ImageSource::init()] Failed to open disk cache: %s\n", e.what());
+        }
+        
         // Init _dataRead
         {
             _dataRead.thread = Thread([&] { _dataRead_thread(); });
@@ -118,6 +141,11 @@ struct ImageSource : Object {
                 _thumbRender.slave.threads.emplace_back([&] { _thumbRender_slaveThread(); });
             }
         }
+        
+        // Init _thumbPrefetch
+        {
+            _thumbPrefetch.thread = Thread([&] { _thumbPrefetch_thread(); });
+        }
     }
     
     ~ImageSource() {
@@ -137,6 +165,7 @@ struct ImageSource : Object {
         _dataRead.signal.stop();
         _thumbRender.master.signal.stop();
         _thumbRender.slave.signal.stop();
+        _thumbPrefetch.signal.stop();
         
         for (_LoadState& loadState : _loadStates.mem()) {
             loadState.signal.stop();
@@ -185,7 +214,8 @@ struct ImageSource : Object {
     
     virtual ImageLibraryPtr imageLibrary() { return _imageLibrary; }
     
-    virtual void renderThumbs(std::set<ImageRecordPtr> recs) {
+    virtual void renderThumbs(ImageSet recs) {
+        _thumbPrefetchConsume(recs);
         try {
             auto lock = _thumbRender.master.signal.lock();
             _thumbRender.master.recs = std::move(recs);
@@ -195,6 +225,59 @@ struct ImageSource : Object {
         _thumbRender.master.signal.signalOne();
     }
     
+    // PrefetchStats: counters describing the effectiveness of prefetchThumbs()
+    struct PrefetchStats {
+        uint64_t hit = 0;           // Thumbnails passed to renderThumbs() that were prefetched
+        uint64_t miss = 0;          // Thumbnails passed to renderThumbs() that weren't prefetched
+        uint64_t prefetched = 0;    // Thumbnails whose data was prefetched
+        uint64_t wasted = 0;        // Prefetched thumbnails that were superseded without being rendered
+    };
+    
+    // prefetchThumbs(): speculatively loads the data for the thumbnails of `recs` into our cache at
+    // Priority::Low, so that rendering them via a future renderThumbs() doesn't need to wait on the
+    // device. `recs` is ordered by how soon each record is expected to be needed.
+    //
+    // Each call supersedes the previous call: records from the previous call that aren't in `recs`
+    // are cancelled, including those that are already queued to be read from the device.
+    virtual void prefetchThumbs(std::vector<ImageRecordPtr> recs) {
+        try {
+            {
+                auto lock = _thumbPrefetch.signal.lock();
+                ImageSet window;
+                for (const ImageRecordPtr& rec : recs) window.insert(rec);
+                
+                // Cancel the records that we already prefetched that are no longer in the window
+                for (auto it=_thumbPrefetch.issued.begin(); it!=_thumbPrefetch.issued.end();) {
+                    const auto& [rec, cancel] = *it;
+                    if (window.find(rec) == window.end()) {
+                        *cancel = true;
+                        _thumbPrefetch.stats.wasted++;
+                        it = _thumbPrefetch.issued.erase(it);
+                    } else {
+                        it++;
+                    }
+                }
+                
+                // Replace the pending records, skipping those that we already prefetched
+                _thumbPrefetch.pending.clear();
+                for (const ImageRecordPtr& rec : recs) {
+                    if (_thumbPrefetch.issued.find(rec) == _thumbPrefetch.issued.end()) {
+                        _thumbPrefetch.pending.push_back(rec);
+                    }
+                }
+            }
+            _thumbPrefetch.signal.signalAll();
+        
+        } catch (const Toastbox::Signal::Stop&) {
+            // No-op if we're in the process of teardown
+        }
+    }
+    
+    PrefetchStats prefetchStats() {
+        auto lock = _thumbPrefetch.signal.lock();
+        return _thumbPrefetch.stats;
+    }
+    
     virtual Image getImage(Priority priority, const ImageRecordPtr& rec) {
         // If the image is in our cache, return it
         _ImageBuffer cached = _imageCache.get(rec);
@@ -210,6 +293,17 @@ struct ImageSource : Object {
         _imageLibrary->write();
     }
     
+    // diskCacheNamespace(): identifies the storage that image ids refer to (eg the SD card), so that
+    // data persisted in our disk cache can't be confused with data from another storage device.
+    // Returns std::nullopt if the disk cache shouldn't be used.
+    virtual std::optional<DiskCache::Namespace> diskCacheNamespace() { return std::nullopt; }
+    
+    // dataReadAddress(): returns the address of `rec`'s thumbnail (thumb==true) or full-size image
+    // (thumb==false) on the device. Reads are issued in ascending address order, so that sources
+    // can stream the data for adjacent records without seeking. Sources where the read order
+    // doesn't matter return 0.
+    virtual uint64_t dataReadAddress(const ImageRecordPtr& rec, bool thumb) { return 0; }
+    
     virtual Cleanup dataReadStart() { return nullptr; }
     virtual void dataRead(const ImageRecordPtr& rec, const _ThumbBuffer& buf) = 0;
     virtual void dataRead(const ImageRecordPtr& rec, const _ImageBuffer& buf) = 0;
@@ -218,6 +312,19 @@ struct ImageSource : Object {
     
     static constexpr uint32_t _Version = 0;
     
+    // _DataReadBatchLenMax: the maximum amount of data that's read from the device in a batch
+    // Work that's enqueued while a batch is underway waits for the batch to complete, so this
+    // bounds the latency of high-priority work.
+    static constexpr size_t _DataReadBatchLenMax = 8*1024*1024;
+    
+    // _ThumbPrefetchUnderwayMax: the maximum number of prefetched thumbnails that can be loading at once
+    static constexpr size_t _ThumbPrefetchUnderwayMax = 8;
+    
+    // _ThumbDiskCacheCap / _ImageDiskCacheCap: size limits of our disk caches
+    // (~11k thumbnails and ~340 full-size images, respectively)
+    static constexpr uint64_t _ThumbDiskCacheCap = UINT64_C(4)<<30; // 4 GiB
+    static constexpr uint64_t _ImageDiskCacheCap = UINT64_C(2)<<30; // 2 GiB
+    
     static constexpr Toastbox::CFADesc _CFADesc = {
         Toastbox::CFAColor::Green, Toastbox::CFAColor::Red,
         Toastbox::CFAColor::Blue, Toastbox::CFAColor::Green,
@@ -230,7 +337,7 @@ struct ImageSource : Object {
     
     struct _LoadState {
         Toastbox::Signal signal; // Protects this struct
-        std::set<ImageRecordPtr> notify;
+        ImageSet notify;
         Toastbox::Atomic<size_t> underway = 0;
     };
     
@@ -274,10 +381,23 @@ struct ImageSource : Object {
         _ImageBufferReserved* image() { return std::get_if<_ImageBufferReserved>(this); }
     };
     
+    // _DataReadCancel: token that allows _DataReadWork to be cancelled after it's been enqueued
+    using _DataReadCancel = std::shared_ptr<std::atomic<bool>>;
+    
     struct _DataReadWork {
         ImageRecordPtr rec;
         _BufferReserved buf;
+        _DataReadCancel cancel; // Optional
         std::function<void(_DataReadWork&&)> callback;
+        // loaded: set before `callback` is called; whether `buf` contains the record's data (false
+        // if the work was cancelled)
+        bool loaded = false;
+        
+        // cancelled(): whether the work is no longer wanted, because its record was deleted or
+        // its cancellation token was set
+        bool cancelled() const {
+            return !rec.alive() || (cancel && *cancel);
+        }
         
         bool operator<(const _DataReadWork& x) const {
             if ((bool)buf.thumb() != (bool)x.buf.thumb()) return (bool)buf.thumb() < (bool)x.buf.thumb();
@@ -304,7 +424,84 @@ struct ImageSource : Object {
         std::function<void()> callback;
     };
     
-    using _DataReadWorkQueue = std::queue<_DataReadWork>;
+    // _DataReadQueue: queue of _DataReadWork, ordered by priority and then by insertion order
+    //
+    // Work for a record that's already queued (for the same image size) is coalesced into the
+    // existing entry, so that the record is only read once. If the new work has a higher priority
+    // than the existing entry, the entry is promoted to the new priority.
+    struct _DataReadQueue {
+        using Works = std::vector<_DataReadWork>;
+        
+        void push(Priority priority, _DataReadWork&& work) {
+            assert(priority <= Priority::Low);
+            const _Key key = { work.rec, (bool)work.buf.thumb() };
+            const auto find = _index.find(key);
+            
+            // Create a new entry if the record isn't already queued
+            if (find == _index.end()) {
+                _List& list = _lists[(size_t)priority];
+                list.push_back({ .key = key });
+                list.back().works.push_back(std::move(work));
+                _index[key] = { priority, std::prev(list.end()) };
+                return;
+            }
+            
+            // Otherwise coalesce the work into the existing entry, promoting the entry if needed
+            auto& [entryPriority, it] = find->second;
+            it->works.push_back(std::move(work));
+            if (priority < entryPriority) {
+                _List& dst = _lists[(size_t)priority];
+                dst.splice(dst.end(), _lists[(size_t)entryPriority], it);
+                entryPriority = priority;
+            }
+        }
+        
+        // pop(): removes the highest-priority entry and returns its work, which all refers to
+        // the same record
+        Works pop() {
+            for (_List& list : _lists) {
+                if (list.empty()) continue;
+                _Entry entry = std::move(list.front());
+                list.pop_front();
+                _index.erase(entry.key);
+                return std::move(entry.works);
+            }
+            return {};
+        }
+        
+        // popBatch(): removes entries of the highest non-empty priority, in order, until their data
+        // would exceed `lenMax` bytes. At least one entry is returned if the queue isn't empty.
+        std::vector<Works> popBatch(size_t lenMax) {
+            std::vector<Works> r;
+            for (_List& list : _lists) {
+                if (list.empty()) continue;
+                size_t len = 0;
+                while (!list.empty()) {
+                    const size_t entryLen = list.front().works.front().buf.cap();
+                    if (!r.empty() && len+entryLen>lenMax) break;
+                    len += entryLen;
+                    r.push_back(pop());
+                }
+                break;
+            }
+            return r;
+        }
+        
+        bool empty() const { return _index.empty(); }
+        
+        using _Key = std::pair<ImageRecordPtr,bool>; // (record, thumb)
+        
+        struct _Entry {
+            _Key key;
+            Works works;
+        };
+        
+        using _List = std::list<_Entry>;
+        
+        _List _lists[(size_t)Priority::Low+1];
+        std::map<_Key,std::pair<Priority,_List::iterator>> _index;
+    };
+    
     using _RenderWorkQueue = std::queue<_RenderWork>;
 //    using _ImageLoadQueue = std::queue<_RenderWork>;
     
@@ -349,6 +546,60 @@ struct ImageSource : Object {
         return true;
     }
     
+    // _EstimateIlluminantCPU(): whether to estimate illuminants with the CPU FFCC, which scales
+    // across cores, instead of the Metal one. Opt-in (via the EstimateIlluminantCPU user default)
+    // until the CPU implementation has been checked against the Metal implementation, via
+    // _EstimateIlluminantCompare().
+    static bool _EstimateIlluminantCPU() {
+        static const bool X = [[NSUserDefaults standardUserDefaults] boolForKey:@"EstimateIlluminantCPU"];
+        return X;
+    }
+    
+    // _EstimateIlluminantCompare(): whether to also run the CPU FFCC for every thumbnail that the
+    // Metal FFCC estimates the illuminant of, and log the angle between their estimates (via the
+    // EstimateIlluminantCompare user default). The Metal estimate is the one that's used.
+    //
+    // This is the Metal parity check for the CPU FFCC, on real thumbnails: load a library with it
+    // enabled (eg after clearing the thumbnail cache), and check that no image's angle exceeds
+    // _EstimateIlluminantCompareMaxDeg before making the CPU FFCC the default.
+    static bool _EstimateIlluminantCompare() {
+        static const bool X = [[NSUserDefaults standardUserDefaults] boolForKey:@"EstimateIlluminantCompare"];
+        return X;
+    }
+    
+    // _EstimateIlluminantCompareMaxDeg: the angle that the CPU and Metal estimates may differ by;
+    // well below the ~2 degree error of FFCC itself
+    static constexpr double _EstimateIlluminantCompareMaxDeg = 0.1;
+    
+    // _EstimateIlluminantCompareLog(): logs the angle between the Metal and CPU estimates of an
+    // image's illuminant, and the running statistics across all images compared so far
+    static void _EstimateIlluminantCompareLog(const ColorRaw& metal, const ColorRaw& cpu) {
+        static std::mutex Lock;
+        static struct {
+            size_t count = 0;
+            size_t failCount = 0;
+            double sum = 0;
+            double max = 0;
+        } Stats;
+        
+        const auto dot = [] (const ColorRaw& a, const ColorRaw& b) {
+            return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+        };
+        const double cosAngle = dot(metal,cpu) / std::sqrt(dot(metal,metal)*dot(cpu,cpu));
+        const double deg = std::acos(std::clamp(cosAngle, -1., 1.)) * (180/M_PI);
+        const bool fail = !(deg <= _EstimateIlluminantCompareMaxDeg);
+        
+        auto lock = std::unique_lock(Lock);
+        Stats.count++;
+        Stats.failCount += fail;
+        Stats.sum += deg;
+        Stats.max = std::max(Stats.max, deg);
+        printf("[EstimateIlluminantCompare] %s: %.4f deg (metal: { %f, %f, %f } cpu: { %f, %f, %f }); "
+            "images: %ju, failed: %ju, avg: %.4f deg, max: %.4f deg\n",
+            (fail ? "FAIL" : "ok"), deg, metal[0], metal[1], metal[2], cpu[0], cpu[1], cpu[2],
+            (uintmax_t)Stats.count, (uintmax_t)Stats.failCount, Stats.sum/Stats.count, Stats.max);
+    }
+    
     static constexpr size_t _ThumbTmpStorageLen = ImageThumb::ThumbWidth * ImageThumb::ThumbHeight * 4;
     using _ThumbTmpStorage = std::array<uint8_t, _ThumbTmpStorageLen>;
     
@@ -373,7 +624,20 @@ struct ImageSource : Object {
             
 //            auto timeStart = std::chrono::steady_clock::now();
             
-            ccm.illum = (estimateIlluminant ? EstimateIlluminant::Run(renderer, _CFADesc, rawTxt) : ColorRaw(opts.whiteBalance.illum));
+            if (estimateIlluminant) {
+                if (_EstimateIlluminantCPU()) {
+                    ccm.illum = EstimateIlluminant::Run(_CFADesc,
+                        Img::Thumb::PixelWidth, Img::Thumb::PixelHeight, (const Img::Pixel*)src);
+                } else {
+                    ccm.illum = EstimateIlluminant::Run(renderer, _CFADesc, rawTxt);
+                    if (_EstimateIlluminantCompare()) {
+                        _EstimateIlluminantCompareLog(ccm.illum, EstimateIlluminant::Run(_CFADesc,
+                            Img::Thumb::PixelWidth, Img::Thumb::PixelHeight, (const Img::Pixel*)src));
+                    }
+                }
+            } else {
+                ccm.illum = ColorRaw(opts.whiteBalance.illum);
+            }
             
 //            const microseconds duration = duration_cast<microseconds>(steady_clock::now()-timeStart);
 //            printf("EstimateIlluminant took %ju us\n", (uintmax_t)duration.count());
@@ -461,14 +725,42 @@ struct ImageSource : Object {
         };
     }
     
-    void _readCompleteCallback(_LoadState& state, _DataReadWork&& work, bool initial) {
+    // _diskCacheRead(): reads `rec`'s data from `cache` into `dst`
+    // Returns whether the data was in the cache.
+    static bool _diskCacheRead(std::optional<DiskCache>& cache, const std::optional<DiskCache::Namespace>& ns,
+        const ImageRecordPtr& rec, void* dst, size_t len) {
+        if (!cache || !ns) return false;
+        return cache->read({ .ns=*ns, .id=rec->info.id }, dst, len);
+    }
+    
+    // _diskCacheWrite(): writes `rec`'s data to `cache`
+    // Failures are logged and otherwise ignored, since the disk cache is only an optimization.
+    static void _diskCacheWrite(std::optional<DiskCache>& cache, const std::optional<DiskCache::Namespace>& ns,
+        const ImageRecordPtr& rec, const void* src, size_t len) {
+        if (!cache || !ns) return;
+        try {
+            cache->write({ .ns=*ns, .id=rec->info.id }, src, len);
+        } catch (const std::exception& e) {
+            printf("[ImageSource::_diskCacheWrite()] Failed to write image id %ju: %s\n",
+                (uintmax_t)rec->info.id, e.what());
+        }
+    }
+    
+    // _diskCacheClear(): removes everything from our disk caches
+    // Must be called whenever the image ids that our disk caches are keyed by become invalid.
+    void _diskCacheClear() {
+        if (_diskCache.thumb) _diskCache.thumb->clear();
+        if (_diskCache.image) _diskCache.image->clear();
+    }
+    
+    void _readCompleteCallback(_LoadState& state, _DataReadWork&& work, bool initial, bool validateChecksum) {
         _ThumbBufferReserved& buf = *work.buf.thumb();
         
         // Enqueue rendering
         {
             {
                 auto lock = _thumbRender.slave.signal.lock();
-                _renderEnqueue(lock, state, initial, true, work.rec, buf.entry());
+                _renderEnqueue(lock, state, initial, validateChecksum, work.rec, buf.entry());
             }
             _thumbRender.slave.signal.signalAll();
         }
@@ -480,15 +772,17 @@ struct ImageSource : Object {
         if (!initial) _thumbCache.set(work.rec, std::move(buf));
     }
     
-    void _renderCompleteCallback(_LoadState& state, ImageRecordPtr rec) {
+    // _renderCompleteCallback(): called when `rec` is done being loaded and rendered, or when its
+    // load was cancelled (rendered==false)
+    void _renderCompleteCallback(_LoadState& state, ImageRecordPtr rec, bool rendered=true) {
         constexpr size_t NotifyThreshold = 8;
         
         const size_t count = --state.underway;
         
-        std::set<ImageRecordPtr> notify;
+        ImageSet notify;
         {
             auto lock = state.signal.lock();
-            state.notify.insert(rec);
+            if (rendered) state.notify.insert(rec);
             if (state.notify.size()>=NotifyThreshold || !count) {
                 notify = std::move(state.notify);
             }
@@ -514,7 +808,7 @@ struct ImageSource : Object {
     }
     
     void _loadThumbs(Priority priority, bool initial,
-        std::set<ImageRecordPtr> recs, std::function<void(float)> progressCallback=nullptr) {
+        ImageSet recs, std::function<void(float)> progressCallback=nullptr) {
         
         const size_t imageCount = recs.size();
         auto timeStart = std::chrono::steady_clock::now();
@@ -544,28 +838,32 @@ struct ImageSource : Object {
             {
                 auto lock = _thumbRender.slave.signal.lock();
                 
-                for (auto it=recs.begin(); it!=recs.end();) {
-                    const ImageRecordPtr& rec = *it;
-                    
+                ImageSet uncached;
+                for (const ImageLibrary::RecordRef& ref : recs) {
                     // If the thumbnail is in our cache, kick off rendering
+                    // (The cache is keyed by strong references, so this is the one strong
+                    // reference that we create per record, which the render work then takes.)
+                    ImageRecordPtr rec = ref;
                     _ThumbBuffer buf = _thumbCache.get(rec);
                     if (buf) {
-                        _renderEnqueue(lock, *state, initial, false, rec, std::move(buf));
+                        _renderEnqueue(lock, *state, initial, false, std::move(rec), std::move(buf));
                         enqueued = true;
-                        it = recs.erase(it);
                     
-                    // Otherwise, on to the next one
+                    // Otherwise, remember it so we load it below
                     } else {
-                        it++;
+                        uncached.insert(ref);
                     }
                 }
+                recs = std::move(uncached);
             }
             
             // Notify _thumbRender of more work
             if (enqueued) _thumbRender.slave.signal.signalAll();
         }
         
-        // The remaining recs aren't in our cache, so kick off SD reading + rendering
+        // The remaining recs aren't in our cache, so try our disk cache, and otherwise kick off
+        // SD reading + rendering
+        const std::optional<DiskCache::Namespace> ns = diskCacheNamespace();
         for (auto it=recs.rbegin(); it!=recs.rend(); it++) {
             const ImageRecordPtr& rec = *it;
             
@@ -573,21 +871,33 @@ struct ImageSource : Object {
             if (rec.alive()) {
                 _ThumbBufferReserved buf = _thumbCache.pop((uint8_t)priority);
                 
+                // If the thumbnail is in our disk cache, kick off rendering without touching the device.
+                // Data in the disk cache was validated before it was written, and DiskCache validates
+                // its own checksum upon reading, so we don't need to validate the image checksum again.
+                if (_diskCacheRead(_diskCache.thumb, ns, rec, &*buf.entry(), Img::Thumb::ImageLen)) {
+                    _DataReadWork work = {
+                        .rec = rec,
+                        .buf = std::move(buf),
+                    };
+                    _readCompleteCallback(*state, std::move(work), initial, false);
+                    continue;
+                }
+                
     //                printf("[_loadImages] Got buffer %p for image id %ju\n", &*buf, (uintmax_t)rec->info.id);
                 
                 _DataReadWork work = {
                     .rec = rec,                
                     .buf = std::move(buf),
                     .callback = [&] (_DataReadWork&& work) {
-                        _readCompleteCallback(*state, std::move(work), initial);
+                        if (work.loaded) _readCompleteCallback(*state, std::move(work), initial, true);
+                        else             _renderCompleteCallback(*state, work.rec, false);
                     },
                 };
                 
 //                printf("[_loadImages:p%ju] Enqueuing _DataReadWork\n", (uintmax_t)priority);
                 {
                     auto lock = _dataRead.signal.lock();
-                    _DataReadWorkQueue& queue = _dataRead.queues[(size_t)priority];
-                    queue.push(std::move(work));
+                    _dataRead.queue.push(priority, std::move(work));
                 }
                 _dataRead.signal.signalOne();
             
@@ -616,27 +926,50 @@ struct ImageSource : Object {
     }
     
     Image _loadImage(Priority priority, const ImageRecordPtr& rec) {
-        auto state = _loadStates.pop().entry();
         _ImageBufferReserved buf = _imageCache.pop((uint8_t)priority);
         
+        // If the image is in our disk cache, don't touch the device
+        const std::optional<DiskCache::Namespace> ns = diskCacheNamespace();
+        if (_diskCacheRead(_diskCache.image, ns, rec, &*buf.entry(), Img::Full::ImageLen)) {
+            Image image = _imageCreate(buf.entry());
+            _imageCache.set(rec, std::move(buf));
+            return image;
+        }
+        
+        auto state = _loadStates.pop().entry();
+        bool done = false;
+        
         _DataReadWork work = {
             .rec = rec,
             .buf = std::move(buf),
             .callback = [&] (_DataReadWork&& work) {
-                buf = std::move(*work.buf.image());
+                {
+                    auto lock = state->signal.lock();
+                    if (work.loaded) buf = std::move(*work.buf.image());
+                    done = true;
+                }
                 state->signal.signalOne();
             },
         };
         
         {
             auto lock = _dataRead.signal.lock();
-            _DataReadWorkQueue& queue = _dataRead.queues[(size_t)priority];
-            queue.push(std::move(work));
+            _dataRead.queue.push(priority, std::move(work));
         }
         _dataRead.signal.signalOne();
         
-        // Wait until the buffer is returned to us by our SDRead callback
-        state->signal.wait([&] { return buf.entry(); });
+        // Wait until our SDRead callback is called
+        state->signal.wait([&] { return done; });
+        // If we didn't get the buffer back, the work was cancelled because the record was deleted
+        if (!buf.entry()) return {};
+        
+        // Persist the image in our disk cache, but only if it's valid
+        if (_ImageChecksumValid(&*buf.entry(), Img::Size::Full)) {
+            _diskCacheWrite(_diskCache.image, ns, rec, &*buf.entry(), Img::Full::ImageLen);
+        } else {
+            printf("Checksum INVALID (full)\n");
+        }
+        
         Image image = _imageCreate(buf.entry());
         _imageCache.set(rec, std::move(buf));
         return image;
@@ -644,13 +977,61 @@ struct ImageSource : Object {
     
     // MARK: - Data Read
     
-    // _dataRead.lock must be held!
-    _DataReadWorkQueue* _dataRead_nextQueue() {
-        for (_DataReadWorkQueue& x : _dataRead.queues) {
-            if (!x.empty()) return &x;
+    // _dataRead_perform(): performs a batch of work returned by _DataReadQueue::popBatch()
+    //
+    // The batch is performed in the order of the records' device addresses, rather than the order
+    // that it was queued in, so that the device can stream adjacent records in a single readout.
+    void _dataRead_perform(std::vector<_DataReadQueue::Works>&& batch) {
+        std::vector<std::pair<uint64_t,_DataReadQueue::Works*>> ordered;
+        ordered.reserve(batch.size());
+        for (_DataReadQueue::Works& works : batch) {
+            const _DataReadWork& work = works.front();
+            const uint64_t addr = (work.rec.alive() ? dataReadAddress(work.rec, (bool)work.buf.thumb()) : 0);
+            ordered.push_back({ addr, &works });
+        }
+        
+        std::stable_sort(ordered.begin(), ordered.end(), [] (const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+        
+        for (const auto& [addr, works] : ordered) {
+            _dataRead_perform(std::move(*works));
+        }
+    }
+    
+    // _dataRead_perform(): reads the data for `works`, which all refer to the same record and size
+    void _dataRead_perform(_DataReadQueue::Works&& works) {
+        // Complete the cancelled work without reading it
+        _DataReadQueue::Works live;
+        for (_DataReadWork& work : works) {
+            if (work.cancelled()) {
+                work.callback(std::move(work));
+            } else {
+                live.push_back(std::move(work));
+            }
+        }
+        if (live.empty()) return;
+        
+//        printf("[_dataRead_thread] reading blockBegin:%ju len:%ju (%.1f MB)\n",
+//            (uintmax_t)blockBegin, (uintmax_t)len, (float)len/(1024*1024));
+        
+        // Read the data once into the first work's buffer, and copy it into the others' buffers
+        _DataReadWork& first = live.front();
+        if (first.buf.thumb()) {
+            dataRead(first.rec, first.buf.thumb()->entry());
+        } else {
+            dataRead(first.rec, first.buf.image()->entry());
+        }
+        
+        for (auto it=live.begin()+1; it!=live.end(); it++) {
+            assert(it->buf.cap() == first.buf.cap());
+            memcpy(it->buf.storage(), first.buf.storage(), first.buf.cap());
+        }
+        
+        for (_DataReadWork& work : live) {
+            work.loaded = true;
+            work.callback(std::move(work));
         }
-        printf("[_dataRead_nextQueue] Stalled\n");
-        return nullptr;
     }
     
     void _dataRead_thread() {
@@ -659,7 +1040,7 @@ struct ImageSource : Object {
             for (;;) {
                 // Wait for work
                 printf("[_dataRead_thread] Waiting for work...\n");
-                _dataRead.signal.wait([&] { return _dataRead_nextQueue() && !_dataRead.pause; });
+                _dataRead.signal.wait([&] { return !_dataRead.queue.empty() && !_dataRead.pause; });
                 
                 // Initiate DataRead mode
                 printf("[_dataRead_thread] Calling dataReadStart() START\n");
@@ -667,37 +1048,23 @@ struct ImageSource : Object {
                 printf("[_dataRead_thread] Calling dataReadStart() END\n");
                 
                 for (;;) {
-                    _DataReadWork work;
+                    std::vector<_DataReadQueue::Works> batch;
                     {
                         // Wait for work
-                        _DataReadWorkQueue* queue = nullptr;
+                        bool empty = true;
                         bool pause = false;
                         auto lock = _dataRead.signal.wait_for(SDModeTimeout, [&] {
-                            queue = _dataRead_nextQueue();
+                            empty = _dataRead.queue.empty();
                             pause = _dataRead.pause;
-                            return queue || pause;
+                            return !empty || pause;
                         });
                         // Check if we timed out waiting for work
-                        if (!queue || pause) break;
+                        if (empty || pause) break;
 //                        printf("[_dataRead_thread] Dequeued work\n");
-                        work = std::move(queue->front());
-                        queue->pop();
+                        batch = _dataRead.queue.popBatch(_DataReadBatchLenMax);
                     }
                     
-                    {
-                        {
-//                            printf("[_dataRead_thread] reading blockBegin:%ju len:%ju (%.1f MB)\n",
-//                                (uintmax_t)blockBegin, (uintmax_t)len, (float)len/(1024*1024));
-                            
-                            if (work.buf.thumb()) {
-                                dataRead(work.rec, work.buf.thumb()->entry());
-                            } else {
-                                dataRead(work.rec, work.buf.image()->entry());
-                            }
-                        }
-                        
-                        work.callback(std::move(work));
-                    }
+                    _dataRead_perform(std::move(batch));
                 }
                 
                 printf("[_dataRead_thread] Exiting SD mode\n");
@@ -710,6 +1077,115 @@ struct ImageSource : Object {
         }
     }
     
+    // MARK: - Thumb Prefetch
+    
+    // _thumbPrefetchConsume(): notes that `recs` are about to be rendered, updating our prefetch
+    // hit/miss counters, and dropping `recs` from the records that are pending prefetch
+    void _thumbPrefetchConsume(const ImageSet& recs) {
+        try {
+            auto lock = _thumbPrefetch.signal.lock();
+            for (const ImageLibrary::RecordRef& rec : recs) {
+                const auto it = _thumbPrefetch.issued.find(rec);
+                if (it != _thumbPrefetch.issued.end()) {
+                    _thumbPrefetch.issued.erase(it);
+                    _thumbPrefetch.stats.hit++;
+                } else {
+                    _thumbPrefetch.stats.miss++;
+                }
+            }
+            
+            auto& pending = _thumbPrefetch.pending;
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [&] (const ImageRecordPtr& rec) {
+                return recs.find(rec) != recs.end();
+            }), pending.end());
+        
+        } catch (const Toastbox::Signal::Stop&) {
+            // No-op if we're in the process of teardown
+        }
+    }
+    
+    void _thumbPrefetchComplete() {
+        {
+            auto lock = _thumbPrefetch.signal.lock();
+            _thumbPrefetch.underway--;
+        }
+        _thumbPrefetch.signal.signalAll();
+    }
+    
+    // _thumbPrefetchLoad(): loads the thumbnail data for `rec` into _thumbCache, from our disk cache
+    // if possible, otherwise from the device
+    void _thumbPrefetchLoad(const ImageRecordPtr& rec, const _DataReadCancel& cancel) {
+        // Short-circuit if the record was deleted, or its thumbnail is already cached
+        if (!rec.alive() || _thumbCache.get(rec)) {
+            _thumbPrefetchComplete();
+            return;
+        }
+        
+        _ThumbBufferReserved buf = _thumbCache.pop((uint8_t)Priority::Low);
+        
+        const std::optional<DiskCache::Namespace> ns = diskCacheNamespace();
+        if (_diskCacheRead(_diskCache.thumb, ns, rec, &*buf.entry(), Img::Thumb::ImageLen)) {
+            _thumbCache.set(rec, std::move(buf));
+            _thumbPrefetchComplete();
+            return;
+        }
+        
+        _DataReadWork work = {
+            .rec = rec,
+            .buf = std::move(buf),
+            .cancel = cancel,
+            .callback = [=] (_DataReadWork&& work) {
+                if (!work.loaded) {
+                    _thumbPrefetchComplete();
+                    return;
+                }
+                
+                _ThumbBufferReserved& buf = *work.buf.thumb();
+                // Only cache valid data, since renderThumbs() doesn't validate the checksum of data that
+                // it finds in _thumbCache
+                if (_ImageChecksumValid(&*buf.entry(), Img::Size::Thumb)) {
+                    _diskCacheWrite(_diskCache.thumb, ns, work.rec, &*buf.entry(), Img::Thumb::ImageLen);
+                    _thumbCache.set(work.rec, std::move(buf));
+                } else {
+                    printf("Checksum INVALID (prefetched thumb)\n");
+                }
+                _thumbPrefetchComplete();
+            },
+        };
+        
+        {
+            auto lock = _dataRead.signal.lock();
+            _dataRead.queue.push(Priority::Low, std::move(work));
+        }
+        _dataRead.signal.signalOne();
+    }
+    
+    void _thumbPrefetch_thread() {
+        try {
+            for (;;) {
+                ImageRecordPtr rec;
+                _DataReadCancel cancel = std::make_shared<std::atomic<bool>>(false);
+                {
+                    // Limit the number of loads that we have underway, so that prefetching can't tie up
+                    // all of _thumbCache's Priority::Low buffers
+                    auto lock = _thumbPrefetch.signal.wait([&] {
+                        return !_thumbPrefetch.pending.empty() && _thumbPrefetch.underway<_ThumbPrefetchUnderwayMax;
+                    });
+                    rec = _thumbPrefetch.pending.front();
+                    _thumbPrefetch.pending.pop_front();
+                    _thumbPrefetch.issued[rec] = cancel;
+                    _thumbPrefetch.underway++;
+                    _thumbPrefetch.stats.prefetched++;
+                }
+                
+                _thumbPrefetchLoad(rec, cancel);
+            }
+        
+        } catch (const Toastbox::Signal::Stop&) {
+            printf("[_thumbPrefetch_thread] Stopping\n");
+        }
+    }
+    
     // MARK: - Thumb Render
     
     template<MTLPixelFormat T_Format>
@@ -741,7 +1217,7 @@ struct ImageSource : Object {
                     recs = std::move(_thumbRender.master.recs);
                     // Update .thumb.render asap (ie before we've actually rendered) so that the
                     // visibleThumbs() function on the main thread stops enqueuing work asap
-                    for (const ImageRecordPtr& rec : recs) {
+                    for (const ImageLibrary::RecordRef& rec : recs) {
                         rec->options.thumb.render = false;
                     }
                 }
@@ -790,6 +1266,8 @@ struct ImageSource : Object {
                 if (work.validateChecksum) {
                     if (_ImageChecksumValid(*work.buf, Img::Size::Thumb)) {
 //                        printf("Checksum valid (thumb)\n");
+                        // The thumbnail came from the device and is valid, so persist it in our disk cache
+                        _diskCacheWrite(_diskCache.thumb, diskCacheNamespace(), work.rec, *work.buf, Img::Thumb::ImageLen);
                     } else {
                         printf("Checksum INVALID (thumb)\n");
 //                        abort();
@@ -837,10 +1315,10 @@ struct ImageSource : Object {
                     }
                 }
                 
-                // Render the thumbnail into rec.thumb
+                // Render the thumbnail into the record's blob
                 {
                     const void* thumbSrc = (*work.buf)+Img::PixelsOffset;
-                    void* thumbDst = rec.thumb.data;
+                    void* thumbDst = work.rec.blob().data;
                     
                     // estimateIlluminant: only perform illuminant estimation upon our initial import
                     const bool estimateIlluminant = work.initial;
@@ -890,10 +1368,17 @@ struct ImageSource : Object {
     _ImageCache _imageCache;
     _LoadStatePool _loadStates;
     
+    // _diskCache: second tier behind _thumbCache / _imageCache, which persists raw image data across
+    // launches so that it doesn't need to be re-read from the device
+    struct {
+        std::optional<DiskCache> thumb;
+        std::optional<DiskCache> image;
+    } _diskCache;
+    
     struct {
         Toastbox::Signal signal; // Protects this struct
         Thread thread;
-        _DataReadWorkQueue queues[(size_t)Priority::Low+1];
+        _DataReadQueue queue;
         uint32_t pause = 0;
     } _dataRead;
     
@@ -910,6 +1395,18 @@ struct ImageSource : Object {
             _RenderWorkQueue queue;
         } slave;
     } _thumbRender;
+    
+    struct {
+        Toastbox::Signal signal; // Protects this struct
+        Thread thread;
+        std::deque<ImageRecordPtr> pending; // Records waiting to be prefetched, most-likely-needed first
+        // issued: records that have been prefetched (or are loading) but haven't been rendered,
+        // and their cancellation tokens
+        // std::less<> allows lookups by RecordRef, without creating a strong reference.
+        std::map<ImageRecordPtr,_DataReadCancel,std::less<>> issued;
+        size_t underway = 0;
+        PrefetchStats stats;
+    } _thumbPrefetch;
 };
 
 } // namespace MDCStudio
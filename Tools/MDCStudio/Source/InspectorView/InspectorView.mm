@@ -1370,7 +1370,7 @@ static void _Update(Item* it) {
 - (_ModelData)_get:(_ModelGetterFn)fn {
     bool init = false;
     id first = nil;
-    for (const ImageRecordPtr& rec : _selection->images()) {
+    for (const ImageLibrary::RecordRef& rec : _selection->images()) {
         const id obj = fn(*rec);
         
         if (!init) {
@@ -1388,14 +1388,17 @@ static void _Update(Item* it) {
 }
 
 - (void)_set:(_ModelSetterFn)fn data:(id)data {
-    for (const ImageRecordPtr& rec : _selection->images()) {
+    for (const ImageLibrary::RecordRef& rec : _selection->images()) {
         fn(*rec, data);
     }
     
-    _notifying = true;
-    _imageSource->imageLibrary()->observersNotify(
-        ImageLibrary::Event::Type::ChangeProperty, _selection->images());
-    _notifying = false;
+    {
+        ImageLibraryPtr imageLibrary = _imageSource->imageLibrary();
+        auto lock = std::unique_lock(*imageLibrary);
+        _notifying = true;
+        imageLibrary->observersNotify(ImageLibrary::Event::Type::ChangeProperty, _selection->images());
+        _notifying = false;
+    }
 }
 
 // MARK: - Tracking Area
@@ -49,7 +49,7 @@ struct MDCDeviceDemo : MDCDevice {
         std::sort(thumbIds.begin(), thumbIds.end());
         
         // Create the image records in our image library
-        std::set<ImageRecordPtr> recs;
+        ImageSet recs;
         {
             auto lock = std::unique_lock(*_imageLibrary);
             
@@ -186,6 +186,7 @@ struct MDCDeviceReal : MDCDevice {
         {
             _thumbCache.clear();
             _imageCache.clear();
+            _diskCacheClear();
         }
     }
     
@@ -263,7 +264,7 @@ struct MDCDeviceReal : MDCDevice {
         
         std::vector<_SDBlock> addrFull;
         std::vector<_SDBlock> addrThumb;
-        for (const ImageRecordPtr& rec : images) {
+        for (const ImageLibrary::RecordRef& rec : images) {
             addrFull.push_back(rec->info.addrFull);
             addrThumb.push_back(rec->info.addrThumb);
         }
@@ -281,6 +282,22 @@ struct MDCDeviceReal : MDCDevice {
         }
     }
     
+    virtual std::optional<DiskCache::Namespace> diskCacheNamespace() override {
+        // Key our disk cache by the SD card's id, so that a different card (or the same card after
+        // it's been reformatted by another device) can't be supplied data for the wrong images
+        auto lock = _status.signal.lock();
+        if (!_status.status || !_status.status->state.sd.valid) return std::nullopt;
+        
+        DiskCache::Namespace ns;
+        static_assert(sizeof(ns) == sizeof(_status.status->state.sd.cardId));
+        memcpy(ns.data(), &_status.status->state.sd.cardId, sizeof(ns));
+        return ns;
+    }
+    
+    virtual uint64_t dataReadAddress(const ImageRecordPtr& rec, bool thumb) override {
+        return (thumb ? rec->info.addrThumb : rec->info.addrFull);
+    }
+    
     virtual Cleanup dataReadStart() override {
         return _sdModeEnter();
     }
@@ -295,12 +312,14 @@ struct MDCDeviceReal : MDCDevice {
 //            printf("[_dataRead_thread] reading blockBegin:%ju len:%ju (%.1f MB)\n",
 //                (uintmax_t)blockBegin, (uintmax_t)len, (float)len/(1024*1024));
             
+            const auto timeStart = std::chrono::steady_clock::now();
             const _SDBlock block = blockBegin;
             if (!_sdMode.state.dataReadEnd || *_sdMode.state.dataReadEnd!=block) {
                 printf("[_dataRead_thread] Starting readout at %ju\n", (uintmax_t)block);
                 // If readout was in progress at a different address, reset the device
                 if (_sdMode.state.dataReadEnd) {
                     _device.device->reset();
+                    _sdMode.state.stats.resets++;
                 }
                 
                 // Verify that blockBegin can be safely cast to SD::Block
@@ -311,8 +330,12 @@ struct MDCDeviceReal : MDCDevice {
             } else {
 //                printf("[_dataRead_thread] Continuing readout at %ju\n", (uintmax_t)block);
                 _device.device->readout(dst, len);
+                _sdMode.state.stats.continued++;
             }
             _sdMode.state.dataReadEnd = _SDBlockEnd(block, len);
+            _sdMode.state.stats.reads++;
+            _sdMode.state.stats.len += len;
+            _sdMode.state.stats.duration += std::chrono::steady_clock::now()-timeStart;
         }
     }
     
@@ -695,6 +718,19 @@ struct MDCDeviceReal : MDCDevice {
                 }
             
             } else {
+                // Print read stats
+                {
+                    using namespace std::chrono;
+                    const auto& stats = _sdMode.state.stats;
+                    if (stats.reads) {
+                        const double sec = duration_cast<duration<double>>(stats.duration).count();
+                        const double mib = (double)stats.len / (1024*1024);
+                        printf("[_sdModeSet] Read %.1f MiB in %ju reads (%ju continued readouts / resets avoided, "
+                            "%ju resets); %.1f MiB/sec\n", mib, (uintmax_t)stats.reads, (uintmax_t)stats.continued,
+                            (uintmax_t)stats.resets, (sec>0 ? mib/sec : 0));
+                    }
+                }
+                
                 // Assume that we were in the middle of readout; reset the device to exit readout.
                 _device.device->reset();
                 // Exit host mode
@@ -730,10 +766,7 @@ struct MDCDeviceReal : MDCDevice {
         const auto removeBegin = imageLibrary->begin();
         
         // Find the first image >= `deviceImageRange.begin`
-        const auto removeEnd = std::lower_bound(imageLibrary->begin(), imageLibrary->end(), 0,
-            [&](const ImageLibrary::RecordRef& sample, auto) -> bool {
-                return sample->info.id < deviceImageRange.begin;
-            });
+        const auto removeEnd = imageLibrary->idLowerBound(deviceImageRange.begin);
         
         printf("[_RemoveStaleImages] Removing %ju stale images\n", (uintmax_t)(removeEnd-removeBegin));
         imageLibrary->remove(removeBegin, removeEnd);
@@ -817,7 +850,7 @@ struct MDCDeviceReal : MDCDevice {
                 // Note that this will also load unloaded images from a previous session, since we may have
                 // been killed or crashed before we finished loading all images.
                 {
-                    std::set<ImageRecordPtr> recs;
+                    ImageSet recs;
                     for (const ImageLibrary::RecordRef& rec : *_imageLibrary) {
                         if (!rec->status.loadCount) {
                             recs.insert(rec);
@@ -841,20 +874,22 @@ struct MDCDeviceReal : MDCDevice {
                 // so we presume that they've been deleted from the device from a previous
                 // MDCStudio session.
                 {
-                    std::set<ImageRecordPtr> recs;
+                    ImageSet recs;
                     for (const ImageLibrary::RecordRef& rec : *_imageLibrary) {
                         if (!rec->status.loadCount) {
                             recs.insert(rec);
                         }
                     }
                     printf("[_sync_thread] Pruning %ju unloaded images\n", (uintmax_t)recs.size());
+                    auto lock = std::unique_lock(*_imageLibrary);
                     _imageLibrary->remove(recs);
                 }
                 
-                // Write the image library now that we're done syncing
+                // Write the image library now that we're done syncing, and take the opportunity to
+                // compact the chunks that were left sparse by the images that we removed
                 {
                     auto lock = std::unique_lock(*_imageLibrary);
-                    _imageLibrary->write();
+                    _imageLibrary->write(true);
                 }
             }
         
@@ -863,6 +898,7 @@ struct MDCDeviceReal : MDCDevice {
             printf("[_sync_thread] Clearing ImageLibrary\n");
             auto lock = std::unique_lock(*_imageLibrary);
             _imageLibrary->clear();
+            _diskCacheClear();
         
         } catch (const Toastbox::Signal::Stop&) {
             printf("[_sync_thread] Stopping\n");
@@ -960,6 +996,13 @@ struct MDCDeviceReal : MDCDevice {
         struct {
             Cleanup hostMode;
             std::optional<_SDBlock> dataReadEnd;
+            struct {
+                uint64_t reads = 0;
+                uint64_t continued = 0; // Reads that continued the previous readout, avoiding a reset
+                uint64_t resets = 0;
+                uint64_t len = 0;
+                std::chrono::steady_clock::duration duration = {};
+            } stats;
         } state;
         STM::SDCardInfo cardInfo;
     } _sdMode;
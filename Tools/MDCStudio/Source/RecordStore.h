@@ -1,43 +1,239 @@
 #include <filesystem>
+#include <chrono>
 #include <vector>
 #include <fstream>
+#include <sstream>
 #include <list>
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <algorithm>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "Code/Lib/Toastbox/FileDescriptor.h"
 #include "Code/Lib/Toastbox/RuntimeError.h"
 #include "Code/Lib/Toastbox/Mmap.h"
 #include "Code/Lib/Toastbox/NumForStr.h"
+#include "Code/Shared/ChecksumFletcher32.h"
 
 // RecordStore: a persistent data structure designed with the following properties:
 //          storage amount: many gigabytes of data
-//             data format: data is stored as individual records, where each record follows a common templated schema (T_Record)
+//             data format: data is stored as individual records, where each record follows a common templated schema (T_Record);
+//                          each record can optionally have a blob (T_Blob), which is stored in a separate file from the
+//                          records, so that scanning records doesn't touch the (typically much larger) blobs
 //     data access pattern: records are optimally added to the end of the store, and removed from the beginning of the store;
 //                          random-removal is supported and does not move or affect adjacent records;
-//                          the space of a randomly-deleted record is not recovered until chunk compaction occurs (currently unimplemented)
+//                          the space of a randomly-deleted record is not recovered until chunk compaction occurs (via compact())
 //               threading: data can be written from one thread and read from another thread in parallel
+//                  memory: chunks are mapped lazily on first access, and only a bounded number of chunks are mapped
+//                          at once, so startup time and file descriptor count don't scale with the size of the store
+//              durability: writes append the changes since the previous write to a journal, so their cost is
+//                          proportional to the amount of change rather than the size of the store; the journal is
+//                          periodically folded into the index ('checkpointing'), and a torn write is discarded
+//                          when the journal is replayed
 
 template<
-typename T_Record,      // The type of the records
-size_t T_ChunkRecordCap // Max number of records per chunk
+typename T_Record,          // The type of the records
+size_t T_ChunkRecordCap,    // Max number of records per chunk
+typename T_Blob=void        // The type of the blob associated with each record (void for none)
 >
 struct RecordStore {
+    // Version: the version of the store's format
+    // Changing the size of T_Blob requires changing T_Record::Version
     static constexpr uint32_t Version = T_Record::Version;
     static constexpr uint32_t ChunkRecordCap = T_ChunkRecordCap;
     
     using Path = std::filesystem::path;
     using Record = T_Record;
+    using Blob = T_Blob;
     
     using ChunkId = uint64_t;
     
+    struct Chunk;
+    struct _ChunkMaps;
+    
+    // ChunkFile: one of the files backing a chunk (either the records or the blobs)
+    struct ChunkFile {
+        ChunkFile(_ChunkMaps& maps, Chunk& chunk, size_t len) : _maps(maps), _chunk(chunk), _len(len) {}
+        ~ChunkFile() { _maps.unmap(*this); }
+        
+        // mmap(): returns the file's mapping, mapping the file if it isn't already mapped.
+        // Only a bounded number of files are mapped at once (excluding the files of chunks with strong
+        // references). A file that's evicted to make room for another is only unmapped on the next
+        // reclaim() though, so the returned mapping stays valid while the caller holds the lock that
+        // reclaim() requires, regardless of which thread evicts it.
+        Toastbox::Mmap& mmap() {
+            _accessTime.store(_maps.accessTime.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+            Toastbox::Mmap* mmap = _mmap.load();
+            if (!mmap) mmap = &_maps.map(*this);
+            return *mmap;
+        }
+        
+        // len(): the length of the file
+        size_t len() const { return _len; }
+        void len(size_t x) { _maps.len(*this, x); }
+        
+        // sync(): ensures that the file's data is written to disk
+        void sync() { _maps.sync(*this); }
+        
+        Path path() const { return _maps.dir / (std::to_string(_chunk.id) + _suffix); }
+        
+        _ChunkMaps& _maps;
+        Chunk& _chunk;
+        size_t _len = 0;
+        // _suffix: appended to the chunk id to form the file's name. Empty, except while the file
+        // is a compacted copy that hasn't replaced the chunk's file yet (see compact()).
+        std::string _suffix;
+        // _mmap: the file's current mapping (owned by _ChunkMaps), or nullptr if it isn't mapped.
+        // Readers load it without taking _ChunkMaps::_lock, so it's only ever replaced atomically,
+        // and the mapping that it pointed to isn't destroyed until reclaim().
+        // Sequentially consistent (like Chunk::strongCount), so that reclaim() sees the strong
+        // reference of any thread that loaded a mapping before it was evicted.
+        std::atomic<Toastbox::Mmap*> _mmap = nullptr;
+        std::atomic<uint64_t> _accessTime = 0;
+    };
+    
     struct Chunk {
-        Chunk(ChunkId id, Toastbox::Mmap&& mmap) : id(id), mmap(std::move(mmap)) {}
+        Chunk(_ChunkMaps& recordMaps, _ChunkMaps& blobMaps, ChunkId id, size_t recordsLen, size_t blobsLen) :
+        id(id), records(recordMaps, *this, recordsLen), blobs(blobMaps, *this, blobsLen) {}
+        
         ChunkId id = 0;                         // Id of the chunk
         size_t recordCount = 0;                 // Count of records currently stored in chunk
         size_t recordIdx = 0;                   // Index of next record
         std::atomic<size_t> strongCount = 0;    // Count of RecordStrongRef's that currently refer to this chunk
         std::atomic<bool> alive = true;         // Whether the chunk is still alive
-        Toastbox::Mmap mmap;
+        ChunkFile records;                      // File containing the chunk's records
+        ChunkFile blobs;                        // File containing the chunk's blobs (unused if T_Blob is void)
+    };
+    
+    // _ChunkMaps: tracks the chunk files (of one kind) that are currently mapped, and evicts the
+    // least-recently accessed file when mapping a new file would exceed `mapMax`
+    //
+    // Evicted mappings are retired rather than unmapped, because another thread may be reading
+    // through a RecordRef into the evicted file. Retired mappings are unmapped by
+    // RecordStore::reclaim(). Threads holding a strong reference don't synchronize with reclaim()
+    // though, and may have loaded the mapping just before it was evicted, so mappings of chunks
+    // with strong references stay retired until the strong references are gone.
+    struct _ChunkMaps {
+        _ChunkMaps(size_t fileCap, size_t mapMax, int advice) : fileCap(fileCap), mapMax(mapMax), advice(advice) {}
+        
+        Toastbox::Mmap& map(ChunkFile& file) {
+            auto lock = std::unique_lock(_lock);
+            if (Toastbox::Mmap* mmap = file._mmap.load()) return *mmap;
+            
+            // Evict the least-recently accessed file if we're at capacity.
+            // Files of chunks with strong references can't be evicted, because the strong
+            // references need the addresses to remain valid.
+            if (_files.size() >= mapMax) {
+                auto evict = _files.end();
+                for (auto it=_files.begin(); it!=_files.end(); it++) {
+                    const ChunkFile& f = *it->first;
+                    if (f._chunk.strongCount) continue;
+                    if (evict==_files.end() || f._accessTime<evict->first->_accessTime) evict = it;
+                }
+                
+                if (evict != _files.end()) {
+                    // Flush the file before retiring it, because write() only syncs mapped files
+                    evict->second->sync();
+                    evict->first->_mmap.store(nullptr);
+                    _retired.push_back(std::move(*evict));
+                    _files.erase(evict);
+                }
+            }
+            
+            auto mmap = std::make_unique<Toastbox::Mmap>(_ChunkFileOpen(file.path(), fileCap));
+            if (mmap->len()) {
+                madvise((void*)mmap->data(), mmap->len(), advice);
+            }
+            
+            Toastbox::Mmap& r = *mmap;
+            file._mmap.store(&r);
+            _files.emplace_back(&file, std::move(mmap));
+            return r;
+        }
+        
+        // unmap(): unmaps `file` immediately, including its retired mappings; only used when the
+        // file's chunk is destroyed
+        void unmap(ChunkFile& file) {
+            auto lock = std::unique_lock(_lock);
+            _retired.erase(std::remove_if(_retired.begin(), _retired.end(), [&](const auto& x) {
+                return x.first == &file;
+            }), _retired.end());
+            if (!file._mmap.load()) return;
+            file._mmap.store(nullptr);
+            _files.erase(_fileFind(file));
+        }
+        
+        // reclaim(): unmaps the retired mappings of chunks without strong references. They're
+        // synced first, because they may have been written to after they were evicted.
+        void reclaim() {
+            auto lock = std::unique_lock(_lock);
+            _retired.erase(std::remove_if(_retired.begin(), _retired.end(), [&](const auto& x) {
+                if (x.first->_chunk.strongCount) return false;
+                x.second->sync();
+                return true;
+            }), _retired.end());
+        }
+        
+        void len(ChunkFile& file, size_t x) {
+            auto lock = std::unique_lock(_lock);
+            if (file._len == x) return;
+            if (Toastbox::Mmap* mmap = file._mmap.load()) {
+                mmap->len(x);
+            } else {
+                const int ir = truncate(file.path().c_str(), x);
+                if (ir) throw Toastbox::RuntimeError("truncate failed: %s", strerror(errno));
+            }
+            file._len = x;
+        }
+        
+        void sync(ChunkFile& file) {
+            auto lock = std::unique_lock(_lock);
+            // Unmapped files were synced when they were evicted
+            if (Toastbox::Mmap* mmap = file._mmap.load()) mmap->sync();
+        }
+        
+        // fork(): copies `file` to a new file named with `suffix`, and switches `file` to the
+        // copy, so that subsequent writes leave the original file untouched
+        void fork(ChunkFile& file, const std::string& suffix) {
+            auto lock = std::unique_lock(_lock);
+            std::optional<Toastbox::Mmap> unmapped;
+            Toastbox::Mmap* mmap = file._mmap.load();
+            if (!mmap) mmap = &unmapped.emplace(_ChunkFileOpen(file.path(), fileCap));
+            
+            const Path path = dir / (std::to_string(file._chunk.id) + suffix);
+            _FileCreate(path, mmap->data(), file._len);
+            
+            // Unmap the original file; the copy is mapped on the next access
+            if (file._mmap.load()) {
+                file._mmap.store(nullptr);
+                _files.erase(_fileFind(file));
+            }
+            file._suffix = suffix;
+        }
+        
+        // rename(): renames `file` to be named with `suffix`
+        void rename(ChunkFile& file, const std::string& suffix) {
+            auto lock = std::unique_lock(_lock);
+            const Path path = dir / (std::to_string(file._chunk.id) + suffix);
+            std::filesystem::rename(file.path(), path);
+            file._suffix = suffix;
+        }
+        
+        auto _fileFind(const ChunkFile& file) {
+            return std::find_if(_files.begin(), _files.end(),
+                [&](const auto& x) { return x.first == &file; });
+        }
+        
+        Path dir;                   // Directory containing the files
+        const size_t fileCap = 0;   // Capacity of a full file
+        const size_t mapMax = 0;    // Max number of files (without strong references) that are mapped at once
+        const int advice = 0;       // madvise() advice for mapped files
+        std::atomic<uint64_t> accessTime = 0;
+        std::mutex _lock;
+        std::vector<std::pair<ChunkFile*,std::unique_ptr<Toastbox::Mmap>>> _files;
+        std::vector<std::pair<ChunkFile*,std::unique_ptr<Toastbox::Mmap>>> _retired;
     };
     
     using Chunks = std::list<Chunk>;
@@ -80,8 +276,8 @@ struct RecordStore {
         ChunkStrongRef(const ChunkStrongRef& x) { _set(x); }
         ChunkStrongRef& operator=(const ChunkStrongRef& x) { _set(x); return *this; }
         // Move
-        ChunkStrongRef(ChunkStrongRef&& x) { _swap(x); }
-        ChunkStrongRef& operator=(ChunkStrongRef&& x) { _swap(x); return *this; }
+        ChunkStrongRef(ChunkStrongRef&& x) noexcept { _swap(x); }
+        ChunkStrongRef& operator=(ChunkStrongRef&& x) noexcept { _swap(x); return *this; }
         ~ChunkStrongRef() { _set({}); }
         
         void _set(const ChunkRef& ref) {
@@ -128,7 +324,13 @@ struct RecordStore {
         T_Record* operator->() const { return &record(); }
         T_Record& operator*() const { return record(); }
         T_Record& record() const {
-            return *(T_Record*)chunkRef().chunk->mmap.data(idx*sizeof(T_Record), sizeof(T_Record));
+            return *(T_Record*)chunkRef().chunk->records.mmap().data(idx*sizeof(T_Record), sizeof(T_Record));
+        }
+        
+        template<typename T=T_Blob>
+        T& blob() const {
+            static_assert(_BlobEn);
+            return *(T*)chunkRef().chunk->blobs.mmap().data(idx*sizeof(T), sizeof(T));
         }
     };
     
@@ -156,6 +358,218 @@ struct RecordStore {
     using RecordRefConstIter = typename RecordRefs::const_iterator;
     using RecordRefConstReverseIter = typename RecordRefs::const_reverse_iterator;
     
+    // RecordSet: an ordered set of records, stored as runs of consecutive records within a chunk
+    //
+    // Each run holds a ChunkStrongRef, so a RecordSet keeps its records' backing data alive (like
+    // RecordStrongRef) while only pinning once per run, rather than once per record. Inserting
+    // records in order (the common case) extends the last run, so building a RecordSet from a
+    // range of N records is linear and doesn't allocate per record.
+    //
+    // Iterating a RecordSet yields RecordRefs, which remain valid for as long as the RecordSet
+    // holds the record.
+    struct RecordSet {
+        struct Run {
+            ChunkStrongRef chunk;
+            size_t idxBegin = 0;
+            size_t idxEnd = 0;
+        };
+        
+        struct ConstIter {
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = RecordRef;
+            using difference_type = std::ptrdiff_t;
+            using reference = RecordRef;
+            
+            struct pointer {
+                RecordRef ref;
+                const RecordRef* operator->() const { return &ref; }
+            };
+            
+            ConstIter() {}
+            ConstIter(const Run* run, const Run* runEnd, size_t idx) : _run(run), _runEnd(runEnd), _idx(idx) {}
+            
+            RecordRef operator*() const { return RecordRef(_run->chunk, _idx); }
+            pointer operator->() const { return { **this }; }
+            
+            ConstIter& operator++() {
+                _idx++;
+                if (_idx == _run->idxEnd) {
+                    _run++;
+                    _idx = (_run!=_runEnd ? _run->idxBegin : 0);
+                }
+                return *this;
+            }
+            
+            ConstIter& operator--() {
+                if (_run==_runEnd || _idx==_run->idxBegin) {
+                    _run--;
+                    _idx = _run->idxEnd-1;
+                } else {
+                    _idx--;
+                }
+                return *this;
+            }
+            
+            ConstIter operator++(int) { ConstIter x = *this; ++*this; return x; }
+            ConstIter operator--(int) { ConstIter x = *this; --*this; return x; }
+            
+            bool operator==(const ConstIter& x) const { return _run==x._run && _idx==x._idx; }
+            bool operator!=(const ConstIter& x) const { return !(*this == x); }
+            
+            const Run* _run = nullptr;
+            const Run* _runEnd = nullptr;
+            size_t _idx = 0;
+        };
+        
+        using value_type = RecordRef;
+        using iterator = ConstIter;
+        using const_iterator = ConstIter;
+        using reverse_iterator = std::reverse_iterator<ConstIter>;
+        using const_reverse_iterator = std::reverse_iterator<ConstIter>;
+        
+        RecordSet() {}
+        RecordSet(const RecordSet& x) = default;
+        RecordSet& operator=(const RecordSet& x) = default;
+        RecordSet(RecordSet&& x) noexcept : _runs(std::move(x._runs)), _size(std::exchange(x._size, 0)) { x._runs.clear(); }
+        RecordSet& operator=(RecordSet&& x) noexcept {
+            if (this == &x) return *this;
+            _runs = std::move(x._runs);
+            _size = std::exchange(x._size, 0);
+            x._runs.clear();
+            return *this;
+        }
+        
+        RecordSet(std::initializer_list<RecordRef> refs) {
+            for (const RecordRef& ref : refs) insert(ref);
+        }
+        
+        template<typename T_Iter>
+        RecordSet(T_Iter begin, T_Iter end) {
+            insert(begin, end);
+        }
+        
+        ConstIter begin() const {
+            if (_runs.empty()) return end();
+            return ConstIter(_runs.data(), _runs.data()+_runs.size(), _runs.front().idxBegin);
+        }
+        
+        ConstIter end() const {
+            const Run* runEnd = _runs.data()+_runs.size();
+            return ConstIter(runEnd, runEnd, 0);
+        }
+        
+        const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+        const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+        
+        size_t size() const { return _size; }
+        bool empty() const { return !_size; }
+        const std::vector<Run>& runs() const { return _runs; }
+        
+        // lower_bound(): returns the first record >= `ref`
+        ConstIter lower_bound(const RecordRef& ref) const {
+            const auto run = _runFind(ref);
+            if (run == _runs.end()) return end();
+            return ConstIter(&*run, _runs.data()+_runs.size(), (_runContains(*run, ref) ? ref.idx : run->idxBegin));
+        }
+        
+        ConstIter find(const RecordRef& ref) const {
+            const auto run = _runFind(ref);
+            if (run==_runs.end() || !_runContains(*run, ref)) return end();
+            return ConstIter(&*run, _runs.data()+_runs.size(), ref.idx);
+        }
+        
+        size_t count(const RecordRef& ref) const {
+            return find(ref) != end();
+        }
+        
+        void insert(const RecordRef& ref) {
+            // Fast path: `ref` comes after all of our records, so we can skip the search
+            auto run = (_runs.empty() || _runBefore(_runs.back(), ref) ? _runs.end() : _runFind(ref));
+            if (run!=_runs.end() && _runContains(*run, ref)) return;
+            
+            const bool mergePrev = (run!=_runs.begin() && std::prev(run)->chunk==ref.chunkRef() &&
+                std::prev(run)->idxEnd==ref.idx);
+            const bool mergeNext = (run!=_runs.end() && run->chunk==ref.chunkRef() &&
+                run->idxBegin==ref.idx+1);
+            
+            if (mergePrev && mergeNext) {
+                std::prev(run)->idxEnd = run->idxEnd;
+                _runs.erase(run);
+            } else if (mergePrev) {
+                std::prev(run)->idxEnd++;
+            } else if (mergeNext) {
+                run->idxBegin--;
+            } else {
+                _runs.insert(run, Run{
+                    .chunk = ref.chunkRef(),
+                    .idxBegin = ref.idx,
+                    .idxEnd = ref.idx+1,
+                });
+            }
+            _size++;
+        }
+        
+        template<typename T_Iter>
+        void insert(T_Iter begin, T_Iter end) {
+            for (auto it=begin; it!=end; it++) insert(*it);
+        }
+        
+        size_t erase(const RecordRef& ref) {
+            const auto run = _runFind(ref);
+            if (run==_runs.end() || !_runContains(*run, ref)) return 0;
+            
+            if (run->idxBegin==ref.idx && run->idxEnd==ref.idx+1) {
+                _runs.erase(run);
+            } else if (run->idxBegin == ref.idx) {
+                run->idxBegin++;
+            } else if (run->idxEnd == ref.idx+1) {
+                run->idxEnd--;
+            } else {
+                // Split the run
+                const size_t idxEnd = run->idxEnd;
+                run->idxEnd = ref.idx;
+                _runs.insert(std::next(run), Run{
+                    .chunk = run->chunk,
+                    .idxBegin = ref.idx+1,
+                    .idxEnd = idxEnd,
+                });
+            }
+            _size--;
+            return 1;
+        }
+        
+        ConstIter erase(ConstIter it) {
+            const RecordRef ref = *it;
+            erase(ref);
+            return lower_bound(ref);
+        }
+        
+        void clear() {
+            _runs.clear();
+            _size = 0;
+        }
+        
+        // _runBefore(): whether every record in `run` comes before `ref`
+        static bool _runBefore(const Run& run, const RecordRef& ref) {
+            if (run.chunk != ref.chunkRef()) return run.chunk < ref.chunkRef();
+            return run.idxEnd <= ref.idx;
+        }
+        
+        static bool _runContains(const Run& run, const RecordRef& ref) {
+            return run.chunk==ref.chunkRef() && ref.idx>=run.idxBegin && ref.idx<run.idxEnd;
+        }
+        
+        // _runFind(): returns the first run that doesn't come entirely before `ref`
+        typename std::vector<Run>::iterator _runFind(const RecordRef& ref) const {
+            auto& runs = const_cast<std::vector<Run>&>(_runs);
+            return std::partition_point(runs.begin(), runs.end(),
+                [&](const Run& run) { return _runBefore(run, ref); });
+        }
+        
+        std::vector<Run> _runs;
+        size_t _size = 0;
+    };
+    
     struct _State {
         ChunkId chunkId = 0;
         RecordRefs recordRefs;
@@ -198,64 +612,236 @@ struct RecordStore {
             });
     }
     
-    std::ifstream read(Path path) {
-        _path = path;
-        std::filesystem::create_directories(_ChunksPath(_path));
-        return _StateRead(_path, _state);
+    // read(): reads the store from disk
+    // Returns a stream containing the subclass state that was supplied to the most recent write()
+    std::istringstream read(Path path) {
+        _pathSet(path);
+        std::istringstream f(_StateRead(_path, *_recordMaps, *_blobMaps, _state, _journal));
+        f.exceptions(std::istringstream::failbit | std::istringstream::badbit);
+        return f;
     }
     
-    std::ofstream write() {
+    // create(): creates an empty store, replacing the store at `path` (if any) on the next write()
+    void create(Path path) {
+        _pathSet(path);
+        _state = {};
+        _journal = {};
+        _journal.checkpoint = true;
+    }
+    
+    // write(): writes the store to disk, along with the subclass state `state`
+    //
+    // The Index isn't rewritten on every write(). Instead, the additions and removals performed
+    // since the previous write() are appended to the Journal as a single transaction, which
+    // read() replays on top of the Index. The Index is rewritten (a 'checkpoint') when the Journal
+    // has grown larger than the Index, or when the store was modified in a way that the Journal
+    // can't describe (via clear() or compact()).
+    void write(const std::string& state) {
         namespace fs = std::filesystem;
         
-        #warning TODO: implement optional 'thorough compaction' (based on argument) to shift records in order to compact chunks into the smallest size possible. skip compaction for chunks with outstanding strong references though (Chunk.strongCount), because the strong references need the addresses to remain constant!
-        
         // Ensure that all chunks are written to disk
-        for (const Chunk& chunk : _state.chunks) {
-            if (chunk.alive) chunk.mmap.sync();
+        // This must happen before the Index/Journal are written, so that they never reference
+        // records that aren't on disk yet.
+        for (Chunk& chunk : _state.chunks) {
+            if (!chunk.alive) continue;
+            chunk.records.sync();
+            if constexpr (_BlobEn) chunk.blobs.sync();
         }
         
+        reclaim();
+        
         // Prune chunks (in memory) that have 0 records and 0 strong references
+        std::vector<ChunkId> prunedChunks;
         {
-            _state.chunks.remove_if([] (const Chunk& chunk) {
-                return chunk.recordCount==0 && chunk.strongCount==0;
+            _state.chunks.remove_if([&] (const Chunk& chunk) {
+                const bool prune = chunk.recordCount==0 && chunk.strongCount==0;
+                if (prune) prunedChunks.push_back(chunk.id);
+                return prune;
             });
         }
         
+        // Ensure that the directory entries of newly-created chunk files are on disk, before the
+        // Index/Journal reference them
+        if (_journal.chunkDirsSync) {
+            _ChunkDirsSync(_path);
+            _journal.chunkDirsSync = false;
+        }
+        
+        // Delete chunk files only after the write is durable, otherwise a crash could leave us with
+        // an Index or Journal that references deleted chunks.
+        if (_journal.checkpoint || !_journal.fd || _journal.len>=_journal.indexLen) {
+            _checkpointWrite(state);
+            _chunkFilesPrune();
+        
+        } else {
+            _journalAppend(state);
+            for (ChunkId id : prunedChunks) {
+                printf("[RecordStore::write()] deleting chunk file %ju\n", (uintmax_t)id);
+                fs::remove(_ChunkPath(_path, id));
+                if constexpr (_BlobEn) fs::remove(_BlobPath(_path, id));
+            }
+        }
+        
         // Perform 'trivial compaction': truncate each chunk to its last record (according to chunk.recordIdx)
+        // This also happens only after the write is durable, because the previous Index may
+        // reference records beyond chunk.recordIdx (if compact() moved them).
+        // Dead chunks are skipped because their files are deleted.
         {
             for (Chunk& chunk : _state.chunks) {
-                chunk.mmap.len(chunk.recordIdx * sizeof(T_Record));
+                if (chunk.alive) _ChunkLenSet(chunk, chunk.recordIdx);
             }
         }
+    }
+    
+    // reclaim(): unmaps the chunk files that were evicted to make room for other mappings
+    //
+    // Evicted files aren't unmapped immediately, because another thread may be reading through a
+    // (weak) RecordRef into them. So reclaim() must be called with whatever lock the readers of
+    // RecordRefs hold, which is also the lock that write() requires.
+    void reclaim() {
+        _recordMaps->reclaim();
+        _blobMaps->reclaim();
+    }
+    
+    struct CompactStats {
+        size_t recordsMoved = 0;    // Count of records that were moved to a new location
+        size_t chunksFreed = 0;     // Count of chunks that no longer contain any records
+        size_t bytesReclaimed = 0;  // Count of bytes that will be truncated from chunk files on the next write()
+        std::chrono::steady_clock::duration duration = {};
+    };
+    
+    // compact(): performs 'thorough compaction', which shifts records out of sparse chunks and into
+    // the free slots of the preceding sparse chunks, so that write() can truncate the chunks to the
+    // smallest size possible and delete the chunks that were emptied.
+    //
+    // The Index on disk still references the records' old locations until the next write(), so
+    // records are never moved within a chunk's file. Instead, the chunks that records are moved
+    // into are first copied to new files (see _ChunkFork()), and write() swaps the copies in
+    // together with the new Index (see _checkpointWrite()).
+    //
+    // The order of records is preserved. Chunks with outstanding strong references (Chunk.strongCount)
+    // are skipped, because the strong references need the addresses to remain constant.
+    //
+    // Compaction is incremental: once `recordMoveMax` records have been moved, compaction stops at
+    // the next chunk boundary, and subsequent calls pick up the remaining work.
+    //
+    // RecordRefs are invalidated by compact(), and the changes aren't persisted until the next write().
+    CompactStats compact(size_t recordMoveMax=SIZE_MAX) {
+        const auto timeStart = std::chrono::steady_clock::now();
+        CompactStats stats;
         
-        // Delete unused chunk files
-        {
-            std::set<ChunkId> aliveChunks;
-            for (Chunk& chunk : _state.chunks) {
-                if (chunk.alive) aliveChunks.insert(chunk.id);
+        size_t recordIdxSumBefore = 0;
+        size_t chunksUsedBefore = 0;
+        for (const Chunk& chunk : _state.chunks) {
+            recordIdxSumBefore += chunk.recordIdx;
+            chunksUsedBefore += (chunk.recordCount ? 1 : 0);
+        }
+        
+        // `dst` / `dstIdx` is the location where the next record in the current run of
+        // compactable chunks will be placed. The location is always <= the record's current
+        // location, so records are never overwritten before they're moved.
+        auto chunkIt = _state.chunks.begin();
+        std::optional<typename Chunks::iterator> dst;
+        size_t dstIdx = 0;
+        Chunk* src = nullptr;
+        
+        const auto runEnd = [&] () {
+            if (!dst) return;
+            (*dst)->recordIdx = dstIdx;
+            // The chunks after `dst` (up to and including `src`) had all their records moved out
+            for (auto it=*dst; &*it!=src;) {
+                it++;
+                if (!it->strongCount) it->recordIdx = 0;
+            }
+            dst = std::nullopt;
+        };
+        
+        for (RecordRef& ref : _state.recordRefs) {
+            if (ref.chunk != src) {
+                // We're entering a new chunk
+                if (stats.recordsMoved >= recordMoveMax) break;
+                if (!_ChunkCompactable(*ref.chunk)) runEnd();
+                
+                src = ref.chunk;
+                if (!_ChunkCompactable(*src)) continue;
+                
+                if (!dst) {
+                    // Start a new run at `src`
+                    while (&*chunkIt != src) chunkIt++;
+                    dst = chunkIt;
+                    dstIdx = 0;
+                    _ChunkLenSet(**dst, T_ChunkRecordCap);
+                }
             }
             
-            for (const fs::path& p : fs::directory_iterator(_ChunksPath(_path))) {
-                // Delete the chunk file if it's beyond the new count of chunks (therefore
-                // it's an old chunk file that's no longer needed).
-                std::optional<ChunkId> deleteName;
-                try {
-                    deleteName = Toastbox::IntForStr<ChunkId>(p.filename().string());
-                    if (aliveChunks.find(*deleteName) != aliveChunks.end()) {
-                        deleteName = std::nullopt; // Chunk file is in use; don't delete it
-                    }
-                // Don't do anything if we can't convert the filename to an integer;
-                // assume the file is supposed to be there.
-                } catch (...) {}
+            if (!dst) continue;
+            
+            // Advance to the next compactable chunk if `dst` is full
+            if (dstIdx == T_ChunkRecordCap) {
+                (*dst)->recordIdx = T_ChunkRecordCap;
+                do (*dst)++; while (!_ChunkCompactable(**dst));
+                dstIdx = 0;
+                _ChunkLenSet(**dst, T_ChunkRecordCap);
+            }
+            
+            Chunk& dstChunk = **dst;
+            if (ref.chunk!=&dstChunk || ref.idx!=dstIdx) {
+                _ChunkFork(dstChunk);
+                std::memcpy(
+                    dstChunk.records.mmap().data(dstIdx*sizeof(T_Record), sizeof(T_Record)),
+                    ref.chunk->records.mmap().data(ref.idx*sizeof(T_Record), sizeof(T_Record)),
+                    sizeof(T_Record)
+                );
                 
-                if (deleteName) {
-                    printf("[RecordStore::write()] deleting chunk file %ju\n", (uintmax_t)*deleteName);
-                    fs::remove(_chunkPath(*deleteName));
+                if constexpr (_BlobEn) {
+                    std::memcpy(
+                        dstChunk.blobs.mmap().data(dstIdx*sizeof(T_Blob), sizeof(T_Blob)),
+                        ref.chunk->blobs.mmap().data(ref.idx*sizeof(T_Blob), sizeof(T_Blob)),
+                        sizeof(T_Blob)
+                    );
                 }
+                
+                ref.chunk->recordCount--;
+                dstChunk.recordCount++;
+                ref.chunk = &dstChunk;
+                ref.idx = dstIdx;
+                stats.recordsMoved++;
             }
+            dstIdx++;
+        }
+        runEnd();
+        
+        // The Journal can't describe records moving, so the next write() needs to checkpoint
+        if (stats.recordsMoved) _journal.checkpoint = true;
+        
+        size_t recordIdxSumAfter = 0;
+        size_t chunksUsedAfter = 0;
+        for (const Chunk& chunk : _state.chunks) {
+            recordIdxSumAfter += chunk.recordIdx;
+            chunksUsedAfter += (chunk.recordCount ? 1 : 0);
         }
         
-        return _StateWrite(_path, _state);
+        stats.chunksFreed = chunksUsedBefore - chunksUsedAfter;
+        stats.bytesReclaimed = (recordIdxSumBefore - recordIdxSumAfter) * sizeof(T_Record);
+        stats.duration = std::chrono::steady_clock::now() - timeStart;
+        
+        printf("[RecordStore::compact()] moved %ju records, freed %ju chunks, reclaimed %ju bytes (took %ju ms)\n",
+            (uintmax_t)stats.recordsMoved, (uintmax_t)stats.chunksFreed, (uintmax_t)stats.bytesReclaimed,
+            (uintmax_t)std::chrono::duration_cast<std::chrono::milliseconds>(stats.duration).count());
+        return stats;
+    }
+    
+    // reclaimableCount(): returns the number of record slots left unused by removals in the chunks
+    // that compact() would compact
+    //
+    // compact() forces the next write() to checkpoint, so callers use this to decide whether
+    // compacting is worthwhile.
+    size_t reclaimableCount() const {
+        size_t r = 0;
+        for (const Chunk& chunk : _state.chunks) {
+            if (_ChunkCompactable(chunk)) r += chunk.recordIdx - chunk.recordCount;
+        }
+        return r;
     }
     
     // add(): adds records to the end
@@ -268,11 +854,35 @@ struct RecordStore {
             ref.idx = chunk.recordIdx;
             chunk.recordCount++;
             chunk.recordIdx++;
+            
+            // Log the addition, coalescing it with the previous addition if possible
+            _SerializedJournalOp* op = (!_journal.ops.empty() ? &_journal.ops.back() : nullptr);
+            if (op && op->type==(uint32_t)_JournalOpType::Add &&
+                op->chunkId==chunk.id && op->idx+op->count==ref.idx) {
+                op->count++;
+            } else {
+                _journal.ops.push_back({
+                    .type = (uint32_t)_JournalOpType::Add,
+                    .count = 1,
+                    .chunkId = chunk.id,
+                    .idx = (uint32_t)ref.idx,
+                });
+            }
         }
     }
     
     // remove(): remove a range of records
     void remove(RecordRefConstIter begin, RecordRefConstIter end) {
+        if (begin == end) return;
+        
+        // Log the removal
+        _journal.ops.push_back({
+            .type = (uint32_t)_JournalOpType::Remove,
+            .count = (uint32_t)(end-begin),
+            .chunkId = begin->chunk->id,
+            .idx = (uint32_t)begin->idx,
+        });
+        
         for (auto it=begin; it!=end; it++) {
             Chunk& chunk = const_cast<Chunk&>(*it->chunk);
             chunk.recordCount--;
@@ -281,47 +891,71 @@ struct RecordStore {
         _state.recordRefs.erase(begin, end);
     }
     
-    // remove(): remove a set of records by composing iterator ranges for the set
-    template<typename T>
-    void remove(const std::set<T>& recs) {
-        // Create a vector of iterator ranges from `recs`
-        struct IterRange {
-            RecordRefConstIter first;
-            RecordRefConstIter last;
-        };
+    // remove(): remove a set of records
+    // This is a single linear pass over the store's records, merged with `recs` (which are in the
+    // same order). Records in `recs` that aren't in the store are ignored.
+    void remove(const RecordSet& recs) {
+        if (recs.empty()) return;
         
-        std::vector<IterRange> iterRanges;
-        std::optional<IterRange> iterRangeCurrent;
+        auto rec = recs.begin();
+        auto dst = _state.recordRefs.begin();
+        std::optional<_SerializedJournalOp> op;
+        size_t rangeCount = 0;
         for (auto it=_state.recordRefs.begin(); it!=_state.recordRefs.end(); it++) {
-            if (recs.find(*it) != recs.end()) {
-                if (!iterRangeCurrent) iterRangeCurrent = { it, it };
-                iterRangeCurrent->last = it;
+            while (rec!=recs.end() && *rec<*it) rec++;
+            
+            if (rec!=recs.end() && *rec==*it) {
+                it->chunk->recordCount--;
+                rec++;
+                
+                // Log the removal, coalescing it with the previous removal if it's contiguous
+                if (op) {
+                    op->count++;
+                } else {
+                    op = {
+                        .type = (uint32_t)_JournalOpType::Remove,
+                        .count = 1,
+                        .chunkId = it->chunk->id,
+                        .idx = (uint32_t)it->idx,
+                    };
+                }
+            
             } else {
-                if (iterRangeCurrent) {
-                    iterRanges.push_back(*iterRangeCurrent);
-                    iterRangeCurrent = std::nullopt;
+                if (op) {
+                    _journal.ops.push_back(*op);
+                    op = std::nullopt;
+                    rangeCount++;
                 }
+                *dst = *it;
+                dst++;
             }
         }
         
-        // Push final IterRange
-        if (iterRangeCurrent) iterRanges.push_back(*iterRangeCurrent);
-        
-        // Call remove() for each IterRange
-        // Iterate backwards over iterRanges, to ensure the iterators remain valid as we remove them!
-        printf("[RecordStore] Removing %ju ranges of records\n", (uintmax_t)iterRanges.size());
-        for (auto it=iterRanges.rbegin(); it!=iterRanges.rend(); it++) {
-            remove(it->first, it->last+1);
+        if (op) {
+            _journal.ops.push_back(*op);
+            rangeCount++;
         }
+        
+        printf("[RecordStore] Removed %ju ranges of records\n", (uintmax_t)rangeCount);
+        _state.recordRefs.erase(dst, _state.recordRefs.end());
     }
     
     void clear() {
         for (Chunk& chunk : _state.chunks) {
+            // Map chunks that have strong references before they die, because their files are
+            // deleted on the next write(), after which they can't be mapped
+            if (chunk.strongCount) {
+                chunk.records.mmap();
+                if constexpr (_BlobEn) chunk.blobs.mmap();
+            }
             chunk.recordCount = 0;
             chunk.alive = false;
         }
         
         _state.recordRefs.clear();
+        
+        // The Journal can't describe clearing, so the next write() needs to checkpoint
+        _journal.checkpoint = true;
     }
     
     bool empty() const { return _state.recordRefs.empty(); }
@@ -351,18 +985,76 @@ struct RecordStore {
         static_assert(std::is_same_v<decltype(chunkId), ChunkId>);
     };
     
-    static constexpr size_t _ChunkLen = sizeof(T_Record)*T_ChunkRecordCap;
+    template<typename T>
+    static constexpr size_t _SizeOf() {
+        if constexpr (std::is_void_v<T>) return 0;
+        else return sizeof(T);
+    }
+    
+    static constexpr bool _BlobEn = !std::is_void_v<T_Blob>;
+    static constexpr size_t _BlobSize = _SizeOf<T_Blob>();
+    
+    // _RecordMapMax / _BlobMapMax: max number of record/blob files (without strong references)
+    // that are mapped at once
+    static constexpr size_t _RecordMapMax = 128;
+    static constexpr size_t _BlobMapMax = 64;
+    
+    static constexpr uint32_t _JournalVersion = 0;
+    
+    // _CompactSuffix: the suffix of the chunk file copies that compact() moves records into
+    static inline const std::string _CompactSuffix = ".compact";
+    
+    enum class _JournalOpType : uint32_t {
+        Add,    // Records were added to the end of the store
+        Remove, // A contiguous range of records was removed from the store
+    };
+    
+    struct [[gnu::packed]] _SerializedJournalHeader {
+        uint32_t version = 0;       // _JournalVersion
+        uint32_t indexChecksum = 0; // Checksum of the Index that the Journal applies to
+    };
+    
+    struct [[gnu::packed]] _SerializedJournalTxn {
+        uint32_t opCount = 0;   // Count of _SerializedJournalOp structs following the header
+        uint32_t stateLen = 0;  // Length of subclass state following the ops
+        uint32_t checksum = 0;  // Checksum of the entire transaction (including the header, with checksum=0)
+        uint32_t _pad = 0;
+    };
+    
+    struct [[gnu::packed]] _SerializedJournalOp {
+        uint32_t type = 0;      // _JournalOpType
+        uint32_t count = 0;     // Count of records
+        uint64_t chunkId = 0;   // Chunk id of the first record
+        uint32_t idx = 0;       // Index of the first record within its chunk
+        uint32_t _pad = 0;
+        
+        // Make sure the type of `chunkId` matches ChunkId
+        static_assert(std::is_same_v<decltype(chunkId), ChunkId>);
+    };
+    
+    struct _Journal {
+        std::optional<Toastbox::FileDescriptor> fd;     // Journal file, opened for appending
+        size_t len = 0;                                 // Length of the Journal file
+        size_t indexLen = 0;                            // Length of the Index file that the Journal applies to
+        std::vector<_SerializedJournalOp> ops;          // Operations performed since the last write()
+        bool checkpoint = false;                        // Whether the next write() needs to checkpoint
+        bool chunkDirsSync = false;                     // Whether the next write() needs to fsync the Chunks/Blobs directories
+    };
     
-    static std::ifstream _StateRead(const Path& path, _State& state) {
+    static std::string _StateRead(const Path& path, _ChunkMaps& recordMaps, _ChunkMaps& blobMaps, _State& state, _Journal& journal) {
+        namespace fs = std::filesystem;
+        
         try {
             state = {};
+            journal = {};
+            
+            const std::string index = _FileRead(_IndexPath(path));
+            size_t off = 0;
             
-            std::ifstream f;
-            f.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-            f.open(_IndexPath(path));
+            _ChunkCopiesRecover(path, index);
             
             _SerializedHeader header;
-            f.read((char*)&header, sizeof(header));
+            _BufRead(index, off, &header, sizeof(header));
             
             if (header.version != Version) {
                 throw Toastbox::RuntimeError("invalid header version (expected: 0x%jx, got: 0x%jx)",
@@ -376,17 +1068,78 @@ struct RecordStore {
                     (uintmax_t)sizeof(T_Record), (uintmax_t)header.recordSize);
             }
             
+            std::vector<_SerializedRecordRef> refs(header.recordCount);
+            _BufRead(index, off, refs.data(), refs.size()*sizeof(_SerializedRecordRef));
+            
+            // The subclass state occupies the remainder of the Index
+            std::string subclassState = index.substr(off);
+            
+            // Replay the Journal on top of the Index
+            journal.indexLen = index.size();
+            journal.checkpoint = true;
+            if (fs::exists(_JournalPath(path))) {
+                const std::string j = _FileRead(_JournalPath(path));
+                size_t off = 0;
+                
+                _SerializedJournalHeader jheader;
+                _BufRead(j, off, &jheader, sizeof(jheader));
+                
+                if (jheader.version != _JournalVersion) {
+                    printf("[RecordStore] ignoring journal: invalid version (expected: 0x%jx, got: 0x%jx)\n",
+                        (uintmax_t)_JournalVersion, (uintmax_t)jheader.version);
+                
+                // If the Journal's checksum doesn't match the Index, the Journal predates the Index (ie we
+                // crashed during a checkpoint after the Index was replaced), so the Index already contains
+                // the Journal's transactions.
+                } else if (jheader.indexChecksum != _Checksum(index)) {
+                    printf("[RecordStore] ignoring journal: belongs to a previous index\n");
+                
+                } else {
+                    // Replay transactions until we hit the end of the Journal, or a transaction that
+                    // was torn by a crash
+                    size_t txnCount = 0;
+                    for (;;) {
+                        const std::optional<size_t> txnLen = _JournalTxnValidate(j, off);
+                        if (!txnLen) break;
+                        
+                        _SerializedJournalTxn txn;
+                        _BufRead(j, off, &txn, sizeof(txn));
+                        for (uint32_t i=0; i<txn.opCount; i++) {
+                            _SerializedJournalOp op;
+                            _BufRead(j, off, &op, sizeof(op));
+                            _JournalOpApply(refs, op);
+                        }
+                        
+                        subclassState = j.substr(off, txn.stateLen);
+                        off += *txnLen - sizeof(txn) - txn.opCount*sizeof(_SerializedJournalOp);
+                        txnCount++;
+                    }
+                    
+                    if (off != j.size()) {
+                        printf("[RecordStore] discarding %ju bytes of torn journal transaction\n", (uintmax_t)(j.size()-off));
+                    }
+                    printf("[RecordStore] replayed %ju journal transactions\n", (uintmax_t)txnCount);
+                    
+                    // Open the Journal for appending, dropping any torn transaction from the end
+                    const int fdi = open(_JournalPath(path).c_str(), O_WRONLY|O_CLOEXEC);
+                    if (fdi < 0) throw Toastbox::RuntimeError("open failed: %s", strerror(errno));
+                    journal.fd.emplace(fdi);
+                    const int ir = ftruncate(*journal.fd, off);
+                    if (ir) throw Toastbox::RuntimeError("ftruncate failed: %s", strerror(errno));
+                    journal.len = off;
+                    journal.checkpoint = false;
+                }
+            }
+            
             // Create RecordRefs
-            state.recordRefs.resize(header.recordCount);
+            state.recordRefs.resize(refs.size());
             
             std::map<ChunkId,Chunk*> chunksMap;
             std::optional<ChunkId> chunkIdPrev;
             std::optional<size_t> idxPrev;
-            for (size_t i=0; i<header.recordCount; i++) {
-                _SerializedRecordRef ref;
-                f.read((char*)&ref, sizeof(ref));
-                
-                const ChunkId chunkId = ref.chunkId;
+            for (size_t i=0; i<refs.size(); i++) {
+                const ChunkId chunkId = refs[i].chunkId;
+                const size_t idx = refs[i].idx;
                 
                 // Verify that chunkId's are monotonically increasing
                 
@@ -400,48 +1153,60 @@ struct RecordStore {
                 }
                 
                 if (chunkIdPrev && idxPrev && chunkId==*chunkIdPrev) {
-                    if (!(ref.idx > *idxPrev)) {
+                    if (!(idx > *idxPrev)) {
                         throw Toastbox::RuntimeError("record indexes aren't monotonically increasing (previous index: %ju, current index: %ju)",
                             (uintmax_t)(*idxPrev),
-                            (uintmax_t)(ref.idx)
+                            (uintmax_t)(idx)
                         );
                     }
                 }
                 
                 Chunk*& chunk = chunksMap[chunkId];
-                if (!chunk) chunk = &state.chunks.emplace_back(chunkId, _ChunkFileOpen(_ChunkPath(path, chunkId)));
+                // Chunks aren't mapped until they're accessed (via ChunkFile::mmap())
+                if (!chunk) {
+                    const size_t recordsLen = _ChunkFileLen(_ChunkPath(path, chunkId));
+                    const size_t blobsLen = (_BlobEn ? _ChunkFileLen(_BlobPath(path, chunkId)) : 0);
+                    chunk = &state.chunks.emplace_back(recordMaps, blobMaps, chunkId, recordsLen, blobsLen);
+                }
                 
-                if (sizeof(T_Record)*(ref.idx+1) > chunk->mmap.len()) {
+                if (sizeof(T_Record)*(idx+1) > chunk->records.len()) {
                     throw Toastbox::RuntimeError("RecordRef extends beyond chunk (RecordRef end: 0x%jx, chunk end: 0x%jx)",
-                        (uintmax_t)(sizeof(T_Record)*(ref.idx+1)),
-                        (uintmax_t)chunk->mmap.len()
+                        (uintmax_t)(sizeof(T_Record)*(idx+1)),
+                        (uintmax_t)chunk->records.len()
+                    );
+                }
+                
+                if (_BlobSize*(idx+1) > chunk->blobs.len()) {
+                    throw Toastbox::RuntimeError("RecordRef extends beyond blob chunk (RecordRef end: 0x%jx, chunk end: 0x%jx)",
+                        (uintmax_t)(_BlobSize*(idx+1)),
+                        (uintmax_t)chunk->blobs.len()
                     );
                 }
                 
                 state.recordRefs[i].chunk = chunk;
-                state.recordRefs[i].idx = ref.idx;
+                state.recordRefs[i].idx = idx;
                 
                 chunk->recordCount++;
-                chunk->recordIdx = ref.idx+1;
+                chunk->recordIdx = idx+1;
                 
                 chunkIdPrev = chunkId;
-                idxPrev = ref.idx;
+                idxPrev = idx;
             }
             
             // Set state.chunkId to the last chunkId we encountered + 1
             state.chunkId = (chunkIdPrev ? *chunkIdPrev+1 : 0);
-            return f;
+            return subclassState;
         
         } catch (...) {
             state = {};
+            journal = {};
             throw;
         }
     }
     
-    static std::ofstream _StateWrite(const Path& path, const _State& state) {
-        std::ofstream f;
-        f.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-        f.open(_IndexPath(path));
+    static std::string _IndexSerialize(const _State& state, const std::string& subclassState) {
+        std::string r;
+        r.reserve(sizeof(_SerializedHeader) + state.recordRefs.size()*sizeof(_SerializedRecordRef) + subclassState.size());
         
         // Write header
         const _SerializedHeader header = {
@@ -449,7 +1214,7 @@ struct RecordStore {
             .recordSize  = (uint32_t)sizeof(T_Record),
             .recordCount = (uint32_t)state.recordRefs.size(),
         };
-        f.write((char*)&header, sizeof(header));
+        r.append((const char*)&header, sizeof(header));
         
         // Write RecordRefs
         for (const RecordRef& ref : state.recordRefs) {
@@ -457,16 +1222,254 @@ struct RecordStore {
                 .chunkId = ref.chunk->id,
                 .idx = (uint32_t)ref.idx,
             };
-            f.write((const char*)&sref, sizeof(sref));
+            r.append((const char*)&sref, sizeof(sref));
         }
         
-        return f;
+        // Write subclass state
+        r.append(subclassState);
+        return r;
+    }
+    
+    // _JournalTxnValidate(): returns the length of the transaction at `off`, or nullopt if the
+    // transaction is incomplete or its checksum doesn't match
+    static std::optional<size_t> _JournalTxnValidate(const std::string& j, size_t off) {
+        if (j.size()-off < sizeof(_SerializedJournalTxn)) return std::nullopt;
+        
+        _SerializedJournalTxn txn;
+        memcpy(&txn, j.data()+off, sizeof(txn));
+        
+        const size_t len = sizeof(txn) + (size_t)txn.opCount*sizeof(_SerializedJournalOp) + txn.stateLen;
+        const size_t lenPadded = len + (len%2);
+        if (j.size()-off < lenPadded) return std::nullopt;
+        
+        std::string buf = j.substr(off, lenPadded);
+        const uint32_t zero = 0;
+        memcpy(buf.data()+offsetof(_SerializedJournalTxn, checksum), &zero, sizeof(zero));
+        if (_Checksum(buf) != txn.checksum) return std::nullopt;
+        return lenPadded;
+    }
+    
+    static void _JournalOpApply(std::vector<_SerializedRecordRef>& refs, const _SerializedJournalOp& op) {
+        switch ((_JournalOpType)op.type) {
+        case _JournalOpType::Add:
+            for (uint32_t i=0; i<op.count; i++) {
+                refs.push_back({
+                    .chunkId = op.chunkId,
+                    .idx = op.idx+i,
+                });
+            }
+            break;
+        
+        case _JournalOpType::Remove: {
+            const ChunkId chunkId = op.chunkId;
+            const uint32_t idx = op.idx;
+            const auto begin = std::lower_bound(refs.begin(), refs.end(), 0,
+                [&](const _SerializedRecordRef& sample, auto) -> bool {
+                    if (sample.chunkId != chunkId) return sample.chunkId < chunkId;
+                    return sample.idx < idx;
+                });
+            
+            if (begin==refs.end() || begin->chunkId!=chunkId || begin->idx!=idx || (size_t)(refs.end()-begin)<op.count) {
+                throw Toastbox::RuntimeError("journal removal refers to nonexistent records (chunk id: %ju, index: %ju, count: %ju)",
+                    (uintmax_t)chunkId, (uintmax_t)idx, (uintmax_t)op.count);
+            }
+            
+            refs.erase(begin, begin+op.count);
+            break;
+        }
+        
+        default:
+            throw Toastbox::RuntimeError("invalid journal op type: %ju", (uintmax_t)op.type);
+        }
+    }
+    
+    // _checkpointWrite(): rewrites the Index and starts a new, empty Journal
+    void _checkpointWrite(const std::string& subclassState) {
+        namespace fs = std::filesystem;
+        
+        const std::string index = _IndexSerialize(_state, subclassState);
+        
+        // Stage the chunk copies made by compact(), under names that tie them to the new Index.
+        // If we crash before the Index is replaced, read() deletes them, and the old Index still
+        // references the original chunk files, which compact() didn't modify. If we crash after
+        // the Index is replaced, read() moves them into place.
+        const std::string stagedSuffix = _StagedSuffix(index);
+        bool staged = false;
+        for (Chunk& chunk : _state.chunks) {
+            if (!chunk.alive || chunk.records._suffix.empty()) continue;
+            _recordMaps->rename(chunk.records, stagedSuffix);
+            if constexpr (_BlobEn) _blobMaps->rename(chunk.blobs, stagedSuffix);
+            staged = true;
+        }
+        if (staged) _ChunkDirsSync(_path);
+        
+        // Write the Index to a temporary file and atomically move it into place
+        _FileCreate(_IndexTmpPath(_path), index);
+        fs::rename(_IndexTmpPath(_path), _IndexPath(_path));
+        // Ensure that the Index rename is durable before the Journal is replaced. Otherwise a crash
+        // could leave us with the old Index and the new (empty) Journal, losing the old Journal's
+        // transactions.
+        _FileSync(_path);
+        
+        // Replace the original chunk files with the staged copies
+        if (staged) {
+            for (Chunk& chunk : _state.chunks) {
+                if (!chunk.alive || chunk.records._suffix.empty()) continue;
+                _recordMaps->rename(chunk.records, "");
+                if constexpr (_BlobEn) _blobMaps->rename(chunk.blobs, "");
+            }
+            _ChunkDirsSync(_path);
+        }
+        
+        // Create an empty Journal that applies to the new Index
+        const _SerializedJournalHeader header = {
+            .version = _JournalVersion,
+            .indexChecksum = _Checksum(index),
+        };
+        _FileCreate(_JournalTmpPath(_path), std::string((const char*)&header, sizeof(header)));
+        fs::rename(_JournalTmpPath(_path), _JournalPath(_path));
+        _FileSync(_path);
+        
+        const int fdi = open(_JournalPath(_path).c_str(), O_WRONLY|O_CLOEXEC);
+        if (fdi < 0) throw Toastbox::RuntimeError("open failed: %s", strerror(errno));
+        _journal.fd.emplace(fdi);
+        _journal.len = sizeof(header);
+        _journal.indexLen = index.size();
+        _journal.ops.clear();
+        _journal.checkpoint = false;
+    }
+    
+    // _journalAppend(): appends the operations performed since the last write() to the Journal,
+    // as a single transaction
+    void _journalAppend(const std::string& subclassState) {
+        const _SerializedJournalTxn txn = {
+            .opCount = (uint32_t)_journal.ops.size(),
+            .stateLen = (uint32_t)subclassState.size(),
+        };
+        
+        std::string buf;
+        buf.append((const char*)&txn, sizeof(txn));
+        buf.append((const char*)_journal.ops.data(), _journal.ops.size()*sizeof(_SerializedJournalOp));
+        buf.append(subclassState);
+        // ChecksumFletcher32() requires a multiple of 2 bytes
+        if (buf.size() % 2) buf.push_back(0);
+        
+        const uint32_t checksum = _Checksum(buf);
+        memcpy(buf.data()+offsetof(_SerializedJournalTxn, checksum), &checksum, sizeof(checksum));
+        
+        _FileWrite(*_journal.fd, _journal.len, buf);
+        const int ir = fsync(*_journal.fd);
+        if (ir) throw Toastbox::RuntimeError("fsync failed: %s", strerror(errno));
+        
+        _journal.len += buf.size();
+        _journal.ops.clear();
+    }
+    
+    // _chunkFilesPrune(): deletes all chunk files that aren't referenced by a live chunk
+    void _chunkFilesPrune() {
+        namespace fs = std::filesystem;
+        
+        std::set<std::string> aliveFiles;
+        for (Chunk& chunk : _state.chunks) {
+            if (!chunk.alive) continue;
+            aliveFiles.insert(chunk.records.path().filename().string());
+            if constexpr (_BlobEn) aliveFiles.insert(chunk.blobs.path().filename().string());
+        }
+        
+        std::vector<Path> dirs = { _ChunksPath(_path) };
+        if constexpr (_BlobEn) dirs.push_back(_BlobsPath(_path));
+        
+        for (const Path& dir : dirs) {
+            for (const fs::path& p : fs::directory_iterator(dir)) {
+                // Delete the chunk file (or a copy made by compact()) if it doesn't belong to a
+                // live chunk (therefore it's an old chunk file that's no longer needed).
+                std::optional<ChunkId> deleteName;
+                try {
+                    const std::string name = p.filename().string();
+                    deleteName = Toastbox::IntForStr<ChunkId>(name.substr(0, name.find('.')));
+                    if (aliveFiles.find(name) != aliveFiles.end()) {
+                        deleteName = std::nullopt; // Chunk file is in use; don't delete it
+                    }
+                // Don't do anything if we can't convert the filename to an integer;
+                // assume the file is supposed to be there.
+                } catch (...) {}
+                
+                if (deleteName) {
+                    printf("[RecordStore::write()] deleting chunk file %s\n", p.c_str());
+                    fs::remove(p);
+                }
+            }
+        }
+    }
+    
+    static uint32_t _Checksum(const std::string& x) {
+        // ChecksumFletcher32() requires a multiple of 2 bytes
+        if (x.size() % 2) return _Checksum(x + '\0');
+        return ChecksumFletcher32(x.data(), x.size());
+    }
+    
+    static void _BufRead(const std::string& buf, size_t& off, void* dst, size_t len) {
+        if (buf.size()-off < len) {
+            throw Toastbox::RuntimeError("unexpected end of file (offset: %ju, len: %ju, file len: %ju)",
+                (uintmax_t)off, (uintmax_t)len, (uintmax_t)buf.size());
+        }
+        if (len) memcpy(dst, buf.data()+off, len);
+        off += len;
+    }
+    
+    static std::string _FileRead(const Path& path) {
+        std::ifstream f;
+        f.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        f.open(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+    
+    static void _FileWrite(int fd, size_t off, const void* data, size_t len) {
+        for (size_t i=0; i<len;) {
+            const ssize_t sr = pwrite(fd, (const uint8_t*)data+i, len-i, off+i);
+            if (sr < 0) {
+                if (errno == EINTR) continue;
+                throw Toastbox::RuntimeError("pwrite failed: %s", strerror(errno));
+            }
+            i += sr;
+        }
+    }
+    
+    static void _FileWrite(int fd, size_t off, const std::string& data) {
+        _FileWrite(fd, off, data.data(), data.size());
+    }
+    
+    static void _FileCreate(const Path& path, const void* data, size_t len) {
+        constexpr int OpenFlags = O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC;
+        constexpr int FilePerm = (S_IRUSR|S_IWUSR) | (S_IRGRP) | (S_IROTH);
+        const int fdi = open(path.c_str(), OpenFlags, FilePerm);
+        if (fdi < 0) throw Toastbox::RuntimeError("failed to create file: %s", strerror(errno));
+        Toastbox::FileDescriptor fd(fdi);
+        _FileWrite(fd, 0, data, len);
+        const int ir = fsync(fd);
+        if (ir) throw Toastbox::RuntimeError("fsync failed: %s", strerror(errno));
+    }
+    
+    static void _FileCreate(const Path& path, const std::string& data) {
+        _FileCreate(path, data.data(), data.size());
     }
     
     static Path _IndexPath(const Path& path) {
         return path / "Index";
     }
     
+    static Path _IndexTmpPath(const Path& path) {
+        return path / "Index.tmp";
+    }
+    
+    static Path _JournalPath(const Path& path) {
+        return path / "Journal";
+    }
+    
+    static Path _JournalTmpPath(const Path& path) {
+        return path / "Journal.tmp";
+    }
+    
     static Path _ChunksPath(const Path& path) {
         return path / "Chunks";
     }
@@ -475,16 +1478,30 @@ struct RecordStore {
         return _ChunksPath(path) / std::to_string(id);
     }
     
-    static Toastbox::Mmap _ChunkFileCreate(const Path& path) {
-        constexpr int OpenFlags = O_RDWR|O_CREAT|O_CLOEXEC;
+    static Path _BlobsPath(const Path& path) {
+        return path / "Blobs";
+    }
+    
+    static Path _BlobPath(const Path& path, ChunkId id) {
+        return _BlobsPath(path) / std::to_string(id);
+    }
+    
+    static void _ChunkFileCreate(const Path& path) {
+        constexpr int OpenFlags = O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC;
         constexpr int ChunkPerm = (S_IRUSR|S_IWUSR) | (S_IRGRP) | (S_IROTH);
-        const int fd = open(path.c_str(), OpenFlags, ChunkPerm);
-        if (fd < 0) throw Toastbox::RuntimeError("failed to create chunk file: %s", strerror(errno));
-        const size_t cap = Toastbox::Mmap::PageCeil(_ChunkLen);
-        return Toastbox::Mmap(fd, cap, OpenFlags);
+        const int fdi = open(path.c_str(), OpenFlags, ChunkPerm);
+        if (fdi < 0) throw Toastbox::RuntimeError("failed to create chunk file: %s", strerror(errno));
+        Toastbox::FileDescriptor fd(fdi);
     }
     
-    static Toastbox::Mmap _ChunkFileOpen(const Path& path) {
+    static size_t _ChunkFileLen(const Path& path) {
+        struct stat st;
+        int ir = stat(path.c_str(), &st);
+        if (ir) throw Toastbox::RuntimeError("stat failed: %s", strerror(errno));
+        return st.st_size;
+    }
+    
+    static Toastbox::Mmap _ChunkFileOpen(const Path& path, size_t fileCap) {
         constexpr int OpenFlags = O_RDWR;
         int fdi = open(path.c_str(), OpenFlags);
         if (fdi < 0) throw Toastbox::RuntimeError("open failed: %s", strerror(errno));
@@ -493,18 +1510,108 @@ struct RecordStore {
         struct stat st;
         int ir = fstat(fd, &st);
         if (ir) throw Toastbox::RuntimeError("fstat failed: %s", strerror(errno));
-        // Create the mapping with a capacity of either the file size or _ChunkLen, whichever is larger.
-        const size_t cap = Toastbox::Mmap::PageCeil(std::max((size_t)st.st_size, _ChunkLen));
+        // Create the mapping with a capacity of either the file size or `fileCap`, whichever is larger.
+        const size_t cap = Toastbox::Mmap::PageCeil(std::max((size_t)st.st_size, fileCap));
         return Toastbox::Mmap(std::move(fd), cap, OpenFlags);
     }
     
-    Path _chunkPath(ChunkId id) const {
-        return _ChunkPath(_path, id);
+    static void _FileSync(const Path& path) {
+        int fdi = open(path.c_str(), O_RDONLY|O_CLOEXEC);
+        if (fdi < 0) throw Toastbox::RuntimeError("open failed: %s", strerror(errno));
+        Toastbox::FileDescriptor fd(fdi);
+        int ir = fsync(fd);
+        if (ir) throw Toastbox::RuntimeError("fsync failed: %s", strerror(errno));
+    }
+    
+    void _pathSet(const Path& path) {
+        _path = path;
+        _recordMaps->dir = _ChunksPath(_path);
+        _blobMaps->dir = _BlobsPath(_path);
+        bool created = std::filesystem::create_directories(_ChunksPath(_path));
+        if constexpr (_BlobEn) created |= std::filesystem::create_directories(_BlobsPath(_path));
+        // Ensure that the new directories' entries are on disk before any file within them is
+        // referenced by the Index/Journal
+        if (created) {
+            _FileSync(_path);
+            _FileSync(_path.parent_path());
+        }
+    }
+    
+    // _ChunkLenSet(): sets the length of a chunk's files to hold `recordCount` records
+    static void _ChunkLenSet(Chunk& chunk, size_t recordCount) {
+        chunk.records.len(recordCount * sizeof(T_Record));
+        if constexpr (_BlobEn) chunk.blobs.len(recordCount * sizeof(T_Blob));
+    }
+    
+    // _ChunkFork(): switches a chunk to copies of its files (if it isn't already using copies),
+    // so that compact() can move records into it without modifying the files that the Index on
+    // disk references
+    void _ChunkFork(Chunk& chunk) {
+        if (!chunk.records._suffix.empty()) return;
+        _recordMaps->fork(chunk.records, _CompactSuffix);
+        if constexpr (_BlobEn) _blobMaps->fork(chunk.blobs, _CompactSuffix);
+    }
+    
+    // _StagedSuffix(): the suffix of the chunk copies that belong to the Index `index`
+    static std::string _StagedSuffix(const std::string& index) {
+        char checksum[16];
+        snprintf(checksum, sizeof(checksum), "%08jx", (uintmax_t)_Checksum(index));
+        return _CompactSuffix + "-" + checksum;
+    }
+    
+    // _ChunkCopiesRecover(): finishes or discards the chunk copies that a checkpoint was
+    // interrupted with (see _checkpointWrite()). Copies that belong to the Index `index` replace
+    // their chunk files; the remaining copies are deleted.
+    static void _ChunkCopiesRecover(const Path& path, const std::string& index) {
+        namespace fs = std::filesystem;
+        const std::string stagedSuffix = _StagedSuffix(index);
+        bool changed = false;
+        
+        std::vector<Path> dirs = { _ChunksPath(path) };
+        if constexpr (_BlobEn) dirs.push_back(_BlobsPath(path));
+        
+        for (const Path& dir : dirs) {
+            std::vector<fs::path> copies;
+            for (const fs::path& p : fs::directory_iterator(dir)) {
+                const std::string name = p.filename().string();
+                const size_t suffixIdx = name.find('.');
+                if (suffixIdx==std::string::npos || name.compare(suffixIdx, _CompactSuffix.size(), _CompactSuffix)) continue;
+                copies.push_back(p);
+            }
+            
+            for (const fs::path& p : copies) {
+                const std::string name = p.filename().string();
+                const size_t suffixIdx = name.find('.');
+                if (name.substr(suffixIdx) == stagedSuffix) {
+                    printf("[RecordStore] finishing compaction of chunk file %s\n", p.c_str());
+                    fs::rename(p, dir / name.substr(0, suffixIdx));
+                } else {
+                    printf("[RecordStore] discarding compacted chunk file %s\n", p.c_str());
+                    fs::remove(p);
+                }
+                changed = true;
+            }
+        }
+        
+        if (changed) _ChunkDirsSync(path);
+    }
+    
+    static void _ChunkDirsSync(const Path& path) {
+        _FileSync(_ChunksPath(path));
+        if constexpr (_BlobEn) _FileSync(_BlobsPath(path));
+    }
+    
+    // _ChunkCompactable(): whether a chunk is a candidate for compaction (via compact())
+    static bool _ChunkCompactable(const Chunk& chunk) {
+        return chunk.alive && !chunk.strongCount && chunk.recordCount<=T_ChunkRecordCap/2;
     }
     
     Chunk& _chunkCreate() {
         const ChunkId chunkId = _state.chunkId++;
-        return _state.chunks.emplace_back(chunkId, _ChunkFileCreate(_chunkPath(chunkId)));
+        _ChunkFileCreate(_ChunkPath(_path, chunkId));
+        if constexpr (_BlobEn) _ChunkFileCreate(_BlobPath(_path, chunkId));
+        _journal.chunkDirsSync = true;
+        return _state.chunks.emplace_back(*_recordMaps, *_blobMaps, chunkId, 0, 0);
     }
     
     Chunk& _chunkGetWritable() {
@@ -521,13 +1628,23 @@ struct RecordStore {
         }
         
         // Resize the chunk file to be a full chunk, in case it wasn't already.
-        // Currently, _ChunkFileCreate() creates 0-byte chunk files, so we set their size here.
-        // In the future, when we implement compaction, chunks could have arbitrary sizes, making it
-        // doubly necessary to set the file size here.
-        chunk->mmap.len(_ChunkLen);
+        // _ChunkFileCreate() creates 0-byte chunk files, and compaction (via write()) truncates chunks
+        // to arbitrary sizes, so we set their size here.
+        _ChunkLenSet(*chunk, T_ChunkRecordCap);
         return *chunk;
     }
     
     Path _path;
+    // _recordMaps / _blobMaps: declared before _state because chunk files unregister themselves
+    // when destroyed
+    //
+    // Records are small and are typically scanned in bulk, so we prefetch them when mapping.
+    // Blobs are accessed in arbitrary order, so readahead across blob boundaries would just
+    // pollute the page cache.
+    std::unique_ptr<_ChunkMaps> _recordMaps = std::make_unique<_ChunkMaps>(
+        sizeof(T_Record)*T_ChunkRecordCap, _RecordMapMax, MADV_WILLNEED);
+    std::unique_ptr<_ChunkMaps> _blobMaps = std::make_unique<_ChunkMaps>(
+        _BlobSize*T_ChunkRecordCap, _BlobMapMax, MADV_RANDOM);
     _State _state;
+    _Journal _journal;
 };
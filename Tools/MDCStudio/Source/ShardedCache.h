@@ -0,0 +1,332 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include <optional>
+#include "Code/Lib/Toastbox/Signal.h"
+
+// ShardedCache: a variant of Cache that's intended to be hit concurrently by many threads
+//
+// ShardedCache has the same interface and the same pop()/priority semantics as Cache, but:
+//
+//   - The key space is split across T_ShardCount shards, each with its own lock, so lookups
+//     of different keys rarely contend.
+//
+//   - get() only acquires its shard's lock in shared mode, so the hit path is read-only with
+//     respect to the shard's lock and map. Recency is tracked by stamping the slot with its
+//     shard's access counter (atomically), and eviction removes the shard entry with the oldest
+//     stamp. Recency is therefore per-shard; evict() visits the shards round-robin.
+//
+//   - Entries are intrusively refcounted via a per-slot atomic, so creating or copying an Entry
+//     doesn't allocate.
+template<
+typename T_Key,
+typename T_Val,
+size_t T_Cap,
+uint8_t T_PriorityLast=0,
+size_t T_ShardCount=8,
+typename T_Hash=std::hash<T_Key>
+>
+struct ShardedCache {
+    static_assert(T_ShardCount && !(T_ShardCount & (T_ShardCount-1)), "T_ShardCount must be a power of 2");
+    
+    struct Entry {
+        Entry() {}
+        Entry(ShardedCache& cache, size_t idx) : _cache(&cache), _idx(idx) { _cache->_retain(_idx); }
+        // Copy
+        Entry(const Entry& x) : _cache(x._cache), _idx(x._idx) { if (_cache) _cache->_retain(_idx); }
+        Entry& operator=(const Entry& x) { Entry y(x); swap(y); return *this; }
+        // Move
+        Entry(Entry&& x) noexcept { swap(x); }
+        Entry& operator=(Entry&& x) noexcept { swap(x); return *this; }
+        ~Entry() { if (_cache) _cache->_release(_idx); }
+        
+        operator bool() const { return _cache; }
+        bool operator<(const Entry& x) const { return val() < x.val(); }
+        bool operator==(const Entry& x) const { return val() == x.val(); }
+        bool operator!=(const Entry& x) const { return val() != x.val(); }
+        T_Val* operator->() const { return val(); }
+        T_Val& operator*() const { return *val(); }
+        T_Val* val() const { return (_cache ? &_cache->_mem[_idx] : nullptr); }
+        
+        void swap(Entry& x) {
+            std::swap(_cache, x._cache);
+            std::swap(_idx, x._idx);
+        }
+        
+        // _Adopt(): create an Entry that takes ownership of an existing reference
+        static Entry _Adopt(ShardedCache& cache, size_t idx) {
+            Entry x;
+            x._cache = &cache;
+            x._idx = idx;
+            return x;
+        }
+        
+        ShardedCache* _cache = nullptr;
+        size_t _idx = 0;
+    };
+    
+    struct Reserved {
+        Reserved() {}
+        Reserved(ShardedCache& cache, size_t idx, uint8_t priority) : _state{.entry=Entry(cache, idx), .priority=priority} {}
+        // Copy
+        Reserved(const Reserved& x) = delete;
+        Reserved& operator=(const Reserved& x) = delete;
+        // Move
+        Reserved(Reserved&& x) { swap(x); }
+        Reserved& operator=(Reserved&& x) { swap(x); return *this; }
+        ~Reserved() { if (_state.entry) _state.entry._cache->_destroy(*this); }
+        
+        const Entry& entry() const { return _state.entry; }
+        
+        void swap(Reserved& x) {
+            std::swap(_state, x._state);
+        }
+        
+        struct {
+            Entry entry;
+            size_t priority = 0;
+        } _state;
+    };
+    
+    ShardedCache() {
+        uint8_t priority = 0;
+        for (size_t i=0; i<T_Cap; i++, priority++) {
+            if (priority > T_PriorityLast) priority = 0;
+            _free.list.push_back(i);
+            _free.counter[priority]++;
+        }
+        
+        for (_Shard& shard : _shards) {
+            shard.map.reserve(_ShardCap+1);
+        }
+    }
+    
+    ~ShardedCache() {
+        // Release the references held by the shards' maps, which hold slot indexes rather than Entrys
+        for (_Shard& shard : _shards) {
+            for (const auto& [key, idx] : shard.map) _release(idx);
+            shard.map.clear();
+        }
+    }
+    
+    // get(): find an existing entry for a key
+    // If the entry didn't exist, (bool)Val == false
+    Entry get(const T_Key& key) {
+        _Shard& shard = _shardGet(key);
+        auto lock = std::shared_lock(shard.lock);
+        const auto find = shard.map.find(key);
+        if (find == shard.map.end()) return {};
+        
+        const size_t idx = find->second;
+        _slots[idx].accessTime.store(shard.accessTime.fetch_add(1, std::memory_order_relaxed)+1,
+            std::memory_order_relaxed);
+        // The map holds a reference to the slot while we hold the shard lock, so it's safe to
+        // retain the slot
+        return Entry(*this, idx);
+    }
+    
+    // set(): set an entry for a key
+    Entry set(const T_Key& key, Reserved&& reserved) {
+        const Entry& entry = reserved.entry();
+        _Shard& shard = _shardGet(key);
+        // Entries that we remove from the shard are released after we release the shard lock, so
+        // that we don't hold the shard lock while we acquire _free.signal
+        Entry replaced;
+        Entry evicted;
+        {
+            auto lock = std::unique_lock(shard.lock);
+            _slots[entry._idx].accessTime.store(shard.accessTime.fetch_add(1, std::memory_order_relaxed)+1,
+                std::memory_order_relaxed);
+            
+            // The map holds its own reference to the slot
+            _retain(entry._idx);
+            const auto [it, inserted] = shard.map.try_emplace(key, entry._idx);
+            if (!inserted) {
+                replaced = Entry::_Adopt(*this, it->second);
+                it->second = entry._idx;
+            }
+            
+            if (shard.map.size() > _ShardCap) {
+                evicted = _evict(lock, shard);
+            }
+        }
+        return entry;
+    }
+    
+    // pop(): return an empty entry
+    Reserved pop(uint8_t priority=0) {
+        assert(priority <= T_PriorityLast);
+        for (;;) {
+            auto& counter = _free.counter[priority];
+            
+            bool evikt = false;
+            {
+                auto l = _free.signal.lock();
+                // If the priority has slots available, and the free list isn't empty, return a Reserved.
+                // If the priority has slots available, but the free list is empty, evict entries to try
+                // to free up slots.
+                // If the priority doesn't have slots available, wait until it does.
+                if (counter) {
+                    if (!_free.list.empty()) {
+                        const size_t idx = _free.list.back();
+                        _free.list.pop_back();
+                        counter--;
+                        return Reserved(*this, idx, priority);
+                    } else {
+                        evikt = true;
+                    }
+                }
+            }
+            
+            // Try to free up space
+            // Like Cache, evicting an entry only frees its slot once the client has also dropped its
+            // references to the entry.
+            if (evikt) evict();
+            
+            _free.signal.wait([&] { return counter && !_free.list.empty(); });
+        }
+    }
+    
+    // evict(): evicts the least-recently-used entry of the next non-empty shard
+    void evict() {
+        for (size_t i=0; i<T_ShardCount; i++) {
+            _Shard& shard = _shards[_evictShard.fetch_add(1, std::memory_order_relaxed) % T_ShardCount];
+            Entry evicted;
+            {
+                auto lock = std::unique_lock(shard.lock);
+                evicted = _evict(lock, shard);
+            }
+            if (evicted) return;
+        }
+    }
+    
+    void clear() {
+        for (_Shard& shard : _shards) {
+            std::vector<Entry> entries;
+            {
+                auto lock = std::unique_lock(shard.lock);
+                entries.reserve(shard.map.size());
+                for (const auto& [key, idx] : shard.map) {
+                    entries.push_back(Entry::_Adopt(*this, idx));
+                }
+                shard.map.clear();
+            }
+        }
+    }
+    
+    // size(): returns the current number of entries stored in the cache
+    size_t size() {
+        size_t r = 0;
+        for (_Shard& shard : _shards) {
+            auto lock = std::shared_lock(shard.lock);
+            r += shard.map.size();
+        }
+        return r;
+    }
+    
+    // sizeFree(): returns the number of unoccupied entries in the cache
+    // This indicates the number of times that pop() can be called without blocking.
+    size_t sizeFree(uint8_t priority=0) {
+        assert(priority <= T_PriorityLast);
+        auto l = _free.signal.lock();
+        return _free.counter[priority];
+    }
+    
+    void stop() {
+        _free.signal.stop();
+    }
+    
+    auto& mem() {
+        return _mem;
+    }
+    
+    struct _Slot {
+        std::atomic<uint32_t> refCount = 0;
+        std::atomic<uint64_t> accessTime = 0;
+    };
+    
+    struct alignas(64) _Shard {
+        std::shared_mutex lock; // Protects `map`
+        std::unordered_map<T_Key,size_t,T_Hash> map;
+        std::atomic<uint64_t> accessTime = 0;
+    };
+    
+    _Shard& _shardGet(const T_Key& key) {
+        // Fibonacci hashing, so that hashes with poorly-distributed low bits (eg pointers) still
+        // spread across shards
+        const uint64_t h = (uint64_t)T_Hash()(key) * UINT64_C(0x9E3779B97F4A7C15);
+        return _shards[(h >> 32) & (T_ShardCount-1)];
+    }
+    
+    // _evict(): removes the least-recently-used entry from `shard`, returning the map's
+    // reference to the entry
+    Entry _evict(const std::unique_lock<std::shared_mutex>& lock, _Shard& shard) {
+        assert(lock);
+        auto oldest = shard.map.end();
+        uint64_t oldestTime = UINT64_MAX;
+        for (auto it=shard.map.begin(); it!=shard.map.end(); it++) {
+            const uint64_t t = _slots[it->second].accessTime.load(std::memory_order_relaxed);
+            if (t < oldestTime) {
+                oldest = it;
+                oldestTime = t;
+            }
+        }
+        if (oldest == shard.map.end()) return {};
+        
+        Entry r = Entry::_Adopt(*this, oldest->second);
+        shard.map.erase(oldest);
+        return r;
+    }
+    
+    void _retain(size_t idx) {
+        _slots[idx].refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    void _release(size_t idx) {
+        if (_slots[idx].refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        try {
+            {
+                auto lock = _free.signal.lock();
+                _free.list.push_back(idx);
+            }
+            _free.signal.signalOne();
+            
+        } catch (const Toastbox::Signal::Stop&) {
+            // We'll crash if we throw within ~Entry() / ~Reserved(), so suppress the Stop exception
+        }
+    }
+    
+    void _destroy(const Reserved& x) {
+        try {
+            {
+                auto lock = _free.signal.lock();
+                _free.counter[x._state.priority]++;
+            }
+            _free.signal.signalOne();
+            
+        } catch (const Toastbox::Signal::Stop&) {
+            // We'll crash if we throw within ~Entry() / ~Reserved(), so suppress the Stop exception
+        }
+    }
+    
+    // _Headroom: see Cache::_Headroom
+    static constexpr size_t _Headroom = std::max((size_t)1, T_Cap/64);
+    static constexpr size_t _ShardCap = std::max((size_t)1, (T_Cap-_Headroom)/T_ShardCount);
+    
+    T_Val _mem[T_Cap];
+    _Slot _slots[T_Cap];
+    std::atomic<size_t> _evictShard = 0;
+    
+    // _free: needs to be declared before _shards, so that upon destruction, _free persists longer
+    // than _shards (see Cache::_free)
+    struct {
+        Toastbox::Signal signal; // Protects this struct
+        std::vector<size_t> list;
+        size_t counter[T_PriorityLast+1] = {};
+    } _free;
+    
+    _Shard _shards[T_ShardCount];
+};
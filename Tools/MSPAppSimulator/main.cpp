@@ -0,0 +1,787 @@
+#include <chrono>
+#include <random>
+#include <optional>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include "Code/Shared/MSP.h"
+#include "Code/Shared/MSPTriggers.h"
+#include "Code/Shared/MSPTasks.h"
+#include "Code/Shared/ImgAutoExposure.h"
+#include "Code/Shared/Time.h"
+#include "Code/Shared/TimeConstants.h"
+#include "Code/Shared/Clock.h"
+#include "Code/Shared/TimeAdjustment.h"
+#include "Tools/Shared/PowerModel.h"
+
+// MSPAppSimulator: runs MSPApp's scheduling logic on the host, so that months of device operation
+// can be replayed in seconds
+//
+// The simulator shares the firmware's platform-independent code: T_MSPTriggers (event list +
+// trigger state), Img::AutoExposure, Time::TimeAdjustmentCalculate(), and MSPTasks.h, which holds
+// the logic of the firmware's tasks (T_MSPEvents: event handling and motion/button captures;
+// MSP::ImgCapture(): the capture/exposure loop; MSP::SDStateLoad() / MSP::ImgWrite(): the SD
+// ring buffer; T_MSPBatterySampleSchedule: battery sampling). Only the hardware operations that
+// the tasks perform, which depend on msp430.h and the Scheduler, are modeled here:
+//
+//   - a virtual RTC: the firmware's RTC ISR logic (including TimeAdjustment correction), driven
+//     by a crystal that drifts from true time by `RTCDrift` ppm
+//   - a fake ICE40: image captures return highlight/shadow counts and histograms from a model of
+//     a scene whose brightness follows the time of day, so AutoExposure converges like it does
+//     on a device
+//   - a fake SD card: validates every write against the card's capacity, and counts blocks
+//
+// Time is event-driven: the simulator jumps directly from one wakeup to the next, so the result
+// is deterministic and independent of the host's speed. Durations of hardware operations are
+// modeled by the constants in `_Cost`.
+//
+// The operations performed are also fed to PowerModel, to show where the energy goes and to
+// project the battery life.
+//
+// Usage:
+//   MSPAppSimulator [Days] [SDCapacity (GiB)] [RTCDrift (ppm)]
+
+using namespace std::chrono;
+
+// MARK: - Config
+
+// Motion / button stimulus intervals, like MDCStudio's BatteryLifeSimulator
+static constexpr Time::TicksU32 MotionStimulusInterval = 10*Time::Minute;
+static constexpr Time::TicksU32 ButtonStimulusInterval = 6*Time::Hour;
+// HostSyncInterval: how often the device is connected to a host, which corrects the device's time
+static constexpr Time::TicksU32 HostSyncInterval = 7*Time::Day;
+
+// _Cost: modeled durations of hardware operations, in microseconds
+struct _Cost {
+    // ICE40Start: _TaskEvent's sleep while ICE40 loads its bitstream, plus _ICEInit()
+    static constexpr uint64_t ICE40Start        = 30000 + 2000;
+    static constexpr uint64_t SDReset           = 1000;
+    // SDInitFirst: SD init including reading CID/CSD; SDInit: re-init with a known RCA
+    static constexpr uint64_t SDInitFirst       = 150000;
+    static constexpr uint64_t SDInit            = 50000;
+    static constexpr uint64_t SensorInit        = 20000;
+    // ImgHistogram: reading a capture's histogram from ICE40 (64 SPI transactions)
+    static constexpr uint64_t ImgHistogram      = 1000;
+    // FramePeriod / RowTime: a frame takes FramePeriod, or longer if the integration time requires it
+    static constexpr uint64_t FramePeriod       = 33333;
+    static constexpr double RowTime             = 25.6;
+    // SDWriteBytesPerSec: sustained SD write throughput
+    static constexpr double SDWriteBytesPerSec  = 10e6;
+    static constexpr uint64_t BatterySample     = 5000;
+    static constexpr uint64_t LEDFlash          = 500;
+    // Wakeup: cost of waking from LPM3.5 + handling an interrupt
+    static constexpr uint64_t Wakeup            = 100;
+};
+
+// MARK: - Stats
+
+enum class _Task : uint8_t {
+    Event,
+    Img,
+    SD,
+    Power,
+    Motion,
+    Button,
+    RTC,
+    Count,
+};
+
+static const char* _TaskName(_Task x) {
+    switch (x) {
+    case _Task::Event:  return "_TaskEvent";
+    case _Task::Img:    return "_TaskImg";
+    case _Task::SD:     return "_TaskSD";
+    case _Task::Power:  return "_TaskPower";
+    case _Task::Motion: return "_TaskMotion";
+    case _Task::Button: return "_TaskButton";
+    case _Task::RTC:    return "RTC ISR";
+    default:            return "?";
+    }
+}
+
+struct _TaskStats {
+    uint64_t wakeups = 0;
+    uint64_t busyUs = 0;
+};
+
+struct _Stats {
+    using Task = _TaskStats;
+    
+    static Task& T(_Task x) { return Tasks[(size_t)x]; }
+    
+    static inline Task Tasks[(size_t)_Task::Count];
+    static inline uint64_t CapturesTime = 0;
+    static inline uint64_t CapturesMotion = 0;
+    static inline uint64_t CapturesButton = 0;
+    static inline uint64_t CaptureAttempts[3] = {};
+    static inline uint64_t CaptureFrames = 0;
+    static inline uint64_t SensorInits = 0;
+    static inline uint64_t ICE40Starts = 0;
+    static inline uint64_t LEDFlashes = 0;
+    static inline uint64_t SDCardInits = 0;
+    static inline uint64_t SDStateInits = 0;
+    static inline uint64_t SDWrites = 0;
+    static inline uint64_t SDBlocksWritten = 0;
+    static inline uint64_t SDRingBufWraps = 0;
+    static inline uint64_t BatterySamples = 0;
+    static inline uint64_t MotionPoweredTicks = 0;
+    static inline uint64_t HostSyncs = 0;
+    static inline uint64_t FastForwardEvents = 0;
+    static inline Time::TicksS64 DriftMax = 0;
+};
+
+static void _Require(bool x, const char* msg) {
+    if (!x) {
+        fprintf(stderr, "FAILED: %s\n", msg);
+        exit(1);
+    }
+}
+
+// Abort(): called by Assert()
+extern "C" [[noreturn]] void Abort(uintptr_t addr) {
+    fprintf(stderr, "FAILED: Abort(0x%jx)\n", (uintmax_t)addr);
+    abort();
+}
+
+// MARK: - State
+
+// _State: like MSPApp's FRAM-backed state
+static MSP::State _State;
+using _TriggersType = T_MSPTriggers<bool>;
+static _TriggersType _Triggers(_State.settings.triggers);
+
+// MotionPowerOnDelayMs: like _Motion::PowerOnDelayMs
+static constexpr uint32_t MotionPowerOnDelayMs = 30000;
+
+// MARK: - _RTC
+
+// _RTC: virtual RTC; mirrors the time-keeping of MSPApp's T_RTC
+//
+// The crystal runs `Drift` faster than true time, so State.time (raw crystal time) diverges from
+// true time until a host computes a TimeAdjustment, which ISR() then applies incrementally.
+struct _RTC {
+    static constexpr Time::TicksU16 InterruptIntervalTicks = 32768;
+    
+    static Time::Instant NowBase() {
+        return State.time + Adjustment.value;
+    }
+    
+    static Time::Instant Now() {
+        return NowBase() + Ticks;
+    }
+    
+    // Init(): sets the time to the true time `t`, like T_RTC::Init()
+    static void Init(Time::Instant t) {
+        State = { .start = t, .time = t };
+        Adjustment = {};
+        Ticks = 0;
+        _TrueAnchor = t;
+        _CrystalAnchor = t;
+    }
+    
+    // NowTrue(): the true time, given the crystal's drift
+    static Time::Clock::time_point NowTrue() {
+        const Time::TicksU64 elapsed = (State.time + Ticks) - _CrystalAnchor;
+        const Time::TicksU64 trueElapsed = std::llround(elapsed / (1+Drift));
+        return Time::Clock::TimePointFromTimeInstant(_TrueAnchor) + Time::Clock::DurationFromTicks(trueElapsed);
+    }
+    
+    // DriftTicks(): the device's time minus the true time
+    static Time::TicksS64 DriftTicks() {
+        return Time::Clock::TicksFromDuration(Time::Clock::TimePointFromTimeInstant(Now()) - NowTrue());
+    }
+    
+    // ISR(): same as T_RTC::ISR(RTCIV_RTCIF)
+    static void ISR() {
+        // Update our time
+        State.time += InterruptIntervalTicks;
+        
+        // Correct time based on our calibration
+        MSP::TimeAdjustment& adj = Adjustment;
+        if (adj.delta) {
+            adj.counter += InterruptIntervalTicks;
+            while (adj.counter >= adj.interval) {
+                adj.counter -= adj.interval;
+                adj.value += adj.delta;
+            }
+        }
+    }
+    
+    static inline MSP::TimeState State = {};
+    static inline MSP::TimeAdjustment Adjustment = {};
+    // Ticks: ticks since the last ISR (the firmware's RTCCNT)
+    static inline Time::TicksU32 Ticks = 0;
+    static inline double Drift = 0;
+    // _TrueAnchor / _CrystalAnchor: the true time and the raw crystal time at the last Init()
+    static inline Time::Instant _TrueAnchor = 0;
+    static inline Time::Instant _CrystalAnchor = 0;
+};
+
+// MARK: - _TaskPower
+
+// _TaskPower: MSPApp's battery-sample scheduling, via T_MSPBatterySampleSchedule
+struct _TaskPower {
+    using _BatterySampleScheduleType = T_MSPBatterySampleSchedule<_RTC::InterruptIntervalTicks>;
+    static_assert(_BatterySampleScheduleType::IntervalRTC == 168); // Debug
+    
+    static void _BatterySample() {
+        _Stats::T(_Task::Power).wakeups++;
+        _Stats::T(_Task::Power).busyUs += _Cost::BatterySample;
+        _Stats::BatterySamples++;
+        _BatterySampleSchedule.reset();
+    }
+    
+    static void CaptureNotify() {
+        if (_BatterySampleSchedule.capture()) _BatterySample();
+    }
+    
+    static void ISRRTC() {
+        if (_BatterySampleSchedule.rtc()) _BatterySample();
+    }
+    
+    static inline _BatterySampleScheduleType _BatterySampleSchedule = [] {
+        _BatterySampleScheduleType x;
+        x.reset();
+        return x;
+    }();
+};
+
+// MARK: - _ICE
+
+// _ICE: fake ICE40 + image sensor
+//
+// Captures produce the histogram of a scene whose brightness follows the time of day. The
+// scene's log2 pixel values are normally distributed around that of 18% gray, shifted by
+// log2(r), where r is the exposure of the capture relative to the ideal exposure. Pixels
+// beyond Img::PixelMax clip into the last bin, like a real sensor.
+//
+// Captures also report highlight/shadow counts: the fraction of highlight (~r^2) and shadow
+// (~1/r^2) pixels, so AutoExposure's log2(shadows/highlights) measures -4*log2(r).
+struct _ICE {
+    struct ImgCaptureStatusResp {
+        uint32_t highlights = 0;
+        uint32_t shadows = 0;
+        uint32_t highlightCount() const { return highlights; }
+        uint32_t shadowCount() const { return shadows; }
+    };
+    
+    // _SceneLuminance(): relative scene brightness at time `t`; 1 at noon
+    static double _SceneLuminance(Time::Instant t) {
+        constexpr double Night = 1./256;
+        const double dayFrac = (double)((t & ~Time::AbsoluteBit) % Time::Day) / Time::Day;
+        const double sun = std::sin((dayFrac-.25) * 2*M_PI);
+        // Add some variation between captures (clouds, etc)
+        const double noise = std::exp2(std::uniform_real_distribution<double>(-.5, .5)(_Rng));
+        return std::max(Night, sun) * noise;
+    }
+    
+    static ImgCaptureStatusResp ImgCapture(uint16_t coarseIntTime, uint16_t analogGain, uint8_t skipCount, Time::Instant t) {
+        using namespace Img::Histogram;
+        // IdealIntTime: the coarse integration time that's ideal for a noon scene
+        constexpr double IdealIntTime = 64;
+        // SceneStops: standard deviation of the scene's log2 pixel values
+        constexpr double SceneStops = 1.5;
+        // Only the coarse gain field (2^field) of the analog gain register is modeled
+        const double gain = std::exp2(analogGain >> 4);
+        const double r = (coarseIntTime * gain * _SceneLuminance(t)) / IdealIntTime;
+        const double mean = std::log2(.18 * Img::PixelMax * r);
+        const auto cdf = [&] (uint8_t bin) {
+            if (!bin) return 0.;
+            if (bin == BinCount) return 1.;
+            return .5 * std::erfc(-(std::log2(BinMin(bin)) - mean) / (SceneStops*M_SQRT2));
+        };
+        for (uint8_t i=0; i<BinCount; i++) {
+            _Hist[i] = (uint16_t)std::lround((cdf(i+1)-cdf(i)) * ChannelSampleCount);
+        }
+        
+        // Account for the capture time: each frame takes FramePeriod, or longer if the integration time requires it
+        const uint64_t frameUs = std::max(_Cost::FramePeriod, (uint64_t)(coarseIntTime*_Cost::RowTime));
+        _Stats::T(_Task::Img).busyUs += frameUs*(skipCount+1);
+        _Stats::CaptureFrames += skipCount+1;
+        
+        constexpr double StatsPixelCount = (double)Img::Full::PixelCount / Img::StatsSubsampleFactor;
+        const double highlightFrac = std::min(1., .01*r*r);
+        const double shadowFrac = std::min(1., .01/(r*r));
+        return {
+            .highlights = (uint32_t)(highlightFrac*StatsPixelCount),
+            .shadows = (uint32_t)(shadowFrac*StatsPixelCount),
+        };
+    }
+    
+    // ImgHistogram(): like T_ICE::ImgHistogram(); every channel has the same histogram
+    template<typename T_Fn>
+    static void ImgHistogram(T_Fn fn) {
+        _Stats::T(_Task::Img).busyUs += _Cost::ImgHistogram;
+        for (uint8_t ch=0; ch<Img::Histogram::ChannelCount; ch++) {
+            for (uint8_t i=0; i<Img::Histogram::BinCount; i++) fn(ch, i, _Hist[i]);
+        }
+    }
+    
+    static inline uint16_t _Hist[Img::Histogram::BinCount] = {};
+    static inline std::mt19937 _Rng = std::mt19937(0);
+};
+
+// MARK: - _SDCard
+
+// _SDCard: fake SD card
+struct _SDCard {
+    static void Reset() {
+        _Stats::T(_Task::SD).busyUs += _Cost::SDReset;
+    }
+    
+    static uint16_t Init(SD::CardId* cardId=nullptr, SD::CardData* cardData=nullptr) {
+        _Stats::SDCardInits++;
+        _Stats::T(_Task::SD).busyUs += (cardId ? _Cost::SDInitFirst : _Cost::SDInit);
+        if (cardId) *cardId = _CardId;
+        if (cardData) *cardData = _CardData;
+        return 0x1234;
+    }
+    
+    static void WriteImage(uint16_t rca, SD::Block block, Img::Size size) {
+        const uint32_t blockCount = (size==Img::Size::Full ? ImgSD::Full::ImageBlockCount : ImgSD::Thumb::ImageBlockCount);
+        _Require((uint64_t)block+blockCount <= SD::BlockCapacity(_CardData), "SD write beyond card capacity");
+        _Stats::SDWrites++;
+        _Stats::SDBlocksWritten += blockCount;
+        _Stats::T(_Task::SD).busyUs += (uint64_t)((blockCount*SD::BlockLen*1e6) / _Cost::SDWriteBytesPerSec);
+    }
+    
+    static void CardSet(uint32_t capacityGiB) {
+        // BlockCapacity = (C_SIZE+1)*1024 blocks, ie C_SIZE+1 == capacity/512KiB
+        const uint64_t cSize = ((uint64_t)capacityGiB*1024*2) - 1;
+        _Require(cSize < ((uint64_t)1<<22)-1, "SD capacity too large");
+        _CardId = { .manufacturerId = 0x42, .productSerialNumber = 0xCAFE };
+        _CardData = {};
+        SetBits<69,48>(_CardData, cSize);
+    }
+    
+    static inline SD::CardId _CardId;
+    static inline SD::CardData _CardData;
+};
+
+// MARK: - _TaskSD
+
+// _TaskSD: MSPApp's _TaskSD, via MSP::SDStateLoad() / MSP::ImgWrite()
+struct _TaskSD {
+    static void CardReset() {
+        _Stats::T(_Task::SD).wakeups++;
+        _SDCard::Reset();
+    }
+    
+    static void CardInit() {
+        _Stats::T(_Task::SD).wakeups++;
+        if (!_State.rca) {
+            SD::CardId cardId;
+            SD::CardData cardData;
+            _State.rca = _SDCard::Init(&cardId, &cardData);
+            const bool reset = MSP::SDStateLoad(::_State.sd, cardId, cardData);
+            if (reset) _Stats::SDStateInits++;
+        
+        } else {
+            _SDCard::Init();
+        }
+    }
+    
+    static void Write() {
+        _Stats::T(_Task::SD).wakeups++;
+        const uint32_t idx = ::_State.sd.imgRingBufs[0].buf.idx;
+        _Require((uint64_t)ImgSD::Full::ImageBlockCount*(idx+1) <= ::_State.sd.baseFull, "full-size block underflow");
+        _Require((uint64_t)ImgSD::Thumb::ImageBlockCount*(idx+1) <= ::_State.sd.baseThumb-::_State.sd.baseFull, "thumbnail block underflow");
+        
+        MSP::ImgWrite(::_State.sd, [] (SD::Block block, Img::Size size) {
+            _SDCard::WriteImage(*_State.rca, block, size);
+        });
+        MSP::ImgRingBufIncrement(::_State.sd);
+        
+        // Verify that both copies of the ring buffer agree, and that the index wraps at `imgCap`
+        const MSP::ImgRingBuf& a = ::_State.sd.imgRingBufs[0];
+        const MSP::ImgRingBuf& b = ::_State.sd.imgRingBufs[1];
+        _Require(a.valid && b.valid && !memcmp(&a.buf, &b.buf, sizeof(a.buf)), "image ring buffers differ");
+        _Require(a.buf.idx == a.buf.id % ::_State.sd.imgCap, "image ring buffer index invalid");
+        if (!a.buf.idx) _Stats::SDRingBufWraps++;
+    }
+    
+    static inline struct __State {
+        __State() {} // Compiler bug workaround
+        std::optional<uint16_t> rca;
+    } _State;
+};
+
+// MARK: - _TaskImg
+
+// _TaskImg: MSPApp's _TaskImg, via MSP::ImgCapture() / MSP::ImgAutoExposureUpdate()
+struct _TaskImg {
+    static void SensorInit() {
+        _Stats::T(_Task::Img).wakeups++;
+        _Stats::T(_Task::Img).busyUs += _Cost::SensorInit;
+        _Stats::SensorInits++;
+    }
+    
+    static void Capture() {
+        _Stats::T(_Task::Img).wakeups++;
+        
+        uint8_t attempts = 0;
+        MSP::ImgCapture(_State.autoExp,
+            [&] (uint8_t expBlock, uint8_t skipCount) {
+                attempts++;
+                const _ICE::ImgCaptureStatusResp resp = _ICE::ImgCapture(_State.autoExp.integrationTime(), _State.autoExp.analogGain(), skipCount, _RTC::Now());
+                return MSP::ImgAutoExposureUpdate<_ICE>(_State.autoExp, resp);
+            },
+            [] {}
+        );
+        _Stats::CaptureAttempts[attempts-1]++;
+    }
+    
+    static inline struct __State {
+        __State() {} // Compiler bug workaround
+        Img::AutoExposure autoExp;
+    } _State;
+};
+
+// MARK: - _TaskEvent
+
+// _TaskEvent: MSPApp's _TaskEvent, via T_MSPEvents; _CaptureImage() models the hardware
+// operations that MSPApp's _TaskEvent::CaptureImage() performs
+struct _TaskEvent {
+    static constexpr uint32_t MotionPowerOnDelayMs = ::MotionPowerOnDelayMs;
+    
+    static bool Live() {
+        return _State.live;
+    }
+    
+    static Time::Instant Now() {
+        return _RTC::Now();
+    }
+    
+    static void EventFirst() {}
+    
+    static void CaptureImage(_TriggersType::CaptureImageEvent& ev) {
+        _TaskPower::CaptureNotify();
+        
+        if (ev.capture->ledFlash) {
+            _Stats::LEDFlashes++;
+            _Stats::T(_Task::Event).busyUs += _Cost::LEDFlash;
+        }
+        
+        // Turn on VDD_B power (turns on ICE40) and wait for ICE40 to start
+        _Stats::T(_Task::Event).busyUs += _Cost::ICE40Start;
+        _Stats::ICE40Starts++;
+        
+        // Reset SD nets before we turn on SD power
+        _TaskSD::CardReset();
+        
+        // Init image sensor / SD card
+        _TaskImg::SensorInit();
+        _TaskSD::CardInit();
+        
+        // Capture image to RAM, and copy it from RAM -> SD card
+        _TaskImg::Capture();
+        _TaskSD::Write();
+        
+        if (&ev >= _Triggers.timeTriggerBegin() && &ev < _Triggers.timeTriggerEnd()) {
+            _Stats::CapturesTime++;
+        } else if (&ev >= _Triggers.buttonTriggerBegin() && &ev < _Triggers.buttonTriggerEnd()) {
+            _Stats::CapturesButton++;
+        } else {
+            _Stats::CapturesMotion++;
+        }
+    }
+    
+    using Events = T_MSPEvents<_TriggersType, _Triggers, _TaskEvent>;
+    
+    static inline struct __State {
+        __State() {} // Compiler bug workaround
+        bool live = false;
+    } _State;
+};
+
+// MARK: - _TaskMotion / _TaskButton
+
+static bool _MotionPowered() {
+    for (auto it=_Triggers.motionTriggerBegin(); it!=_Triggers.motionTriggerEnd(); it++) {
+        if (it->powered) return true;
+    }
+    return false;
+}
+
+// MARK: - Triggers
+
+// _TriggersCreate(): a representative configuration:
+//   - time trigger: a capture every 2 hours
+//   - motion trigger: enabled 07:00-19:00 daily, 2 captures per motion, 10 minute suppression
+//   - button trigger: 1 capture
+//   - DST: +1 hour in March, -1 hour in November
+static MSP::Triggers _TriggersCreate(Time::Instant start) {
+    using namespace Time;
+    MSP::Triggers t = {};
+    const Instant day = AbsoluteBit | (((start & ~AbsoluteBit) / Day) * Day);
+    
+    t.timeTrigger[0] = { .capture = { .delayTicks = 0, .count = 1, .ledFlash = 0 } };
+    t.timeTriggerCount = 1;
+    for (uint8_t h=0; h<24; h+=2) {
+        MSP::Triggers::RepeatEvent& ev = t.repeatEvent[t.repeatEventCount++];
+        ev.time = day + h*Hour;
+        ev.type = MSP::Triggers::Event::Type::TimeTrigger;
+        ev.idx = 0;
+        ev.repeat = { .type = MSP::Repeat::Type::Daily };
+        ev.repeat.Daily.interval = 1;
+    }
+    
+    t.motionTrigger[0] = {
+        .capture = { .delayTicks = 5*Second, .count = 2, .ledFlash = 0 },
+        .count = 0,
+        .durationTicks = 12*Hour,
+        .suppressTicks = 10*Minute,
+    };
+    t.motionTriggerCount = 1;
+    {
+        MSP::Triggers::RepeatEvent& ev = t.repeatEvent[t.repeatEventCount++];
+        ev.time = day + 7*Hour;
+        ev.type = MSP::Triggers::Event::Type::MotionEnable;
+        ev.idx = 0;
+        ev.repeat = { .type = MSP::Repeat::Type::Daily };
+        ev.repeat.Daily.interval = 1;
+    }
+    
+    t.buttonTrigger[0] = { .capture = { .delayTicks = 0, .count = 1, .ledFlash = 1 } };
+    t.buttonTriggerCount = 1;
+    
+    // DST start / end, relative to our start day (which is Jan 1)
+    t.dstEvent[0] = { { .time = day + 69*Day + 10*Hour, .type = MSP::Triggers::Event::Type::DST, .idx = 0 }, {}, +Hour };
+    t.dstEvent[1] = { { .time = day + 307*Day + 9*Hour, .type = MSP::Triggers::Event::Type::DST, .idx = 1 }, {}, -Hour };
+    t.dstEventCount = 2;
+    return t;
+}
+
+// MARK: - Simulator
+
+// Stimuli: scheduled in the same list as the firmware's events, like MDCStudio's BatteryLifeSimulator
+static _TriggersType::Event _MotionStimulus;
+static _TriggersType::Event _ButtonStimulus;
+static _TriggersType::Event _HostSync;
+
+// _Wait(): advances the RTC until its current time reaches `t`, handling each RTC interrupt along the way
+static void _Wait(Time::Instant t) {
+    for (;;) {
+        // The event is already due (eg because a DST event moved it into the past)
+        if ((Time::TicksS64)(t-_RTC::Now()) <= 0) return;
+        
+        const bool motionPowered = _MotionPowered();
+        const Time::Instant isrTime = _RTC::NowBase() + _RTC::InterruptIntervalTicks;
+        if ((Time::TicksS64)(t-isrTime) < 0) {
+            const Time::TicksU32 ticks = (Time::TicksU32)(t-_RTC::NowBase());
+            if (motionPowered) _Stats::MotionPoweredTicks += ticks-_RTC::Ticks;
+            _RTC::Ticks = ticks;
+            return;
+        }
+        
+        if (motionPowered) _Stats::MotionPoweredTicks += _RTC::InterruptIntervalTicks-_RTC::Ticks;
+        _RTC::Ticks = 0;
+        _RTC::ISR();
+        _Stats::T(_Task::RTC).wakeups++;
+        _Stats::T(_Task::RTC).busyUs += _Cost::Wakeup;
+        _TaskPower::ISRRTC();
+        _Stats::DriftMax = std::max(_Stats::DriftMax, std::abs(_RTC::DriftTicks()));
+    }
+}
+
+// _TaskEventRun(): resets the event state and fast-forwards through past events, like
+// _TaskEvent::Reset() + the first half of _TaskEvent::Run()
+static void _TaskEventRun() {
+    _TaskSD::_State = {};
+    _TaskImg::_State = {};
+    _TaskEvent::_State = {};
+    
+    // Our stimuli are dropped from the event list by Init(); mark them as unscheduled
+    _MotionStimulus = {};
+    _ButtonStimulus = {};
+    _HostSync = {};
+    
+    const Time::Instant startTime = _RTC::Now();
+    _Triggers.init(startTime);
+    
+    // Fast-forward through events
+    for (;;) {
+        _TriggersType::Event* ev = _Triggers.eventBegin();
+        if (ev==_Triggers.eventEnd() || (ev->time > startTime)) break;
+        _TaskEvent::Events::EventHandle(_Triggers.eventPop());
+        _Stats::FastForwardEvents++;
+    }
+    
+    _TaskEvent::_State.live = true;
+    
+    _Triggers.eventInsert(_MotionStimulus, startTime+MotionStimulusInterval);
+    _Triggers.eventInsert(_ButtonStimulus, startTime+ButtonStimulusInterval);
+    _Triggers.eventInsert(_HostSync, startTime+HostSyncInterval);
+}
+
+// _HostSyncHandle(): the host connects to the device: it adjusts the device's time like
+// MDCUSBDevice::mspTimeAdjust(), and leaving host mode restarts _TaskEvent
+static void _HostSyncHandle() {
+    _Stats::HostSyncs++;
+    
+    // Clear the device's current adjustment so we can read its unadjusted time
+    _RTC::Adjustment = {};
+    const MSP::TimeState state = { .start = _RTC::State.start, .time = _RTC::Now() };
+    try {
+        _RTC::Adjustment = Time::TimeAdjustmentCalculate(state, _RTC::NowTrue());
+    } catch (const std::exception& e) {
+        printf("Time::TimeAdjustmentCalculate failed: %s\n", e.what());
+        _RTC::Init(Time::Clock::TimeInstantFromTimePoint(_RTC::NowTrue()));
+    }
+    
+    _TaskEventRun();
+}
+
+static double _Sec(uint64_t us) {
+    return (double)us / 1e6;
+}
+
+// _PowerUsage(): the operations that the firmware performed over `durationSec`, for PowerModel
+static PowerModel::Usage _PowerUsage(double durationSec) {
+    // Count the wakeups from LPM3.5; the remaining tasks' wakeups occur while we're already awake
+    const uint64_t wakeups =
+        _Stats::T(_Task::RTC).wakeups       +
+        _Stats::T(_Task::Motion).wakeups    +
+        _Stats::T(_Task::Button).wakeups    +
+        _Stats::T(_Task::Event).wakeups     ;
+    
+    return {
+        .durationSec        = durationSec,
+        .motionPoweredSec   = (double)_Stats::MotionPoweredTicks / Time::Second,
+        .wakeups            = (double)wakeups,
+        .ice40Starts        = (double)_Stats::ICE40Starts,
+        .sensorInits        = (double)_Stats::SensorInits,
+        .frames             = (double)_Stats::CaptureFrames,
+        .sdInits            = (double)_Stats::SDCardInits,
+        .sdWriteBlocks      = (double)_Stats::SDBlocksWritten,
+        .ledFlashes         = (double)_Stats::LEDFlashes,
+        .batterySamples     = (double)_Stats::BatterySamples,
+    };
+}
+
+static void _PowerPrint(const PowerModel::Energy& e, double days) {
+    const double total = e.total();
+    const auto row = [&] (const char* name, double j) {
+        printf("%-14s %10.1f %12.2f %9.1f%%\n", name, j, j/days, 100*j/total);
+    };
+    printf("%-14s %10s %12s %10s\n", "Energy", "Total (J)", "J/day", "Share");
+    row("Sleep", e.sleep);
+    row("Motion sensor", e.motion);
+    row("Wakeups", e.wakeup);
+    row("ICE40 start", e.ice40);
+    row("Sensor init", e.sensor);
+    row("Capture", e.capture);
+    row("SD", e.sd);
+    row("LED", e.led);
+    row("Battery sample", e.battery);
+    row("Total", total);
+    printf("\n");
+    printf("Battery life:           %.0f days (%.0f J battery, excluding self-discharge)\n",
+        PowerModel::BatteryEnergy / (total/days), PowerModel::BatteryEnergy);
+}
+
+int main(int argc, const char* argv[]) {
+    const uint32_t days = (argc>1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : 180);
+    const uint32_t capacityGiB = (argc>2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 64);
+    const double driftPpm = (argc>3 ? strtod(argv[3], nullptr) : 20);
+    _Require(days > 0, "invalid day count");
+    _Require(capacityGiB > 0, "invalid SD capacity");
+    
+    const auto timeStart = steady_clock::now();
+    
+    // Start at 2024-01-01 12:00:00 (730 days after our epoch)
+    const Time::Instant start = Time::AbsoluteBit | (730*(Time::TicksU64)Time::Day + 12*Time::Hour);
+    const Time::Instant end = start + days*(Time::TicksU64)Time::Day;
+    
+    _SDCard::CardSet(capacityGiB);
+    _RTC::Init(start);
+    _RTC::Drift = driftPpm/1e6;
+    _State.header = MSP::StateHeader;
+    _State.settings.triggers = _TriggersCreate(start);
+    _TaskEventRun();
+    
+    for (;;) {
+        _TriggersType::Event* next = _Triggers.eventBegin();
+        _Require(next != _Triggers.eventEnd(), "no events");
+        if (next->time >= end) break;
+        
+        _TriggersType::Event& ev = _Triggers.eventPop();
+        _Wait(ev.time);
+        
+        if (&ev == &_MotionStimulus) {
+            // Motion only wakes us if the motion sensor is powered
+            if (_MotionPowered()) {
+                _Stats::T(_Task::Motion).wakeups++;
+                _Stats::T(_Task::Motion).busyUs += _Cost::Wakeup;
+                _TaskEvent::Events::MotionHandle();
+            }
+            _Triggers.eventInsert(_MotionStimulus, ev.time+MotionStimulusInterval);
+            
+        } else if (&ev == &_ButtonStimulus) {
+            _Stats::T(_Task::Button).wakeups++;
+            _Stats::T(_Task::Button).busyUs += _Cost::Wakeup;
+            _TaskEvent::Events::ButtonHandle();
+            _Triggers.eventInsert(_ButtonStimulus, ev.time+ButtonStimulusInterval);
+            
+        } else if (&ev == &_HostSync) {
+            _HostSyncHandle();
+            
+        } else {
+            _Stats::T(_Task::Event).wakeups++;
+            _Stats::T(_Task::Event).busyUs += _Cost::Wakeup;
+            _TaskEvent::Events::EventHandle(ev);
+        }
+    }
+    _Wait(end);
+    
+    const double wallSec = duration<double>(steady_clock::now()-timeStart).count();
+    const double simSec = (double)(end-start) / Time::Second;
+    
+    uint64_t wakeups = 0;
+    uint64_t busyUs = 0;
+    for (const _Stats::Task& t : _Stats::Tasks) {
+        wakeups += t.wakeups;
+        busyUs += t.busyUs;
+    }
+    
+    const uint64_t captures = _Stats::CapturesTime + _Stats::CapturesMotion + _Stats::CapturesButton;
+    const MSP::ImgRingBuf& ringBuf = _State.sd.imgRingBufs[0];
+    const Time::TicksS64 drift = _RTC::DriftTicks();
+    
+    printf("Simulated %ju days in %.2f sec (SD: %ju GiB, RTC drift: %+.1f ppm)\n",
+        (uintmax_t)days, wallSec, (uintmax_t)capacityGiB, driftPpm);
+    printf("\n");
+    printf("Captures:               %ju (time: %ju, motion: %ju, button: %ju)\n",
+        (uintmax_t)captures, (uintmax_t)_Stats::CapturesTime, (uintmax_t)_Stats::CapturesMotion, (uintmax_t)_Stats::CapturesButton);
+    printf("  Attempts:             1: %ju, 2: %ju, 3: %ju\n",
+        (uintmax_t)_Stats::CaptureAttempts[0], (uintmax_t)_Stats::CaptureAttempts[1], (uintmax_t)_Stats::CaptureAttempts[2]);
+    printf("  LED flashes:          %ju\n", (uintmax_t)_Stats::LEDFlashes);
+    printf("SD:\n");
+    printf("  Card inits:           %ju (state inits: %ju)\n", (uintmax_t)_Stats::SDCardInits, (uintmax_t)_Stats::SDStateInits);
+    printf("  Writes:               %ju (%ju blocks, %.1f GiB)\n", (uintmax_t)_Stats::SDWrites,
+        (uintmax_t)_Stats::SDBlocksWritten, (double)_Stats::SDBlocksWritten*SD::BlockLen/(1024*1024*1024));
+    printf("  Image ring buffer:    id=%ju idx=%ju cap=%ju wraps=%ju\n", (uintmax_t)ringBuf.buf.id,
+        (uintmax_t)ringBuf.buf.idx, (uintmax_t)_State.sd.imgCap, (uintmax_t)_Stats::SDRingBufWraps);
+    printf("Battery samples:        %ju\n", (uintmax_t)_Stats::BatterySamples);
+    printf("Motion sensor powered:  %.1f%%\n", 100*(double)_Stats::MotionPoweredTicks/(end-start));
+    printf("Time:\n");
+    printf("  Host syncs:           %ju (fast-forwarded events: %ju)\n",
+        (uintmax_t)_Stats::HostSyncs, (uintmax_t)_Stats::FastForwardEvents);
+    printf("  Drift:                final: %+.2f sec, max: %.2f sec\n",
+        (double)drift/Time::Second, (double)_Stats::DriftMax/Time::Second);
+    printf("\n");
+    printf("%-14s %10s %12s %12s %10s\n", "Task", "Wakeups", "Wakeups/day", "Busy (sec)", "Busy/day");
+    for (size_t i=0; i<(size_t)_Task::Count; i++) {
+        const _Stats::Task& t = _Stats::Tasks[i];
+        printf("%-14s %10ju %12.1f %12.1f %10.2f\n", _TaskName((_Task)i), (uintmax_t)t.wakeups,
+            (double)t.wakeups/days, _Sec(t.busyUs), _Sec(t.busyUs)/days);
+    }
+    printf("%-14s %10ju %12.1f %12.1f %10.2f\n", "Total", (uintmax_t)wakeups,
+        (double)wakeups/days, _Sec(busyUs), _Sec(busyUs)/days);
+    printf("\n");
+    printf("Duty cycle:             %.4f%%\n", 100*_Sec(busyUs)/simSec);
+    printf("\n");
+    _PowerPrint(PowerModel::EnergyForUsage(PowerModel::Default, _PowerUsage(simSec)), days);
+    return 0;
+}
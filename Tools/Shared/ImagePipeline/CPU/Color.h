@@ -0,0 +1,157 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+namespace ImagePipeline::CPU {
+
+using Mat3 = std::array<std::array<float,3>,3>; // [row][col]
+
+inline Mat3 operator*(const Mat3& a, const Mat3& b) {
+    Mat3 r = {};
+    for (size_t i=0; i<3; i++) {
+        for (size_t j=0; j<3; j++) {
+            for (size_t k=0; k<3; k++) r[i][j] += a[i][k]*b[k][j];
+        }
+    }
+    return r;
+}
+
+// ColorTransform: the per-pixel stages of Pipeline::Run(), from debayered camera RGB to
+// linear sRGB (see ImagePipeline.metal and Saturation.metal)
+//
+// Successive linear stages are folded into a single matrix:
+//   - white balance, the color matrix and exposure (which scales Y in xyY, and therefore
+//     scales XYZ) become `camToXYZ`
+//   - Bradford XYZ.D50 -> XYZ.D65 and XYZ.D65 -> LSRGB.D65 become `xyzToLSRGB`
+//
+// Saturation scales C in LCHuv, which is equivalent to scaling the u'v' chromaticity's
+// distance from the white point while holding Y constant, so it's applied in that form
+// instead of converting to polar coordinates and back.
+//
+// The loops operate on planar rows and are written without branches so that they vectorize.
+struct ColorTransform {
+    Mat3 camToXYZ = {{ {1,0,0}, {0,1,0}, {0,0,1} }};
+    float brightness = 0;
+    float contrast = 0;
+    float saturation = 1; // Multiplier for the chroma
+    Mat3 xyzToLSRGB = _LSRGBD65FromXYZD65 * _BradfordXYZD65FromXYZD50;
+    
+    // toLab(): camera RGB -> Lab.D50, applying brightness and contrast
+    void toLab(size_t n, const float* r, const float* g, const float* b,
+        float* __restrict L, float* __restrict A, float* __restrict B) const {
+        
+        const Mat3& m = camToXYZ;
+        for (size_t i=0; i<n; i++) {
+            const float X = m[0][0]*r[i] + m[0][1]*g[i] + m[0][2]*b[i];
+            const float Y = m[1][0]*r[i] + m[1][1]*g[i] + m[1][2]*b[i];
+            const float Z = m[2][0]*r[i] + m[2][1]*g[i] + m[2][2]*b[i];
+            const float fx = _Labf(X/_D50[0]);
+            const float fy = _Labf(Y/_D50[1]);
+            const float fz = _Labf(Z/_D50[2]);
+            L[i] = 116*fy - 16;
+            A[i] = 500*(fx-fy);
+            B[i] = 200*(fy-fz);
+        }
+        
+        if (brightness != 0) {
+            for (size_t i=0; i<n; i++) L[i] = 100*brightness + L[i]*(1-brightness);
+        }
+        
+        if (contrast != 0) {
+            for (size_t i=0; i<n; i++) {
+                const float x = 2.7f*((L[i]/100)-.5f);
+                const float x2 = x*x;
+                const float k = 1+std::exp(-(x2*x2))*contrast;
+                L[i] = (k*(L[i]-50))+50;
+            }
+        }
+    }
+    
+    // localContrast(): Lab.L += (L-blurredL)*amount
+    static void localContrast(size_t n, float amount, const float* blurredL, float* L) {
+        for (size_t i=0; i<n; i++) L[i] += (L[i]-blurredL[i])*amount;
+    }
+    
+    // toLSRGB(): Lab.D50 -> linear sRGB.D65, applying saturation, writing interleaved
+    // RGB samples to `dst`
+    void toLSRGB(size_t n, const float* L, const float* A, const float* B, float* __restrict dst) const {
+        const Mat3& m = xyzToLSRGB;
+        const float uw = _LuvU(_D50[0], _D50[1], _D50[2]);
+        const float vw = _LuvV(_D50[0], _D50[1], _D50[2]);
+        for (size_t i=0; i<n; i++) {
+            const float fy = (L[i]+16)/116;
+            float X = _D50[0]*_LabfInv(fy + A[i]/500);
+            const float Y = _D50[1]*_LabfInv(fy);
+            float Z = _D50[2]*_LabfInv(fy - B[i]/200);
+            
+            {
+                const float denom = X + 15*Y + 3*Z;
+                const float u = uw + saturation*(4*X/denom - uw);
+                const float v = vw + saturation*(9*Y/denom - vw);
+                const float Xs = Y*(9*u)/(4*v);
+                const float Zs = Y*(12-3*u-20*v)/(4*v);
+                // Leave black (and degenerate) pixels alone, where chroma isn't defined
+                const bool valid = (Y>0 && denom>0 && v>0);
+                X = (valid ? Xs : X);
+                Z = (valid ? Zs : Z);
+            }
+            
+            dst[3*i+0] = m[0][0]*X + m[0][1]*Y + m[0][2]*Z;
+            dst[3*i+1] = m[1][0]*X + m[1][1]*Y + m[1][2]*Z;
+            dst[3*i+2] = m[2][0]*X + m[2][1]*Y + m[2][2]*Z;
+        }
+    }
+
+private:
+    static constexpr float _D50[] = { 0.96422, 1.00000, 0.82521 };
+    
+    // From http://www.brucelindbloom.com/index.html?Eqn_ChromAdapt.html
+    static constexpr Mat3 _BradfordXYZD65FromXYZD50 = {{
+        {  0.9555766, -0.0230393,  0.0631636 },
+        { -0.0282895,  1.0099416,  0.0210077 },
+        {  0.0122982, -0.0204830,  1.3299098 },
+    }};
+    
+    // From http://www.brucelindbloom.com/index.html?Eqn_RGB_XYZ_Matrix.html
+    static constexpr Mat3 _LSRGBD65FromXYZD65 = {{
+        {  3.2404542, -1.5371385, -0.4985314 },
+        { -0.9692660,  1.8760108,  0.0415560 },
+        {  0.0556434, -0.2040259,  1.0572252 },
+    }};
+    
+    // _Cbrt(): cube root of x>0, via an initial estimate from the float's exponent bits
+    // refined by Newton's method, which (unlike std::cbrt) vectorizes
+    static float _Cbrt(float x) {
+        uint32_t i = 0;
+        std::memcpy(&i, &x, sizeof(i));
+        i = i/3 + 0x2a514067;
+        float y = 0;
+        std::memcpy(&y, &i, sizeof(y));
+        for (int k=0; k<3; k++) y = (2*y + x/(y*y)) * (1.f/3);
+        return y;
+    }
+    
+    // From https://en.wikipedia.org/wiki/CIELAB_color_space
+    static float _Labf(float x) {
+        constexpr float d = 6./29;
+        constexpr float d3 = d*d*d;
+        const float c = _Cbrt(std::max(x, d3));
+        const float l = x*(1/(3*d*d)) + 4.f/29;
+        return (x > d3 ? c : l);
+    }
+    
+    static float _LabfInv(float x) {
+        constexpr float d = 6./29;
+        const float c = x*x*x;
+        const float l = 3*d*d*(x - 4.f/29);
+        return (x > d ? c : l);
+    }
+    
+    static float _LuvU(float X, float Y, float Z) { return 4*X/(X+15*Y+3*Z); }
+    static float _LuvV(float X, float Y, float Z) { return 9*Y/(X+15*Y+3*Z); }
+};
+
+} // namespace ImagePipeline::CPU
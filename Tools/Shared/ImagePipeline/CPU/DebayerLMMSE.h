@@ -0,0 +1,338 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include "Plane.h"
+
+namespace ImagePipeline::CPU {
+
+// DebayerLMMSE: CPU counterpart of LMMSE::Run(), the directional linear minimum mean-square
+// error demosaicing of Zhang & Wu ("Color Demosaicking via Directional Linear Minimum Mean
+// Square-Error Estimation", 2005)
+//
+// This is implemented from the paper rather than ported from LMMSE-Metal, and its output
+// hasn't been compared against LMMSE::Run(), so the two may differ. applyGamma=true costs
+// ~5x the time of applyGamma=false (a std::pow() per sample in each direction).
+//
+// The image is processed in tiles so that the intermediate planes stay in cache. Each tile
+// is padded by a halo of `Halo` pixels on every side, which covers the footprint of every
+// filter below. The CFA-dependent logic is expressed as per-row masks rather than
+// branches, so that the inner loops vectorize.
+class DebayerLMMSE {
+public:
+    // Halo: even, so that a tile's padded origin has the same CFA phase as the image
+    static constexpr size_t Halo = 16;
+    
+    // Tile: scratch buffers for debayering one tile at a time, reused across tiles
+    class Tile {
+    public:
+        Tile(size_t tileSize) : _tileSize(tileSize) {
+            const size_t p = tileSize + 2*Halo;
+            for (std::vector<float>& x : _buf) x.resize(p*p);
+            for (std::vector<float>& x : _out) x.resize(tileSize*tileSize);
+            for (std::vector<float>& x : _stats) x.resize(p);
+            for (auto& masks : _masks) for (std::vector<float>& x : masks) x.resize(p);
+        }
+        
+        // run(): debayers the tile at (x0,y0) of size (w,h) of `raw`
+        // The result is available via row() until the next call to run().
+        void run(const CFADesc& cfaDesc, bool applyGamma, const Plane& raw,
+            size_t x0, size_t y0, size_t w, size_t h) {
+            
+            assert(w<=_tileSize && h<=_tileSize);
+            assert(!(x0%2) && !(y0%2));
+            _w = w;
+            const size_t W = w + 2*Halo;
+            const size_t H = h + 2*Halo;
+            _stride = W;
+            
+            // Per-row-parity masks: 1 where the CFA has the given color, else 0
+            for (size_t py=0; py<2; py++) {
+                for (size_t x=0; x<W; x++) {
+                    const CFAColor c = cfaDesc.color(x, py);
+                    _masks[py][_MaskR][x] = (c == CFAColor::Red);
+                    _masks[py][_MaskG][x] = (c == CFAColor::Green);
+                    _masks[py][_MaskB][x] = (c == CFAColor::Blue);
+                }
+            }
+            
+            // Load the padded tile, mirroring at the image's edges (which preserves the
+            // CFA phase)
+            float* r0 = _buf[_R0].data();
+            for (size_t y=0; y<H; y++) {
+                const float* src = raw.row(MirrorClamp(raw.height, (ptrdiff_t)(y0+y)-(ptrdiff_t)Halo));
+                float* d = r0 + y*W;
+                if (x0>=Halo && x0+w+Halo<=raw.width) {
+                    std::copy(src+x0-Halo, src+x0+w+Halo, d);
+                } else {
+                    for (size_t x=0; x<W; x++) {
+                        d[x] = src[MirrorClamp(raw.width, (ptrdiff_t)(x0+x)-(ptrdiff_t)Halo)];
+                    }
+                }
+                if (applyGamma) {
+                    for (size_t x=0; x<W; x++) d[x] = _GammaForward(d[x]);
+                }
+            }
+            
+            _colorDifferences(W, H);
+            _lowpass(W, H);
+            _estimate(W, H);
+            _interpolate(W, H, h);
+            
+            if (applyGamma) {
+                for (std::vector<float>& out : _out) {
+                    for (size_t i=0; i<w*h; i++) out[i] = _GammaReverse(out[i]);
+                }
+            }
+        }
+        
+        // row(): returns row `y` of channel `c` of the debayered tile
+        const float* row(size_t c, size_t y) const {
+            return _out[c].data() + y*_w;
+        }
+    
+    private:
+        // Indexes into _buf. Later stages reuse buffers that are no longer needed.
+        static constexpr size_t _R0 = 0;
+        static constexpr size_t _DH = 1;
+        static constexpr size_t _DV = 2;
+        static constexpr size_t _SH = 3;
+        static constexpr size_t _SV = 4;
+        static constexpr size_t _D  = 5;
+        static constexpr size_t _DR = _DH;
+        static constexpr size_t _DB = _DV;
+        
+        static constexpr size_t _MaskR = 0;
+        static constexpr size_t _MaskG = 1;
+        static constexpr size_t _MaskB = 2;
+        
+        // Margins within the padded tile where each stage's output is valid
+        static constexpr size_t _MarginDiff     = 2;
+        static constexpr size_t _MarginLowpass  = _MarginDiff+4;
+        static constexpr size_t _MarginEstimate = _MarginLowpass+4;
+        static constexpr size_t _MarginDiag     = _MarginEstimate+1;
+        static_assert(_MarginDiag+1 <= Halo);
+        
+        float* _row(size_t buf, size_t y) { return _buf[buf].data() + y*_stride; }
+        const float* _mask(size_t y, size_t m) const { return _masks[y%2][m].data(); }
+        
+        // _colorDifferences(): horizontal/vertical estimates of the green-red/green-blue
+        // difference at every pixel, by interpolating the missing color with the 5-tap
+        // filter [-1 2 2 2 -1]/4
+        void _colorDifferences(size_t W, size_t H) {
+            constexpr size_t M = _MarginDiff;
+            for (size_t y=M; y<H-M; y++) {
+                _ColorDifferencesRow(W-2*M, _row(_R0,y-2)+M, _row(_R0,y-1)+M, _row(_R0,y)+M,
+                    _row(_R0,y+1)+M, _row(_R0,y+2)+M, _mask(y,_MaskG)+M, _row(_DH,y)+M, _row(_DV,y)+M);
+            }
+        }
+        
+        static void _ColorDifferencesRow(size_t n, const float* rn2, const float* rn1, const float* r,
+            const float* rp1, const float* rp2, const float* g, float* __restrict dh, float* __restrict dv) {
+            
+            for (size_t x=0; x<n; x++) {
+                // Difference is G-X at non-green pixels, and G-X̃ at green pixels
+                const float sign = 1-2*g[x];
+                const float fh = (-r[x-2] + 2*(r[x-1] + r[x] + r[x+1]) - r[x+2]) / 4;
+                const float fv = (-rn2[x] + 2*(rn1[x] + r[x] + rp1[x]) - rp2[x]) / 4;
+                dh[x] = sign*(fh-r[x]);
+                dv[x] = sign*(fv-r[x]);
+            }
+        }
+        
+        // _lowpass(): smooths the color differences along their direction with a 9-tap
+        // Gaussian, which yields the estimate of the noise-free signal
+        void _lowpass(size_t W, size_t H) {
+            constexpr float K[] = { 4/128., 9/128., 15/128., 23/128., 26/128., 23/128., 15/128., 9/128., 4/128. };
+            constexpr size_t M = _MarginLowpass;
+            for (size_t y=M; y<H-M; y++) {
+                const float* dh = _row(_DH, y);
+                float* __restrict sh = _row(_SH, y);
+                float* __restrict sv = _row(_SV, y);
+                for (size_t x=M; x<W-M; x++) {
+                    float s = 0;
+                    for (int i=-4; i<=4; i++) s += K[i+4]*dh[x+i];
+                    sh[x] = s;
+                    sv[x] = 0;
+                }
+                for (int i=-4; i<=4; i++) {
+                    const float k = K[i+4];
+                    const float* dv = _row(_DV, y+i);
+                    for (size_t x=M; x<W-M; x++) sv[x] += k*dv[x];
+                }
+            }
+        }
+        
+        // _estimate(): LMMSE estimate of the color difference in each direction, fused
+        // according to each estimate's error variance
+        //
+        // For each direction, the signal's mean and variance are estimated from the lowpassed
+        // differences over a 9-pixel window, and the noise variance from the residual.
+        void _estimate(size_t W, size_t H) {
+            constexpr size_t M = _MarginEstimate;
+            const size_t n = W-2*M;
+            float* __restrict muv = _stats[0].data();
+            float* __restrict vxv = _stats[1].data();
+            float* __restrict vnv = _stats[2].data();
+            for (size_t y=M; y<H-M; y++) {
+                // Vertical statistics, accumulated row by row so that the loops vectorize
+                std::fill(muv, muv+n, 0.f);
+                std::fill(vxv, vxv+n, 0.f);
+                std::fill(vnv, vnv+n, 0.f);
+                for (int i=-4; i<=4; i++) {
+                    const float* sv = _row(_SV, y+i)+M;
+                    for (size_t x=0; x<n; x++) muv[x] += sv[x]/9;
+                }
+                for (int i=-4; i<=4; i++) {
+                    const float* sv = _row(_SV, y+i)+M;
+                    const float* dv = _row(_DV, y+i)+M;
+                    for (size_t x=0; x<n; x++) {
+                        const float sx = sv[x]-muv[x];
+                        const float sn = dv[x]-sv[x];
+                        vxv[x] += sx*sx;
+                        vnv[x] += sn*sn;
+                    }
+                }
+                
+                _EstimateRow(n, _row(_DH,y)+M, _row(_SH,y)+M, _row(_DV,y)+M, muv, vxv, vnv, _row(_D,y)+M);
+            }
+        }
+        
+        static void _EstimateRow(size_t n, const float* dh, const float* sh, const float* dv,
+            const float* muv, const float* vxvSum, const float* vnvSum, float* __restrict d) {
+            
+            constexpr float Eps = 1e-7;
+            constexpr float N = 9;
+            for (size_t x=0; x<n; x++) {
+                float muh = 0;
+                for (int i=-4; i<=4; i++) muh += sh[x+i];
+                muh /= N;
+                
+                float vxh = 0, vnh = 0;
+                for (int i=-4; i<=4; i++) {
+                    const float sx = sh[x+i]-muh;
+                    const float sn = dh[x+i]-sh[x+i];
+                    vxh += sx*sx;
+                    vnh += sn*sn;
+                }
+                vxh = vxh/N + Eps;
+                vnh = vnh/N + Eps;
+                const float vxv = vxvSum[x]/N + Eps;
+                const float vnv = vnvSum[x]/N + Eps;
+                
+                const float xh = muh + vxh/(vxh+vnh)*(dh[x]-muh);
+                const float xv = muv[x] + vxv/(vxv+vnv)*(dv[x]-muv[x]);
+                const float ph = vxh*vnh/(vxh+vnh);
+                const float pv = vxv*vnv/(vxv+vnv);
+                d[x] = (xh*pv + xv*ph) / (ph+pv);
+            }
+        }
+        
+        // _interpolate(): reconstructs green from the color difference, then red/blue at
+        // blue/red pixels from the diagonal neighbors' differences, then red/blue at green
+        // pixels from the 4 neighbors' differences
+        void _interpolate(size_t W, size_t H, size_t h) {
+            // D becomes G-X at non-green pixels and 0 at green pixels
+            for (size_t y=_MarginEstimate; y<H-_MarginEstimate; y++) {
+                const float* g = _mask(y, _MaskG);
+                float* __restrict d = _row(_D, y);
+                for (size_t x=_MarginEstimate; x<W-_MarginEstimate; x++) d[x] *= (1-g[x]);
+            }
+            
+            // DR/DB: G-R / G-B at non-green pixels, where the opposite color's difference is
+            // the average of the 4 diagonal neighbors
+            constexpr size_t M = _MarginDiag;
+            for (size_t y=M; y<H-M; y++) {
+                _DiagonalRow(W-2*M, _row(_D,y-1)+M, _row(_D,y)+M, _row(_D,y+1)+M,
+                    _mask(y,_MaskR)+M, _mask(y,_MaskB)+M, _row(_DR,y)+M, _row(_DB,y)+M);
+            }
+            
+            // Output the tile's interior; at green pixels, DR/DB come from the 4 neighbors
+            for (size_t ty=0; ty<h; ty++) {
+                const size_t y = ty+Halo;
+                _OutputRow(_w, _row(_R0,y)+Halo, _row(_D,y)+Halo, _mask(y,_MaskG)+Halo,
+                    _row(_DR,y-1)+Halo, _row(_DR,y)+Halo, _row(_DR,y+1)+Halo,
+                    _row(_DB,y-1)+Halo, _row(_DB,y)+Halo, _row(_DB,y+1)+Halo,
+                    _out[0].data()+ty*_w, _out[1].data()+ty*_w, _out[2].data()+ty*_w);
+            }
+        }
+        
+        static void _DiagonalRow(size_t n, const float* dn, const float* d, const float* dp,
+            const float* mr, const float* mb, float* __restrict dr, float* __restrict db) {
+            
+            for (size_t x=0; x<n; x++) {
+                const float q = (dn[x-1] + dn[x+1] + dp[x-1] + dp[x+1]) / 4;
+                dr[x] = mr[x]*d[x] + mb[x]*q;
+                db[x] = mb[x]*d[x] + mr[x]*q;
+            }
+        }
+        
+        static void _OutputRow(size_t n, const float* r0, const float* d, const float* g,
+            const float* drn, const float* dr, const float* drp,
+            const float* dbn, const float* db, const float* dbp,
+            float* __restrict outR, float* __restrict outG, float* __restrict outB) {
+            
+            for (size_t x=0; x<n; x++) {
+                const float G = r0[x] + d[x];
+                const float DR = dr[x] + g[x]*(dr[x-1] + dr[x+1] + drn[x] + drp[x])/4;
+                const float DB = db[x] + g[x]*(db[x-1] + db[x+1] + dbn[x] + dbp[x])/4;
+                outR[x] = G-DR;
+                outG[x] = G;
+                outB[x] = G-DB;
+            }
+        }
+        
+        // From http://www.brucelindbloom.com/index.html?Eqn_RGB_XYZ_Matrix.html
+        static float _GammaForward(float x) {
+            if (x <= 0.0031308) return 12.92*x;
+            return 1.055*std::pow(x, 1/2.4)-.055;
+        }
+        
+        static float _GammaReverse(float x) {
+            if (x <= 0.04045) return x/12.92;
+            return std::pow((x+.055)/1.055, 2.4);
+        }
+        
+        const size_t _tileSize = 0;
+        size_t _w = 0;
+        size_t _stride = 0;
+        std::array<std::vector<float>,6> _buf;
+        std::array<std::vector<float>,3> _out;
+        std::array<std::vector<float>,3> _stats;
+        std::array<std::array<std::vector<float>,3>,2> _masks;
+    };
+    
+    // TileSize: size of the tiles, chosen so that a tile's intermediate planes fit in L2
+    static constexpr size_t TileSize = 128;
+    
+    // Run(): debayers `raw` into the planes of `rgb`
+    static void Run(const CFADesc& cfaDesc, bool applyGamma, const Plane& raw, std::array<Plane,3>& rgb) {
+        for (Plane& p : rgb) p = Plane(raw.width, raw.height);
+        ForEachTile(cfaDesc, applyGamma, raw, [&] (const Tile& tile, size_t x0, size_t y0, size_t w, size_t h) {
+            for (size_t c=0; c<3; c++) {
+                for (size_t y=0; y<h; y++) {
+                    const float* src = tile.row(c, y);
+                    std::copy(src, src+w, rgb[c].row(y0+y)+x0);
+                }
+            }
+        });
+    }
+    
+    // ForEachTile(): debayers `raw` tile by tile across the available cores, calling
+    // fn(tile, x0, y0, w, h) with each debayered tile while it's still in cache
+    template<typename T_Fn>
+    static void ForEachTile(const CFADesc& cfaDesc, bool applyGamma, const Plane& raw, T_Fn&& fn) {
+        assert(!(raw.width%2) && !(raw.height%2));
+        const size_t tilesX = (raw.width+TileSize-1) / TileSize;
+        const size_t tilesY = (raw.height+TileSize-1) / TileSize;
+        ParallelFor(tilesX*tilesY, [] { return Tile(TileSize); }, [&] (Tile& tile, size_t i) {
+            const size_t x0 = (i%tilesX)*TileSize;
+            const size_t y0 = (i/tilesX)*TileSize;
+            const size_t w = std::min(TileSize, raw.width-x0);
+            const size_t h = std::min(TileSize, raw.height-y0);
+            tile.run(cfaDesc, applyGamma, raw, x0, y0, w, h);
+            fn(tile, x0, y0, w, h);
+        });
+    }
+};
+
+} // namespace ImagePipeline::CPU
@@ -0,0 +1,348 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include "Plane.h"
+#include "Code/Shared/Img.h"
+
+namespace ImagePipeline::CPU {
+
+// FFCC: CPU equivalent of FFCC::Run(), the illuminant estimator of Barron & Tsai ("Fast
+// Fourier Color Constancy", 2017)
+//
+// The image is reduced to two log-chroma histograms (one of the pixels' colors, one of
+// their local absolute deviation), which are convolved with the model's filters in the
+// frequency domain. The bias is added, and the illuminant is the circular mean of the
+// softmax of the result.
+//
+// run() is single-threaded, so that callers can estimate the illuminant of many images
+// concurrently, one per core.
+class FFCC {
+public:
+    // BinCount: the histogram size that FFCC supports; a power of 2 so that the histogram
+    // wraps with a mask, and the FFT is radix-2
+    static constexpr size_t BinCount = 64;
+    static constexpr size_t ChannelCount = 2;
+    
+    // Model: mirrors FFCC::Model
+    struct Model {
+        struct {
+            struct {
+                size_t binCount = 0;
+                double binSize = 0;
+                double startingUV = 0;
+                double minIntensity = 0;
+            } histogram;
+        } params;
+        
+        // F_fft: BinCount x BinCount complex values per channel, in MATLAB's column-major order
+        const std::complex<double>* F_fft[ChannelCount] = {};
+        // B: BinCount x BinCount values, in MATLAB's column-major order
+        const double* B = nullptr;
+    };
+    
+    FFCC(const Model& model) : _params(model.params.histogram) {
+        assert(_params.binCount == BinCount);
+        // Required by _Bins()
+        assert((-std::log(_params.minIntensity) + std::abs(_params.startingUV))/_params.binSize < 4*BinCount);
+        // Our 2D FFT produces its output transposed (see _fft2()), so store the filters
+        // transposed to match
+        for (size_t c=0; c<ChannelCount; c++) {
+            for (size_t v=0; v<BinCount; v++) {
+                for (size_t u=0; u<BinCount; u++) {
+                    const std::complex<double> f = model.F_fft[c][v*BinCount + u];
+                    _fRe[c][u*BinCount + v] = f.real();
+                    _fIm[c][u*BinCount + v] = f.imag();
+                }
+            }
+        }
+        for (size_t i=0; i<BinCount*BinCount; i++) _b[i] = model.B[i];
+        
+        for (size_t i=0; i<BinCount; i++) {
+            const double a = (2*M_PI*i) / BinCount;
+            _cos[i] = std::cos(a);
+            _sin[i] = std::sin(a);
+        }
+        for (size_t i=0; i<BinCount/2; i++) {
+            _twiddleRe[i] = _cos[i];
+            _twiddleIm[i] = -_sin[i];
+        }
+    }
+    
+    // run(): estimates the illuminant of the `width` x `height` raw image `raw`
+    std::array<double,3> run(const CFADesc& cfaDesc, size_t width, size_t height, const Img::Pixel* raw) const {
+        std::vector<float> re(BinCount*BinCount), im(BinCount*BinCount);
+        
+        // Pack the two (real) histograms into one complex signal, so that a single complex
+        // FFT transforms both
+        _histograms(cfaDesc, width, height, raw, re.data(), im.data());
+        _fft2<false>(re.data(), im.data());
+        
+        // Unpack the two spectra, and multiply by the filters
+        // The spectrum of a real signal is Hermitian, so with Z = X0 + i*X1:
+        //   X0[k] = (Z[k] + conj(Z[-k])) / 2
+        //   X1[k] = (Z[k] - conj(Z[-k])) / 2i
+        std::vector<float> fxRe(BinCount*BinCount), fxIm(BinCount*BinCount);
+        for (size_t y=0; y<BinCount; y++) {
+            const size_t ym = (BinCount-y) & (BinCount-1);
+            for (size_t x=0; x<BinCount; x++) {
+                const size_t xm = (BinCount-x) & (BinCount-1);
+                const size_t k = y*BinCount + x;
+                const size_t km = ym*BinCount + xm;
+                const float x0Re = (re[k] + re[km]) / 2;
+                const float x0Im = (im[k] - im[km]) / 2;
+                const float x1Re = (im[k] + im[km]) / 2;
+                const float x1Im = (re[km] - re[k]) / 2;
+                fxRe[k] = x0Re*_fRe[0][k] - x0Im*_fIm[0][k] + x1Re*_fRe[1][k] - x1Im*_fIm[1][k];
+                fxIm[k] = x0Re*_fIm[0][k] + x0Im*_fRe[0][k] + x1Re*_fIm[1][k] + x1Im*_fRe[1][k];
+            }
+        }
+        
+        _fft2<true>(fxRe.data(), fxIm.data());
+        
+        // H = real(ifft2(FX)) + B, P = softmax(H)
+        constexpr float Norm = 1.f / (BinCount*BinCount);
+        std::vector<float>& p = fxRe;
+        float hMax = -INFINITY;
+        for (size_t i=0; i<BinCount*BinCount; i++) {
+            p[i] = p[i]*Norm + _b[i];
+            hMax = std::max(hMax, p[i]);
+        }
+        for (float& x : p) x = std::exp(x-hMax);
+        
+        // Fit a bivariate von Mises distribution to P: the mean of each dimension is the
+        // circular mean of its marginal distribution (P doesn't need to be normalized)
+        double uSin = 0, uCos = 0, vSin = 0, vCos = 0;
+        for (size_t v=0; v<BinCount; v++) {
+            double pv = 0;
+            for (size_t u=0; u<BinCount; u++) {
+                const float x = p[v*BinCount + u];
+                pv += x;
+                uSin += x*_sin[u];
+                uCos += x*_cos[u];
+            }
+            vSin += pv*_sin[v];
+            vCos += pv*_cos[v];
+        }
+        
+        const double u = _params.startingUV + _params.binSize*_Bin(uSin, uCos);
+        const double v = _params.startingUV + _params.binSize*_Bin(vSin, vCos);
+        
+        // u = log(g/r), v = log(g/b)
+        const std::array<double,3> rgb = { std::exp(-u), 1, std::exp(-v) };
+        const double mag = std::sqrt(rgb[0]*rgb[0] + rgb[1]*rgb[1] + rgb[2]*rgb[2]);
+        return { rgb[0]/mag, rgb[1]/mag, rgb[2]/mag };
+    }
+
+private:
+    using _Params = decltype(Model::params.histogram);
+    
+    // _Bin(): converts a circular mean's (sin,cos) to a bin position in [0,BinCount)
+    static double _Bin(double s, double c) {
+        double a = std::atan2(s, c);
+        if (a < 0) a += 2*M_PI;
+        return a * (BinCount/(2*M_PI));
+    }
+    
+    // _histograms(): writes the histogram of the pixels to `h0`, and the histogram of the
+    // pixels' local absolute deviation to `h1`, each normalized to sum to 1
+    //
+    // The image is first reduced to one RGB pixel per 2x2 CFA block, and each RGB plane is
+    // padded by 1 pixel (replicating the edges) for the local absolute deviation.
+    void _histograms(const CFADesc& cfaDesc, size_t width, size_t height, const Img::Pixel* raw,
+        float* h0, float* h1) const {
+        
+        assert(!(width%2) && !(height%2));
+        const size_t w = width/2;
+        const size_t h = height/2;
+        const size_t pw = w+2;
+        const size_t ph = h+2;
+        std::array<std::vector<float>,3> rgb;
+        for (std::vector<float>& x : rgb) x.resize(pw*ph);
+        
+        const CFABlock blk(cfaDesc);
+        constexpr float K = 1.f / Img::PixelMax;
+        for (size_t y=0; y<h; y++) {
+            const Img::Pixel* row0 = raw + (2*y)*width;
+            const Img::Pixel* row1 = raw + (2*y+1)*width;
+            float* r = rgb[0].data() + (y+1)*pw + 1;
+            float* g = rgb[1].data() + (y+1)*pw + 1;
+            float* b = rgb[2].data() + (y+1)*pw + 1;
+            for (size_t x=0; x<w; x++) {
+                const float s[] = { (float)row0[2*x], (float)row1[2*x], (float)row0[2*x+1], (float)row1[2*x+1] };
+                r[x] = s[blk.r]*K;
+                g[x] = (s[blk.g0]+s[blk.g1])*(K/2);
+                b[x] = s[blk.b]*K;
+            }
+        }
+        
+        for (std::vector<float>& c : rgb) {
+            float* d = c.data();
+            for (size_t y=1; y<ph-1; y++) {
+                d[y*pw] = d[y*pw+1];
+                d[y*pw+pw-1] = d[y*pw+pw-2];
+            }
+            std::copy(d+pw, d+2*pw, d);
+            std::copy(d+(ph-2)*pw, d+(ph-1)*pw, d+(ph-1)*pw);
+        }
+        
+        std::fill(h0, h0+BinCount*BinCount, 0.f);
+        std::fill(h1, h1+BinCount*BinCount, 0.f);
+        std::vector<float> dev[3] = { std::vector<float>(w), std::vector<float>(w), std::vector<float>(w) };
+        std::vector<uint32_t> bins(w);
+        std::vector<float> weights(w);
+        for (size_t y=1; y<ph-1; y++) {
+            const float* px[3];
+            for (size_t c=0; c<3; c++) {
+                const float* s = rgb[c].data() + y*pw + 1;
+                _LocalAbsoluteDeviation(w, s-pw, s, s+pw, dev[c].data());
+                px[c] = s;
+            }
+            
+            _Bins(w, px[0], px[1], px[2], bins.data(), weights.data());
+            for (size_t x=0; x<w; x++) h0[bins[x]] += weights[x];
+            
+            _Bins(w, dev[0].data(), dev[1].data(), dev[2].data(), bins.data(), weights.data());
+            for (size_t x=0; x<w; x++) h1[bins[x]] += weights[x];
+        }
+        
+        for (float* hist : { h0, h1 }) {
+            float sum = 0;
+            for (size_t i=0; i<BinCount*BinCount; i++) sum += hist[i];
+            if (sum > 0) for (size_t i=0; i<BinCount*BinCount; i++) hist[i] /= sum;
+        }
+    }
+    
+    // _LocalAbsoluteDeviation(): mean absolute difference between each pixel of row `s` and
+    // its 8 neighbors, where `sn`/`sp` are the rows above and below
+    static void _LocalAbsoluteDeviation(size_t n, const float* sn, const float* s, const float* sp,
+        float* __restrict d) {
+        
+        for (size_t x=0; x<n; x++) {
+            const float c = s[x];
+            d[x] = (std::abs(c-sn[x-1]) + std::abs(c-sn[x]) + std::abs(c-sn[x+1]) +
+                    std::abs(c-s[x-1])                      + std::abs(c-s[x+1]) +
+                    std::abs(c-sp[x-1]) + std::abs(c-sp[x]) + std::abs(c-sp[x+1])) / 8;
+        }
+    }
+    
+    // _Bins(): computes the histogram bin of each pixel's log-chroma (u,v), and its weight,
+    // which is 0 for pixels that are too dark, or clipped
+    void _Bins(size_t n, const float* r, const float* g, const float* b,
+        uint32_t* __restrict bins, float* __restrict weights) const {
+        
+        const float minIntensity = _params.minIntensity;
+        const float k = 1 / _params.binSize;
+        // Rounds to the nearest bin; the mask wraps the bin into [0,BinCount), like FFCC's
+        // mod(round((u-startingUV)/binSize), binCount)
+        // The positions are offset by a multiple of BinCount that keeps them positive for
+        // every pixel that has a nonzero weight (whose |u|,|v| <= -log(minIntensity)), so
+        // that truncation rounds down, which (unlike std::floor) vectorizes.
+        const float off = 4*BinCount + .5f - _params.startingUV*k;
+        for (size_t x=0; x<n; x++) {
+            const float lr = _Log(r[x]);
+            const float lg = _Log(g[x]);
+            const float lb = _Log(b[x]);
+            const int32_t u = (lg-lr)*k + off;
+            const int32_t v = (lg-lb)*k + off;
+            const uint32_t ub = (uint32_t)u & (BinCount-1);
+            const uint32_t vb = (uint32_t)v & (BinCount-1);
+            bins[x] = vb*BinCount + ub;
+            const float mn = std::min(std::min(r[x], g[x]), b[x]);
+            const float mx = std::max(std::max(r[x], g[x]), b[x]);
+            weights[x] = (mn>=minIntensity) & (mx<1);
+        }
+    }
+    
+    // _Log(): natural log of x>0, via the float's exponent bits and the atanh series for
+    // the mantissa (error <1e-6), which (unlike std::log) vectorizes
+    static float _Log(float x) {
+        uint32_t i = 0;
+        std::memcpy(&i, &x, sizeof(i));
+        const float e = (float)(int32_t)((i>>23)&0xFF) - 127;
+        i = (i & 0x007FFFFF) | 0x3F800000;
+        float m = 0;
+        std::memcpy(&m, &i, sizeof(m));
+        const float t = (m-1)/(m+1);
+        const float t2 = t*t;
+        const float s = 1 + t2*(1.f/3 + t2*(1.f/5 + t2*(1.f/7 + t2*(1.f/9))));
+        return e*(float)M_LN2 + 2*t*s;
+    }
+    
+    // _fft2(): in-place 2D FFT (or inverse FFT, without the 1/N^2 factor) of the
+    // BinCount x BinCount complex array (re,im)
+    //
+    // Each 1D pass transforms every column at once, so that the butterflies operate on
+    // whole rows and vectorize. The array is transposed between the passes, so the output
+    // of the forward FFT is transposed (with respect to the input), as is the input of the
+    // inverse FFT.
+    template<bool T_Inverse>
+    void _fft2(float* re, float* im) const {
+        _fftColumns<T_Inverse>(re, im);
+        _Transpose(re);
+        _Transpose(im);
+        _fftColumns<T_Inverse>(re, im);
+    }
+    
+    template<bool T_Inverse>
+    void _fftColumns(float* re, float* im) const {
+        constexpr size_t N = BinCount;
+        constexpr size_t Log2N = 6;
+        static_assert((1<<Log2N) == N);
+        
+        // Bit-reversal permutation of the rows
+        for (size_t i=0; i<N; i++) {
+            size_t j = 0;
+            for (size_t b=0; b<Log2N; b++) j |= ((i>>b)&1) << (Log2N-1-b);
+            if (i < j) {
+                std::swap_ranges(re+i*N, re+(i+1)*N, re+j*N);
+                std::swap_ranges(im+i*N, im+(i+1)*N, im+j*N);
+            }
+        }
+        
+        for (size_t len=2; len<=N; len*=2) {
+            for (size_t k=0; k<len/2; k++) {
+                // w = exp(-2πik/len), or its conjugate for the inverse
+                const float wr = _twiddleRe[k*(N/len)];
+                const float wi = (T_Inverse ? -1 : 1) * _twiddleIm[k*(N/len)];
+                for (size_t i=k; i<N; i+=len) {
+                    const size_t j = i+len/2;
+                    _Butterfly(re+i*N, im+i*N, re+j*N, im+j*N, wr, wi);
+                }
+            }
+        }
+    }
+    
+    static void _Butterfly(float* __restrict ar, float* __restrict ai, float* __restrict br, float* __restrict bi,
+        float wr, float wi) {
+        
+        for (size_t x=0; x<BinCount; x++) {
+            const float tr = wr*br[x] - wi*bi[x];
+            const float ti = wr*bi[x] + wi*br[x];
+            br[x] = ar[x]-tr;
+            bi[x] = ai[x]-ti;
+            ar[x] += tr;
+            ai[x] += ti;
+        }
+    }
+    
+    static void _Transpose(float* a) {
+        for (size_t y=0; y<BinCount; y++) {
+            for (size_t x=y+1; x<BinCount; x++) std::swap(a[y*BinCount+x], a[x*BinCount+y]);
+        }
+    }
+    
+    _Params _params;
+    std::array<float,BinCount*BinCount> _fRe[ChannelCount];
+    std::array<float,BinCount*BinCount> _fIm[ChannelCount];
+    std::array<float,BinCount*BinCount> _b;
+    std::array<double,BinCount> _cos;
+    std::array<double,BinCount> _sin;
+    std::array<float,BinCount/2> _twiddleRe;
+    std::array<float,BinCount/2> _twiddleIm;
+};
+
+} // namespace ImagePipeline::CPU
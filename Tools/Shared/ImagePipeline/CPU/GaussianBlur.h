@@ -0,0 +1,140 @@
+#pragma once
+#include <cmath>
+#include "Plane.h"
+
+namespace ImagePipeline::CPU {
+
+// GaussianBlur: CPU equivalent of MPSImageGaussianBlur with MPSImageEdgeModeClamp
+//
+// Small sigmas are convolved with a true Gaussian kernel. Large sigmas (where the kernel
+// would be hundreds of taps wide) are approximated by three successive box blurs, whose
+// cost is independent of sigma.
+class GaussianBlur {
+public:
+    static void Run(Plane& plane, float sigma) {
+        if (sigma <= 0) return;
+        Plane tmp(plane.width, plane.height);
+        if (sigma <= _KernelSigmaMax) {
+            const std::vector<float> k = _Kernel(sigma);
+            _ConvolveH(k, plane, tmp);
+            _ConvolveV(k, tmp, plane);
+            
+        } else {
+            for (size_t r : _BoxRadii(sigma)) {
+                _BoxH(r, plane, tmp);
+                _BoxV(r, tmp, plane);
+            }
+        }
+    }
+
+private:
+    // _KernelSigmaMax: largest sigma that we convolve with a true Gaussian kernel
+    static constexpr float _KernelSigmaMax = 4;
+    // _StripWidth: width of the column strips for vertical passes, so that a strip's
+    // rows stay in cache
+    static constexpr size_t _StripWidth = 256;
+    
+    static std::vector<float> _Kernel(float sigma) {
+        const ptrdiff_t r = std::ceil(3*sigma);
+        std::vector<float> k(2*r+1);
+        float sum = 0;
+        for (ptrdiff_t i=-r; i<=r; i++) {
+            k[i+r] = std::exp(-(float)(i*i) / (2*sigma*sigma));
+            sum += k[i+r];
+        }
+        for (float& x : k) x /= sum;
+        return k;
+    }
+    
+    // _BoxRadii(): radii of the three box blurs whose combined variance matches sigma^2
+    // (from Kovesi, "Fast Almost-Gaussian Filtering")
+    static std::vector<size_t> _BoxRadii(float sigma) {
+        constexpr int N = 3;
+        int wl = std::floor(std::sqrt(12*sigma*sigma/N + 1));
+        if (!(wl % 2)) wl--;
+        const int wu = wl+2;
+        const int m = std::lround((12*sigma*sigma - N*wl*wl - 4*N*wl - 3*N) / (-4*wl - 4));
+        std::vector<size_t> r;
+        for (int i=0; i<N; i++) r.push_back(((i<m ? wl : wu)-1) / 2);
+        return r;
+    }
+    
+    static void _ConvolveH(const std::vector<float>& k, const Plane& src, Plane& dst) {
+        const size_t w = src.width;
+        const ptrdiff_t r = k.size()/2;
+        ParallelForRows(src.height, [&] (size_t y0, size_t y1) {
+            std::vector<float> padded(w+2*r);
+            for (size_t y=y0; y<y1; y++) {
+                const float* s = src.row(y);
+                for (ptrdiff_t x=-r; x<(ptrdiff_t)w+r; x++) padded[x+r] = s[Clamp(w, x)];
+                float* d = dst.row(y);
+                std::fill(d, d+w, 0.f);
+                for (size_t i=0; i<k.size(); i++) {
+                    const float ki = k[i];
+                    const float* p = padded.data()+i;
+                    for (size_t x=0; x<w; x++) d[x] += ki*p[x];
+                }
+            }
+        });
+    }
+    
+    static void _ConvolveV(const std::vector<float>& k, const Plane& src, Plane& dst) {
+        const size_t h = src.height;
+        const ptrdiff_t r = k.size()/2;
+        ParallelForRows(h, [&] (size_t y0, size_t y1) {
+            for (size_t y=y0; y<y1; y++) {
+                float* d = dst.row(y);
+                std::fill(d, d+src.width, 0.f);
+                for (ptrdiff_t i=-r; i<=r; i++) {
+                    const float ki = k[i+r];
+                    const float* s = src.row(Clamp(h, (ptrdiff_t)y+i));
+                    for (size_t x=0; x<src.width; x++) d[x] += ki*s[x];
+                }
+            }
+        });
+    }
+    
+    static void _BoxH(size_t r, const Plane& src, Plane& dst) {
+        const size_t w = src.width;
+        const float norm = 1.f / (2*r+1);
+        ParallelForRows(src.height, [&] (size_t y0, size_t y1) {
+            for (size_t y=y0; y<y1; y++) {
+                const float* s = src.row(y);
+                float* d = dst.row(y);
+                double sum = 0;
+                for (ptrdiff_t i=-(ptrdiff_t)r; i<=(ptrdiff_t)r; i++) sum += s[Clamp(w, i)];
+                for (size_t x=0; x<w; x++) {
+                    d[x] = sum*norm;
+                    sum += s[Clamp(w, x+r+1)] - s[Clamp(w, (ptrdiff_t)x-(ptrdiff_t)r)];
+                }
+            }
+        });
+    }
+    
+    static void _BoxV(size_t r, const Plane& src, Plane& dst) {
+        const size_t w = src.width;
+        const size_t h = src.height;
+        const float norm = 1.f / (2*r+1);
+        const size_t stripCount = (w+_StripWidth-1) / _StripWidth;
+        ParallelFor(stripCount, [&] (size_t strip) {
+            const size_t x0 = strip*_StripWidth;
+            const size_t n = std::min(w, x0+_StripWidth) - x0;
+            std::vector<float> sum(n);
+            for (ptrdiff_t i=-(ptrdiff_t)r; i<=(ptrdiff_t)r; i++) {
+                const float* s = src.row(Clamp(h, i)) + x0;
+                for (size_t x=0; x<n; x++) sum[x] += s[x];
+            }
+            for (size_t y=0; y<h; y++) {
+                float* d = dst.row(y) + x0;
+                const float* add = src.row(Clamp(h, y+r+1)) + x0;
+                const float* sub = src.row(Clamp(h, (ptrdiff_t)y-(ptrdiff_t)r)) + x0;
+                for (size_t x=0; x<n; x++) {
+                    d[x] = sum[x]*norm;
+                    sum[x] += add[x] - sub[x];
+                }
+            }
+        });
+    }
+};
+
+} // namespace ImagePipeline::CPU
@@ -0,0 +1,184 @@
+#pragma once
+#include <array>
+#include <optional>
+#include <chrono>
+#include <cmath>
+#include "Plane.h"
+#include "Color.h"
+#include "GaussianBlur.h"
+#include "ReconstructHighlights.h"
+#include "DebayerLMMSE.h"
+#include "Code/Shared/Img.h"
+
+// ImagePipeline::CPU: a portable implementation of ImagePipeline::Pipeline::Run(), for
+// platforms without Metal
+//
+// Pipeline::Run() follows the stages of the Metal pipeline, but fuses them into as few
+// passes over the image as possible:
+//
+//   1. Load the raw image (+ ReconstructHighlights, if enabled, which needs the whole image)
+//   2. Debayer tile by tile, and apply the per-pixel color stages to each tile while it's
+//      still in cache
+//   3. If local contrast is enabled: blur the L channel of the whole image, then apply local
+//      contrast and the remaining per-pixel stages
+//
+// Options mirrors ImagePipeline::Pipeline::Options, minus `defringe` (unused by the Metal
+// pipeline) and `timestamp` (which requires text rendering).
+//
+// The output hasn't been compared against the Metal pipeline's, so this isn't a drop-in
+// replacement for it yet.
+namespace ImagePipeline::CPU {
+
+using ColorRaw = std::array<double,3>;
+using ColorMatrix = std::array<std::array<double,3>,3>; // [row][col]
+
+class Pipeline {
+public:
+    struct Options {
+        CFADesc cfaDesc;
+        
+        std::optional<ColorRaw> illum;
+        std::optional<ColorMatrix> colorMatrix;
+        
+        struct {
+            bool en = false;
+        } reconstructHighlights;
+        
+        struct {
+            bool applyGamma = false;
+        } debayerLMMSE;
+        
+        float exposure = 0;
+        float saturation = 0;
+        float brightness = 0;
+        float contrast = 0;
+        
+        struct {
+            float amount = 0;
+            float radius = 0;
+        } localContrast;
+    };
+    
+    // Stats: the time spent in each pass of Run()
+    struct Stats {
+        using Duration = std::chrono::duration<double,std::milli>;
+        Duration load;
+        Duration reconstructHighlights;
+        Duration debayer;       // Includes the per-pixel color stages when they're fused
+        Duration localContrast;
+        Duration color;         // Per-pixel color stages that follow local contrast
+    };
+    
+    // Run(): processes the `width` x `height` raw image `srcRaw` into `dstRgb`, which
+    // receives interleaved linear sRGB samples (3 floats per pixel)
+    static void Run(const Options& opts, size_t width, size_t height,
+        const Img::Pixel* srcRaw, float* dstRgb, Stats* stats=nullptr) {
+        
+        using Clock = std::chrono::steady_clock;
+        Stats st;
+        auto t = Clock::now();
+        const auto lap = [&] (Stats::Duration& d) {
+            const auto now = Clock::now();
+            d = now-t;
+            t = now;
+        };
+        
+        Plane raw = LoadRaw(width, height, srcRaw);
+        lap(st.load);
+        
+        // Reconstruct highlights
+        if (opts.reconstructHighlights.en) {
+            assert(opts.illum);
+            ReconstructHighlights::Run(opts.cfaDesc, *opts.illum, raw);
+        }
+        lap(st.reconstructHighlights);
+        
+        const ColorTransform ct = ColorTransformForOptions(opts);
+        const bool localContrast = (opts.localContrast.amount != 0);
+        constexpr size_t TileSize = DebayerLMMSE::TileSize;
+        
+        // Without local contrast, every remaining stage is per-pixel, so we go straight from
+        // each debayered tile to the output.
+        // With local contrast, we need the L channel of the whole image before continuing,
+        // so we stop at Lab.
+        std::array<Plane,3> lab;
+        if (localContrast) lab = { Plane(width,height), Plane(width,height), Plane(width,height) };
+        
+        DebayerLMMSE::ForEachTile(opts.cfaDesc, opts.debayerLMMSE.applyGamma, raw,
+        [&] (const DebayerLMMSE::Tile& tile, size_t x0, size_t y0, size_t w, size_t h) {
+            float L[TileSize], A[TileSize], B[TileSize];
+            for (size_t y=0; y<h; y++) {
+                if (localContrast) {
+                    ct.toLab(w, tile.row(0,y), tile.row(1,y), tile.row(2,y),
+                        lab[0].row(y0+y)+x0, lab[1].row(y0+y)+x0, lab[2].row(y0+y)+x0);
+                } else {
+                    ct.toLab(w, tile.row(0,y), tile.row(1,y), tile.row(2,y), L, A, B);
+                    ct.toLSRGB(w, L, A, B, dstRgb + 3*((y0+y)*width + x0));
+                }
+            }
+        });
+        lap(st.debayer);
+        
+        if (localContrast) {
+            Plane blurredL = lab[0];
+            GaussianBlur::Run(blurredL, opts.localContrast.radius);
+            lap(st.localContrast);
+            
+            ParallelForRows(height, [&] (size_t y0, size_t y1) {
+                for (size_t y=y0; y<y1; y++) {
+                    ColorTransform::localContrast(width, opts.localContrast.amount, blurredL.row(y), lab[0].row(y));
+                    ct.toLSRGB(width, lab[0].row(y), lab[1].row(y), lab[2].row(y), dstRgb + 3*y*width);
+                }
+            });
+            lap(st.color);
+        }
+        
+        if (stats) *stats = st;
+    }
+    
+    // LoadRaw(): converts raw pixels to normalized floats
+    static Plane LoadRaw(size_t width, size_t height, const Img::Pixel* srcRaw) {
+        Plane raw(width, height);
+        ParallelForRows(height, [&] (size_t y0, size_t y1) {
+            constexpr float K = 1.f / Img::PixelMax;
+            const Img::Pixel* src = srcRaw + y0*width;
+            float* dst = raw.row(y0);
+            for (size_t i=0; i<(y1-y0)*width; i++) dst[i] = src[i]*K;
+        });
+        return raw;
+    }
+    
+    static ColorTransform ColorTransformForOptions(const Options& opts) {
+        ColorTransform ct;
+        
+        // White balance
+        Mat3 wb = {{ {1,0,0}, {0,1,0}, {0,0,1} }};
+        if (opts.illum) {
+            const ColorRaw& illum = *opts.illum;
+            const double factor = std::max(std::max(illum[0], illum[1]), illum[2]);
+            for (size_t i=0; i<3; i++) wb[i][i] = factor/illum[i];
+        }
+        
+        // Color correction (Camera raw -> XYZ.D50)
+        Mat3 cm = {{ {1,0,0}, {0,1,0}, {0,0,1} }};
+        if (opts.colorMatrix) {
+            for (size_t i=0; i<3; i++) {
+                for (size_t j=0; j<3; j++) cm[i][j] = (*opts.colorMatrix)[i][j];
+            }
+        }
+        
+        // Exposure
+        constexpr float ExposureCoeff = 4;
+        const float exposure = std::pow(2.f, ExposureCoeff*opts.exposure);
+        Mat3 ex = {{ {exposure,0,0}, {0,exposure,0}, {0,0,exposure} }};
+        
+        constexpr float SaturationCoeff = 2;
+        ct.camToXYZ = ex * cm * wb;
+        ct.brightness = opts.brightness;
+        ct.contrast = opts.contrast;
+        ct.saturation = std::pow(2.f, 2*SaturationCoeff*opts.saturation);
+        return ct;
+    }
+};
+
+} // namespace ImagePipeline::CPU
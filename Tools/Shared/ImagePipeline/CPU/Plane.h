@@ -0,0 +1,118 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace ImagePipeline::CPU {
+
+// CFAColor / CFADesc: mirrors Toastbox::CFAColor / Toastbox::CFADesc, which are only
+// available on macOS
+enum class CFAColor : uint8_t {
+    Red     = 0,
+    Green   = 1,
+    Blue    = 2,
+};
+
+struct CFADesc {
+    CFAColor desc[2][2] = {};
+    
+    CFAColor color(size_t x, size_t y) const {
+        return desc[y&1][x&1];
+    }
+};
+
+// CFABlock: the index of each color's samples within a 2x2 CFA block that starts on an
+// even coordinate, where the block's samples are ordered (x0,y0), (x0,y1), (x1,y0), (x1,y1)
+struct CFABlock {
+    CFABlock(const CFADesc& cfaDesc) {
+        const CFAColor c = cfaDesc.color(0,0);
+        const CFAColor cn = cfaDesc.color(1,0);
+        if (c == CFAColor::Red) {
+            r = 0; b = 3; g0 = 1; g1 = 2;
+        } else if (c==CFAColor::Green && cn==CFAColor::Red) {
+            r = 2; b = 1; g0 = 0; g1 = 3;
+        } else if (c==CFAColor::Green && cn==CFAColor::Blue) {
+            r = 1; b = 2; g0 = 0; g1 = 3;
+        } else {
+            r = 3; b = 0; g0 = 1; g1 = 2;
+        }
+    }
+    
+    size_t r = 0;
+    size_t g0 = 0;
+    size_t g1 = 0;
+    size_t b = 0;
+};
+
+// Plane: a single-channel float image
+struct Plane {
+    Plane() {}
+    Plane(size_t w, size_t h) : width(w), height(h), data(w*h) {}
+    
+    float* row(size_t y) { return data.data() + y*width; }
+    const float* row(size_t y) const { return data.data() + y*width; }
+    
+    float& at(size_t x, size_t y) { return data[y*width + x]; }
+    float at(size_t x, size_t y) const { return data[y*width + x]; }
+    
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<float> data;
+};
+
+// MirrorClamp(): reflects `n` into [0,N) without repeating the edge sample, which
+// preserves the parity of `n` (and therefore the CFA color) for reflections of up to N-1
+inline size_t MirrorClamp(size_t N, ptrdiff_t n) {
+    if (n < 0)                  return -n;
+    else if ((size_t)n >= N)    return 2*(N-1) - (size_t)n;
+    else                        return n;
+}
+
+// Clamp(): clamps `n` into [0,N), equivalent to Metal's clamp_to_edge
+inline size_t Clamp(size_t N, ptrdiff_t n) {
+    return std::clamp(n, (ptrdiff_t)0, (ptrdiff_t)N-1);
+}
+
+// ParallelFor(): calls fn(state, i) for every i in [0,count), distributing the calls across
+// the available cores. Each worker creates its own `state` via makeState(), for scratch
+// buffers that are reused across calls. Returns once every call has completed.
+template<typename T_MakeState, typename T_Fn>
+inline void ParallelFor(size_t count, T_MakeState&& makeState, T_Fn&& fn) {
+    const size_t threadCount = std::min((size_t)std::max(1u, std::thread::hardware_concurrency()), count);
+    std::atomic<size_t> next = 0;
+    const auto work = [&] {
+        auto state = makeState();
+        for (;;) {
+            const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= count) break;
+            fn(state, i);
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    for (size_t i=1; i<threadCount; i++) threads.emplace_back(work);
+    work();
+    for (std::thread& t : threads) t.join();
+}
+
+// ParallelFor(): calls fn(i) for every i in [0,count), distributing the calls across
+// the available cores. Returns once every call has completed.
+template<typename T_Fn>
+inline void ParallelFor(size_t count, T_Fn&& fn) {
+    ParallelFor(count, [] { return 0; }, [&] (int, size_t i) { fn(i); });
+}
+
+// ParallelForRows(): calls fn(y0, y1) for bands of rows covering [0,height)
+template<typename T_Fn>
+inline void ParallelForRows(size_t height, T_Fn&& fn) {
+    constexpr size_t BandHeight = 16;
+    const size_t bandCount = (height+BandHeight-1) / BandHeight;
+    ParallelFor(bandCount, [&] (size_t i) {
+        fn(i*BandHeight, std::min(height, (i+1)*BandHeight));
+    });
+}
+
+} // namespace ImagePipeline::CPU
@@ -0,0 +1,172 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include "Plane.h"
+#include "GaussianBlur.h"
+
+namespace ImagePipeline::CPU {
+
+// ReconstructHighlights: CPU equivalent of ImagePipeline::ReconstructHighlights (see
+// ReconstructHighlights.metal), which replaces clipped raw samples with the illuminant's
+// color scaled to the surrounding brightness
+class ReconstructHighlights {
+public:
+    static void Run(const CFADesc& cfaDesc, const std::array<double,3>& illum, Plane& raw) {
+        const size_t w = raw.width;
+        const size_t h = raw.height;
+        assert(!(w%2) && !(h%2));
+        
+        const double illumMin = std::min(std::min(illum[0], illum[1]), illum[2]);
+        const std::array<float,3> illumMin1 = {
+            (float)(illum[0]/illumMin),
+            (float)(illum[1]/illumMin),
+            (float)(illum[2]/illumMin),
+        };
+        
+        const std::array<Plane,3> rgb = _DebayerDownsample(cfaDesc, raw);
+        
+        // Create threshold map and blur it
+        Plane thresholdMap(w, h);
+        ParallelForRows(h, [&] (size_t y0, size_t y1) {
+            std::array<std::vector<float>,3> s;
+            for (size_t y=y0; y<y1; y++) {
+                _SampleLinear(rgb, w, y, s);
+                float* d = thresholdMap.row(y);
+                for (size_t x=0; x<w; x++) {
+                    constexpr float Sat = 0.9999;
+                    constexpr float Thresh[] = { .99, 0.25, 0.25/2, 0.25/4 };
+                    const int count = (s[0][x]>Sat) + (s[1][x]>Sat) + (s[2][x]>Sat);
+                    d[x] = Thresh[count];
+                }
+            }
+        });
+        GaussianBlur::Run(thresholdMap, 20);
+        
+        // Create highlight map (illuminant brightness + alpha)
+        // `Scale` balances the raw colors from the sensor for the purpose
+        // of highlight reconstruction (empirically determined)
+        constexpr float Scale[] = { 1.179, 0.649, 1.180 };
+        const float magMax = std::sqrt(Scale[0]*Scale[0] + Scale[1]*Scale[1] + Scale[2]*Scale[2]);
+        Plane mapK(w, h);
+        Plane mapA(w, h);
+        ParallelForRows(h, [&] (size_t y0, size_t y1) {
+            std::array<std::vector<float>,3> s;
+            for (size_t y=y0; y<y1; y++) {
+                _SampleLinear(rgb, w, y, s);
+                const float* thresh = thresholdMap.row(y);
+                float* k = mapK.row(y);
+                float* a = mapA.row(y);
+                for (size_t x=0; x<w; x++) {
+                    const float r = Scale[0]*s[0][x];
+                    const float g = Scale[1]*s[1][x];
+                    const float b = Scale[2]*s[2][x];
+                    const float mag = std::sqrt(r*r + g*g + b*b) / magMax;
+                    const float highlight = (mag >= thresh[x]);
+                    k[x] = highlight * (s[0][x]/illumMin1[0] + s[1][x]/illumMin1[1] + s[2][x]/illumMin1[2])/3;
+                    a[x] = highlight;
+                }
+            }
+        });
+        
+        // Blur the highlight map and blend it into `raw`
+        // Since alpha is either 0 or 1 in the highlight map, and k is 0 wherever alpha is 0:
+        //   color = weighted average of neighbors' k, ignoring samples with alpha=0
+        //         = (weighted sum of k) / (weighted sum of alpha)
+        //   alpha = weighted average of neighbors' alpha, *not* ignoring samples with alpha=0
+        ParallelForRows(h, [&] (size_t y0, size_t y1) {
+            constexpr float CoeffSum = 16;
+            std::vector<float> sumK(w), sumA(w);
+            for (size_t y=y0; y<y1; y++) {
+                // The 3x3 [1 2 1] kernel is separable: vertical pass into sumK/sumA, then
+                // horizontal pass below
+                const size_t yn = MirrorClamp(h, (ptrdiff_t)y-1);
+                const size_t yp = MirrorClamp(h, (ptrdiff_t)y+1);
+                _Sum121(w, mapK.row(yn), mapK.row(y), mapK.row(yp), sumK.data());
+                _Sum121(w, mapA.row(yn), mapA.row(y), mapA.row(yp), sumA.data());
+                
+                const float illumC[] = {
+                    illumMin1[(size_t)cfaDesc.color(0, y)],
+                    illumMin1[(size_t)cfaDesc.color(1, y)],
+                };
+                float* dst = raw.row(y);
+                for (size_t x=0; x<w; x++) {
+                    const size_t xn = MirrorClamp(w, (ptrdiff_t)x-1);
+                    const size_t xp = MirrorClamp(w, (ptrdiff_t)x+1);
+                    const float k = sumK[xn] + 2*sumK[x] + sumK[xp];
+                    const float a = sumA[xn] + 2*sumA[x] + sumA[xp];
+                    // k is 0 wherever a is 0
+                    const float color = k / std::max(a, 1.f);
+                    // Strength=2
+                    const float alpha = (a/CoeffSum)*(a/CoeffSum);
+                    dst[x] = alpha*color*illumC[x&1] + (1-alpha)*dst[x];
+                }
+            }
+        });
+    }
+
+private:
+    static void _Sum121(size_t n, const float* a, const float* b, const float* c, float* __restrict d) {
+        for (size_t x=0; x<n; x++) d[x] = a[x] + 2*b[x] + c[x];
+    }
+    
+    // _DebayerDownsample(): half-resolution RGB image, one pixel per 2x2 CFA block
+    // (see Base::DebayerDownsample)
+    static std::array<Plane,3> _DebayerDownsample(const CFADesc& cfaDesc, const Plane& raw) {
+        const size_t w = raw.width/2;
+        const size_t h = raw.height/2;
+        std::array<Plane,3> rgb = { Plane(w,h), Plane(w,h), Plane(w,h) };
+        
+        // Every 2x2 block starts on an even coordinate, so the CFA layout is the same
+        // for every block; green averages two samples.
+        const CFABlock blk(cfaDesc);
+        ParallelForRows(h, [&] (size_t y0, size_t y1) {
+            for (size_t y=y0; y<y1; y++) {
+                const float* row0 = raw.row(2*y);
+                const float* row1 = raw.row(2*y+1);
+                float* r = rgb[0].row(y);
+                float* g = rgb[1].row(y);
+                float* b = rgb[2].row(y);
+                for (size_t x=0; x<w; x++) {
+                    const float s[] = { row0[2*x], row1[2*x], row0[2*x+1], row1[2*x+1] };
+                    r[x] = s[blk.r];
+                    g[x] = (s[blk.g0]+s[blk.g1])/2;
+                    b[x] = s[blk.b];
+                }
+            }
+        });
+        return rgb;
+    }
+    
+    // _SampleLinear(): bilinearly samples the half-resolution `rgb` at the centers of
+    // full-resolution row `y`, equivalent to sampling with filter::linear
+    static void _SampleLinear(const std::array<Plane,3>& rgb, size_t w, size_t y,
+        std::array<std::vector<float>,3>& dst) {
+        
+        const size_t hw = rgb[0].width;
+        const size_t hh = rgb[0].height;
+        // Full-resolution pixel centers land at 1/4 and 3/4 between half-resolution
+        // pixel centers
+        const size_t i = y/2;
+        const size_t ya = Clamp(hh, (y%2) ? (ptrdiff_t)i : (ptrdiff_t)i-1);
+        const size_t yb = Clamp(hh, (y%2) ? (ptrdiff_t)i+1 : (ptrdiff_t)i);
+        const float ka = ((y%2) ? .75f : .25f);
+        
+        std::vector<float> tmp(hw);
+        for (size_t c=0; c<3; c++) {
+            const float* a = rgb[c].row(ya);
+            const float* b = rgb[c].row(yb);
+            for (size_t x=0; x<hw; x++) tmp[x] = ka*a[x] + (1-ka)*b[x];
+            
+            dst[c].resize(w);
+            float* d = dst[c].data();
+            for (size_t x=0; x<hw; x++) {
+                const float l = tmp[Clamp(hw, (ptrdiff_t)x-1)];
+                const float r = tmp[Clamp(hw, x+1)];
+                d[2*x]   = .25f*l + .75f*tmp[x];
+                d[2*x+1] = .75f*tmp[x] + .25f*r;
+            }
+        }
+    }
+};
+
+} // namespace ImagePipeline::CPU
@@ -3,6 +3,8 @@
 #import "Code/Lib/FFCC-Metal/FFCC.h"
 #import "Code/Lib/Toastbox/Mac/Renderer.h"
 #import "Code/Lib/Toastbox/Mac/Color.h"
+#import "Code/Shared/Img.h"
+#import "CPU/FFCC.h"
 
 namespace ImagePipeline {
 
@@ -16,6 +18,37 @@ public:
         return FFCC::Run(_Model, renderer, cfaDesc, raw);
     }
     
+    // Run(): CPU implementation, which runs on the calling thread without involving the
+    // GPU, so that the illuminants of many images can be estimated concurrently.
+    // Not yet verified against the Metal implementation above, which remains the default; see
+    // MDCStudio's EstimateIlluminantCompare user default for the comparison.
+    static Toastbox::Color<Toastbox::ColorSpace::Raw> Run(
+        const Toastbox::CFADesc& cfaDesc,
+        size_t width, size_t height,
+        const Img::Pixel* raw
+    ) {
+        static const CPU::FFCC ffcc({
+            .params = {
+                .histogram = {
+                    .binCount       = _Model.params.histogram.binCount,
+                    .binSize        = _Model.params.histogram.binSize,
+                    .startingUV     = _Model.params.histogram.startingUV,
+                    .minIntensity   = _Model.params.histogram.minIntensity,
+                },
+            },
+            .F_fft = { _Model.F_fft[0], _Model.F_fft[1], },
+            .B = _Model.B,
+        });
+        
+        CPU::CFADesc cpuCFADesc;
+        for (size_t y=0; y<2; y++) {
+            for (size_t x=0; x<2; x++) cpuCFADesc.desc[y][x] = (CPU::CFAColor)cfaDesc.color(x,y);
+        }
+        
+        const std::array<double,3> illum = ffcc.run(cpuCFADesc, width, height, raw);
+        return Toastbox::Color<Toastbox::ColorSpace::Raw>(illum[0], illum[1], illum[2]);
+    }
+    
 private:
     static const FFCC::Model _Model;
     static const uint64_t _F_fft0Vals[8192];
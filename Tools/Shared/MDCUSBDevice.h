@@ -12,12 +12,15 @@
 #include "Code/Shared/ChecksumFletcher32.h"
 #include "Code/Shared/TimeAdjustment.h"
 #include "Code/Shared/TimeString.h"
+#include "USBFSDevice.h"
 
-struct MDCUSBDevice; using MDCUSBDevicePtr = std::unique_ptr<MDCUSBDevice>;
-class MDCUSBDevice {
+// MDCUSBDeviceT: T_USBDevice is the USB transport; Toastbox::USBDevice or USBFSDevice (Linux) for
+// real devices, or VirtualPhoton to talk to an emulated device
+template<typename T_USBDevice>
+class MDCUSBDeviceT {
 public:
-    using USBDevice = Toastbox::USBDevice;
-    using USBDevicePtr = Toastbox::USBDevicePtr;
+    using USBDevice = T_USBDevice;
+    using USBDevicePtr = std::unique_ptr<T_USBDevice>;
     
     struct IncompatibleVersion : Toastbox::RuntimeError {
         using Toastbox::RuntimeError::RuntimeError;
@@ -58,13 +61,13 @@ public:
         }
     }
     
-    static std::vector<MDCUSBDevicePtr> GetDevices() {
-        std::vector<MDCUSBDevicePtr> devs;
+    static std::vector<std::unique_ptr<MDCUSBDeviceT>> GetDevices() {
+        std::vector<std::unique_ptr<MDCUSBDeviceT>> devs;
         auto usbDevs = USBDevice::GetDevices();
         for (USBDevicePtr& usbDev : usbDevs) {
             if (USBDeviceMatches(*usbDev)) {
                 try {
-                    devs.push_back(std::make_unique<MDCUSBDevice>(std::move(usbDev)));
+                    devs.push_back(std::make_unique<MDCUSBDeviceT>(std::move(usbDev)));
                 
                 // Suppress failures to create a MDCUSBDevice
                 } catch (const std::exception& e) {
@@ -75,7 +78,7 @@ public:
         return devs;
     }
     
-    MDCUSBDevice(std::unique_ptr<USBDevice>&& dev) : _dev(std::move(dev)) {
+    MDCUSBDeviceT(std::unique_ptr<USBDevice>&& dev) : _dev(std::move(dev)) {
         printf("[MDCUSBDevice] reset START\n");
         // We don't know what state the device was left in, so reset its state
         reset();
@@ -87,13 +90,13 @@ public:
     }
     
     // Copy
-    MDCUSBDevice(const MDCUSBDevice& x) = delete;
-    MDCUSBDevice& operator=(const MDCUSBDevice& x) = delete;
+    MDCUSBDeviceT(const MDCUSBDeviceT& x) = delete;
+    MDCUSBDeviceT& operator=(const MDCUSBDeviceT& x) = delete;
     // Move
-    MDCUSBDevice(MDCUSBDevice&& x) = default;
-    MDCUSBDevice& operator=(MDCUSBDevice&& x) = default;
+    MDCUSBDeviceT(MDCUSBDeviceT&& x) = default;
+    MDCUSBDeviceT& operator=(MDCUSBDeviceT&& x) = default;
     
-    bool operator==(const MDCUSBDevice& x) const {
+    bool operator==(const MDCUSBDeviceT& x) const {
         return _dev == x._dev;
     }
     
@@ -777,14 +780,16 @@ public:
     std::unique_ptr<uint8_t[]> imgReadout(Img::Size size) {
         assert(_mode == STM::Status::Mode::STMApp);
         const size_t imageLen = (size==Img::Size::Full ? ImgSD::Full::ImagePaddedLen : ImgSD::Thumb::ImagePaddedLen);
+        const size_t checksumOffset = (size==Img::Size::Full ? Img::Full::ChecksumOffset : Img::Thumb::ChecksumOffset);
         std::unique_ptr<uint8_t[]> buf = std::make_unique<uint8_t[]>(imageLen);
+        // Read the image with a single transfer, rather than in chunks, so that the host controller
+        // can keep the bulk pipe full for the entire image
         const size_t lenGot = _dev->read(STM::Endpoint::DataIn, buf.get(), imageLen);
         if (lenGot != imageLen) {
             throw Toastbox::RuntimeError("expected 0x%jx bytes, got 0x%jx bytes", (uintmax_t)imageLen, (uintmax_t)lenGot);
         }
         
         // Validate checksum
-        const size_t checksumOffset = (size==Img::Size::Full ? Img::Full::ChecksumOffset : Img::Thumb::ChecksumOffset);
         const uint32_t checksumExpected = ChecksumFletcher32(buf.get(), checksumOffset);
         uint32_t checksumGot = 0;
         memcpy(&checksumGot, (uint8_t*)buf.get()+checksumOffset, Img::ChecksumLen);
@@ -884,3 +889,11 @@ private:
     std::string _serial = {};
     STM::Status::Mode _mode = STM::Status::Mode::None;
 };
+
+#if __linux__
+// On Linux, use usbfs directly so that readout() keeps several transfers in flight (via USBBulkReader)
+using MDCUSBDevice = MDCUSBDeviceT<USBFSDevice>;
+#else
+using MDCUSBDevice = MDCUSBDeviceT<Toastbox::USBDevice>;
+#endif
+using MDCUSBDevicePtr = std::unique_ptr<MDCUSBDevice>;
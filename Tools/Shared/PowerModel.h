@@ -0,0 +1,169 @@
+#pragma once
+#include <algorithm>
+#include "Code/Shared/ImgSD.h"
+
+// PowerModel: estimates the energy that MSPApp consumes, from the operations that it performs
+//
+// A Usage counts the operations performed over a span of time (captures, SD writes, time that
+// the motion sensor was powered, etc), and EnergyForUsage() converts it into joules using the
+// per-operation Costs. The result is broken down by category so that it shows where the energy
+// goes.
+//
+// Usage is either measured (eg from MSPAppSimulator's trace of the firmware's work), or
+// synthesized for a single capture via CaptureUsage() (as BatteryLifeSimulator does).
+namespace PowerModel {
+
+// Costs: the energy of each operation (in microjoules), and the currents drawn continuously
+// (in microamps, from the battery)
+struct Costs {
+    double batteryVoltage   = 0;
+    // sleepCurrent: current in LPM3.5, including the RTC and regulators' quiescent current
+    double sleepCurrent     = 0;
+    // motionCurrent: current drawn by the motion sensor while powered
+    double motionCurrent    = 0;
+    // wakeup: exiting LPM3.5 + handling an interrupt
+    double wakeup           = 0;
+    // ice40Start: turning on VDD_B and waiting for ICE40 to load its bitstream
+    double ice40Start       = 0;
+    double sensorInit       = 0;
+    // frame: capturing one frame, including skipped frames
+    double frame            = 0;
+    double sdInit           = 0;
+    double sdWriteBlock     = 0;
+    double ledFlash         = 0;
+    double batterySample    = 0;
+};
+
+// Default: estimates derived from the durations in MSPAppSimulator's _Cost and typical
+// active currents. These should be replaced with measurements as they become available.
+constexpr Costs Default = {
+    .batteryVoltage     = 3.7,
+    .sleepCurrent       = 5,
+    .motionCurrent      = 10,
+    .wakeup             = 1,
+    .ice40Start         = 1780,     // 32 ms @ 15 mA
+    .sensorInit         = 2220,     // 20 ms @ 30 mA
+    .frame              = 7330,     // 33 ms @ 60 mA
+    .sdInit             = 5550,     // 50 ms @ 30 mA
+    .sdWriteBlock       = 8.5,      // 512 bytes @ 10 MB/s @ 45 mA
+    .ledFlash           = 37,       // 0.5 ms @ 20 mA
+    .batterySample      = 18,       // 5 ms @ 1 mA
+};
+
+// BatteryEnergy: the usable energy of a new, fully-charged battery, in joules.
+// Calibrated so that a single-attempt capture (see CaptureUsage()) costs roughly 1/80000 of the
+// battery, which matches BatteryLifeSimulator's previous best-case capacity of 80000 captures.
+constexpr double BatteryEnergy = 10000;
+
+// Usage: the operations performed over a span of time
+// Counts are doubles so that a Usage can represent an average (eg CaptureUsage(1.2)).
+struct Usage {
+    double durationSec      = 0;
+    double motionPoweredSec = 0;
+    double wakeups          = 0;
+    double ice40Starts      = 0;
+    double sensorInits      = 0;
+    double frames           = 0;
+    double sdInits          = 0;
+    double sdWriteBlocks    = 0;
+    double ledFlashes       = 0;
+    double batterySamples   = 0;
+};
+
+// Energy: energy consumed, in joules, by category
+struct Energy {
+    double sleep    = 0;
+    double motion   = 0;
+    double wakeup   = 0;
+    double ice40    = 0;
+    double sensor   = 0;
+    double capture  = 0;
+    double sd       = 0;
+    double led      = 0;
+    double battery  = 0;
+    
+    double total() const {
+        return sleep + motion + wakeup + ice40 + sensor + capture + sd + led + battery;
+    }
+    
+    Energy& operator+=(const Energy& x) {
+        sleep += x.sleep;
+        motion += x.motion;
+        wakeup += x.wakeup;
+        ice40 += x.ice40;
+        sensor += x.sensor;
+        capture += x.capture;
+        sd += x.sd;
+        led += x.led;
+        battery += x.battery;
+        return *this;
+    }
+    
+    Energy operator-(const Energy& x) const {
+        Energy r = *this;
+        r += x*-1;
+        return r;
+    }
+    
+    Energy operator*(double k) const {
+        return {
+            .sleep      = sleep*k,
+            .motion     = motion*k,
+            .wakeup     = wakeup*k,
+            .ice40      = ice40*k,
+            .sensor     = sensor*k,
+            .capture    = capture*k,
+            .sd         = sd*k,
+            .led        = led*k,
+            .battery    = battery*k,
+        };
+    }
+};
+
+inline Energy EnergyForUsage(const Costs& c, const Usage& u) {
+    constexpr double Micro = 1e-6;
+    return {
+        .sleep      = c.sleepCurrent*Micro * c.batteryVoltage * u.durationSec,
+        .motion     = c.motionCurrent*Micro * c.batteryVoltage * u.motionPoweredSec,
+        .wakeup     = c.wakeup*Micro * u.wakeups,
+        .ice40      = c.ice40Start*Micro * u.ice40Starts,
+        .sensor     = c.sensorInit*Micro * u.sensorInits,
+        .capture    = c.frame*Micro * u.frames,
+        .sd         = (c.sdInit*Micro * u.sdInits) + (c.sdWriteBlock*Micro * u.sdWriteBlocks),
+        .led        = c.ledFlash*Micro * u.ledFlashes,
+        .battery    = c.batterySample*Micro * u.batterySamples,
+    };
+}
+
+// CaptureAttemptFrames(): the number of frames captured by `attempts` capture attempts.
+// Every attempt after the first skips a frame so that the new exposure settings take
+// effect (see MSPApp's _TaskImg::_Capture()).
+inline double CaptureAttemptFrames(double attempts) {
+    return std::max(0., 2*attempts - 1);
+}
+
+// CaptureUsage(): the operations that a single capture performs (see MSPApp's
+// _TaskEvent::_CaptureImage()), where `attempts` is the (average) number of capture
+// attempts required for auto exposure to converge
+inline Usage CaptureUsage(double attempts, bool ledFlash) {
+    return {
+        .wakeups        = 1,
+        .ice40Starts    = 1,
+        .sensorInits    = 1,
+        .frames         = CaptureAttemptFrames(attempts),
+        .sdInits        = 1,
+        .sdWriteBlocks  = ImgSD::Full::ImageBlockCount + ImgSD::Thumb::ImageBlockCount,
+        .ledFlashes     = (ledFlash ? 1. : 0.),
+    };
+}
+
+// SleepUsage(): the operations performed while otherwise idle for `durationSec`, with the
+// motion sensor powered for `motionPoweredSec` of it
+inline Usage SleepUsage(double durationSec, double motionPoweredSec) {
+    return {
+        .durationSec        = durationSec,
+        .motionPoweredSec   = motionPoweredSec,
+    };
+}
+
+} // namespace PowerModel
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cassert>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include "Code/Lib/Toastbox/RuntimeError.h"
+
+// USBBulkReader: reads from a bulk-IN endpoint with multiple transfers in flight
+//
+// A single synchronous read leaves the bus idle between the completion of one transfer and the
+// submission of the next. read() instead splits the destination into transfers of up to
+// `transferLen` bytes and keeps up to T_InFlight of them submitted at once, so the host
+// controller always has a transfer queued.
+//
+// T_Endpoint provides the asynchronous transfer primitives:
+//
+//   // submit(): starts an asynchronous read of up to `len` bytes into `buf`
+//   // `continuation` is true for every transfer of a read() except the first. If a transfer
+//   // ends with a short packet, the endpoint must not let the continuation transfers that follow
+//   // it receive data (see USBFSBulkIn).
+//   void submit(size_t id, void* buf, size_t len, bool continuation);
+//
+//   // reap(): waits for a submitted transfer to complete, in submission order
+//   USBBulkReaderCompletion reap();
+//
+//   // cancel(): cancels a submitted transfer; it's still returned by reap()
+//   void cancel(size_t id);
+struct USBBulkReaderCompletion {
+    size_t id = 0;
+    size_t len = 0; // Number of bytes transferred
+    int err = 0;    // 0 on success, otherwise an errno value
+};
+
+template<typename T_Endpoint, size_t T_InFlight=4>
+struct USBBulkReader {
+    static_assert(T_InFlight > 0);
+    
+    USBBulkReader(T_Endpoint& ep, size_t transferLen) : _ep(ep), _transferLen(transferLen) {
+        assert(_transferLen);
+    }
+    
+    // read(): reads `len` bytes into `dst`
+    // Returns the number of bytes read, which is less than `len` if the device ended the transfer
+    // early (with a short packet).
+    size_t read(void* dst, size_t len) {
+        uint8_t*const d = (uint8_t*)dst;
+        size_t submitted = 0;
+        size_t done = 0;
+        bool end = false;
+        
+        try {
+            for (;;) {
+                // Keep our transfers in flight
+                while (!end && _inFlight.size()<T_InFlight && submitted<len) {
+                    const size_t id = _nextId;
+                    _nextId = (_nextId+1) % T_InFlight;
+                    const size_t chunkLen = std::min(_transferLen, len-submitted);
+                    _ep.submit(id, d+submitted, chunkLen, submitted!=0);
+                    _inFlight.push_back({ .id=id, .len=chunkLen });
+                    submitted += chunkLen;
+                    _stats.inFlightMax = std::max(_stats.inFlightMax, _inFlight.size());
+                }
+                
+                if (_inFlight.empty()) break;
+                
+                const USBBulkReaderCompletion c = _ep.reap();
+                const _Transfer t = _inFlight.front();
+                _inFlight.pop_front();
+                if (c.id != t.id) {
+                    throw Toastbox::RuntimeError("transfer completed out of order (expected: %ju, got: %ju)",
+                        (uintmax_t)t.id, (uintmax_t)c.id);
+                }
+                if (c.err) {
+                    throw Toastbox::RuntimeError("transfer failed: %s", strerror(c.err));
+                }
+                
+                _stats.transfers++;
+                done += c.len;
+                
+                // A short transfer means that the device has no more data. The transfers that are
+                // still in flight would receive data that doesn't follow the data that we've read,
+                // so cancel them.
+                if (c.len < t.len) {
+                    end = true;
+                    _cancel();
+                    break;
+                }
+            }
+        
+        } catch (...) {
+            _cancel();
+            throw;
+        }
+        
+        _stats.len += done;
+        return done;
+    }
+    
+    struct Stats {
+        uint64_t transfers = 0;
+        uint64_t len = 0;
+        size_t inFlightMax = 0;
+    };
+    
+    const Stats& stats() const { return _stats; }
+    
+    struct _Transfer {
+        size_t id = 0;
+        size_t len = 0;
+    };
+    
+    // _cancel(): cancels our in-flight transfers and waits for them to complete
+    void _cancel() {
+        for (const _Transfer& t : _inFlight) {
+            _ep.cancel(t.id);
+        }
+        while (!_inFlight.empty()) {
+            _ep.reap();
+            _inFlight.pop_front();
+        }
+    }
+    
+    T_Endpoint& _ep;
+    const size_t _transferLen = 0;
+    std::deque<_Transfer> _inFlight;
+    size_t _nextId = 0;
+    Stats _stats;
+};
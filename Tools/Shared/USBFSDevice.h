@@ -0,0 +1,264 @@
+#pragma once
+#if __linux__
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <optional>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+#include <linux/usb/ch9.h>
+#include "Code/Lib/Toastbox/RuntimeError.h"
+#include "Code/Lib/Toastbox/FileDescriptor.h"
+#include "USBBulkReader.h"
+
+// USBFSBulkIn: USBBulkReader endpoint that uses Linux's usbfs URB interface
+//
+// Every URB is submitted with USBDEVFS_URB_SHORT_NOT_OK, and every URB except the first of a
+// read() with USBDEVFS_URB_BULK_CONTINUATION. When a URB completes with a short packet, usbfs
+// then cancels the continuation URBs queued behind it, instead of letting them receive the data
+// that the device sends next (which doesn't belong to this read()).
+//
+// usbfs copies the data between its own buffer and `buf`. (Zero-copy would require buffers
+// allocated by mmap()ing the usbfs device node.)
+template<size_t T_InFlight=4>
+struct USBFSBulkIn {
+    USBFSBulkIn(int fd, uint8_t ep) : _fd(fd), _ep(ep) {}
+    
+    void submit(size_t id, void* buf, size_t len, bool continuation) {
+        assert(id < T_InFlight);
+        if (len > INT_MAX) throw Toastbox::RuntimeError("transfer too large: %ju", (uintmax_t)len);
+        usbdevfs_urb& urb = _urbs[id];
+        urb = {};
+        urb.type = USBDEVFS_URB_TYPE_BULK;
+        urb.endpoint = _ep;
+        urb.flags = USBDEVFS_URB_SHORT_NOT_OK | (continuation ? USBDEVFS_URB_BULK_CONTINUATION : 0);
+        urb.buffer = buf;
+        urb.buffer_length = (int)len;
+        urb.usercontext = (void*)id;
+        const int ir = ioctl(_fd, USBDEVFS_SUBMITURB, &urb);
+        if (ir) throw Toastbox::RuntimeError("USBDEVFS_SUBMITURB failed: %s", strerror(errno));
+    }
+    
+    USBBulkReaderCompletion reap() {
+        usbdevfs_urb* urb = nullptr;
+        for (;;) {
+            const int ir = ioctl(_fd, USBDEVFS_REAPURB, &urb);
+            if (!ir) break;
+            if (errno == EINTR) continue;
+            throw Toastbox::RuntimeError("USBDEVFS_REAPURB failed: %s", strerror(errno));
+        }
+        
+        return {
+            .id = (size_t)(uintptr_t)urb->usercontext,
+            .len = (size_t)std::max(0, urb->actual_length),
+            // usbfs reports errors as negative errno values. EREMOTEIO is how a short packet is
+            // reported (because of USBDEVFS_URB_SHORT_NOT_OK), which USBBulkReader expects to
+            // see as a successful short transfer.
+            .err = (urb->status==-EREMOTEIO ? 0 : -urb->status),
+        };
+    }
+    
+    void cancel(size_t id) {
+        assert(id < T_InFlight);
+        // EINVAL: the URB already completed, which is fine since reap() still returns it
+        const int ir = ioctl(_fd, USBDEVFS_DISCARDURB, &_urbs[id]);
+        if (ir && errno!=EINVAL) {
+            throw Toastbox::RuntimeError("USBDEVFS_DISCARDURB failed: %s", strerror(errno));
+        }
+    }
+    
+    const int _fd = -1;
+    const uint8_t _ep = 0;
+    std::array<usbdevfs_urb,T_InFlight> _urbs = {};
+};
+
+// USBFSDevice: a USB device accessed through its Linux usbfs device node (/dev/bus/usb/BBB/DDD)
+//
+// Implements the USBDevice interface that MDCUSBDeviceT expects. Bulk-IN reads go through
+// USBBulkReader, so large reads (like MDCUSBDeviceT::readout()) keep several transfers in flight.
+// Only interface 0 is used; it's claimed on the first transfer, so that enumerating devices
+// doesn't claim the interfaces of unrelated devices.
+struct USBFSDevice {
+    static constexpr const char* DevicesPath = "/dev/bus/usb";
+    static constexpr unsigned int Interface = 0;
+    static constexpr size_t ReadTransferLen = 128*1024;
+    static constexpr size_t ReadInFlight = 4;
+    
+    static std::vector<std::unique_ptr<USBFSDevice>> GetDevices() {
+        namespace fs = std::filesystem;
+        std::vector<std::unique_ptr<USBFSDevice>> devs;
+        std::error_code ec;
+        for (const fs::directory_entry& bus : fs::directory_iterator(DevicesPath, ec)) {
+            for (const fs::directory_entry& dev : fs::directory_iterator(bus.path(), ec)) {
+                try {
+                    devs.push_back(std::make_unique<USBFSDevice>(dev.path()));
+                // Suppress devices that we don't have permission to open
+                } catch (...) {}
+            }
+        }
+        return devs;
+    }
+    
+    USBFSDevice(const std::filesystem::path& path) {
+        const int fdi = open(path.c_str(), O_RDWR|O_CLOEXEC);
+        if (fdi < 0) throw Toastbox::RuntimeError("open failed: %s", strerror(errno));
+        _fd = Toastbox::FileDescriptor(fdi);
+        
+        // Reading the device node returns the device descriptor, followed by the configuration
+        // descriptors
+        uint8_t buf[4096];
+        const ssize_t sr = ::read(_fd, buf, sizeof(buf));
+        if (sr < (ssize_t)sizeof(_desc)) throw Toastbox::RuntimeError("failed to read descriptors: %s", strerror(errno));
+        memcpy(&_desc, buf, sizeof(_desc));
+        
+        // Collect the endpoints of interface 0 (alternate setting 0) from the first configuration
+        bool iface = false;
+        for (size_t off=sizeof(_desc); off+2<=(size_t)sr && buf[off];) {
+            const uint8_t len = buf[off];
+            const uint8_t type = buf[off+1];
+            if (off+len > (size_t)sr) break;
+            
+            if (type == USB_DT_CONFIG && off!=sizeof(_desc)) break;
+            
+            if (type==USB_DT_INTERFACE && len>=USB_DT_INTERFACE_SIZE) {
+                usb_interface_descriptor d;
+                memcpy(&d, buf+off, sizeof(d));
+                iface = (d.bInterfaceNumber==Interface && d.bAlternateSetting==0);
+                
+            } else if (type==USB_DT_ENDPOINT && len>=USB_DT_ENDPOINT_SIZE && iface) {
+                usb_endpoint_descriptor d;
+                memcpy(&d, buf+off, USB_DT_ENDPOINT_SIZE);
+                _endpoints.push_back({ .addr = d.bEndpointAddress, .maxPacketSize = le16toh(d.wMaxPacketSize) });
+            }
+            
+            off += len;
+        }
+    }
+    
+    // Copy
+    USBFSDevice(const USBFSDevice& x) = delete;
+    USBFSDevice& operator=(const USBFSDevice& x) = delete;
+    
+    std::string manufacturer() const { return _stringDescriptor(_desc.iManufacturer); }
+    std::string product() const { return _stringDescriptor(_desc.iProduct); }
+    std::string serialNumber() const { return _stringDescriptor(_desc.iSerialNumber); }
+    
+    std::vector<uint8_t> endpoints() const {
+        std::vector<uint8_t> r;
+        for (const _Endpoint& ep : _endpoints) r.push_back(ep.addr);
+        return r;
+    }
+    
+    size_t maxPacketSize(uint8_t ep) const {
+        for (const _Endpoint& x : _endpoints) {
+            if (x.addr == ep) return x.maxPacketSize;
+        }
+        throw Toastbox::RuntimeError("invalid endpoint: 0x%02x", ep);
+    }
+    
+    template<typename T>
+    void vendorRequestOut(uint8_t req, const T& x) {
+        _claim();
+        usbdevfs_ctrltransfer xfer = {
+            .bRequestType = USB_DIR_OUT | USB_TYPE_VENDOR | USB_RECIP_INTERFACE,
+            .bRequest = req,
+            .wValue = 0,
+            .wIndex = Interface,
+            .wLength = (uint16_t)sizeof(x),
+            .timeout = 0,
+            .data = (void*)&x,
+        };
+        _ioctl(USBDEVFS_CONTROL, &xfer, "USBDEVFS_CONTROL");
+    }
+    
+    template<typename T>
+    void read(uint8_t ep, T& x) {
+        const size_t len = read(ep, &x, sizeof(x));
+        if (len != sizeof(x)) {
+            throw Toastbox::RuntimeError("read returned invalid length (expected: %ju, got: %ju)",
+                (uintmax_t)sizeof(x), (uintmax_t)len);
+        }
+    }
+    
+    size_t read(uint8_t ep, void* dst, size_t len) {
+        _claim();
+        USBFSBulkIn<ReadInFlight> in(_fd, ep);
+        USBBulkReader<USBFSBulkIn<ReadInFlight>,ReadInFlight> reader(in, ReadTransferLen);
+        return reader.read(dst, len);
+    }
+    
+    void write(uint8_t ep, const void* src, size_t len) {
+        _claim();
+        if (len > UINT_MAX) throw Toastbox::RuntimeError("transfer too large: %ju", (uintmax_t)len);
+        usbdevfs_bulktransfer xfer = {
+            .ep = ep,
+            .len = (unsigned int)len,
+            .timeout = 0,
+            .data = (void*)src,
+        };
+        const int ir = _ioctl(USBDEVFS_BULK, &xfer, "USBDEVFS_BULK");
+        if ((size_t)ir != len) {
+            throw Toastbox::RuntimeError("write returned invalid length (expected: %ju, got: %ju)",
+                (uintmax_t)len, (uintmax_t)ir);
+        }
+    }
+    
+    struct _Endpoint {
+        uint8_t addr = 0;
+        uint16_t maxPacketSize = 0;
+    };
+    
+    int _ioctl(unsigned long req, void* arg, const char* name) const {
+        for (;;) {
+            const int ir = ioctl(_fd, req, arg);
+            if (ir >= 0) return ir;
+            if (errno == EINTR) continue;
+            throw Toastbox::RuntimeError("%s failed: %s", name, strerror(errno));
+        }
+    }
+    
+    void _claim() {
+        if (_claimed) return;
+        unsigned int iface = Interface;
+        _ioctl(USBDEVFS_CLAIMINTERFACE, &iface, "USBDEVFS_CLAIMINTERFACE");
+        _claimed = true;
+    }
+    
+    // _stringDescriptor(): returns the string descriptor `idx` (in US English), converted to ASCII
+    std::string _stringDescriptor(uint8_t idx) const {
+        if (!idx) return {};
+        uint8_t buf[255] = {};
+        usbdevfs_ctrltransfer xfer = {
+            .bRequestType = USB_DIR_IN | USB_TYPE_STANDARD | USB_RECIP_DEVICE,
+            .bRequest = USB_REQ_GET_DESCRIPTOR,
+            .wValue = (uint16_t)((USB_DT_STRING << 8) | idx),
+            .wIndex = 0x0409,
+            .wLength = sizeof(buf),
+            .timeout = 1000,
+            .data = buf,
+        };
+        const int len = _ioctl(USBDEVFS_CONTROL, &xfer, "USBDEVFS_CONTROL");
+        if (len<2 || buf[1]!=USB_DT_STRING) throw Toastbox::RuntimeError("invalid string descriptor");
+        
+        // The string is UTF-16LE; keep the low byte of each code unit
+        std::string r;
+        for (int i=2; i+1<std::min(len, (int)buf[0]); i+=2) r.push_back((char)buf[i]);
+        return r;
+    }
+    
+    Toastbox::FileDescriptor _fd;
+    usb_device_descriptor _desc = {};
+    std::vector<_Endpoint> _endpoints;
+    bool _claimed = false;
+};
+
+#endif // __linux__
@@ -0,0 +1,549 @@
+#pragma once
+#include <deque>
+#include <optional>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Code/Lib/Toastbox/RuntimeError.h"
+#include "Code/Lib/Toastbox/FileDescriptor.h"
+#include "Code/Lib/Toastbox/USB.h"
+#include "Code/Shared/STM.h"
+#include "Code/Shared/MSP.h"
+#include "Code/Shared/Img.h"
+#include "Code/Shared/SD.h"
+#include "Code/Shared/ImgSD.h"
+#include "Code/Shared/ChecksumFletcher32.h"
+
+// VirtualPhoton: in-process emulator of a Photon, at the level of its USB interface
+//
+// VirtualPhoton implements the subset of Toastbox::USBDevice's interface that MDCUSBDevice uses,
+// and responds to STM::Cmds the way STMApp does, so that MDCUSBDeviceT<VirtualPhoton> exercises
+// the same protocol (and the same host code) as a real device, without hardware.
+//
+// The SD card is backed by a sparse file (the "SD image"), laid out the way MSPApp lays out a real
+// card (see MSP::SDState / MSP::SDBlockStart()). The emulated MSP's state is stored in a trailer
+// after the card's last block. Images are written as a header + checksum with zero pixels, so that
+// the SD image stays sparse, which allows libraries of 100k+ images.
+//
+// DataIn bandwidth and command/SD latencies are configurable, so that host throughput can be
+// measured against a realistic device.
+class VirtualPhoton {
+public:
+    struct Config {
+        std::filesystem::path sdImage;
+        std::string serial = "VirtualPhoton";
+        // bandwidth: DataIn throughput in bytes/sec; 0 == unlimited
+        double bandwidth = 40e6;
+        // cmdLatency: time to complete a control request
+        std::chrono::microseconds cmdLatency = std::chrono::microseconds(500);
+        // sdReadLatency: time from SDRead until the first block is available
+        std::chrono::microseconds sdReadLatency = std::chrono::microseconds(2000);
+    };
+    
+    struct Stats {
+        uint64_t cmds = 0;
+        uint64_t resets = 0;
+        uint64_t sdReads = 0;
+        uint64_t readLen = 0; // Bytes transferred on DataIn
+    };
+    
+    // SDImageCreate(): creates an empty SD image that can hold at least `imgCap` images
+    // The SD state is initialized the same way that MSPApp initializes it for a new card.
+    static void SDImageCreate(const std::filesystem::path& path, uint32_t imgCap, const SD::CardId& cardId) {
+        constexpr uint32_t CombinedBlockCount = ImgSD::Thumb::ImageBlockCount + ImgSD::Full::ImageBlockCount;
+        if (!imgCap) throw Toastbox::RuntimeError("invalid image capacity: %ju", (uintmax_t)imgCap);
+        
+        // Calculate the card's C_SIZE field, which determines the card's capacity:
+        //   BlockCapacity = (C_SIZE+1)*1024
+        // The largest C_SIZE is limited by SD::BlockCapacity() returning a uint32_t.
+        const uint64_t blockCapMin = (uint64_t)imgCap * CombinedBlockCount;
+        const uint64_t cSize = (blockCapMin+1023)/1024 - 1;
+        if (cSize >= ((uint64_t)1<<22)-1) {
+            throw Toastbox::RuntimeError("image capacity too large: %ju", (uintmax_t)imgCap);
+        }
+        
+        _Trailer trailer = {
+            .magic = _TrailerMagic,
+            .version = _TrailerVersion,
+            .cardId = cardId,
+        };
+        SetBits<69,48>(trailer.cardData, cSize);
+        
+        const uint32_t blockCap = SD::BlockCapacity(trailer.cardData);
+        
+        // Initialize the MSP state, like MSPApp's _SDStateInit()
+        MSP::State& msp = trailer.msp;
+        msp.header = MSP::StateHeader;
+        MSP::SDStateInit(msp.sd, cardId, trailer.cardData);
+        
+        const int fdi = open(path.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+        if (fdi < 0) throw Toastbox::RuntimeError("failed to create SD image: %s", strerror(errno));
+        Toastbox::FileDescriptor fd(fdi);
+        
+        const off_t len = (off_t)blockCap*SD::BlockLen + sizeof(trailer);
+        const int ir = ftruncate(fd, len);
+        if (ir) throw Toastbox::RuntimeError("ftruncate failed: %s", strerror(errno));
+        _Write(fd, len-sizeof(trailer), &trailer, sizeof(trailer));
+    }
+    
+    VirtualPhoton(const Config& cfg) : _cfg(cfg) {
+        const int fdi = open(_cfg.sdImage.c_str(), O_RDWR|O_CLOEXEC);
+        if (fdi < 0) throw Toastbox::RuntimeError("failed to open SD image: %s", strerror(errno));
+        _sd.fd = Toastbox::FileDescriptor(fdi);
+        
+        const off_t len = lseek(_sd.fd, 0, SEEK_END);
+        if (len < (off_t)sizeof(_Trailer)) throw Toastbox::RuntimeError("invalid SD image (too small)");
+        _sd.trailerOff = len-sizeof(_Trailer);
+        _Read(_sd.fd, _sd.trailerOff, &_sd.trailer, sizeof(_sd.trailer));
+        
+        if (_sd.trailer.magic != _TrailerMagic) {
+            throw Toastbox::RuntimeError("invalid SD image magic number (expected:0x%08jx got:0x%08jx)",
+                (uintmax_t)_TrailerMagic, (uintmax_t)_sd.trailer.magic);
+        }
+        
+        if (_sd.trailer.version != _TrailerVersion) {
+            throw Toastbox::RuntimeError("invalid SD image version (expected:%ju got:%ju)",
+                (uintmax_t)_TrailerVersion, (uintmax_t)_sd.trailer.version);
+        }
+        
+        _sd.blockCap = SD::BlockCapacity(_sd.trailer.cardData);
+        if (_sd.trailerOff != (off_t)_sd.blockCap*SD::BlockLen) {
+            throw Toastbox::RuntimeError("invalid SD image (length doesn't match card capacity)");
+        }
+    }
+    
+    // MARK: - Device Side
+    
+    // imagesCapture(): adds `count` images to the SD card, like MSPApp does when it captures images
+    void imagesCapture(uint32_t count) {
+        MSP::SDState& sd = _sd.trailer.msp.sd;
+        for (uint32_t i=0; i<count; i++) {
+            const MSP::ImgRingBuf& ringBuf = sd.imgRingBufs[0];
+            const Img::Id id = ringBuf.buf.id;
+            const uint32_t idx = ringBuf.buf.idx;
+            _imageWrite(MSP::SDBlockStart(sd.baseFull, ImgSD::Full::ImageBlockCount, idx), Img::Size::Full, id);
+            _imageWrite(MSP::SDBlockStart(sd.baseThumb, ImgSD::Thumb::ImageBlockCount, idx), Img::Size::Thumb, id);
+            MSP::ImgRingBufIncrement(sd);
+        }
+        _mspStateWrite();
+    }
+    
+    const MSP::State& mspState() const { return _sd.trailer.msp; }
+    const Stats& stats() const { return _stats; }
+    
+    // MARK: - USBDevice Interface
+    
+    std::string manufacturer() const { return "Toaster LLC"; }
+    std::string product() const { return "Photon"; }
+    std::string serialNumber() const { return _cfg.serial; }
+    
+    std::vector<uint8_t> endpoints() const {
+        return { STM::Endpoint::DataOut, STM::Endpoint::DataIn };
+    }
+    
+    size_t maxPacketSize(uint8_t ep) const {
+        return Toastbox::USB::Endpoint::MaxPacketSizeBulk;
+    }
+    
+    template<typename T>
+    void vendorRequestOut(uint8_t req, const T& x) {
+        static_assert(sizeof(T) == sizeof(STM::Cmd));
+        _cmd((const STM::Cmd&)x);
+    }
+    
+    template<typename T>
+    void read(uint8_t ep, T& x) {
+        const size_t len = read(ep, &x, sizeof(x));
+        if (len != sizeof(x)) {
+            throw Toastbox::RuntimeError("read returned invalid length (expected: %ju, got: %ju)",
+                (uintmax_t)sizeof(x), (uintmax_t)len);
+        }
+    }
+    
+    size_t read(uint8_t ep, void* dst, size_t len) {
+        if (ep != STM::Endpoint::DataIn) throw Toastbox::RuntimeError("invalid endpoint: 0x%02x", ep);
+        
+        size_t r = 0;
+        // Messages (status, structs, captured images) are sent before a readout stream
+        if (!_in.empty()) {
+            _Message& msg = _in.front();
+            r = std::min(len, msg.data.size()-msg.off);
+            if (r) memcpy(dst, msg.data.data()+msg.off, r);
+            msg.off += r;
+            if (msg.off == msg.data.size()) _in.pop_front();
+        
+        // SD readout: continues indefinitely, until the next Reset
+        } else if (_readout) {
+            const uint64_t off = (uint64_t)_readout->block*SD::BlockLen + _readout->off;
+            if (off+len > (uint64_t)_sd.blockCap*SD::BlockLen) {
+                throw Toastbox::RuntimeError("readout beyond the end of the SD card");
+            }
+            _Read(_sd.fd, (off_t)off, dst, len);
+            _readout->off += len;
+            r = len;
+        
+        } else {
+            // A real device wouldn't respond, and the transfer would time out
+            throw Toastbox::RuntimeError("DataIn timeout");
+        }
+        
+        _throttle(r);
+        _stats.readLen += r;
+        return r;
+    }
+    
+    void write(uint8_t ep, const void* src, size_t len) {
+        if (ep != STM::Endpoint::DataOut) throw Toastbox::RuntimeError("invalid endpoint: 0x%02x", ep);
+        
+        // After a Reset, the host flushes DataOut with 2 ZLPs + a 1-byte sentinel
+        if (_outFlush) {
+            if (len == 1) _outFlush = false;
+            return;
+        }
+        
+        if (len > _out.len-_out.data.size()) {
+            throw Toastbox::RuntimeError("unexpected DataOut data (len: %ju, expected: %ju)",
+                (uintmax_t)len, (uintmax_t)(_out.len-_out.data.size()));
+        }
+        
+        const uint8_t* s = (const uint8_t*)src;
+        _out.data.insert(_out.data.end(), s, s+len);
+        if (_out.data.size() == _out.len) {
+            const std::vector<uint8_t> data = std::move(_out.data);
+            const STM::Op op = _out.op;
+            _out = {};
+            _outComplete(op, data);
+        }
+    }
+    
+    // MARK: - Private
+    
+    static constexpr uint32_t _TrailerMagic = 0x5D1A6E00;
+    static constexpr uint32_t _TrailerVersion = 0;
+    
+    struct [[gnu::packed]] _Trailer {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        SD::CardId cardId;
+        SD::CardData cardData;
+        MSP::State msp = {};
+    };
+    
+    struct _Message {
+        std::vector<uint8_t> data;
+        size_t off = 0;
+    };
+    
+    struct _Readout {
+        SD::Block block = 0;
+        uint64_t off = 0;
+    };
+    
+    static void _Read(int fd, off_t off, void* dst, size_t len) {
+        uint8_t* d = (uint8_t*)dst;
+        while (len) {
+            const ssize_t sr = pread(fd, d, len, off);
+            if (sr < 0) {
+                if (errno == EINTR) continue;
+                throw Toastbox::RuntimeError("pread failed: %s", strerror(errno));
+            }
+            if (!sr) throw Toastbox::RuntimeError("pread: unexpected end of file");
+            d += sr;
+            off += sr;
+            len -= sr;
+        }
+    }
+    
+    static void _Write(int fd, off_t off, const void* src, size_t len) {
+        const uint8_t* s = (const uint8_t*)src;
+        while (len) {
+            const ssize_t sr = pwrite(fd, s, len, off);
+            if (sr < 0) {
+                if (errno == EINTR) continue;
+                throw Toastbox::RuntimeError("pwrite failed: %s", strerror(errno));
+            }
+            s += sr;
+            off += sr;
+            len -= sr;
+        }
+    }
+    
+    static Img::Header _ImageHeader(Img::Size size, Img::Id id) {
+        // Timestamps are relative (ie not Time::Absolute()), 1 image per minute
+        constexpr Time::Instant ImageInterval = 60 * Time::TicksFreq::num;
+        const bool full = (size == Img::Size::Full);
+        return Img::Header{
+            .magic = Img::Header::MagicNumber,
+            .version = Img::Header::Version,
+            .imageWidth = (uint16_t)(full ? Img::Full::PixelWidth : Img::Thumb::PixelWidth),
+            .imageHeight = (uint16_t)(full ? Img::Full::PixelHeight : Img::Thumb::PixelHeight),
+            .coarseIntTime = 0x1111,
+            .analogGain = 0x0011,
+            .id = id,
+            .timestamp = id * ImageInterval,
+            .batteryLevelMv = 4000,
+        };
+    }
+    
+    // _imageWrite(): writes an image with zero pixels to the SD card
+    // Only the header and checksum are written, so that the image's pixels remain a hole in the
+    // SD image file.
+    void _imageWrite(SD::Block block, Img::Size size, Img::Id id) {
+        const bool full = (size == Img::Size::Full);
+        const uint32_t checksumOffset = (full ? Img::Full::ChecksumOffset : Img::Thumb::ChecksumOffset);
+        const Img::Header header = _ImageHeader(size, id);
+        
+        ChecksumFletcher32Engine checksum;
+        checksum.update(&header, sizeof(header));
+        checksum.updateZeros(checksumOffset-sizeof(header));
+        const uint32_t c = checksum.checksum();
+        
+        const off_t off = (off_t)block*SD::BlockLen;
+        _Write(_sd.fd, off, &header, sizeof(header));
+        _Write(_sd.fd, off+checksumOffset, &c, sizeof(c));
+    }
+    
+    // _sdErase(): erases blocks [first, last]; erased blocks read as zeros
+    void _sdErase(SD::Block first, SD::Block last) {
+        if (first>last || last>=_sd.blockCap) {
+            throw Toastbox::RuntimeError("invalid SD erase range [%ju, %ju]", (uintmax_t)first, (uintmax_t)last);
+        }
+        
+        constexpr size_t ChunkLen = 1024*1024;
+        static const std::vector<uint8_t> Zeros(ChunkLen);
+        off_t off = (off_t)first*SD::BlockLen;
+        off_t rem = ((off_t)last-first+1)*SD::BlockLen;
+        while (rem) {
+            const size_t len = (size_t)std::min((off_t)ChunkLen, rem);
+            _Write(_sd.fd, off, Zeros.data(), len);
+            off += len;
+            rem -= len;
+        }
+    }
+    
+    void _mspStateWrite() {
+        _Write(_sd.fd, _sd.trailerOff, &_sd.trailer, sizeof(_sd.trailer));
+    }
+    
+    // _throttle(): delays until `len` bytes could have been transferred at the configured bandwidth
+    void _throttle(size_t len) {
+        if (_cfg.bandwidth <= 0) return;
+        using namespace std::chrono;
+        const auto now = steady_clock::now();
+        _busTime = std::max(_busTime, now) + duration_cast<steady_clock::duration>(duration<double>(len/_cfg.bandwidth));
+        std::this_thread::sleep_until(_busTime);
+    }
+    
+    template<typename T>
+    void _send(const T& x) {
+        const uint8_t* b = (const uint8_t*)&x;
+        _in.push_back({ .data = std::vector<uint8_t>(b, b+sizeof(x)) });
+    }
+    
+    void _sendStatus(bool s) { _send(s); }
+    
+    void _expectOut(STM::Op op, size_t len) {
+        _out = { .op = op, .len = len };
+        // Zero-length data completes immediately
+        if (!len) {
+            _out = {};
+            _outComplete(op, {});
+        }
+    }
+    
+    void _outComplete(STM::Op op, const std::vector<uint8_t>& data) {
+        switch (op) {
+        case STM::Op::MSPStateWrite:
+            memcpy(&_sd.trailer.msp, data.data(), std::min(data.size(), sizeof(_sd.trailer.msp)));
+            _mspStateWrite();
+            break;
+        default:
+            // ICERAMWrite / ICEFlashWrite: accept the data
+            break;
+        }
+        _sendStatus(true);
+    }
+    
+    void _cmd(const STM::Cmd& cmd) {
+        using namespace STM;
+        std::this_thread::sleep_for(_cfg.cmdLatency);
+        _stats.cmds++;
+        
+        // Reset doesn't send the 'command accepted' status; it resets the endpoints
+        if (cmd.op == Op::Reset) {
+            _stats.resets++;
+            _in.clear();
+            _out = {};
+            _readout = std::nullopt;
+            _outFlush = true;
+            // DataIn: ZLP, sentinel, status
+            _in.push_back({});
+            _send((uint8_t)0);
+            _sendStatus(true);
+            return;
+        }
+        
+        // Commands are only accepted when the previous command has completed
+        if (!_in.empty() || _out.len) {
+            throw Toastbox::RuntimeError("control request rejected: previous command still in progress");
+        }
+        
+        switch (cmd.op) {
+        case Op::StatusGet:
+            _sendStatus(true);
+            _send(Status{
+                .header = StatusHeader,
+                .mspVersion = MSP::StateHeader.version,
+                .mode = Status::Mode::STMApp,
+            });
+            break;
+        
+        case Op::BatteryStatusGet:
+            _sendStatus(true);
+            _send(BatteryStatus{
+                .chargeStatus = MSP::ChargeStatus::Complete,
+                .level = 4000,
+            });
+            break;
+        
+        case Op::LEDSet:
+        case Op::BootloaderInvoke:
+            _sendStatus(true);
+            break;
+        
+        case Op::HostModeSet:
+        case Op::MSPTimeInit:
+        case Op::MSPTimeAdjust:
+        case Op::MSPLock:
+        case Op::MSPUnlock:
+        case Op::ImgInit:
+        case Op::ImgExposureSet:
+            _sendStatus(true);
+            _sendStatus(true);
+            break;
+        
+        case Op::ICERAMWrite:
+            _sendStatus(true);
+            _expectOut(cmd.op, cmd.arg.ICERAMWrite.len);
+            break;
+        
+        case Op::ICEFlashWrite:
+            _sendStatus(true);
+            _expectOut(cmd.op, cmd.arg.ICEFlashWrite.len);
+            break;
+        
+        case Op::ICEFlashRead:
+            _sendStatus(true);
+            _in.push_back({ .data = std::vector<uint8_t>(cmd.arg.ICEFlashRead.len) });
+            _sendStatus(true);
+            break;
+        
+        case Op::MSPStateRead: {
+            const size_t len = std::min((size_t)cmd.arg.MSPStateRead.len, sizeof(_sd.trailer.msp));
+            const uint8_t* b = (const uint8_t*)&_sd.trailer.msp;
+            _sendStatus(true);
+            _in.push_back({ .data = std::vector<uint8_t>(b, b+len) });
+            _sendStatus(true);
+            break;
+        }
+        
+        case Op::MSPStateWrite:
+            _sendStatus(true);
+            _expectOut(cmd.op, cmd.arg.MSPStateWrite.len);
+            break;
+        
+        case Op::MSPTimeGet:
+            _sendStatus(true);
+            _sendStatus(true);
+            _send(MSP::TimeState{});
+            break;
+        
+        case Op::SDInit:
+            _sendStatus(true);
+            _sendStatus(true);
+            _send(SDCardInfo{
+                .cardId = _sd.trailer.cardId,
+                .cardData = _sd.trailer.cardData,
+            });
+            _sdInit = true;
+            break;
+        
+        case Op::SDRead:
+            _sendStatus(true);
+            _sendStatus(_sdInit && cmd.arg.SDRead.block<_sd.blockCap);
+            if (_sdInit && cmd.arg.SDRead.block<_sd.blockCap) {
+                _readout = _Readout{ .block = cmd.arg.SDRead.block };
+                _stats.sdReads++;
+                _busTime = std::max(_busTime, std::chrono::steady_clock::now()) + _cfg.sdReadLatency;
+            }
+            break;
+        
+        case Op::SDErase:
+            _sendStatus(true);
+            _sdErase(cmd.arg.SDErase.first, cmd.arg.SDErase.last);
+            _sendStatus(true);
+            break;
+        
+        case Op::ImgCapture: {
+            // Capture a full-size or thumbnail image into RAM; the readout that follows streams it
+            const Img::Size size = cmd.arg.ImgCapture.size;
+            const bool full = (size == Img::Size::Full);
+            const size_t imageLen = (full ? Img::Full::ImageLen : Img::Thumb::ImageLen);
+            const size_t paddedLen = (full ? ImgSD::Full::ImagePaddedLen : ImgSD::Thumb::ImagePaddedLen);
+            const size_t checksumOffset = (full ? Img::Full::ChecksumOffset : Img::Thumb::ChecksumOffset);
+            
+            _Message img = { .data = std::vector<uint8_t>(paddedLen) };
+            const Img::Header header = _ImageHeader(size, _captureId++);
+            memcpy(img.data.data(), &header, sizeof(header));
+            // Fill the pixels with a gradient
+            Img::Pixel* pixels = (Img::Pixel*)(img.data.data()+Img::PixelsOffset);
+            const size_t pixelCount = (full ? Img::Full::PixelCount : Img::Thumb::PixelCount);
+            for (size_t i=0; i<pixelCount; i++) {
+                pixels[i] = (Img::Pixel)(i % (Img::PixelMax+1));
+            }
+            const uint32_t checksum = ChecksumFletcher32(img.data.data(), checksumOffset);
+            memcpy(img.data.data()+checksumOffset, &checksum, sizeof(checksum));
+            
+            _sendStatus(true);
+            _send(ImgCaptureStats{ .len = (uint32_t)imageLen });
+            _sendStatus(true);
+            _in.push_back(std::move(img));
+            break;
+        }
+        
+        default:
+            // Commands that we don't emulate (STMLoader, flash writes, SBW) are rejected
+            _sendStatus(false);
+            break;
+        }
+    }
+    
+    const Config _cfg;
+    
+    struct {
+        Toastbox::FileDescriptor fd;
+        off_t trailerOff = 0;
+        uint32_t blockCap = 0;
+        _Trailer trailer;
+    } _sd;
+    
+    std::deque<_Message> _in;
+    struct {
+        STM::Op op = STM::Op::None;
+        size_t len = 0;
+        std::vector<uint8_t> data;
+    } _out;
+    bool _outFlush = false;
+    std::optional<_Readout> _readout;
+    bool _sdInit = false;
+    Img::Id _captureId = 0;
+    std::chrono::steady_clock::time_point _busTime;
+    Stats _stats;
+};
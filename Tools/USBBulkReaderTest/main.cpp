@@ -0,0 +1,269 @@
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include "USBBulkReader.h"
+
+// USBBulkReaderTest: loopback test of USBBulkReader against a mock bulk-IN endpoint
+//
+// MockEndpoint models a device streaming into the transfers that the host has queued: the bus
+// moves data at BusRate while a transfer is queued, and the host learns that a transfer completed
+// only after CompletionLatency (the controller's interrupt + the kernel's completion path). With
+// one transfer in flight the bus idles for that latency after every transfer; with several in
+// flight, the device continues into the next queued transfer immediately.
+
+using namespace std::chrono;
+using _Clock = steady_clock;
+
+static constexpr size_t TransferLen = 512*1024;
+static constexpr size_t ThroughputTransferLen = 64*1024;
+static constexpr double BusRate = 40e6; // Bytes/sec, roughly USB HS bulk throughput
+static constexpr auto CompletionLatency = microseconds(2000);
+
+static uint8_t _PatternByte(size_t off) {
+    return (uint8_t)(off ^ (off >> 8) ^ (off >> 16));
+}
+
+struct MockEndpoint {
+    struct Config {
+        size_t streamLen = SIZE_MAX;   // Device sends a short transfer after this many bytes
+        size_t errorOffset = SIZE_MAX; // Device stalls when it reaches this offset
+        bool bus = true;               // Simulate bus time + completion latency
+    };
+
+    MockEndpoint(const Config& cfg) : _cfg(cfg), _thread([&] { _device(); }) {}
+
+    ~MockEndpoint() {
+        {
+            auto lock = std::unique_lock(_lock);
+            _stop = true;
+        }
+        _signal.notify_all();
+        _thread.join();
+    }
+
+    void submit(size_t id, void* buf, size_t len, bool continuation) {
+        {
+            auto lock = std::unique_lock(_lock);
+            _submitted.push_back({ .id=id, .buf=(uint8_t*)buf, .len=len });
+            _inFlight++;
+            _inFlightMax = std::max(_inFlightMax, _inFlight);
+        }
+        _signal.notify_all();
+    }
+
+    USBBulkReaderCompletion reap() {
+        auto lock = std::unique_lock(_lock);
+        for (;;) {
+            if (!_completed.empty()) {
+                const _Completion& c = _completed.front();
+                if (_Clock::now() >= c.ready) break;
+                _signal.wait_until(lock, c.ready);
+            } else {
+                _signal.wait(lock);
+            }
+        }
+        const USBBulkReaderCompletion c = _completed.front().c;
+        _completed.pop_front();
+        _inFlight--;
+        return c;
+    }
+
+    void cancel(size_t id) {
+        {
+            auto lock = std::unique_lock(_lock);
+            _cancelled.push_back(id);
+        }
+        _signal.notify_all();
+    }
+
+    size_t inFlightMax() {
+        auto lock = std::unique_lock(_lock);
+        return _inFlightMax;
+    }
+
+    struct _Transfer {
+        size_t id = 0;
+        uint8_t* buf = nullptr;
+        size_t len = 0;
+    };
+
+    struct _Completion {
+        USBBulkReaderCompletion c;
+        _Clock::time_point ready;
+    };
+
+    bool _isCancelled(size_t id) {
+        return std::find(_cancelled.begin(), _cancelled.end(), id) != _cancelled.end();
+    }
+
+    void _complete(const _Transfer& t, size_t len, int err) {
+        const auto ready = _Clock::now() + (_cfg.bus ? CompletionLatency : microseconds(0));
+        _completed.push_back({ .c={ .id=t.id, .len=len, .err=err }, .ready=ready });
+        std::erase(_cancelled, t.id);
+        _signal.notify_all();
+    }
+
+    // _device(): completes transfers in submission order, like a host controller's queue
+    void _device() {
+        auto lock = std::unique_lock(_lock);
+        for (;;) {
+            _signal.wait(lock, [&] {
+                if (_stop) return true;
+                if (_submitted.empty()) return false;
+                // Once the stream has ended, transfers only complete when they're cancelled
+                return !_ended || _isCancelled(_submitted.front().id);
+            });
+            if (_stop) return;
+
+            const _Transfer t = _submitted.front();
+            _submitted.pop_front();
+
+            if (_isCancelled(t.id)) {
+                _complete(t, 0, ECONNRESET);
+                continue;
+            }
+
+            size_t len = std::min(t.len, _cfg.streamLen-_off);
+            const bool error = (_off+len > _cfg.errorOffset);
+            if (error) len = _cfg.errorOffset-_off;
+
+            for (size_t i=0; i<len; i++) {
+                t.buf[i] = _PatternByte(_off+i);
+            }
+            _off += len;
+
+            // Simulate the bus time (without holding the lock so the host can submit/cancel)
+            if (_cfg.bus) {
+                const auto dur = duration<double>(len / BusRate);
+                lock.unlock();
+                std::this_thread::sleep_for(dur);
+                lock.lock();
+            }
+
+            if (error) {
+                _complete(t, len, EPIPE);
+            } else {
+                if (len < t.len) _ended = true;
+                _complete(t, len, 0);
+            }
+        }
+    }
+
+    const Config _cfg;
+    std::mutex _lock;
+    std::condition_variable _signal;
+    std::deque<_Transfer> _submitted;
+    std::deque<_Completion> _completed;
+    std::vector<size_t> _cancelled;
+    size_t _off = 0;
+    size_t _inFlight = 0;
+    size_t _inFlightMax = 0;
+    bool _ended = false;
+    bool _stop = false;
+    std::thread _thread;
+};
+
+static void _Require(bool x, const char* msg) {
+    if (!x) {
+        fprintf(stderr, "FAILED: %s\n", msg);
+        exit(1);
+    }
+}
+
+static void _CheckPattern(const std::vector<uint8_t>& buf, size_t off, size_t len) {
+    for (size_t i=0; i<len; i++) {
+        if (buf[i] != _PatternByte(off+i)) {
+            fprintf(stderr, "FAILED: data mismatch at offset %zu\n", off+i);
+            exit(1);
+        }
+    }
+}
+
+template<size_t T_InFlight>
+static void _TestReads() {
+    MockEndpoint ep({ .bus=false });
+    USBBulkReader<MockEndpoint,T_InFlight> reader(ep, TransferLen);
+
+    // Multiple reads of various lengths must continue the stream seamlessly
+    size_t off = 0;
+    for (size_t len : { (size_t)1, TransferLen, TransferLen*3+17, (size_t)4096, TransferLen*T_InFlight*2 }) {
+        std::vector<uint8_t> buf(len);
+        const size_t r = reader.read(buf.data(), len);
+        _Require(r == len, "read length");
+        _CheckPattern(buf, off, len);
+        off += len;
+    }
+    _Require(ep.inFlightMax() == T_InFlight, "in-flight transfer count");
+}
+
+template<size_t T_InFlight>
+static void _TestShort() {
+    // The stream ends partway through a transfer, with more transfers queued behind it
+    const size_t streamLen = TransferLen*5 + 1234;
+    MockEndpoint ep({ .streamLen=streamLen, .bus=false });
+    USBBulkReader<MockEndpoint,T_InFlight> reader(ep, TransferLen);
+    std::vector<uint8_t> buf(TransferLen*16);
+    const size_t r = reader.read(buf.data(), buf.size());
+    _Require(r == streamLen, "short read length");
+    _CheckPattern(buf, 0, r);
+}
+
+template<size_t T_InFlight>
+static void _TestError() {
+    // The device stalls; read() must throw, with every transfer reaped (so none reference `buf`)
+    MockEndpoint ep({ .errorOffset=TransferLen*2+100, .bus=false });
+    USBBulkReader<MockEndpoint,T_InFlight> reader(ep, TransferLen);
+    std::vector<uint8_t> buf(TransferLen*16);
+    bool threw = false;
+    try {
+        reader.read(buf.data(), buf.size());
+    } catch (const std::exception&) {
+        threw = true;
+    }
+    _Require(threw, "error not reported");
+    _Require(reader._inFlight.empty(), "transfers still in flight after error");
+}
+
+template<size_t T_InFlight>
+static double _Throughput() {
+    constexpr size_t Len = 32*1024*1024;
+    MockEndpoint ep({});
+    USBBulkReader<MockEndpoint,T_InFlight> reader(ep, ThroughputTransferLen);
+    std::vector<uint8_t> buf(Len);
+    const auto start = _Clock::now();
+    const size_t r = reader.read(buf.data(), buf.size());
+    const double sec = duration<double>(_Clock::now()-start).count();
+    _Require(r == Len, "throughput read length");
+    _CheckPattern(buf, 0, r);
+    return (double)Len / sec;
+}
+
+template<size_t T_InFlight>
+static void _Test() {
+    _TestReads<T_InFlight>();
+    _TestShort<T_InFlight>();
+    _TestError<T_InFlight>();
+    printf("[InFlight=%zu] reads, short transfer, error: OK\n", T_InFlight);
+}
+
+int main(int argc, const char* argv[]) {
+    _Test<1>();
+    _Test<2>();
+    _Test<4>();
+    _Test<8>();
+
+    const double rate1 = _Throughput<1>();
+    const double rate4 = _Throughput<4>();
+    printf("Throughput (bus: %.1f MB/s, completion latency: %ju us, transfer: %zu KiB):\n",
+        BusRate/1e6, (uintmax_t)CompletionLatency.count(), ThroughputTransferLen/1024);
+    printf("  InFlight=1: %.1f MB/s\n", rate1/1e6);
+    printf("  InFlight=4: %.1f MB/s\n", rate4/1e6);
+    _Require(rate4 > rate1, "multiple in-flight transfers should be faster");
+    return 0;
+}
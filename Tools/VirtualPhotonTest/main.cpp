@@ -0,0 +1,233 @@
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include "MDCUSBDevice.h"
+#include "VirtualPhoton.h"
+
+// VirtualPhotonTest: syncs a VirtualPhoton's images via MDCUSBDevice, and measures throughput
+//
+// The sync follows the same device protocol as MDCDeviceReal::_sync_thread(): determine the
+// device's image range from MSP's state, then read every thumbnail in SD block order, continuing
+// the SD readout across contiguous thumbnails and resetting the device when the address jumps.
+// Every thumbnail is validated (checksum, magic number, id), and a few other commands (full-size
+// reads, SDErase, ImgCapture) are checked along the way.
+//
+// Usage:
+//   VirtualPhotonTest <SDImagePath> [ImageCount] [Bandwidth (MB/s), 0=unlimited]
+
+using namespace std::chrono;
+using _MDCUSBDevice = MDCUSBDeviceT<VirtualPhoton>;
+
+static constexpr size_t ReadLenMax = 8*1024*1024; // Like ImageSource::_DataReadBatchLenMax
+static constexpr SD::CardId CardId = { .manufacturerId = 0x42, .productSerialNumber = 0xCAFE };
+
+struct _Image {
+    Img::Id id = 0;
+    SD::Block addrThumb = 0;
+    SD::Block addrFull = 0;
+};
+
+static void _Require(bool x, const char* msg) {
+    if (!x) {
+        fprintf(stderr, "FAILED: %s\n", msg);
+        exit(1);
+    }
+}
+
+static void _ImageValidate(const uint8_t* data, Img::Size size, Img::Id id) {
+    const uint32_t checksumOffset = (size==Img::Size::Full ? Img::Full::ChecksumOffset : Img::Thumb::ChecksumOffset);
+    const uint32_t checksumExpected = ChecksumFletcher32(data, checksumOffset);
+    uint32_t checksumGot = 0;
+    memcpy(&checksumGot, data+checksumOffset, Img::ChecksumLen);
+    if (checksumGot != checksumExpected) {
+        fprintf(stderr, "FAILED: image %ju: invalid checksum (expected:0x%08x got:0x%08x)\n",
+            (uintmax_t)id, checksumExpected, checksumGot);
+        exit(1);
+    }
+
+    const Img::Header& header = *(const Img::Header*)data;
+    _Require(header.magic.u24 == Img::Header::MagicNumber.u24, "invalid magic number");
+    if (header.id != id) {
+        fprintf(stderr, "FAILED: invalid image id (expected:%ju got:%ju)\n", (uintmax_t)id, (uintmax_t)header.id);
+        exit(1);
+    }
+}
+
+// _Images(): returns the images that the device has, like MDCDeviceReal::_sync_thread()
+static std::vector<_Image> _Images(const MSP::SDState& sd) {
+    const MSP::ImgRingBuf& a = sd.imgRingBufs[0];
+    const MSP::ImgRingBuf& b = sd.imgRingBufs[1];
+    const std::optional<int> comp = MSP::ImgRingBuf::Compare(a, b);
+    _Require((bool)comp, "image ring buf invalid");
+    const MSP::ImgRingBuf& ringBuf = (*comp>=0 ? a : b);
+
+    const Img::Id idEnd = ringBuf.buf.id;
+    const Img::Id idBegin = idEnd - std::min(idEnd, (Img::Id)sd.imgCap);
+
+    std::vector<_Image> images;
+    uint32_t idx = ringBuf.buf.idx;
+    for (Img::Id id=idEnd; id>idBegin; id--) {
+        idx = (idx ? idx-1 : sd.imgCap-1);
+        images.push_back({
+            .id = id-1,
+            .addrThumb = MSP::SDBlockStart(sd.baseThumb, ImgSD::Thumb::ImageBlockCount, idx),
+            .addrFull = MSP::SDBlockStart(sd.baseFull, ImgSD::Full::ImageBlockCount, idx),
+        });
+    }
+    return images;
+}
+
+struct _ReadStats {
+    uint64_t reads = 0;
+    uint64_t continued = 0;
+    uint64_t resets = 0;
+    uint64_t len = 0;
+};
+
+// _ThumbsRead(): reads and validates the thumbnails of `images`, in SD block order
+static void _ThumbsRead(_MDCUSBDevice& dev, std::vector<_Image> images, _ReadStats& stats) {
+    constexpr size_t ThumbLen = ImgSD::Thumb::ImagePaddedLen;
+    constexpr size_t BatchCountMax = ReadLenMax / ThumbLen;
+    std::sort(images.begin(), images.end(), [] (const _Image& a, const _Image& b) {
+        return a.addrThumb < b.addrThumb;
+    });
+
+    std::vector<uint8_t> buf(BatchCountMax*ThumbLen);
+    std::optional<SD::Block> readoutEnd;
+    for (auto it=images.begin(); it!=images.end();) {
+        // Collect a batch of thumbnails that are contiguous on the SD card
+        auto batchEnd = std::next(it);
+        while (batchEnd!=images.end() && (size_t)(batchEnd-it)<BatchCountMax &&
+               batchEnd->addrThumb == std::prev(batchEnd)->addrThumb+ImgSD::Thumb::ImageBlockCount) {
+            batchEnd++;
+        }
+
+        const size_t count = batchEnd-it;
+        const size_t len = count*ThumbLen;
+        if (!readoutEnd || *readoutEnd!=it->addrThumb) {
+            if (readoutEnd) {
+                dev.reset();
+                stats.resets++;
+            }
+            dev.sdRead(it->addrThumb);
+        } else {
+            stats.continued++;
+        }
+
+        const size_t lenGot = dev.readout(buf.data(), len);
+        _Require(lenGot == len, "short readout");
+        for (size_t i=0; i<count; i++) {
+            _ImageValidate(buf.data()+i*ThumbLen, Img::Size::Thumb, it[i].id);
+        }
+
+        readoutEnd = it->addrThumb + (SD::Block)(count*ImgSD::Thumb::ImageBlockCount);
+        stats.reads++;
+        stats.len += len;
+        it = batchEnd;
+    }
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: VirtualPhotonTest <SDImagePath> [ImageCount] [Bandwidth (MB/s), 0=unlimited]\n");
+        return 1;
+    }
+
+    const std::filesystem::path sdImage = argv[1];
+    const uint32_t imageCount = (argc>2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 10000);
+    const double bandwidth = (argc>3 ? strtod(argv[3], nullptr)*1e6 : 0);
+    _Require(imageCount > 0, "invalid image count");
+
+    // Create an SD image that's slightly smaller than the number of images that we capture, so that
+    // the image ring buffer wraps around
+    {
+        const auto timeStart = steady_clock::now();
+        VirtualPhoton::SDImageCreate(sdImage, imageCount, CardId);
+        VirtualPhoton vp({ .sdImage = sdImage });
+        vp.imagesCapture(imageCount + imageCount/4);
+        const double sec = duration<double>(steady_clock::now()-timeStart).count();
+        printf("Created SD image with capacity of %ju images, captured %ju images (%.1f sec)\n",
+            (uintmax_t)vp.mspState().sd.imgCap, (uintmax_t)(imageCount + imageCount/4), sec);
+    }
+
+    std::unique_ptr<VirtualPhoton> vpOwned = std::make_unique<VirtualPhoton>(VirtualPhoton::Config{
+        .sdImage = sdImage,
+        .bandwidth = bandwidth,
+    });
+    VirtualPhoton& vp = *vpOwned;
+    _MDCUSBDevice dev(std::move(vpOwned));
+
+    // Enter host mode, configure ICE40, init the SD card (like MDCDeviceReal::_sdModeSet())
+    const MSP::State msp = dev.mspStateRead();
+    dev.hostModeSet(true);
+    {
+        const std::vector<uint8_t> iceBin(128*1024);
+        dev.iceRAMWrite(iceBin.data(), iceBin.size());
+    }
+    const STM::SDCardInfo cardInfo = dev.sdInit();
+    _Require(!memcmp(&cardInfo.cardId, &msp.sd.cardId, sizeof(cardInfo.cardId)), "card id mismatch");
+
+    const std::vector<_Image> images = _Images(msp.sd);
+    _Require(images.size() == std::min(imageCount, msp.sd.imgCap), "image count");
+
+    // Sync: read all thumbnails
+    {
+        _ReadStats stats;
+        const auto timeStart = steady_clock::now();
+        _ThumbsRead(dev, images, stats);
+        const double sec = duration<double>(steady_clock::now()-timeStart).count();
+        const double mib = (double)stats.len / (1024*1024);
+        printf("Synced %ju thumbnails: %.1f MiB in %ju reads (%ju continued, %ju resets); "
+            "%.1f sec, %.0f images/sec, %.1f MiB/sec\n",
+            (uintmax_t)images.size(), mib, (uintmax_t)stats.reads, (uintmax_t)stats.continued,
+            (uintmax_t)stats.resets, sec, images.size()/sec, mib/sec);
+    }
+
+    // Read a few full-size images
+    {
+        std::vector<uint8_t> buf(ImgSD::Full::ImagePaddedLen);
+        std::mt19937 rng(0);
+        for (int i=0; i<4; i++) {
+            const _Image& img = images[rng() % images.size()];
+            dev.reset();
+            dev.sdRead(img.addrFull);
+            _Require(dev.readout(buf.data(), buf.size()) == buf.size(), "short readout (full)");
+            _ImageValidate(buf.data(), Img::Size::Full, img.id);
+        }
+    }
+
+    // Erase a thumbnail, and verify that it no longer reads as an image
+    {
+        const _Image& img = images.front();
+        dev.reset();
+        dev.sdErase(img.addrThumb, img.addrThumb+ImgSD::Thumb::ImageBlockCount-1);
+        std::vector<uint8_t> buf(ImgSD::Thumb::ImagePaddedLen);
+        dev.sdRead(img.addrThumb);
+        _Require(dev.readout(buf.data(), buf.size()) == buf.size(), "short readout (erased)");
+        const Img::Header& header = *(const Img::Header*)buf.data();
+        _Require(header.magic.u24 != Img::Header::MagicNumber.u24, "erased image still valid");
+    }
+
+    // Capture + read out an image directly (like MDCStream)
+    {
+        dev.reset();
+        dev.imgInit();
+        dev.imgExposureSet({ .coarseIntTime = 0x1111, .analogGain = 0x11 });
+        const STM::ImgCaptureStats stats = dev.imgCapture(0, 0, Img::Size::Thumb);
+        _Require(stats.len == Img::Thumb::ImageLen, "ImgCapture length");
+        dev.imgReadout(Img::Size::Thumb);
+    }
+
+    dev.reset();
+    dev.hostModeSet(false);
+
+    const VirtualPhoton::Stats& stats = vp.stats();
+    printf("VirtualPhoton: %ju commands, %ju resets, %ju SD reads, %.1f MiB read\n",
+        (uintmax_t)stats.cmds, (uintmax_t)stats.resets, (uintmax_t)stats.sdReads,
+        (double)stats.readLen/(1024*1024));
+    printf("OK\n");
+    return 0;
+}